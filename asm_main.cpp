@@ -0,0 +1,83 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "assembler.h"
+#include "common.h"
+
+// Assembles a 6502 source file into an NROM .nes image, see assembler.h.
+//
+// Usage: nes2x_asm [--prg16] [--chr FILE | --chr-ram] [--horizontal] [--symbols] in.s out.nes
+//
+// PRG is 32k at $8000, or 16k at $C000 with --prg16. CHR is 8k of zeros unless given.
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Could not read " + path);
+  }
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    bool prg16 = false;
+    bool chr_ram = false;
+    bool vertical = true;
+    bool print_symbols = false;
+    std::string chr_path;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--prg16") {
+        prg16 = true;
+      } else if (arg == "--chr" && i + 1 < argc) {
+        chr_path = argv[++i];
+      } else if (arg == "--chr-ram") {
+        chr_ram = true;
+      } else if (arg == "--horizontal") {
+        vertical = false;
+      } else if (arg == "--symbols") {
+        print_symbols = true;
+      } else if (arg.rfind("--", 0) == 0) {
+        throw std::runtime_error("Unknown or incomplete option " + arg);
+      } else {
+        paths.push_back(arg);
+      }
+    }
+    if (paths.size() != 2) {
+      throw std::runtime_error("Usage: nes2x_asm [--prg16] [--chr FILE | --chr-ram] [--horizontal] "
+                               "[--symbols] in.s out.nes");
+    }
+
+    std::vector<uint8_t> source = ReadFile(paths[0]);
+    Assembler assembler(prg16 ? 0xC000 : 0x8000, prg16 ? 0x4000 : 0x8000);
+    assembler.Assemble(std::string(source.begin(), source.end()), paths[0]);
+    std::vector<uint8_t> chr;
+    if (!chr_path.empty()) {
+      chr = ReadFile(chr_path);
+    } else if (!chr_ram) {
+      chr.resize(0x2000, 0);
+    }
+    std::vector<uint8_t> image = InesImage(assembler.Output(), chr, vertical);
+
+    std::ofstream out(paths[1], std::ios::binary);
+    out.write(reinterpret_cast<const char*>(image.data()), image.size());
+    if (!out) {
+      throw std::runtime_error("Could not write " + paths[1]);
+    }
+    if (print_symbols) {
+      for (const auto& symbol : assembler.Symbols()) {
+        printf("%04llX %s\n", static_cast<unsigned long long>(symbol.second & 0xFFFF), symbol.first.c_str());
+      }
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,462 @@
+#include "assembler.h"
+
+#include <cctype>
+
+#include "opcode_info.h"
+
+namespace {
+
+using OpcodeMap = std::map<std::pair<std::string, AddressingMode>, uint8_t>;
+
+// Official opcodes win where an unofficial one has the same name and mode, e.g. SBC #i is
+// $E9 rather than $EB, and NOP is $EA. Otherwise the first in the table wins.
+const OpcodeMap& Opcodes() {
+  static const OpcodeMap* opcodes = [] {
+    OpcodeMap* map = new OpcodeMap();
+    for (bool unofficial : {false, true}) {
+      for (uint8_t opcode : ListedOpcodes()) {
+        const OpcodeInfo& info = OpcodeInfos()[opcode];
+        if (info.unofficial == unofficial) {
+          map->emplace(std::make_pair(std::string(info.mnemonic), info.mode), opcode);
+        }
+      }
+    }
+    return map;
+  }();
+  return *opcodes;
+}
+
+bool IsIdentStart(char c) { return isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+bool IsIdentChar(char c) { return isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+std::string Trim(const std::string& s) {
+  size_t start = s.find_first_not_of(" \t\r");
+  if (start == std::string::npos) {
+    return "";
+  }
+  return s.substr(start, s.find_last_not_of(" \t\r") - start + 1);
+}
+
+std::string Upper(std::string s) {
+  for (char& c : s) {
+    c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+  }
+  return s;
+}
+
+// Splits on commas outside quotes and trims each piece.
+std::vector<std::string> SplitArgs(const std::string& s) {
+  std::vector<std::string> args;
+  std::string current;
+  char quote = 0;
+  for (char c : s) {
+    if (quote != 0) {
+      quote = c == quote ? 0 : quote;
+    } else if (c == '"' || c == '\'') {
+      quote = c;
+    } else if (c == ',') {
+      args.push_back(Trim(current));
+      current.clear();
+      continue;
+    }
+    current += c;
+  }
+  args.push_back(Trim(current));
+  return args;
+}
+
+// Assembles one source. The first pass finds every label and settles the size of every
+// statement; the second emits bytes with the same sizes.
+class Pass {
+  public:
+    Pass(uint16_t origin, std::vector<uint8_t>* output, std::map<std::string, int64_t>* symbols,
+         std::vector<AddressingMode>* modes, bool final)
+        : origin_(origin), output_(output), symbols_(symbols), modes_(modes), final_(final), pc_(origin) {}
+
+    void Line(size_t line_number, const std::string& raw) {
+      line_ = line_number;
+      std::string line = Trim(StripComment(raw));
+      size_t i = 0;
+      while (i < line.size() && IsIdentChar(line[i])) {
+        i++;
+      }
+      if (i > 0 && IsIdentStart(line[0]) && i < line.size() && line[i] == ':') {
+        Define(line.substr(0, i), pc_, /*is_label=*/true);
+        line = Trim(line.substr(i + 1));
+      }
+      if (line.empty()) {
+        return;
+      }
+      size_t equals = line.find('=');
+      if (equals != std::string::npos && IsIdentStart(line[0]) &&
+          Trim(line.substr(0, equals)).find_first_of(" \t") == std::string::npos) {
+        bool known = true;
+        int64_t value = Eval(line.substr(equals + 1), &known);
+        if (known) {
+          Define(Trim(line.substr(0, equals)), value, /*is_label=*/false);
+        }
+        return;
+      }
+      size_t space = line.find_first_of(" \t");
+      std::string word = line.substr(0, space);
+      std::string rest = space == std::string::npos ? "" : Trim(line.substr(space));
+      if (word[0] == '.') {
+        Directive(Upper(word), rest);
+      } else {
+        Instruction(Upper(word), rest);
+      }
+    }
+
+  private:
+    static std::string StripComment(const std::string& s) {
+      char quote = 0;
+      for (size_t i = 0; i < s.size(); ++i) {
+        if (quote != 0) {
+          quote = s[i] == quote ? 0 : quote;
+        } else if (s[i] == '"' || s[i] == '\'') {
+          quote = s[i];
+        } else if (s[i] == ';') {
+          return s.substr(0, i);
+        }
+      }
+      return s;
+    }
+
+    void Define(const std::string& name, int64_t value, bool is_label) {
+      if (!final_ && is_label && symbols_->count(name) > 0) {
+        throw std::runtime_error("Duplicate label " + name);
+      }
+      (*symbols_)[name] = value;
+    }
+
+    // Clears *known if text names something not defined yet; on the final pass that throws.
+    int64_t Eval(const std::string& text, bool* known) {
+      std::string s = Trim(text);
+      if (s.empty()) {
+        throw std::runtime_error("Missing expression.");
+      }
+      char byte_select = 0;
+      size_t i = 0;
+      if (s[0] == '<' || s[0] == '>') {
+        byte_select = s[i++];
+      }
+      int64_t total = 0;
+      int sign = 1;
+      bool need_term = true;
+      while (i < s.size()) {
+        char c = s[i];
+        if (c == ' ' || c == '\t') {
+          i++;
+        } else if (!need_term && (c == '+' || c == '-')) {
+          sign = c == '+' ? 1 : -1;
+          need_term = true;
+          i++;
+        } else if (need_term && c == '-') {
+          sign = -sign;
+          i++;
+        } else if (need_term) {
+          total += sign * Term(s, &i, known);
+          need_term = false;
+        } else {
+          throw std::runtime_error("Bad expression " + s);
+        }
+      }
+      if (need_term) {
+        throw std::runtime_error("Bad expression " + s);
+      }
+      if (byte_select == '<') {
+        return total & 0xFF;
+      } else if (byte_select == '>') {
+        return (total >> 8) & 0xFF;
+      }
+      return total;
+    }
+
+    int64_t Term(const std::string& s, size_t* i, bool* known) {
+      auto digits = [&](int base) {
+        size_t start = *i;
+        while (*i < s.size() && isxdigit(static_cast<unsigned char>(s[*i]))) {
+          (*i)++;
+        }
+        if (*i == start) {
+          throw std::runtime_error("Bad number in " + s);
+        }
+        size_t used = 0;
+        int64_t value = std::stoll(s.substr(start, *i - start), &used, base);
+        if (used != *i - start) {
+          throw std::runtime_error("Bad number in " + s);
+        }
+        return value;
+      };
+      char c = s[*i];
+      if (c == '$') {
+        (*i)++;
+        return digits(16);
+      } else if (c == '%') {
+        (*i)++;
+        return digits(2);
+      } else if (isdigit(static_cast<unsigned char>(c))) {
+        return digits(10);
+      } else if (c == '\'' && *i + 2 < s.size() && s[*i + 2] == '\'') {
+        *i += 3;
+        return static_cast<uint8_t>(s[*i - 2]);
+      } else if (c == '*') {
+        (*i)++;
+        return pc_;
+      } else if (IsIdentStart(c)) {
+        size_t start = *i;
+        while (*i < s.size() && IsIdentChar(s[*i])) {
+          (*i)++;
+        }
+        std::string name = s.substr(start, *i - start);
+        auto it = symbols_->find(name);
+        if (it != symbols_->end()) {
+          return it->second;
+        } else if (final_) {
+          throw std::runtime_error("Undefined symbol " + name);
+        }
+        *known = false;
+        return 0;
+      }
+      throw std::runtime_error("Bad expression " + s);
+    }
+
+    // An expression that must be known on the first pass, e.g. a .org.
+    int64_t EvalNow(const std::string& text) {
+      bool known = true;
+      int64_t value = Eval(text, &known);
+      if (!known) {
+        throw std::runtime_error("Expression must not name a later label: " + text);
+      }
+      return value;
+    }
+
+    void Emit(int64_t value) {
+      if (final_) {
+        if (pc_ < origin_ || pc_ >= origin_ + static_cast<int64_t>(output_->size())) {
+          throw std::runtime_error(string_format("Address $%04llX is outside the output.",
+                                                 static_cast<long long>(pc_)));
+        }
+        (*output_)[pc_ - origin_] = static_cast<uint8_t>(value);
+      }
+      pc_++;
+    }
+
+    void EmitByte(int64_t value) {
+      if (final_ && (value < -128 || value > 0xFF)) {
+        throw std::runtime_error(string_format("Value %lld does not fit in a byte.", static_cast<long long>(value)));
+      }
+      Emit(value);
+    }
+
+    void EmitWord(int64_t value) {
+      if (final_ && (value < -32768 || value > 0xFFFF)) {
+        throw std::runtime_error(string_format("Value %lld does not fit in a word.", static_cast<long long>(value)));
+      }
+      Emit(value & 0xFF);
+      Emit((value >> 8) & 0xFF);
+    }
+
+    void Directive(const std::string& name, const std::string& rest) {
+      std::vector<std::string> args = SplitArgs(rest);
+      bool known = true;
+      if (name == ".ORG") {
+        pc_ = EvalNow(rest);
+        if (pc_ < 0 || pc_ > 0xFFFF) {
+          throw std::runtime_error("Bad .org " + rest);
+        }
+      } else if (name == ".BYTE") {
+        for (const std::string& arg : args) {
+          if (arg.size() >= 2 && arg.front() == '"' && arg.back() == '"') {
+            for (size_t i = 1; i + 1 < arg.size(); ++i) {
+              Emit(static_cast<uint8_t>(arg[i]));
+            }
+          } else {
+            EmitByte(Eval(arg, &known));
+          }
+        }
+      } else if (name == ".WORD") {
+        for (const std::string& arg : args) {
+          EmitWord(Eval(arg, &known));
+        }
+      } else if (name == ".FILL" || name == ".ALIGN") {
+        if (args.size() > 2) {
+          throw std::runtime_error("Usage: " + name + " n [, value]");
+        }
+        int64_t n = EvalNow(args[0]);
+        int64_t value = args.size() == 2 ? Eval(args[1], &known) : 0;
+        if (n < 0 || (name == ".ALIGN" && n == 0)) {
+          throw std::runtime_error("Bad count " + args[0]);
+        }
+        int64_t count = name == ".FILL" ? n : (n - pc_ % n) % n;
+        for (int64_t i = 0; i < count; ++i) {
+          EmitByte(value);
+        }
+      } else {
+        throw std::runtime_error("Unknown directive " + name);
+      }
+    }
+
+    void Instruction(const std::string& mnemonic, const std::string& rest) {
+      const OpcodeMap& opcodes = Opcodes();
+      auto has = [&](AddressingMode mode) { return opcodes.count({mnemonic, mode}) > 0; };
+      auto first = opcodes.lower_bound({mnemonic, AddressingMode::kImmediate});
+      if (first == opcodes.end() || first->first.first != mnemonic) {
+        throw std::runtime_error("Unknown instruction " + mnemonic);
+      }
+      std::string operand;
+      for (char c : rest) {
+        if (c != ' ' && c != '\t') {
+          operand += c;
+        }
+      }
+      std::string upper = Upper(operand);
+      auto ends_with = [&](const char* suffix) {
+        size_t n = strlen(suffix);
+        return upper.size() > n && upper.compare(upper.size() - n, n, suffix) == 0;
+      };
+
+      AddressingMode mode;
+      std::string expr;
+      // Candidates when the operand may be zero page or absolute.
+      AddressingMode zero_page = AddressingMode::kNone;
+      AddressingMode absolute = AddressingMode::kNone;
+      if (operand.empty()) {
+        mode = has(AddressingMode::kNone) ? AddressingMode::kNone : AddressingMode::kAccumulator;
+      } else if (upper == "A" && has(AddressingMode::kAccumulator)) {
+        mode = AddressingMode::kAccumulator;
+      } else if (operand[0] == '#') {
+        mode = AddressingMode::kImmediate;
+        expr = operand.substr(1);
+      } else if (operand[0] == '(' && ends_with(",X)")) {
+        mode = AddressingMode::kIndirectX;
+        expr = operand.substr(1, operand.size() - 4);
+      } else if (operand[0] == '(' && ends_with("),Y")) {
+        mode = AddressingMode::kIndirectY;
+        expr = operand.substr(1, operand.size() - 4);
+      } else if (operand[0] == '(' && operand.back() == ')') {
+        mode = AddressingMode::kAbsoluteIndirect;
+        expr = operand.substr(1, operand.size() - 2);
+      } else if (ends_with(",X")) {
+        zero_page = AddressingMode::kZeroPageX;
+        absolute = AddressingMode::kAbsoluteX;
+        expr = operand.substr(0, operand.size() - 2);
+      } else if (ends_with(",Y")) {
+        zero_page = AddressingMode::kZeroPageY;
+        absolute = AddressingMode::kAbsoluteY;
+        expr = operand.substr(0, operand.size() - 2);
+      } else if (has(AddressingMode::kRelative)) {
+        mode = AddressingMode::kRelative;
+        expr = operand;
+      } else {
+        zero_page = AddressingMode::kZeroPage;
+        absolute = AddressingMode::kAbsolute;
+        expr = operand;
+      }
+
+      bool known = true;
+      int64_t value = expr.empty() ? 0 : Eval(expr, &known);
+      if (zero_page != AddressingMode::kNone) {
+        if (!final_) {
+          bool fits = known && value >= 0 && value <= 0xFF;
+          (*modes_)[line_] = has(zero_page) && (fits || !has(absolute)) ? zero_page : absolute;
+        }
+        mode = (*modes_)[line_];
+      }
+      auto it = opcodes.find({mnemonic, mode});
+      if (it == opcodes.end()) {
+        throw std::runtime_error("No addressing mode of " + mnemonic + " takes " + rest);
+      }
+
+      Emit(it->second);
+      switch (mode) {
+        case AddressingMode::kNone:
+        case AddressingMode::kAccumulator:
+          break;
+        case AddressingMode::kRelative: {
+          int64_t offset = value - (pc_ + 1);
+          if (final_ && (offset < -128 || offset > 127)) {
+            throw std::runtime_error(string_format("Branch is %lld bytes away.", static_cast<long long>(offset)));
+          }
+          Emit(offset & 0xFF);
+          break;
+        }
+        case AddressingMode::kImmediate:
+          EmitByte(value);
+          break;
+        case AddressingMode::kZeroPage:
+        case AddressingMode::kZeroPageX:
+        case AddressingMode::kZeroPageY:
+        case AddressingMode::kIndirectX:
+        case AddressingMode::kIndirectY:
+          if (final_ && (value < 0 || value > 0xFF)) {
+            throw std::runtime_error(string_format("$%llX is not a zero page address.", static_cast<long long>(value)));
+          }
+          Emit(value);
+          break;
+        default:
+          if (final_ && (value < 0 || value > 0xFFFF)) {
+            throw std::runtime_error(string_format("$%llX is not an address.", static_cast<long long>(value)));
+          }
+          EmitWord(value);
+          break;
+      }
+    }
+
+    int64_t origin_;
+    std::vector<uint8_t>* output_;
+    std::map<std::string, int64_t>* symbols_;
+    std::vector<AddressingMode>* modes_;  // per line, chosen on the first pass
+    bool final_;
+    int64_t pc_;
+    size_t line_ = 0;
+};
+
+} // namespace
+
+Assembler::Assembler(uint16_t origin, size_t size) : origin_(origin), output_(size, 0xFF) {
+  if (origin + size > 0x10000) {
+    throw std::runtime_error("Assembler output runs past $FFFF.");
+  }
+}
+
+void Assembler::Assemble(const std::string& source, const std::string& name) {
+  std::vector<std::string> lines;
+  size_t start = 0;
+  while (start <= source.size()) {
+    size_t end = source.find('\n', start);
+    if (end == std::string::npos) {
+      end = source.size();
+    }
+    lines.push_back(source.substr(start, end - start));
+    start = end + 1;
+  }
+  std::vector<AddressingMode> modes(lines.size(), AddressingMode::kNone);
+  for (bool final : {false, true}) {
+    Pass pass(origin_, &output_, &symbols_, &modes, final);
+    for (size_t i = 0; i < lines.size(); ++i) {
+      try {
+        pass.Line(i, lines[i]);
+      } catch (const std::exception& e) {
+        throw std::runtime_error(string_format("%s:%zu: %s", name.c_str(), i + 1, e.what()));
+      }
+    }
+  }
+}
+
+std::vector<uint8_t> InesImage(const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr,
+                               bool vertical_mirroring) {
+  if (prg.size() != 0x4000 && prg.size() != 0x8000) {
+    throw std::runtime_error("NROM PRG must be 16k or 32k.");
+  } else if (!chr.empty() && chr.size() != 0x2000) {
+    throw std::runtime_error("NROM CHR must be 8k, or none for CHR-RAM.");
+  }
+  std::vector<uint8_t> image = {'N', 'E', 'S', 0x1A};
+  image.push_back(static_cast<uint8_t>(prg.size() / 0x4000));
+  image.push_back(static_cast<uint8_t>(chr.size() / 0x2000));
+  image.push_back(vertical_mirroring ? 1 : 0);  // flags 6: mapper 0, no trainer or battery
+  image.resize(16, 0);
+  image.insert(image.end(), prg.begin(), prg.end());
+  image.insert(image.end(), chr.begin(), chr.end());
+  return image;
+}
@@ -0,0 +1,46 @@
+#ifndef ASSEMBLER_H_
+#define ASSEMBLER_H_
+
+#include <map>
+
+#include "common.h"
+
+// A two-pass 6502 assembler, enough to build synthetic test and benchmark ROMs from source
+// in the tree. Knows every opcode in cpu6502_opcodes.h; the unofficial ones go by their
+// usual names (LAX, SAX, DCP, ISB, SLO, RLA, SRE, RRA, and NOP with an operand).
+//
+// One statement per line, ';' starts a comment:
+//   label:                      a label for the current address
+//   NAME = expr                 a constant
+//   LDA #$10 / LDA ($20),Y ...  an instruction; ASL alone or ASL A for accumulator mode
+//   .org expr                   moves the current address
+//   .byte expr|"text", ...      .word expr, ...   .fill count [, value]   .align n [, value]
+// Expressions are numbers ($hex, %binary, decimal, 'c'), names and * (the current address),
+// joined by + and -, with an optional leading < (low byte) or > (high byte). An operand
+// under $100 uses zero page when the instruction has it and the value is known on the
+// first pass, i.e. it doesn't name a label further down.
+class Assembler {
+  public:
+    // Output covers size bytes from origin, e.g. $8000 and 32k of NROM PRG. Bytes nothing
+    // is assembled into are $FF.
+    Assembler(uint16_t origin, size_t size);
+
+    // Throws "name:line: message" on the first error.
+    void Assemble(const std::string& source, const std::string& name = "<source>");
+
+    const std::vector<uint8_t>& Output() const { return output_; }
+    // Every label and constant, e.g. for a symbol listing.
+    const std::map<std::string, int64_t>& Symbols() const { return symbols_; }
+
+  private:
+    uint16_t origin_;
+    std::vector<uint8_t> output_;
+    std::map<std::string, int64_t> symbols_;
+};
+
+// Builds an iNES 1.0 image for mapper 0 (NROM). prg must be 16k or 32k; chr is 8k of
+// CHR-ROM, or empty for CHR-RAM.
+std::vector<uint8_t> InesImage(const std::vector<uint8_t>& prg, const std::vector<uint8_t>& chr,
+                               bool vertical_mirroring = true);
+
+#endif  // ASSEMBLER_H_
@@ -0,0 +1,750 @@
+#include "batch_cpu6502.h"
+
+#include <array>
+
+#include "cartridge.h"
+#include "common.h"
+#include "opcode_info.h"
+#include "ppu.h"
+
+namespace {
+
+enum class Op : uint8_t {
+  kInvalid,
+  ADC, JMP, BRK, RTI, LDX, STX, JSR, SEC, BCS, CLC, BCC, LDA, BEQ, BNE, STA, BIT, BVS, BVC,
+  BPL, RTS, NOP, SEI, SED, PHP, PLA, AND, CMP, CLD, PHA, PLP, BMI, ORA, CLV, EOR, LDY, CPX,
+  CPY, SBC, INX, INY, DEX, DEY, TAX, TAY, TXA, TYA, TSX, TXS, LSR, ASL, ROR, ROL, STY, INC,
+  DEC, UN_NOP, UN_LAX, UN_SAX, UN_SBC, UN_DCP, UN_ISB, UN_SLO, UN_RLA, UN_SRE, UN_RRA
+};
+
+struct Decoded {
+  Op op = Op::kInvalid;
+  AddressingMode mode = AddressingMode::kNone;
+  uint8_t cycles = 0;
+};
+
+std::array<Decoded, 256> BuildDecodeTable() {
+  std::array<Decoded, 256> table = {};
+  #define OPCODE(opcode, name, mode, cycles) table[opcode] = {Op::name, AddressingMode::mode, cycles};
+  #include "cpu6502_opcodes.h"
+  #undef OPCODE
+  return table;
+}
+
+const std::array<Decoded, 256> kDecode = BuildDecodeTable();
+
+// How many CPU cycles to add to next_ppu_update_at_. Same as Cpu6502.
+const std::array<uint8_t, 3> kPpuUpdatePattern = {114, 114, 113};
+
+constexpr uint8_t kFlagC = 1 << 0;
+constexpr uint8_t kFlagZ = 1 << 1;
+constexpr uint8_t kFlagI = 1 << 2;
+constexpr uint8_t kFlagD = 1 << 3;
+constexpr uint8_t kFlagV = 1 << 6;
+constexpr uint8_t kFlagN = 1 << 7;
+
+// Branch-free helpers so the per-lane loops vectorize.
+inline uint8_t Sel(uint8_t mask, uint8_t a, uint8_t b) {
+  return (a & mask) | (b & ~mask);
+}
+
+inline uint8_t SetFlagIf(uint8_t p, uint8_t flag, bool on) {
+  return (p & ~flag) | (on ? flag : 0);
+}
+
+inline uint8_t SetNZ(uint8_t p, uint8_t val) {
+  return (p & ~(kFlagN | kFlagZ)) | (val & kFlagN) | (val == 0 ? kFlagZ : 0);
+}
+
+// Matches Cpu6502::ADC, including its overflow check.
+inline void Adc(uint8_t& a, uint8_t& p, uint8_t val) {
+  uint16_t sum = a + val + (p & kFlagC);
+  uint8_t res = static_cast<uint8_t>(sum);
+  p = SetFlagIf(p, kFlagC, sum > 0xFF);
+  p = SetFlagIf(p, kFlagV, !(a & 0x80) && !(val & 0x80) && (res & 0x80));
+  a = res;
+  p = SetNZ(p, a);
+}
+
+// Matches Cpu6502::SBC. Subtracts val; overflow is judged against orig like Cpu6502::UN_ISB.
+inline void Sbc(uint8_t& a, uint8_t& p, uint8_t val, uint8_t orig) {
+  uint16_t sum = a + static_cast<uint8_t>(~val) + (p & kFlagC);
+  uint8_t res = static_cast<uint8_t>(sum);
+  p = SetFlagIf(p, kFlagC, sum > 0xFF);
+  bool overflow = (!(a & 0x80) && (orig & 0x80) && (res & 0x80)) ||
+                  ((a & 0x80) && !(orig & 0x80) && !(res & 0x80));
+  p = SetFlagIf(p, kFlagV, overflow);
+  a = res;
+  p = SetNZ(p, a);
+}
+
+inline uint8_t Compare(uint8_t p, uint8_t reg, uint8_t val) {
+  p = SetFlagIf(p, kFlagC, reg >= val);
+  p = SetFlagIf(p, kFlagZ, reg == val);
+  return SetFlagIf(p, kFlagN, static_cast<uint8_t>(reg - val) & 0x80);
+}
+
+} // namespace
+
+BatchCpu6502::BatchCpu6502(const std::string& file_path, int num_lanes)
+    : BatchCpu6502(Cartridge::FromFile(file_path), num_lanes) {}
+
+BatchCpu6502::BatchCpu6502(std::shared_ptr<const Cartridge> cartridge, int num_lanes)
+    : num_lanes_(num_lanes), cartridge_(std::move(cartridge)) {
+  if (num_lanes_ < 1 || num_lanes_ > kMaxLanes) {
+    throw std::runtime_error(string_format("Lane count must be 1-%d.", kMaxLanes));
+  }
+  if (cartridge_->MapperId() != MapperId::kNrom) {
+    throw std::runtime_error("Batch emulation only supports NROM.");
+  }
+  prg_rom_ = cartridge_->PrgRom();
+  prg_rom_size_ = cartridge_->PrgRomSize();
+  Reset();
+  DBG("Batch of %d lanes ready.\n", num_lanes_);
+}
+
+void BatchCpu6502::Reset() {
+  ram_.assign(0x800 * num_lanes_, 0);
+  // nestest wants APU ram FF'd.
+  apu_ram_.assign(0x20 * num_lanes_, 0xFF);
+  prg_ram_.assign(0x2000 * num_lanes_, 0);
+  // Ppus and Controllers point into lane_states_, so it must not move after this.
+  lane_states_.assign(num_lanes_, LaneState{});
+  ppus_.clear();
+  controllers_.clear();
+  for (int l = 0; l < num_lanes_; ++l) {
+    LaneState& lane = lane_states_[l];
+    ppus_.push_back(std::make_unique<Ppu>(cartridge_->ChrRom(), cartridge_->ChrRomSize(), cartridge_->Mirroring(),
+        &lane.ppu, lane.chr_ram));
+    controllers_.emplace_back(&lane.controllers[0]);
+    controllers_.emplace_back(&lane.controllers[1]);
+    #ifdef NESTEST
+    pc_[l] = 0xC000;
+    #else
+    pc_[l] = Read16(l, 0xFFFC);
+    #endif
+    a_[l] = x_[l] = y_[l] = 0;
+    p_[l] = 0x24;
+    sp_[l] = 0xFD;
+    cycle_[l] = 7;
+    next_ppu_update_at_[l] = 114;
+    ppu_update_pattern_position_[l] = 1;
+  }
+}
+
+void BatchCpu6502::SetRenderingEnabled(bool enabled) {
+  for (auto& ppu : ppus_) {
+    ppu->SetRenderingEnabled(enabled);
+  }
+}
+
+void BatchCpu6502::CopyRam(int lane, uint8_t* out) {
+  for (int addr = 0; addr < 0x800; ++addr) {
+    out[addr] = ram_[addr * num_lanes_ + lane];
+  }
+}
+
+void BatchCpu6502::RunFrame() {
+  for (int l = 0; l < num_lanes_; ++l) {
+    running_[l] = 1;
+    target_frame_[l] = ppus_[l]->FrameCount() + 1;
+  }
+  while (BuildGroup()) {
+    ExecuteGroup();
+    FinishGroup();
+  }
+}
+
+template <typename F>
+void BatchCpu6502::ForGroup(F&& f) {
+  if (dense_) {
+    for (int l = 0; l < num_lanes_; ++l) {
+      f(l, mask_[l]);
+    }
+  } else {
+    for (int i = 0; i < group_size_; ++i) {
+      f(group_[i], static_cast<uint8_t>(0xFF));
+    }
+  }
+}
+
+template <typename F>
+void BatchCpu6502::ForLanes(F&& f) {
+  for (int i = 0; i < group_size_; ++i) {
+    f(group_[i]);
+  }
+}
+
+bool BatchCpu6502::BuildGroup() {
+  // Lanes that are done sort after every real PC.
+  uint32_t min_key = 0x10000;
+  for (int l = 0; l < num_lanes_; ++l) {
+    uint32_t key = running_[l] ? pc_[l] : 0x10000;
+    min_key = key < min_key ? key : min_key;
+  }
+  if (min_key == 0x10000) {
+    return false;
+  }
+  uint16_t pc = static_cast<uint16_t>(min_key);
+  for (int l = 0; l < num_lanes_; ++l) {
+    mask_[l] = (running_[l] && pc_[l] == pc) ? 0xFF : 0x00;
+  }
+  group_size_ = 0;
+  for (int l = 0; l < num_lanes_; ++l) {
+    if (mask_[l]) {
+      group_[group_size_++] = l;
+    }
+  }
+  if (pc < 0x8000 && group_size_ > 1) {
+    // Code running from RAM may differ per lane, so it always runs alone.
+    for (int i = 1; i < group_size_; ++i) {
+      mask_[group_[i]] = 0x00;
+    }
+    group_size_ = 1;
+  }
+  // Visiting every lane with a mask only pays off when most of them take part.
+  dense_ = group_size_ * 4 >= num_lanes_;
+  return true;
+}
+
+bool BatchCpu6502::UniformEa() {
+  uint16_t addr = ea_[group_[0]];
+  for (int i = 1; i < group_size_; ++i) {
+    if (ea_[group_[i]] != addr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint8_t BatchCpu6502::Rom(uint16_t addr) {
+  if (addr < 0xC000 || prg_rom_size_ != 0x4000) {
+    return prg_rom_[addr - 0x8000];
+  }
+  return prg_rom_[addr - 0xC000];  // NROM-128 mirror
+}
+
+uint8_t BatchCpu6502::Read(int lane, uint16_t addr) {
+  if (addr < 0x2000) {
+    return ram_[(addr % 0x800) * num_lanes_ + lane];
+  } else if (addr < 0x4000) {
+    Ppu* ppu = ppus_[lane].get();
+    switch (0x2000 + (addr % 8)) {
+      case 0x2002:  // PPUSTATUS
+        return ppu->GetSTATUS();
+      case 0x2004:  // OAMDATA
+        return ppu->GetOAMDATA();
+      default:
+        return ppu->GetLatch();
+    }
+  } else if (addr == 0x4016 || addr == 0x4017) {
+    return controllers_[lane * 2 + addr - 0x4016].Read();
+  } else if (addr < 0x4020) {
+    return apu_ram_[(addr % 0x4000) * num_lanes_ + lane];
+  } else if (addr < 0x6000) {
+    throw std::runtime_error("Invalid read addr");
+  } else if (addr < 0x8000) {
+    return prg_ram_[(addr - 0x6000) * num_lanes_ + lane];
+  }
+  return Rom(addr);
+}
+
+uint16_t BatchCpu6502::Read16(int lane, uint16_t addr, bool page_wrap) {
+  uint16_t msb_addr = addr + 1;
+  if (page_wrap && CrossedPage(msb_addr, addr)) {
+    msb_addr -= 0x100;
+  }
+  uint8_t lsb = Read(lane, addr);
+  return static_cast<uint16_t>(Read(lane, msb_addr)) << 8 | lsb;
+}
+
+void BatchCpu6502::Write(int lane, uint16_t addr, uint8_t val) {
+  if (addr < 0x2000) {
+    ram_[(addr % 0x800) * num_lanes_ + lane] = val;
+  } else if (addr < 0x4000) {
+    Ppu* ppu = ppus_[lane].get();
+    switch (0x2000 + (addr % 8)) {
+      case 0x2000: ppu->SetCTRL(val); break;
+      case 0x2001: ppu->SetMASK(val); break;
+      case 0x2002: ppu->SetLatch(val); break;
+      case 0x2003: ppu->SetOAMADDR(val); break;
+      case 0x2004: ppu->SetOAMDATA(val); break;
+      case 0x2005: ppu->SetPPUSCROLL(val); break;
+      case 0x2006: ppu->SetPPUADDR(val); break;
+      case 0x2007: ppu->SetPPUDATA(val); break;
+    }
+  } else if (addr == 0x4014) {  // OAMDMA
+    uint16_t page = static_cast<uint16_t>(val) << 8;
+    uint8_t data[256];
+    if (page < 0x2000) {
+      for (int i = 0; i < 256; ++i) {
+        data[i] = ram_[((page + i) % 0x800) * num_lanes_ + lane];
+      }
+    } else if (page < 0x8000) {
+      throw std::runtime_error("Invalid read addr for DMA");
+    } else {
+      for (int i = 0; i < 256; ++i) {
+        data[i] = Rom(page + i);
+      }
+    }
+    ppus_[lane]->SetOAMDMA(data);
+    cycle_[lane] += 513 + (cycle_[lane] % 2 == 0 ? 0 : 1);
+  } else if (addr < 0x4020) {
+    if (addr == 0x4016) {  // strobes both controllers
+      controllers_[lane * 2].Write(val);
+      controllers_[lane * 2 + 1].Write(val);
+    }
+    apu_ram_[(addr % 0x4000) * num_lanes_ + lane] = val;
+  } else if (addr < 0x6000 || addr >= 0x8000) {
+    throw std::runtime_error("Invalid write addr");
+  } else {
+    prg_ram_[(addr - 0x6000) * num_lanes_ + lane] = val;
+  }
+}
+
+void BatchCpu6502::LoadGroup() {
+  if (UniformEa()) {
+    uint16_t addr = ea_[group_[0]];
+    if (addr < 0x2000) {
+      const uint8_t* row = &ram_[(addr % 0x800) * num_lanes_];
+      ForGroup([&](int l, uint8_t m) { val_[l] = row[l]; });
+      return;
+    } else if (addr >= 0x8000) {
+      uint8_t val = Rom(addr);
+      ForGroup([&](int l, uint8_t m) { val_[l] = val; });
+      return;
+    }
+  }
+  ForLanes([&](int l) { val_[l] = Read(l, ea_[l]); });
+}
+
+void BatchCpu6502::StoreGroup(const uint8_t* vals) {
+  if (UniformEa() && ea_[group_[0]] < 0x2000) {
+    uint8_t* row = &ram_[(ea_[group_[0]] % 0x800) * num_lanes_];
+    ForGroup([&](int l, uint8_t m) { row[l] = Sel(m, vals[l], row[l]); });
+    return;
+  }
+  ForLanes([&](int l) { Write(l, ea_[l], vals[l]); });
+}
+
+void BatchCpu6502::PushGroup(const uint8_t* vals) {
+  ForGroup([&](int l, uint8_t m) {
+    ea_[l] = 0x100 | sp_[l];
+    sp_[l] = Sel(m, sp_[l] - 1, sp_[l]);
+  });
+  StoreGroup(vals);
+}
+
+void BatchCpu6502::PopGroup(uint8_t* out) {
+  ForGroup([&](int l, uint8_t m) {
+    sp_[l] = Sel(m, sp_[l] + 1, sp_[l]);
+    ea_[l] = 0x100 | sp_[l];
+  });
+  LoadGroup();
+  if (out != val_) {
+    ForGroup([&](int l, uint8_t m) { out[l] = val_[l]; });
+  }
+}
+
+void BatchCpu6502::ExecuteGroup() {
+  int lead = group_[0];
+  uint16_t pc = pc_[lead];
+  auto fetch = [&](uint16_t addr) { return addr >= 0x8000 ? Rom(addr) : Read(lead, addr); };
+
+  uint8_t opcode = fetch(pc);
+  const Decoded& d = kDecode[opcode];
+  if (d.op == Op::kInvalid) {
+    throw std::runtime_error(string_format("Unknown opcode %02X at %04X.", opcode, pc));
+  }
+  int num_operand_bytes = OperandBytes(d.mode);
+  uint8_t op1 = num_operand_bytes >= 1 ? fetch(pc + 1) : 0;
+  uint8_t op2 = num_operand_bytes >= 2 ? fetch(pc + 2) : 0;
+  uint16_t abs = static_cast<uint16_t>(op2) << 8 | op1;
+  uint16_t next_pc = pc + 1 + num_operand_bytes;
+
+  /// Effective addresses.
+  ForGroup([&](int l, uint8_t m) {
+    pc_[l] = m ? next_pc : pc_[l];
+    crossed_[l] = 0;
+  });
+  switch (d.mode) {
+    case AddressingMode::kZeroPage:
+    case AddressingMode::kAbsolute:
+      ForGroup([&](int l, uint8_t m) { ea_[l] = abs; });
+      break;
+    case AddressingMode::kZeroPageX:
+      ForGroup([&](int l, uint8_t m) { ea_[l] = static_cast<uint8_t>(op1 + x_[l]); });
+      break;
+    case AddressingMode::kZeroPageY:
+      ForGroup([&](int l, uint8_t m) { ea_[l] = static_cast<uint8_t>(op1 + y_[l]); });
+      break;
+    case AddressingMode::kAbsoluteX:
+      ForGroup([&](int l, uint8_t m) {
+        uint16_t addr = abs + x_[l];
+        ea_[l] = addr;
+        crossed_[l] = ((addr ^ abs) & 0xFF00) != 0;
+      });
+      break;
+    case AddressingMode::kAbsoluteY:
+      ForGroup([&](int l, uint8_t m) {
+        uint16_t addr = abs + y_[l];
+        ea_[l] = addr;
+        crossed_[l] = ((addr ^ abs) & 0xFF00) != 0;
+      });
+      break;
+    case AddressingMode::kIndirectX:
+      ForLanes([&](int l) { ea_[l] = Read16(l, static_cast<uint8_t>(op1 + x_[l]), /*page_wrap=*/true); });
+      break;
+    case AddressingMode::kIndirectY: {
+      // The pointer is in zero page, so both bytes come from contiguous RAM rows.
+      const uint8_t* lsb_row = &ram_[op1 * num_lanes_];
+      const uint8_t* msb_row = &ram_[static_cast<uint8_t>(op1 + 1) * num_lanes_];
+      ForGroup([&](int l, uint8_t m) {
+        uint16_t base = static_cast<uint16_t>(msb_row[l]) << 8 | lsb_row[l];
+        uint16_t addr = base + y_[l];
+        ea_[l] = addr;
+        crossed_[l] = ((addr ^ base) & 0xFF00) != 0;
+      });
+      break;
+    }
+    case AddressingMode::kAbsoluteIndirect:
+      ForLanes([&](int l) { ea_[l] = Read16(l, abs, /*page_wrap=*/true); });
+      break;
+    default:
+      break;
+  }
+
+  /// Helpers for the ops below.
+  auto load = [&]() {
+    if (d.mode == AddressingMode::kImmediate) {
+      ForGroup([&](int l, uint8_t m) { val_[l] = op1; });
+    } else if (d.mode == AddressingMode::kAccumulator || d.mode == AddressingMode::kNone) {
+      ForGroup([&](int l, uint8_t m) { val_[l] = a_[l]; });
+    } else {
+      LoadGroup();
+    }
+  };
+  auto add_crossed = [&]() {
+    ForGroup([&](int l, uint8_t m) { cycle_[l] += m ? crossed_[l] : 0; });
+  };
+  auto set_reg = [&](uint8_t* reg) {
+    ForGroup([&](int l, uint8_t m) {
+      reg[l] = Sel(m, val_[l], reg[l]);
+      p_[l] = Sel(m, SetNZ(p_[l], val_[l]), p_[l]);
+    });
+  };
+  auto transfer = [&](const uint8_t* from, uint8_t* to) {
+    ForGroup([&](int l, uint8_t m) {
+      to[l] = Sel(m, from[l], to[l]);
+      p_[l] = Sel(m, SetNZ(p_[l], to[l]), p_[l]);
+    });
+  };
+  auto set_flag = [&](uint8_t flag, bool on) {
+    ForGroup([&](int l, uint8_t m) { p_[l] = Sel(m, SetFlagIf(p_[l], flag, on), p_[l]); });
+  };
+  auto branch = [&](uint8_t flag, bool want_set) {
+    uint16_t target = next_pc + static_cast<int8_t>(op1);
+    uint8_t extra = 1 + CrossedPage(next_pc, target);
+    ForGroup([&](int l, uint8_t m) {
+      bool taken = m && (((p_[l] & flag) != 0) == want_set);
+      pc_[l] = taken ? target : pc_[l];
+      cycle_[l] += taken ? extra : 0;
+    });
+  };
+  auto compare = [&](const uint8_t* reg) {
+    load();
+    add_crossed();
+    ForGroup([&](int l, uint8_t m) { p_[l] = Sel(m, Compare(p_[l], reg[l], val_[l]), p_[l]); });
+  };
+  auto step = [&](uint8_t* reg, uint8_t delta) {
+    ForGroup([&](int l, uint8_t m) {
+      uint8_t res = reg[l] + delta;
+      reg[l] = Sel(m, res, reg[l]);
+      p_[l] = Sel(m, SetNZ(p_[l], res), p_[l]);
+    });
+  };
+  // Shifts and rotates. res_fn(val, carry_in) -> result, carry_out is bit carry_bit of val.
+  auto shift = [&](auto res_fn, int carry_bit) {
+    bool accumulator = d.mode == AddressingMode::kAccumulator;
+    load();
+    ForGroup([&](int l, uint8_t m) {
+      uint8_t val = val_[l];
+      uint8_t res = res_fn(val, p_[l] & kFlagC);
+      tmp_[l] = res;
+      if (accumulator) {
+        a_[l] = Sel(m, res, a_[l]);
+      }
+      uint8_t p = SetFlagIf(p_[l], kFlagC, (val >> carry_bit) & 1);
+      p_[l] = Sel(m, SetNZ(p, res), p_[l]);
+    });
+    if (!accumulator) {
+      StoreGroup(tmp_);
+    }
+  };
+  auto asl = [](uint8_t val, uint8_t c) { return static_cast<uint8_t>(val << 1); };
+  auto rol = [](uint8_t val, uint8_t c) { return static_cast<uint8_t>(val << 1 | c); };
+  auto lsr = [](uint8_t val, uint8_t c) { return static_cast<uint8_t>(val >> 1); };
+  auto ror = [](uint8_t val, uint8_t c) { return static_cast<uint8_t>(val >> 1 | c << 7); };
+  // Unofficial shift-then-ALU combos. alu_fn(a, p, shifted) updates a and p.
+  auto shift_combo = [&](auto res_fn, int carry_bit, auto alu_fn) {
+    load();
+    add_crossed();
+    ForGroup([&](int l, uint8_t m) { tmp_[l] = res_fn(val_[l], p_[l] & kFlagC); });
+    StoreGroup(tmp_);
+    ForGroup([&](int l, uint8_t m) {
+      uint8_t a = a_[l];
+      uint8_t p = SetFlagIf(p_[l], kFlagC, (val_[l] >> carry_bit) & 1);
+      alu_fn(a, p, tmp_[l]);
+      a_[l] = Sel(m, a, a_[l]);
+      p_[l] = Sel(m, p, p_[l]);
+    });
+  };
+  auto fill_tmp = [&](auto fn) {
+    ForGroup([&](int l, uint8_t m) { tmp_[l] = fn(l); });
+  };
+
+  switch (d.op) {
+    case Op::ADC:
+      load();
+      add_crossed();
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t a = a_[l];
+        uint8_t p = p_[l];
+        Adc(a, p, val_[l]);
+        a_[l] = Sel(m, a, a_[l]);
+        p_[l] = Sel(m, p, p_[l]);
+      });
+      break;
+    case Op::SBC:
+    case Op::UN_SBC:
+      load();
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t a = a_[l];
+        uint8_t p = p_[l];
+        Sbc(a, p, val_[l], val_[l]);
+        a_[l] = Sel(m, a, a_[l]);
+        p_[l] = Sel(m, p, p_[l]);
+      });
+      break;
+    case Op::AND:
+    case Op::ORA:
+    case Op::EOR: {
+      load();
+      add_crossed();
+      Op op = d.op;
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t res = op == Op::AND ? (a_[l] & val_[l]) : op == Op::ORA ? (a_[l] | val_[l]) : (a_[l] ^ val_[l]);
+        a_[l] = Sel(m, res, a_[l]);
+        p_[l] = Sel(m, SetNZ(p_[l], res), p_[l]);
+      });
+      break;
+    }
+    case Op::LDA: load(); add_crossed(); set_reg(a_); break;
+    case Op::LDX: load(); add_crossed(); set_reg(x_); break;
+    case Op::LDY: load(); add_crossed(); set_reg(y_); break;
+    case Op::UN_LAX: load(); add_crossed(); set_reg(a_); set_reg(x_); break;
+    case Op::STA: StoreGroup(a_); break;
+    case Op::STX: StoreGroup(x_); break;
+    case Op::STY: StoreGroup(y_); break;
+    case Op::UN_SAX:
+      add_crossed();
+      fill_tmp([&](int l) { return static_cast<uint8_t>(a_[l] & x_[l]); });
+      StoreGroup(tmp_);
+      break;
+    case Op::CMP: compare(a_); break;
+    case Op::CPX: compare(x_); break;
+    case Op::CPY: compare(y_); break;
+    case Op::BIT:
+      load();
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t val = val_[l];
+        uint8_t p = SetFlagIf(p_[l], kFlagZ, (val & a_[l]) == 0);
+        p = (p & ~(kFlagV | kFlagN)) | (val & (kFlagV | kFlagN));
+        p_[l] = Sel(m, p, p_[l]);
+      });
+      break;
+
+    case Op::BCS: branch(kFlagC, true); break;
+    case Op::BCC: branch(kFlagC, false); break;
+    case Op::BEQ: branch(kFlagZ, true); break;
+    case Op::BNE: branch(kFlagZ, false); break;
+    case Op::BVS: branch(kFlagV, true); break;
+    case Op::BVC: branch(kFlagV, false); break;
+    case Op::BMI: branch(kFlagN, true); break;
+    case Op::BPL: branch(kFlagN, false); break;
+
+    case Op::JMP:
+      if (d.mode == AddressingMode::kAbsolute) {
+        ForGroup([&](int l, uint8_t m) { pc_[l] = m ? abs : pc_[l]; });
+      } else {
+        ForGroup([&](int l, uint8_t m) { pc_[l] = m ? ea_[l] : pc_[l]; });
+      }
+      break;
+    case Op::JSR: {
+      uint16_t ret = next_pc - 1;
+      fill_tmp([&](int l) { return static_cast<uint8_t>(ret >> 8); });
+      PushGroup(tmp_);
+      fill_tmp([&](int l) { return static_cast<uint8_t>(ret); });
+      PushGroup(tmp_);
+      ForGroup([&](int l, uint8_t m) { pc_[l] = m ? abs : pc_[l]; });
+      break;
+    }
+    case Op::RTS:
+      PopGroup(tmp_);
+      PopGroup(val_);
+      ForGroup([&](int l, uint8_t m) {
+        uint16_t ret = (static_cast<uint16_t>(val_[l]) << 8 | tmp_[l]) + 1;
+        pc_[l] = m ? ret : pc_[l];
+      });
+      break;
+    case Op::BRK: {
+      fill_tmp([&](int l) { return static_cast<uint8_t>(next_pc >> 8); });
+      PushGroup(tmp_);
+      fill_tmp([&](int l) { return static_cast<uint8_t>(next_pc); });
+      PushGroup(tmp_);
+      fill_tmp([&](int l) { return static_cast<uint8_t>(p_[l] | 0b0011'0000); });
+      PushGroup(tmp_);
+      uint16_t vector = static_cast<uint16_t>(Rom(0xFFFF)) << 8 | Rom(0xFFFE);
+      ForGroup([&](int l, uint8_t m) { pc_[l] = m ? vector : pc_[l]; });
+      set_flag(kFlagI, true);
+      break;
+    }
+    case Op::RTI:
+      PopGroup(val_);
+      ForGroup([&](int l, uint8_t m) {
+        p_[l] = Sel(m, (val_[l] & 0b1100'1111) | (p_[l] & 0b0011'0000), p_[l]);
+      });
+      PopGroup(tmp_);
+      PopGroup(val_);
+      ForGroup([&](int l, uint8_t m) {
+        uint16_t ret = static_cast<uint16_t>(val_[l]) << 8 | tmp_[l];
+        pc_[l] = m ? ret : pc_[l];
+      });
+      break;
+    case Op::PHP:
+      fill_tmp([&](int l) { return static_cast<uint8_t>(p_[l] | 0b0011'0000); });
+      PushGroup(tmp_);
+      break;
+    case Op::PLP:
+      PopGroup(val_);
+      ForGroup([&](int l, uint8_t m) {
+        p_[l] = Sel(m, (val_[l] & 0b1100'1111) | (p_[l] & 0b0011'0000), p_[l]);
+      });
+      break;
+    case Op::PHA: PushGroup(a_); break;
+    case Op::PLA: PopGroup(val_); set_reg(a_); break;
+
+    case Op::SEC: set_flag(kFlagC, true); break;
+    case Op::CLC: set_flag(kFlagC, false); break;
+    case Op::SEI: set_flag(kFlagI, true); break;
+    case Op::SED: set_flag(kFlagD, true); break;
+    case Op::CLD: set_flag(kFlagD, false); break;
+    case Op::CLV: set_flag(kFlagV, false); break;
+    case Op::NOP: break;
+    case Op::UN_NOP: load(); add_crossed(); break;
+
+    case Op::INX: step(x_, 1); break;
+    case Op::INY: step(y_, 1); break;
+    case Op::DEX: step(x_, 0xFF); break;
+    case Op::DEY: step(y_, 0xFF); break;
+    case Op::TAX: transfer(a_, x_); break;
+    case Op::TAY: transfer(a_, y_); break;
+    case Op::TXA: transfer(x_, a_); break;
+    case Op::TYA: transfer(y_, a_); break;
+    case Op::TSX: transfer(sp_, x_); break;
+    case Op::TXS:
+      ForGroup([&](int l, uint8_t m) { sp_[l] = Sel(m, x_[l], sp_[l]); });
+      break;
+
+    case Op::ASL: shift(asl, 7); break;
+    case Op::ROL: shift(rol, 7); break;
+    case Op::LSR: shift(lsr, 0); break;
+    case Op::ROR: shift(ror, 0); break;
+    case Op::INC:
+    case Op::DEC: {
+      uint8_t delta = d.op == Op::INC ? 1 : 0xFF;
+      load();
+      LoadGroup();  // Cpu6502 reads the target a second time
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t res = val_[l] + delta;
+        tmp_[l] = res;
+        p_[l] = Sel(m, SetNZ(p_[l], res), p_[l]);
+      });
+      StoreGroup(tmp_);
+      break;
+    }
+
+    case Op::UN_DCP:
+      load();
+      add_crossed();
+      LoadGroup();
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t res = val_[l] - 1;
+        tmp_[l] = res;
+        p_[l] = Sel(m, Compare(p_[l], a_[l], res), p_[l]);
+      });
+      StoreGroup(tmp_);
+      break;
+    case Op::UN_ISB: {
+      load();
+      add_crossed();
+      uint8_t orig[kMaxLanes];
+      ForGroup([&](int l, uint8_t m) { orig[l] = val_[l]; });
+      LoadGroup();
+      ForGroup([&](int l, uint8_t m) { tmp_[l] = val_[l] + 1; });
+      StoreGroup(tmp_);
+      ForGroup([&](int l, uint8_t m) {
+        uint8_t a = a_[l];
+        uint8_t p = p_[l];
+        Sbc(a, p, tmp_[l], orig[l]);
+        a_[l] = Sel(m, a, a_[l]);
+        p_[l] = Sel(m, p, p_[l]);
+      });
+      break;
+    }
+    case Op::UN_SLO:
+      shift_combo(asl, 7, [](uint8_t& a, uint8_t& p, uint8_t res) { a |= res; p = SetNZ(p, a); });
+      break;
+    case Op::UN_RLA:
+      shift_combo(rol, 7, [](uint8_t& a, uint8_t& p, uint8_t res) { a &= res; p = SetNZ(p, a); });
+      break;
+    case Op::UN_SRE:
+      shift_combo(lsr, 0, [](uint8_t& a, uint8_t& p, uint8_t res) { a ^= res; p = SetNZ(p, a); });
+      break;
+    case Op::UN_RRA:
+      shift_combo(ror, 0, [](uint8_t& a, uint8_t& p, uint8_t res) { Adc(a, p, res); });
+      break;
+    case Op::kInvalid:
+      break;
+  }
+
+  uint8_t cycles = d.cycles;
+  ForGroup([&](int l, uint8_t m) { cycle_[l] += m ? cycles : 0; });
+}
+
+void BatchCpu6502::FinishGroup() {
+  ForLanes([&](int l) {
+    while (cycle_[l] >= next_ppu_update_at_[l]) {
+      ppus_[l]->Update();
+      next_ppu_update_at_[l] += kPpuUpdatePattern[ppu_update_pattern_position_[l]];
+      ppu_update_pattern_position_[l] = (ppu_update_pattern_position_[l] + 1) % 3;
+    }
+    if (ppus_[l]->PollNmi()) {
+      Nmi(l);
+    }
+    if (ppus_[l]->FrameCount() >= target_frame_[l]) {
+      running_[l] = 0;
+    }
+  });
+  num_group_steps_++;
+  num_lane_steps_ += group_size_;
+}
+
+void BatchCpu6502::Nmi(int lane) {
+  Write(lane, 0x100 | sp_[lane]--, pc_[lane] >> 8);
+  Write(lane, 0x100 | sp_[lane]--, static_cast<uint8_t>(pc_[lane]));
+  Write(lane, 0x100 | sp_[lane]--, (p_[lane] | 0b0010'0000) & ~0b0001'0000);
+  p_[lane] |= kFlagI;
+  pc_[lane] = Read16(lane, 0xFFFA);
+  cycle_[lane] += 7;
+}
@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+#include "opcode_info.h"
+#include "perf_counters.h"
+#include "version.h"
+
+// CPU benchmarks. Each opcode in cpu6502_opcodes.h is timed in a tight loop of copies of
+// itself, built into an NROM image in memory, then whole ROMs are timed frame by frame.
+// Every benchmark is warmed up, then repeated; the report gives the median and p99 of the
+// repetitions. --json writes the same numbers for comparing runs across commits.
+//
+// Where Linux perf counters are available (see PerfCounters), each opcode also gets the
+// median host cycles, instructions and branch misses per emulated instruction, and each ROM
+// gets one more, instrumented, pass that splits its counters into CPU and PPU per frame.
+// Without them only the timings are reported.
+//
+// Usage: nes2x_bench [--json FILE] [--label TEXT] [--reps N] [--warmup N] [--instrs N]
+//                    [--frames N] [--only NAME] [--no-micro] [rom.nes...]
+
+namespace {
+
+// Where the loops keep their operands: all internal RAM, so no PPU or mapper side effects.
+constexpr uint8_t kZeroPageOperand = 0x10;
+constexpr uint16_t kAbsoluteOperand = 0x0200;
+// In PRG: an RTS for JSR to call and an RTI for BRK (and NMI, which stays off) to land on.
+constexpr uint16_t kRtsAddr = 0xF000;
+constexpr uint16_t kRtiAddr = 0xF001;
+// In PRG, since RAM starts zeroed: the target of JMP ($xxxx).
+constexpr uint16_t kJmpPointer = 0xF010;
+// Copies of the opcode per trip around the loop, so the closing JMP is under half a percent.
+constexpr int kCopiesPerLoop = 256;
+
+struct Options {
+  std::string json_path;
+  std::string label;
+  int reps = 25;
+  int warmup = 3;
+  int instrs = 20000;  // instructions per microbenchmark repetition
+  int frames = 60;     // frames per whole-ROM repetition
+  std::string only;
+  bool micro = true;
+  std::vector<std::string> roms;
+};
+
+struct Summary {
+  double median = 0;
+  double p99 = 0;
+};
+
+// Median and nearest-rank p99. With fewer than 100 samples the p99 is the slowest.
+Summary Summarize(std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  Summary summary;
+  summary.median = n % 2 == 1 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  summary.p99 = samples[static_cast<size_t>(std::ceil(0.99 * n)) - 1];
+  return summary;
+}
+
+double NsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// The JMPs loop on themselves; RTS and RTI can only be timed along with JSR and BRK.
+bool IsJmp(const OpcodeInfo& op) { return strcmp(op.name, "JMP") == 0; }
+bool IsPaired(const OpcodeInfo& op) { return strcmp(op.name, "RTS") == 0 || strcmp(op.name, "RTI") == 0; }
+
+std::string DisplayName(const OpcodeInfo& op) {
+  if (strcmp(op.name, "JSR") == 0) {
+    return "JSR+RTS";
+  } else if (strcmp(op.name, "BRK") == 0) {
+    return "BRK+RTI";
+  }
+  return op.name;
+}
+
+// An NROM image that resets into kCopiesPerLoop copies of op followed by JMP $8000. Branch
+// offsets are 0, so taken or not they fall through to the next copy.
+std::vector<uint8_t> LoopRom(const OpcodeInfo& op) {
+  std::vector<uint8_t> rom(16 + 0x8000 + 0x2000, 0);
+  memcpy(rom.data(), "NES\x1A", 4);
+  rom[4] = 2;  // 32kb PRG at $8000-$FFFF
+  rom[5] = 1;  // 8kb CHR
+  uint8_t* prg = rom.data() + 16;
+  auto put16 = [prg](uint16_t addr, uint16_t val) {
+    prg[addr - 0x8000] = val & 0xFF;
+    prg[addr - 0x8000 + 1] = val >> 8;
+  };
+  prg[kRtsAddr - 0x8000] = 0x60;
+  prg[kRtiAddr - 0x8000] = 0x40;
+  put16(kJmpPointer, 0x8000);
+  put16(0xFFFA, kRtiAddr);
+  put16(0xFFFC, 0x8000);
+  put16(0xFFFE, kRtiAddr);
+
+  uint16_t pc = 0x8000;
+  int copies = IsJmp(op) ? 1 : kCopiesPerLoop;
+  for (int i = 0; i < copies; ++i) {
+    prg[pc++ - 0x8000] = op.opcode;
+    if (IsJmp(op)) {
+      put16(pc, op.mode == AddressingMode::kAbsolute ? 0x8000 : kJmpPointer);
+    } else if (strcmp(op.name, "JSR") == 0) {
+      put16(pc, kRtsAddr);
+    } else if (strcmp(op.name, "BRK") == 0) {
+      continue;  // returns to the byte after it
+    } else if (op.mode == AddressingMode::kRelative) {
+      prg[pc - 0x8000] = 0;
+    } else if (OperandBytes(op.mode) == 1) {
+      prg[pc - 0x8000] = kZeroPageOperand;
+    } else if (OperandBytes(op.mode) == 2) {
+      put16(pc, kAbsoluteOperand);
+    }
+    pc += OperandBytes(op.mode);
+  }
+  if (!IsJmp(op)) {
+    prg[pc++ - 0x8000] = 0x4C;
+    put16(pc, 0x8000);
+  }
+  return rom;
+}
+
+// Counters reported per emulated instruction by the microbenchmarks.
+const PerfCounters::Counter kMicroCounters[] = {
+  PerfCounters::kCycles, PerfCounters::kInstructions, PerfCounters::kBranchMisses,
+};
+
+struct MicroResult {
+  const OpcodeInfo* op;
+  Summary ns_per_instr;
+  // Medians per emulated instruction, for the counters that are open.
+  std::array<double, PerfCounters::kNumCounters> per_instr = {};
+};
+
+MicroResult RunMicro(const OpcodeInfo& op, const Options& opts, const PerfCounters& counters) {
+  Cpu6502 cpu(Cartridge::FromBytes(LoopRom(op)));
+  std::vector<double> samples;
+  std::array<std::vector<double>, PerfCounters::kNumCounters> counts;
+  for (int rep = 0; rep < opts.warmup + opts.reps; ++rep) {
+    PerfCounters::Reading before = counters.Read();
+    auto start = Clock::now();
+    for (int i = 0; i < opts.instrs; ++i) {
+      cpu.RunCycle();
+    }
+    double ns = NsSince(start);
+    PerfCounters::Reading used = counters.Read() - before;
+    if (rep >= opts.warmup) {
+      samples.push_back(ns / opts.instrs);
+      for (int c = 0; c < PerfCounters::kNumCounters; ++c) {
+        counts[c].push_back(static_cast<double>(used.counts[c]) / opts.instrs);
+      }
+    }
+  }
+  MicroResult result = {&op, Summarize(samples)};
+  for (int c = 0; c < PerfCounters::kNumCounters; ++c) {
+    result.per_instr[c] = Summarize(counts[c]).median;
+  }
+  return result;
+}
+
+struct RomResult {
+  std::string path;
+  uint64_t instrs_per_rep = 0;
+  uint64_t cycles_per_rep = 0;
+  Summary ns_per_instr;
+  double mips = 0;          // from the median
+  double emulated_mhz = 0;  // CPU cycles per second of host time, from the median
+  double fps = 0;
+  // From the instrumented pass: each phase's time and counters, per frame.
+  std::array<PerfCounters::Reading, PhaseCounters::kNumPhases> phases_per_frame;
+  std::vector<std::string> perf;
+};
+
+// Warms up, saves the state, then times the same opts.frames frames from it every repetition.
+// A final pass over the same frames reads counters per phase, apart from the timed ones.
+RomResult RunRom(const std::string& path, const Options& opts, const PerfCounters& counters) {
+  Cpu6502 cpu(path);
+  for (int i = 0; i < opts.warmup * opts.frames; ++i) {
+    cpu.RunFrame();
+  }
+  auto saved = std::make_unique<ConsoleState>();
+  cpu.SaveState(saved.get());
+
+  RomResult result;
+  result.path = path;
+  std::vector<double> samples;
+  for (int rep = 0; rep < opts.reps; ++rep) {
+    cpu.LoadState(*saved);
+    uint64_t end_frame = cpu.FrameCount() + opts.frames;
+    uint64_t start_cycle = cpu.Cycle();
+    uint64_t instrs = 0;
+    auto start = Clock::now();
+    while (cpu.FrameCount() < end_frame) {
+      cpu.RunCycle();
+      instrs++;
+    }
+    double ns = NsSince(start);
+    result.instrs_per_rep = instrs;
+    result.cycles_per_rep = cpu.Cycle() - start_cycle;
+    samples.push_back(ns / instrs);
+  }
+  result.ns_per_instr = Summarize(samples);
+  double seconds = result.ns_per_instr.median * result.instrs_per_rep / 1e9;
+  result.mips = 1e3 / result.ns_per_instr.median;
+  result.emulated_mhz = result.cycles_per_rep / seconds / 1e6;
+  result.fps = opts.frames / seconds;
+
+  PhaseCounters phases(&counters);
+  cpu.LoadState(*saved);
+  cpu.SetPhaseCounters(&phases);
+  for (int i = 0; i < opts.frames; ++i) {
+    phases.StartFrame();
+    cpu.RunFrame();
+    phases.EndFrame();
+  }
+  cpu.SetPhaseCounters(nullptr);
+  for (int p = 0; p < PhaseCounters::kNumPhases; ++p) {
+    PerfCounters::Reading& out = result.phases_per_frame[p];
+    const PerfCounters::Reading& total = phases.Total(static_cast<PhaseCounters::Phase>(p));
+    out.ns = total.ns / opts.frames;
+    for (int c = 0; c < PerfCounters::kNumCounters; ++c) {
+      out.counts[c] = total.counts[c] / opts.frames;
+    }
+  }
+  result.perf = phases.Describe();
+  return result;
+}
+
+// Escapes a string for JSON. Paths and names only, so control characters are just dropped.
+std::string Quote(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    if (static_cast<unsigned char>(c) >= 0x20) {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// {"cycles": 1.0, ...} with the open counters among which, or {} with none.
+std::string CountersJson(const PerfCounters& counters, const PerfCounters::Counter* which, size_t count,
+                         const std::function<double(PerfCounters::Counter)>& value) {
+  std::string out = "{";
+  for (size_t i = 0; i < count; ++i) {
+    if (counters.Has(which[i])) {
+      out += string_format("%s\"%s\": %.3f", out.size() > 1 ? ", " : "", PerfCounters::Name(which[i]),
+                           value(which[i]));
+    }
+  }
+  return out + "}";
+}
+
+void WriteJson(const std::string& path, const Options& opts, const PerfCounters& counters,
+               const std::vector<MicroResult>& micro, const std::vector<RomResult>& roms) {
+  FILE* f = path == "-" ? stdout : fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    throw std::runtime_error("Could not write " + path + ": " + strerror(errno));
+  }
+  #ifdef DEBUG
+  bool debug = true;
+  #else
+  bool debug = false;
+  #endif
+  fprintf(f, "{\n  \"version\": %s,\n  \"label\": %s,\n  \"debug\": %s,\n", Quote(EmulatorVersion()).c_str(),
+          Quote(opts.label).c_str(), debug ? "true" : "false");
+  fprintf(f, "  \"reps\": %d,\n  \"warmup\": %d,\n  \"instrs_per_rep\": %d,\n  \"frames_per_rep\": %d,\n",
+          opts.reps, opts.warmup, opts.instrs, opts.frames);
+  const PerfCounters::Counter kAllCounters[] = {
+    PerfCounters::kCycles, PerfCounters::kInstructions, PerfCounters::kBranchMisses, PerfCounters::kL1dMisses,
+    PerfCounters::kLlcMisses,
+  };
+  std::string open_counters;
+  for (PerfCounters::Counter c : kAllCounters) {
+    if (counters.Has(c)) {
+      open_counters += (open_counters.empty() ? "" : ", ") + Quote(PerfCounters::Name(c));
+    }
+  }
+  fprintf(f, "  \"perf_counters\": [%s],\n  \"perf_error\": %s,\n", open_counters.c_str(),
+          Quote(counters.Error()).c_str());
+
+  fprintf(f, "  \"opcodes\": [");
+  for (size_t i = 0; i < micro.size(); ++i) {
+    const OpcodeInfo& op = *micro[i].op;
+    std::string per_instr = CountersJson(counters, kMicroCounters, std::size(kMicroCounters),
+        [&](PerfCounters::Counter c) { return micro[i].per_instr[c]; });
+    fprintf(f, "%s\n    {\"opcode\": \"%02X\", \"name\": %s, \"mode\": %s, \"cycles\": %d, "
+            "\"ns_per_instr\": {\"median\": %.3f, \"p99\": %.3f}, \"counters_per_instr\": %s}", i == 0 ? "" : ",",
+            op.opcode, Quote(DisplayName(op)).c_str(), Quote(op.mode_name).c_str(), op.cycles,
+            micro[i].ns_per_instr.median, micro[i].ns_per_instr.p99, per_instr.c_str());
+  }
+  fprintf(f, "%s],\n", micro.empty() ? "" : "\n  ");
+
+  // Per mode: the median and p99 over its opcodes' medians.
+  fprintf(f, "  \"modes\": [");
+  bool first = true;
+  for (int mode = 0; mode < kNumAddressingModes; ++mode) {
+    std::vector<double> medians;
+    const char* mode_name = nullptr;
+    for (const MicroResult& r : micro) {
+      if (static_cast<int>(r.op->mode) == mode) {
+        medians.push_back(r.ns_per_instr.median);
+        mode_name = r.op->mode_name;
+      }
+    }
+    if (medians.empty()) {
+      continue;
+    }
+    Summary summary = Summarize(medians);
+    fprintf(f, "%s\n    {\"mode\": %s, \"opcodes\": %zu, \"ns_per_instr\": {\"median\": %.3f, \"p99\": %.3f}}",
+            first ? "" : ",", Quote(mode_name).c_str(), medians.size(), summary.median, summary.p99);
+    first = false;
+  }
+  fprintf(f, "%s],\n", first ? "" : "\n  ");
+
+  fprintf(f, "  \"roms\": [");
+  for (size_t i = 0; i < roms.size(); ++i) {
+    const RomResult& r = roms[i];
+    std::string phases;
+    for (int p = 0; p < PhaseCounters::kNumPhases; ++p) {
+      const PerfCounters::Reading& phase = r.phases_per_frame[p];
+      phases += string_format("%s{\"phase\": %s, \"ns\": %llu, \"counters\": %s}", p == 0 ? "" : ", ",
+          Quote(PhaseCounters::Name(static_cast<PhaseCounters::Phase>(p))).c_str(),
+          static_cast<unsigned long long>(phase.ns),
+          CountersJson(counters, kAllCounters, std::size(kAllCounters),
+              [&](PerfCounters::Counter c) { return static_cast<double>(phase.counts[c]); }).c_str());
+    }
+    fprintf(f, "%s\n    {\"path\": %s, \"instrs_per_rep\": %llu, \"cycles_per_rep\": %llu, "
+            "\"ns_per_instr\": {\"median\": %.3f, \"p99\": %.3f}, \"mips\": %.3f, \"emulated_mhz\": %.3f, "
+            "\"fps\": %.1f, \"phases_per_frame\": [%s]}", i == 0 ? "" : ",", Quote(r.path).c_str(),
+            static_cast<unsigned long long>(r.instrs_per_rep), static_cast<unsigned long long>(r.cycles_per_rep),
+            r.ns_per_instr.median, r.ns_per_instr.p99, r.mips, r.emulated_mhz, r.fps, phases.c_str());
+  }
+  fprintf(f, "%s]\n}\n", roms.empty() ? "" : "\n  ");
+  if (f != stdout) {
+    fclose(f);
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (arg == "--json" && has_value) {
+        opts.json_path = argv[++i];
+      } else if (arg == "--label" && has_value) {
+        opts.label = argv[++i];
+      } else if (arg == "--reps" && has_value) {
+        opts.reps = std::stoi(argv[++i]);
+      } else if (arg == "--warmup" && has_value) {
+        opts.warmup = std::stoi(argv[++i]);
+      } else if (arg == "--instrs" && has_value) {
+        opts.instrs = std::stoi(argv[++i]);
+      } else if (arg == "--frames" && has_value) {
+        opts.frames = std::stoi(argv[++i]);
+      } else if (arg == "--only" && has_value) {
+        opts.only = argv[++i];
+      } else if (arg == "--no-micro") {
+        opts.micro = false;
+      } else if (arg.rfind("--", 0) == 0) {
+        throw std::runtime_error("Unknown or incomplete option " + arg);
+      } else {
+        opts.roms.push_back(arg);
+      }
+    }
+    if (opts.reps < 1 || opts.warmup < 0 || opts.instrs < 1 || opts.frames < 1) {
+      throw std::runtime_error("--reps, --instrs and --frames must be positive.");
+    }
+    #ifdef DEBUG
+    fprintf(stderr, "Warning: built with DEBUG; rebuild with TEST_DEFINES=\"-U DEBUG\" for real numbers.\n");
+    #endif
+    // With --json - the report goes to stderr so stdout is only JSON.
+    FILE* out = opts.json_path == "-" ? stderr : stdout;
+
+    PerfCounters counters;
+    if (!counters.Error().empty()) {
+      fprintf(out, "Perf counters: %s%s\n", counters.Error().c_str(), counters.Any() ? "" : "; timing only.");
+    }
+    std::string counter_columns;
+    for (PerfCounters::Counter c : kMicroCounters) {
+      if (counters.Has(c)) {
+        counter_columns += string_format(" %14s", PerfCounters::Name(c));
+      }
+    }
+
+    std::vector<MicroResult> micro;
+    if (opts.micro) {
+      fprintf(out, "%-4s %-8s %-16s %6s %10s %10s%s\n", "OP", "NAME", "MODE", "CYCLES", "MEDIAN_NS", "P99_NS",
+              counter_columns.c_str());
+      for (uint8_t opcode : ListedOpcodes()) {
+        const OpcodeInfo& op = OpcodeInfos()[opcode];
+        if (IsPaired(op) || (!opts.only.empty() && opts.only != op.name)) {
+          continue;
+        }
+        micro.push_back(RunMicro(op, opts, counters));
+        std::string per_instr;
+        for (PerfCounters::Counter c : kMicroCounters) {
+          if (counters.Has(c)) {
+            per_instr += string_format(" %14.2f", micro.back().per_instr[c]);
+          }
+        }
+        fprintf(out, "%02X   %-8s %-16s %6d %10.2f %10.2f%s\n", op.opcode, DisplayName(op).c_str(),
+                op.mode_name, op.cycles, micro.back().ns_per_instr.median, micro.back().ns_per_instr.p99,
+                per_instr.c_str());
+      }
+    }
+
+    std::vector<RomResult> roms;
+    for (const std::string& path : opts.roms) {
+      roms.push_back(RunRom(path, opts, counters));
+      const RomResult& r = roms.back();
+      fprintf(out, "ROM %s instrs/rep=%llu ns/instr median=%.2f p99=%.2f mips=%.2f emulated_mhz=%.2f "
+              "(%.1fx NTSC) fps=%.1f\n", r.path.c_str(), static_cast<unsigned long long>(r.instrs_per_rep),
+              r.ns_per_instr.median, r.ns_per_instr.p99, r.mips, r.emulated_mhz, r.emulated_mhz / 1.789773,
+              r.fps);
+      for (const std::string& line : r.perf) {
+        fprintf(out, "    %s\n", line.c_str());
+      }
+    }
+
+    if (!opts.json_path.empty()) {
+      WriteJson(opts.json_path, opts, counters, micro, roms);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+; ALU-heavy loop: arithmetic, logic, shifts and compares on zero page and registers,
+; with no PPU traffic. Stresses instruction decode and flag handling.
+
+a_val = $10
+b_val = $11
+sum = $12
+
+        .org $8000
+reset:  sei
+        cld
+        ldx #$FF
+        txs
+        lda #$5A
+        sta a_val
+        lda #$C3
+        sta b_val
+
+loop:   ldx #0
+inner:  lda a_val
+        clc
+        adc b_val
+        sta sum
+        sec
+        sbc #$17
+        and #$F0
+        ora sum
+        eor a_val
+        asl a
+        rol b_val
+        lsr sum
+        ror a
+        cmp #$80
+        bcc skip
+        inc a_val
+skip:   adc sum
+        sta a_val
+        cpx b_val
+        inx
+        dey
+        bne inner
+        jmp loop
+
+nmi:
+irq:    rti
+
+        .org $FFFA
+        .word nmi, reset, irq
@@ -0,0 +1,53 @@
+; Branch-heavy code steered by an 8-bit Galois LFSR, so the direction of each branch
+; changes from one pass to the next. Stresses the branch instructions and page-crossing
+; cycle accounting.
+
+lfsr = $10
+count = $11
+
+        .org $8000
+reset:  sei
+        cld
+        ldx #$FF
+        txs
+        lda #$01
+        sta lfsr
+
+loop:   lda lfsr
+        lsr a
+        bcc no_tap
+        eor #$B8
+no_tap: sta lfsr
+        bmi minus
+        bvs overflow
+        beq zero
+        inc count
+        jmp far
+minus:  bit lfsr
+        bvc loop
+        dec count
+        bpl loop
+        bmi loop
+overflow:
+        clv
+        bcs loop
+        bcc loop
+zero:   lda #$01
+        sta lfsr
+        jmp loop
+
+        ; A taken branch onto the next page costs a cycle more.
+        .align $100
+        .fill $F9, $EA
+far:    lda count
+        and #$01
+        beq back
+        nop
+        nop
+back:   jmp loop
+
+nmi:
+irq:    rti
+
+        .org $FFFA
+        .word nmi, reset, irq
@@ -0,0 +1,38 @@
+; Walks $0200-$07FF through a zero page pointer with (d),Y and (d,X), summing and
+; rewriting every byte. Stresses indirect addressing and RAM reads and writes.
+
+ptr = $00
+sum = $02
+
+        .org $8000
+reset:  sei
+        cld
+        ldx #$FF
+        txs
+
+walk:   lda #$00
+        sta ptr
+        lda #$02
+        sta ptr+1
+        ldx #0
+page:   ldy #0
+byte:   lda (ptr),Y
+        clc
+        adc sum
+        sta sum
+        eor #$A5
+        sta (ptr),Y
+        lda (ptr,X)
+        iny
+        bne byte
+        inc ptr+1
+        lda ptr+1
+        cmp #$08
+        bne page
+        jmp walk
+
+nmi:
+irq:    rti
+
+        .org $FFFA
+        .word nmi, reset, irq
@@ -0,0 +1,46 @@
+; Fills page 2 with 64 sprites, then starts OAM DMA from it back to back, moving the
+; sprites a little between transfers. Each DMA stalls the CPU for 513 or 514 cycles, so
+; this stresses the DMA path and sprite state far past what a game does.
+
+PPUCTRL = $2000
+PPUMASK = $2001
+OAMADDR = $2003
+OAMDMA = $4014
+
+sprites = $0200
+
+        .org $8000
+reset:  sei
+        cld
+        ldx #$FF
+        txs
+        lda #$00
+        sta PPUCTRL
+        lda #%00011110      ; background and sprites on
+        sta PPUMASK
+
+        ldx #0
+fill:   txa
+        sta sprites,X       ; y, tile, attributes, x all from the index
+        inx
+        bne fill
+
+dma:    lda #$00
+        sta OAMADDR
+        lda #>sprites
+        sta OAMDMA
+        ldx #0
+move:   inc sprites,X       ; y
+        inc sprites+3,X     ; x
+        txa
+        clc
+        adc #16
+        tax
+        bne move
+        jmp dma
+
+nmi:
+irq:    rti
+
+        .org $FFFA
+        .word nmi, reset, irq
@@ -0,0 +1,45 @@
+; Spins on PPUSTATUS waiting for vblank, the way most games wait for a frame, then sets
+; the scroll and control registers and reads PPUSTATUS and OAMDATA between frames.
+; Stresses PPU register reads and the CPU-PPU catch-up.
+
+PPUCTRL = $2000
+PPUMASK = $2001
+PPUSTATUS = $2002
+OAMADDR = $2003
+OAMDATA = $2004
+PPUSCROLL = $2005
+
+frame = $10
+
+        .org $8000
+reset:  sei
+        cld
+        ldx #$FF
+        txs
+        lda #$00
+        sta PPUCTRL
+        lda #%00011110      ; background and sprites on
+        sta PPUMASK
+
+wait:   bit PPUSTATUS
+        bpl wait
+        inc frame
+        lda frame
+        sta PPUSCROLL
+        sta PPUSCROLL
+        and #$01
+        sta PPUCTRL
+        ; Keep reading registers for the rest of the frame.
+        ldx #0
+busy:   lda PPUSTATUS
+        stx OAMADDR
+        lda OAMDATA
+        inx
+        bne busy
+        jmp wait
+
+nmi:
+irq:    rti
+
+        .org $FFFA
+        .word nmi, reset, irq
@@ -0,0 +1,69 @@
+; Uploads whole nametables and the palette through PPUADDR/PPUDATA in an unrolled loop,
+; with rendering off as a game would during a screen change. Stresses PPU register writes
+; and VRAM addressing.
+
+PPUCTRL = $2000
+PPUMASK = $2001
+PPUSTATUS = $2002
+PPUADDR = $2006
+PPUDATA = $2007
+
+tile = $10
+
+        .org $8000
+reset:  sei
+        cld
+        ldx #$FF
+        txs
+        lda #$00
+        sta PPUCTRL
+        sta PPUMASK
+
+upload: bit PPUSTATUS       ; reset the address latch
+        lda #$20
+        sta PPUADDR
+        lda #$00
+        sta PPUADDR
+        inc tile
+        lda tile
+        ldy #8              ; 8 * 256 bytes: both nametables
+page:   ldx #0
+burst:  sta PPUDATA
+        sta PPUDATA
+        sta PPUDATA
+        sta PPUDATA
+        sta PPUDATA
+        sta PPUDATA
+        sta PPUDATA
+        sta PPUDATA
+        inx
+        inx
+        inx
+        inx
+        inx
+        inx
+        inx
+        inx
+        bne burst
+        dey
+        bne page
+
+        lda #$3F
+        sta PPUADDR
+        lda #$00
+        sta PPUADDR
+        ldx #0
+palette:
+        txa
+        adc tile
+        sta PPUDATA
+        inx
+        cpx #32
+        bne palette
+        jmp upload
+
+nmi:
+irq:    rti
+
+        .org $FFFA
+        .word nmi, reset, irq
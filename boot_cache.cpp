@@ -0,0 +1,111 @@
+#include "boot_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "version.h"
+
+BootCache::BootCache(const std::string& dir, BootPoint point) : dir_(dir), point_(point) {
+  boot_key_ = point_.at_first_poll ? ~0ULL : point_.frames;
+}
+
+bool BootCache::Boot(const Cartridge& cartridge, Cpu6502* cpu) {
+  FileHeader header = {};
+  header.magic = FileHeader::kMagic;
+  header.state_size = sizeof(ConsoleState);
+  header.rom_hash = cartridge.ContentHash();
+  const std::string& version = EmulatorVersion();
+  header.version_hash = Fnv1a64(reinterpret_cast<const uint8_t*>(version.data()), version.size());
+  header.boot_key = boot_key_;
+
+  std::string path = PathFor(header.rom_hash);
+  if (Load(path, header, cpu)) {
+    return true;
+  }
+  RunBoot(cpu);
+  auto state = std::make_unique<ConsoleState>();
+  cpu->SaveState(state.get());
+  Store(path, header, *state);
+  return false;
+}
+
+std::string BootCache::PathFor(uint64_t rom_hash) {
+  std::string point = point_.at_first_poll ? "poll" : string_format("f%llu",
+      static_cast<unsigned long long>(point_.frames));
+  return string_format("%s/%016llx-%s-%s.boot", dir_.c_str(),
+      static_cast<unsigned long long>(rom_hash), EmulatorVersion().c_str(), point.c_str());
+}
+
+bool BootCache::Load(const std::string& path, const FileHeader& expected, Cpu6502* cpu) {
+  const size_t file_size = sizeof(FileHeader) + sizeof(ConsoleState);
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st = {};
+  void* mem = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == file_size) {
+    mem = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mem == MAP_FAILED) {
+    return false;
+  }
+  const FileHeader* header = static_cast<const FileHeader*>(mem);
+  bool ok = memcmp(header, &expected, sizeof(FileHeader)) == 0;
+  if (ok) {
+    try {
+      // The mapping is page aligned, so the state after the 64-byte header is aligned too.
+      cpu->LoadState(*reinterpret_cast<const ConsoleState*>(static_cast<const uint8_t*>(mem) +
+                                                            sizeof(FileHeader)));
+    } catch (const std::exception& e) {
+      DBG("Ignoring boot cache entry %s: %s\n", path.c_str(), e.what());
+      ok = false;
+    }
+  }
+  munmap(mem, file_size);
+  return ok;
+}
+
+void BootCache::Store(const std::string& path, const FileHeader& header, const ConsoleState& state) {
+  std::string tmp_path = string_format("%s.%d.%zx", path.c_str(), static_cast<int>(getpid()),
+      std::hash<std::thread::id>()(std::this_thread::get_id()));
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr) {
+    throw std::runtime_error("Could not write boot cache entry " + tmp_path + ": " + strerror(errno));
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(&state, sizeof(state), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    throw std::runtime_error("Could not write boot cache entry " + path);
+  }
+}
+
+void BootCache::RunBoot(Cpu6502* cpu) {
+  cpu->SetButtons(0, 0);
+  cpu->SetButtons(1, 0);
+  if (!point_.at_first_poll) {
+    for (uint64_t i = 0; i < point_.frames; ++i) {
+      cpu->RunFrame();
+    }
+    return;
+  }
+  // Keep the state from the start of each frame, and go back to it once a frame polls.
+  auto frame_start = std::make_unique<ConsoleState>();
+  for (uint64_t i = 0; i < kMaxPollFrames; ++i) {
+    cpu->SaveState(frame_start.get());
+    uint64_t reads = cpu->ControllerReads();
+    cpu->RunFrame();
+    if (cpu->ControllerReads() != reads) {
+      cpu->LoadState(*frame_start);
+      return;
+    }
+  }
+  throw std::runtime_error(string_format("No controller read in the first %llu frames.",
+      static_cast<unsigned long long>(kMaxPollFrames)));
+}
@@ -0,0 +1,63 @@
+#ifndef BOOT_CACHE_H_
+#define BOOT_CACHE_H_
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+
+// On-disk cache of post-boot save states, so short runs can skip a ROM's boot and title
+// logic. Entries are keyed by the ROM's content hash, EmulatorVersion() and the boot point,
+// and are loaded straight out of an mmap of the file.
+//
+// Boot frames always run with no buttons held, so a cached boot is exactly what a fresh
+// run without input would reach.
+class BootCache {
+  public:
+    // Where booting ends: after a fixed number of frames, or at the start of the first
+    // frame in which the game reads a controller.
+    struct BootPoint {
+      bool at_first_poll = true;
+      uint64_t frames = 0;
+    };
+
+    // The directory must exist.
+    BootCache(const std::string& dir, BootPoint point);
+
+    // Brings a freshly reset console to the boot point, from the cache if possible and by
+    // running it (then filling the cache) if not. Returns true on a cache hit.
+    // Throws if the game never polls input within kMaxPollFrames.
+    //
+    // The frame buffer is not part of the entry, so after a hit it is left as it was (blank
+    // on a fresh console) rather than showing the last boot frame. Boot points are at the
+    // end of a frame, so the next RunFrame() redraws all of it.
+    bool Boot(const Cartridge& cartridge, Cpu6502* cpu);
+
+    static constexpr uint64_t kMaxPollFrames = 3600;
+
+  private:
+    // Precedes the ConsoleState in each file. 64 bytes, so the state stays aligned in the mapping.
+    struct FileHeader {
+      static constexpr uint32_t kMagic = 0x4253454E;  // "NESB"
+      uint32_t magic;
+      uint32_t state_size;
+      uint64_t rom_hash;
+      uint64_t version_hash;
+      uint64_t boot_key;
+      uint8_t reserved[32];
+    };
+    static_assert(sizeof(FileHeader) == 64, "FileHeader must keep the state 64-byte aligned.");
+
+    std::string PathFor(uint64_t rom_hash);
+    // Returns false, leaving cpu alone, if there is no usable entry.
+    bool Load(const std::string& path, const FileHeader& expected, Cpu6502* cpu);
+    // Writes to a temporary file and renames it, so concurrent runs never see a partial entry.
+    void Store(const std::string& path, const FileHeader& header, const ConsoleState& state);
+    // Runs cpu to the boot point.
+    void RunBoot(Cpu6502* cpu);
+
+    std::string dir_;
+    BootPoint point_;
+    uint64_t boot_key_;  // ~0 for the first poll, else the frame count
+};
+
+#endif  // BOOT_CACHE_H_
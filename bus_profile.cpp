@@ -0,0 +1,364 @@
+#include "bus_profile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+namespace {
+
+const std::array<const char*, 8> kPpuRegisterNames = {
+  "PPUCTRL", "PPUMASK", "PPUSTATUS", "OAMADDR", "OAMDATA", "PPUSCROLL", "PPUADDR", "PPUDATA",
+};
+
+const std::array<const char*, 32> kIoRegisterNames = {
+  "SQ1_VOL", "SQ1_SWEEP", "SQ1_LO", "SQ1_HI", "SQ2_VOL", "SQ2_SWEEP", "SQ2_LO", "SQ2_HI",
+  "TRI_LINEAR", "-", "TRI_LO", "TRI_HI", "NOISE_VOL", "-", "NOISE_LO", "NOISE_HI",
+  "DMC_FREQ", "DMC_RAW", "DMC_START", "DMC_LEN", "OAMDMA", "SND_CHN", "JOY1", "JOY2",
+  "-", "-", "-", "-", "-", "-", "-", "-",
+};
+
+struct Region {
+  const char* name;
+  int first_page;
+  int last_page;
+};
+
+const std::array<Region, 6> kRegions = {{
+  {"RAM", 0x00, 0x1F}, {"PPU", 0x20, 0x3F}, {"APU/IO", 0x40, 0x40}, {"UNMAPPED", 0x41, 0x5F},
+  {"PRG-RAM", 0x60, 0x7F}, {"PRG-ROM", 0x80, 0xFF},
+}};
+
+// Heatmap shades: no accesses, then one access up to the busiest page.
+const char kShades[] = ".:-=+*#%@";
+
+bool IsPpuRegister(uint16_t addr) {
+  return addr >= 0x2000 && addr < 0x4000;
+}
+
+bool IsIoRegister(uint16_t addr) {
+  return addr >= 0x4000 && addr < 0x4020;
+}
+
+// What an access's cycles are charged to: the register for I/O, else the page.
+uint32_t Target(uint16_t addr) {
+  if (IsPpuRegister(addr)) {
+    return 0x10000 | (addr % 8);
+  } else if (IsIoRegister(addr)) {
+    return 0x10000 | addr;
+  }
+  return addr >> 8;
+}
+
+double Percent(double part, double whole) {
+  return whole == 0 ? 0 : 100.0 * part / whole;
+}
+
+} // namespace
+
+// Every merged profile, by ROM. Reports when destroyed at exit.
+class BusProfileTotals {
+  public:
+    static BusProfileTotals& Get() {
+      static BusProfileTotals totals;
+      return totals;
+    }
+
+    void Add(uint64_t rom_hash, BusProfile::BusCounts counts) {
+      const std::lock_guard<std::mutex> lock(mu_);
+      RomTotal& total = by_rom_[rom_hash];
+      total.consoles.push_back(std::move(counts.frames));
+      counts.frames.clear();
+      if (total.consoles.size() == 1) {
+        total.counts = std::move(counts);
+        return;
+      }
+      BusProfile::BusCounts& to = total.counts;
+      auto add = [](BusProfile::Counts* to, const BusProfile::Counts& from) {
+        to->reads += from.reads;
+        to->writes += from.writes;
+        to->cycles += from.cycles;
+      };
+      for (size_t i = 0; i < to.pages.size(); ++i) {
+        add(&to.pages[i], counts.pages[i]);
+        to.pages[i].fetches += counts.pages[i].fetches;
+      }
+      for (size_t i = 0; i < to.ppu_registers.size(); ++i) {
+        add(&to.ppu_registers[i], counts.ppu_registers[i]);
+      }
+      for (size_t i = 0; i < to.io_registers.size(); ++i) {
+        add(&to.io_registers[i], counts.io_registers[i]);
+      }
+      to.oam_dmas += counts.oam_dmas;
+      to.oam_dma_cycles += counts.oam_dma_cycles;
+      to.cycles += counts.cycles;
+      to.instructions += counts.instructions;
+    }
+
+    ~BusProfileTotals() {
+      if (by_rom_.empty()) {
+        return;
+      }
+      FILE* csv = fopen("nes2x_bus_profile.csv", "w");
+      if (csv != nullptr) {
+        fprintf(csv, "rom,kind,addr,name,reads,writes,fetches,cycles\n");
+      }
+      FILE* frames = fopen("nes2x_bus_frames.csv", "w");
+      if (frames != nullptr) {
+        fprintf(frames, "rom,console,frame,cycles,reads,writes,ppu_reads,ppu_writes,status_reads,status_cycles,"
+                        "vram_writes,vram_cycles,oam_dmas\n");
+      }
+      for (const auto& rom : by_rom_) {
+        Report(rom.first, rom.second, csv, frames);
+      }
+      if (csv != nullptr) {
+        fclose(csv);
+      }
+      if (frames != nullptr) {
+        fclose(frames);
+      }
+      if (csv != nullptr && frames != nullptr) {
+        fprintf(stderr, "Bus profile written to nes2x_bus_profile.csv and nes2x_bus_frames.csv\n");
+      }
+    }
+
+  private:
+    struct RomTotal {
+      BusProfile::BusCounts counts;
+      std::vector<std::vector<BusProfile::FrameCounts>> consoles;  // each console's frames
+    };
+
+    BusProfileTotals() = default;
+
+    static void Report(uint64_t rom_hash, const RomTotal& total, FILE* csv, FILE* frames_csv) {
+      const BusProfile::BusCounts& c = total.counts;
+      double cycles = static_cast<double>(c.cycles);
+      uint64_t frames = 0;
+      for (const auto& console : total.consoles) {
+        frames += console.size();
+      }
+      fprintf(stderr, "BUS rom=%016llx instructions=%llu cycles=%llu frames=%llu\n",
+              static_cast<unsigned long long>(rom_hash), static_cast<unsigned long long>(c.instructions),
+              static_cast<unsigned long long>(c.cycles), static_cast<unsigned long long>(frames));
+
+      fprintf(stderr, "  %-9s %-11s %13s %13s %13s %7s\n", "REGION", "ADDRS", "READS", "WRITES", "FETCHES",
+              "%CYC");
+      for (const Region& region : kRegions) {
+        BusProfile::PageCounts sum;
+        for (int page = region.first_page; page <= region.last_page; ++page) {
+          sum.reads += c.pages[page].reads;
+          sum.writes += c.pages[page].writes;
+          sum.fetches += c.pages[page].fetches;
+          sum.cycles += c.pages[page].cycles;
+        }
+        fprintf(stderr, "  %-9s $%02X00-$%02XFF %13llu %13llu %13llu %7.2f\n", region.name, region.first_page,
+                region.last_page, static_cast<unsigned long long>(sum.reads),
+                static_cast<unsigned long long>(sum.writes), static_cast<unsigned long long>(sum.fetches),
+                Percent(sum.cycles, cycles));
+      }
+
+      double per_frame = frames == 0 ? 0 : 1.0 / frames;
+      fprintf(stderr, "  %-4s %-10s %13s %13s %7s %9s %9s\n", "REG", "NAME", "READS", "WRITES", "%CYC",
+              "R/FRAME", "W/FRAME");
+      auto print_register = [&](uint16_t addr, const char* name, const BusProfile::Counts& r) {
+        if (r.reads + r.writes == 0) {
+          return;
+        }
+        fprintf(stderr, "  %04X %-10s %13llu %13llu %7.2f %9.1f %9.1f\n", addr, name,
+                static_cast<unsigned long long>(r.reads), static_cast<unsigned long long>(r.writes),
+                Percent(r.cycles, cycles), r.reads * per_frame, r.writes * per_frame);
+      };
+      for (size_t i = 0; i < c.ppu_registers.size(); ++i) {
+        print_register(0x2000 + i, kPpuRegisterNames[i], c.ppu_registers[i]);
+      }
+      for (size_t i = 0; i < c.io_registers.size(); ++i) {
+        print_register(0x4000 + i, kIoRegisterNames[i], c.io_registers[i]);
+      }
+      fprintf(stderr, "  OAMDMA count=%llu stall_cycles=%llu %%cyc=%.2f\n",
+              static_cast<unsigned long long>(c.oam_dmas), static_cast<unsigned long long>(c.oam_dma_cycles),
+              Percent(c.oam_dma_cycles, cycles));
+
+      // The busiest frame for each fast path, next to the mean.
+      uint64_t ppu_accesses = 0;
+      uint64_t max_ppu_accesses = 0;
+      double max_status = 0;
+      uint64_t max_vram_writes = 0;
+      for (const auto& console : total.consoles) {
+        for (const BusProfile::FrameCounts& f : console) {
+          ppu_accesses += f.ppu_reads + f.ppu_writes;
+          max_ppu_accesses = std::max(max_ppu_accesses, f.ppu_reads + f.ppu_writes);
+          max_status = std::max(max_status, Percent(f.status_cycles, f.cycles));
+          max_vram_writes = std::max(max_vram_writes, f.vram_writes);
+        }
+      }
+      const BusProfile::Counts& status = c.ppu_registers[2];
+      const BusProfile::Counts& vram = c.ppu_registers[7];
+      fprintf(stderr, "  FAST PATHS\n");
+      fprintf(stderr, "    idle-loop skip: PPUSTATUS polling %.2f%% of cycles (max %.2f%% in a frame)\n",
+              Percent(status.cycles, cycles), max_status);
+      fprintf(stderr, "    catch-up PPU:   %.1f PPU register accesses per frame (max %llu)\n",
+              ppu_accesses * per_frame, static_cast<unsigned long long>(max_ppu_accesses));
+      fprintf(stderr, "    VRAM bursts:    %.1f PPUDATA writes per frame (max %llu), %.2f%% of cycles\n",
+              vram.writes * per_frame, static_cast<unsigned long long>(max_vram_writes),
+              Percent(vram.cycles, cycles));
+
+      // Accesses per page on a log scale, one row per 4 KiB.
+      uint64_t busiest = 1;
+      for (const BusProfile::PageCounts& page : c.pages) {
+        busiest = std::max(busiest, page.reads + page.writes + page.fetches);
+      }
+      fprintf(stderr, "  HEATMAP accesses per page, '%c'=none, '%c'=1 to '%c'=%llu\n", kShades[0], kShades[1],
+              kShades[sizeof(kShades) - 2], static_cast<unsigned long long>(busiest));
+      fprintf(stderr, "        0123456789ABCDEF\n");
+      for (int row = 0; row < 16; ++row) {
+        std::string shades;
+        for (int col = 0; col < 16; ++col) {
+          const BusProfile::PageCounts& page = c.pages[row * 16 + col];
+          uint64_t accesses = page.reads + page.writes + page.fetches;
+          size_t shade = 0;
+          if (accesses > 0) {
+            double scale = std::log1p(static_cast<double>(accesses)) / std::log1p(static_cast<double>(busiest));
+            shade = 1 + static_cast<size_t>(scale * (sizeof(kShades) - 3) + 0.5);
+          }
+          shades += kShades[shade];
+        }
+        fprintf(stderr, "    $%X000 %s\n", row, shades.c_str());
+      }
+
+      if (csv != nullptr) {
+        for (size_t i = 0; i < c.pages.size(); ++i) {
+          const BusProfile::PageCounts& p = c.pages[i];
+          fprintf(csv, "%016llx,page,%02X00,,%llu,%llu,%llu,%.1f\n", static_cast<unsigned long long>(rom_hash),
+                  static_cast<unsigned>(i), static_cast<unsigned long long>(p.reads),
+                  static_cast<unsigned long long>(p.writes), static_cast<unsigned long long>(p.fetches), p.cycles);
+        }
+        auto write_register = [&](uint16_t addr, const char* name, const BusProfile::Counts& r) {
+          fprintf(csv, "%016llx,register,%04X,%s,%llu,%llu,,%.1f\n", static_cast<unsigned long long>(rom_hash),
+                  addr, name, static_cast<unsigned long long>(r.reads), static_cast<unsigned long long>(r.writes),
+                  r.cycles);
+        };
+        for (size_t i = 0; i < c.ppu_registers.size(); ++i) {
+          write_register(0x2000 + i, kPpuRegisterNames[i], c.ppu_registers[i]);
+        }
+        for (size_t i = 0; i < c.io_registers.size(); ++i) {
+          write_register(0x4000 + i, kIoRegisterNames[i], c.io_registers[i]);
+        }
+      }
+      if (frames_csv != nullptr) {
+        for (size_t console = 0; console < total.consoles.size(); ++console) {
+          for (const BusProfile::FrameCounts& f : total.consoles[console]) {
+            fprintf(frames_csv, "%016llx,%zu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%llu,%.1f,%llu\n",
+                    static_cast<unsigned long long>(rom_hash), console, static_cast<unsigned long long>(f.frame),
+                    static_cast<unsigned long long>(f.cycles), static_cast<unsigned long long>(f.reads),
+                    static_cast<unsigned long long>(f.writes), static_cast<unsigned long long>(f.ppu_reads),
+                    static_cast<unsigned long long>(f.ppu_writes), static_cast<unsigned long long>(f.status_reads),
+                    f.status_cycles, static_cast<unsigned long long>(f.vram_writes), f.vram_cycles,
+                    static_cast<unsigned long long>(f.oam_dmas));
+          }
+        }
+      }
+    }
+
+    std::mutex mu_;
+    std::map<uint64_t, RomTotal> by_rom_;
+};
+
+BusProfile::BusProfile(std::unique_ptr<Mapper> inner, uint64_t rom_hash)
+    : Mapper(inner->cpu_ram_, inner->ppu_, inner->apu_ram_, inner->controllers_, inner->prg_rom_,
+             inner->prg_rom_size_, inner->prg_ram_),
+      inner_(std::move(inner)), rom_hash_(rom_hash) {
+  mapper_id_ = inner_->mapper_id_;
+  frame_.frame = ppu_->FrameCount();
+}
+
+BusProfile::~BusProfile() {
+  if (frame_.cycles > 0) {
+    counts_.frames.push_back(frame_);
+  }
+  BusProfileTotals::Get().Add(rom_hash_, std::move(counts_));
+}
+
+uint16_t BusProfile::Set(uint16_t addr, uint8_t val, uint64_t current_cycle) {
+  Touch(addr, true);
+  uint16_t dma_cycles = inner_->Set(addr, val, current_cycle);
+  if (dma_cycles > 0) {
+    counts_.oam_dmas++;
+    counts_.oam_dma_cycles += dma_cycles;
+    frame_.oam_dmas++;
+  }
+  return dma_cycles;
+}
+
+void BusProfile::Touch(uint16_t addr, bool write) {
+  Counts* reg = nullptr;
+  if (IsPpuRegister(addr)) {
+    reg = &counts_.ppu_registers[addr % 8];
+    if (write) {
+      frame_.ppu_writes++;
+      frame_.vram_writes += addr % 8 == 7;
+    } else {
+      frame_.ppu_reads++;
+      frame_.status_reads += addr % 8 == 2;
+    }
+  } else if (IsIoRegister(addr)) {
+    reg = &counts_.io_registers[addr - 0x4000];
+  }
+  Counts& page = counts_.pages[addr >> 8];
+  if (write) {
+    page.writes++;
+    frame_.writes++;
+  } else {
+    page.reads++;
+    frame_.reads++;
+  }
+  if (reg != nullptr) {
+    write ? reg->writes++ : reg->reads++;
+  }
+  if (touched_count_ < kMaxTouched) {
+    touched_[touched_count_++] = addr;
+  }
+}
+
+void BusProfile::EndInstruction(uint64_t cycles) {
+  counts_.instructions++;
+  counts_.cycles += cycles;
+  frame_.cycles += cycles;
+  if (touched_count_ == 0) {
+    counts_.pages[pc_ >> 8].cycles += cycles;
+  } else {
+    // A read-modify-write touches its address twice but is charged to it once.
+    std::array<uint16_t, kMaxTouched> targets;
+    int count = 0;
+    for (int i = 0; i < touched_count_; ++i) {
+      bool seen = false;
+      for (int j = 0; j < count && !seen; ++j) {
+        seen = Target(targets[j]) == Target(touched_[i]);
+      }
+      if (!seen) {
+        targets[count++] = touched_[i];
+      }
+    }
+    double share = static_cast<double>(cycles) / count;
+    for (int i = 0; i < count; ++i) {
+      uint16_t addr = targets[i];
+      counts_.pages[addr >> 8].cycles += share;
+      if (IsPpuRegister(addr)) {
+        counts_.ppu_registers[addr % 8].cycles += share;
+        if (addr % 8 == 2) {
+          frame_.status_cycles += share;
+        } else if (addr % 8 == 7) {
+          frame_.vram_cycles += share;
+        }
+      } else if (IsIoRegister(addr)) {
+        counts_.io_registers[addr - 0x4000].cycles += share;
+      }
+    }
+  }
+
+  uint64_t frame = ppu_->FrameCount();
+  if (frame != frame_.frame) {
+    counts_.frames.push_back(frame_);
+    frame_ = FrameCounts();
+    frame_.frame = frame;
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef BUS_PROFILE_H_
+#define BUS_PROFILE_H_
+
+#include <array>
+#include <memory>
+
+#include "common.h"
+#include "mapper.h"
+
+// Counts how guest code uses the bus: reads and writes per 256-byte page, per PPU register
+// (mirrors folded onto $2000-$2007) and per APU/IO register, OAM DMAs, and the cycles spent on
+// each. Shows where idle-loop skipping, a catch-up PPU or VRAM-burst fast paths would pay off
+// for a game. Only built into Cpu6502 with -D BUS_PROFILE
+// (make ... TEST_DEFINES="-U DEBUG -D BUS_PROFILE"), so other builds pay nothing.
+//
+// A BusProfile wraps the console's real mapper and passes every access through. The CPU
+// brackets each instruction with BeginInstruction() and EndInstruction(); reads of the
+// instruction's own bytes count as fetches, and its cycles are split evenly between the
+// registers and pages of whatever else it touched, or charged to the page it runs from if it
+// touched nothing else. An NMI is bracketed on its own.
+//
+// Each console merges its counts into a per-ROM total when destroyed. At exit the totals are
+// reported to stderr with a heatmap of the pages, and written to nes2x_bus_profile.csv and
+// nes2x_bus_frames.csv (one row per frame) in the working directory.
+class BusProfile : public Mapper {
+  public:
+    BusProfile(std::unique_ptr<Mapper> inner, uint64_t rom_hash);
+    // Adds this console's counts to its ROM's total.
+    ~BusProfile() override;
+
+    uint8_t Get(uint16_t addr) override {
+      if (static_cast<uint16_t>(addr - pc_) < 3) {
+        counts_.pages[addr >> 8].fetches++;
+      } else {
+        Touch(addr, false);
+      }
+      return inner_->Get(addr);
+    }
+    // Not counted: a store's operand is never read from the bus.
+    uint8_t Peek(uint16_t addr) override { return inner_->Peek(addr); }
+    uint16_t Set(uint16_t addr, uint8_t val, uint64_t current_cycle) override;
+    int64_t PrgRomOffset(uint16_t addr) override { return inner_->PrgRomOffset(addr); }
+
+    // The instruction at pc is about to run.
+    void BeginInstruction(uint16_t pc) {
+      pc_ = pc;
+      touched_count_ = 0;
+    }
+    // It took cycles, DMA stalls included.
+    void EndInstruction(uint64_t cycles);
+
+  private:
+    friend class BusProfileTotals;
+
+    struct Counts {
+      uint64_t reads = 0;
+      uint64_t writes = 0;
+      double cycles = 0;
+    };
+    struct PageCounts : Counts {
+      uint64_t fetches = 0;  // opcode and operand reads
+    };
+    struct FrameCounts {
+      uint64_t frame = 0;
+      uint64_t cycles = 0;
+      uint64_t reads = 0;  // data reads and writes, fetches not included
+      uint64_t writes = 0;
+      uint64_t ppu_reads = 0;
+      uint64_t ppu_writes = 0;
+      uint64_t status_reads = 0;  // PPUSTATUS
+      double status_cycles = 0;
+      uint64_t vram_writes = 0;  // PPUDATA
+      double vram_cycles = 0;
+      uint64_t oam_dmas = 0;
+    };
+    struct BusCounts {
+      std::array<PageCounts, 256> pages;
+      std::array<Counts, 8> ppu_registers;   // $2000-$2007
+      std::array<Counts, 32> io_registers;   // $4000-$401F
+      uint64_t oam_dmas = 0;
+      uint64_t oam_dma_cycles = 0;
+      uint64_t cycles = 0;
+      uint64_t instructions = 0;
+      std::vector<FrameCounts> frames;  // finished frames, oldest first
+    };
+
+    // Most addresses one instruction touches besides its own bytes (BRK and an NMI touch 5).
+    static constexpr int kMaxTouched = 8;
+
+    void Touch(uint16_t addr, bool write);
+
+    std::unique_ptr<Mapper> inner_;
+    uint64_t rom_hash_;
+    BusCounts counts_;
+    FrameCounts frame_;  // the frame in progress
+    uint16_t pc_ = 0;
+    std::array<uint16_t, kMaxTouched> touched_;
+    int touched_count_ = 0;
+};
+
+#endif  // BUS_PROFILE_H_
@@ -0,0 +1,115 @@
+#include "cartridge.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "mapper_id.h"
+
+std::shared_ptr<const Cartridge> Cartridge::FromFile(const std::string& file_path) {
+  std::shared_ptr<Cartridge> cart(new Cartridge());
+  int fd = open(file_path.c_str(), O_RDONLY);
+  struct stat st = {};
+  if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    // Read-only and never written, so the pages stay shared with every other mapping of the file.
+    void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mem != MAP_FAILED) {
+      cart->mapping_ = mem;
+      cart->data_ = static_cast<const uint8_t*>(mem);
+      cart->size_ = st.st_size;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  cart->Parse();
+  return cart;
+}
+
+std::shared_ptr<const Cartridge> Cartridge::FromBytes(std::vector<uint8_t> bytes) {
+  std::shared_ptr<Cartridge> cart(new Cartridge());
+  cart->bytes_ = std::move(bytes);
+  cart->data_ = cart->bytes_.data();
+  cart->size_ = cart->bytes_.size();
+  cart->Parse();
+  return cart;
+}
+
+Cartridge::~Cartridge() {
+  if (mapping_ != nullptr) {
+    munmap(mapping_, size_);
+  }
+}
+
+void Cartridge::Parse() {
+  if (size_ <= 0) {
+    throw std::runtime_error("No file or empty file.");
+  } else if (size_ < 8) {
+    throw std::runtime_error("Invalid file format.");
+  }
+
+  bool is_ines = false;
+  if (data_[0] == 'N' && data_[1] == 'E' && data_[2] == 'S' && data_[3] == 0x1A) {
+    is_ines = true;
+  }
+
+  bool is_nes2 = false;
+  if (is_ines == true && (data_[7]&0x0C)==0x08) {
+    is_nes2 = true;
+  }
+
+  if (is_nes2) {
+    DBG("Found %llu byte NES 2.0 file.\n", static_cast<unsigned long long>(size_));
+    // TODO: Load NES 2.0 specific
+    // Back-compat with ines 1.0
+    LoadNes1File();
+  } else if (is_ines) {
+    DBG("Found %llu byte iNES 1.0 file.\n", static_cast<unsigned long long>(size_));
+    LoadNes1File();
+  } else {
+    throw std::runtime_error("Rom file is not iNES format.");
+  }
+  content_hash_ = Fnv1a64(data_, size_);
+}
+
+void Cartridge::LoadNes1File() {
+  if (size_ < 16) {
+    throw std::runtime_error("Incomplete iNes header.");
+  }
+
+  prg_rom_size_ = static_cast<uint32_t>(data_[4]) * 0x4000;
+  chr_rom_size_ = static_cast<uint32_t>(data_[5]) * 0x2000;
+  chr_rom_offset_ = prg_rom_offset_ + prg_rom_size_;
+
+  if (size_ < (prg_rom_size_ + chr_rom_size_ + 16)) {
+    throw std::runtime_error("Rom file size less than header suggests.");
+  }
+
+  // TODO: Handle flags as needed.
+  uint8_t flags6 = data_[6];  // msb are lower nybble of mapper num
+  if (flags6 & 0b0010'0000) {
+    throw std::runtime_error("Rom has a trainer!");
+  }
+  if (flags6 & 0b0000'1000) {
+    throw std::runtime_error("Rom needs four-screen VRAM.");
+  }
+  mirroring_ = (flags6 & 1) ? ::Mirroring::kVertical : ::Mirroring::kHorizontal;
+  uint8_t flags7 = data_[7];  // lsb are upper nybble of mapper num
+  uint8_t mapper_number = ((flags7 >> 4) << 4) | (flags6 >> 4);
+  if (mapper_number != static_cast<uint8_t>(::MapperId::kNrom)) {
+    throw std::runtime_error(string_format("Unsupported mapper %d.", mapper_number));
+  }
+  mapper_id_ = ::MapperId::kNrom;
+  if (prg_rom_size_ != 0x4000 && prg_rom_size_ != 0x8000) {
+    throw std::runtime_error(string_format("NROM needs 16k or 32k of PRG-ROM, not %uk.",
+                                           static_cast<unsigned>(prg_rom_size_ / 1024)));
+  }
+
+      #ifdef DEBUG
+      uint8_t prg_ram_size = data_[8] == 0x0 ? static_cast<uint8_t>(0x2000) : data_[8] * 0x2000;
+      DBG("Mapper ID %d PRG_ROM sz %d CHAR_ROM sz %d PRG_RAM sz %d\n",
+          mapper_number, static_cast<int>(prg_rom_size_), static_cast<int>(chr_rom_size_), prg_ram_size);
+      #endif
+}
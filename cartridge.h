@@ -0,0 +1,60 @@
+#ifndef CARTRIDGE_H_
+#define CARTRIDGE_H_
+
+#include "common.h"
+#include "mapper_id.h"
+
+// How the PPU's 2kB of nametable RAM backs its four nametables, from the iNES header.
+enum class Mirroring {
+  kHorizontal,  // $2000 = $2400 and $2800 = $2C00, for games that scroll vertically
+  kVertical,    // $2000 = $2800 and $2400 = $2C00, for games that scroll horizontally
+};
+
+// A parsed, immutable iNES image. PRG-ROM and CHR-ROM are read in place, never copied,
+// so every console running the same ROM can share one Cartridge. Writable cartridge
+// memory (PRG-RAM, CHR-RAM) lives in each console's ConsoleState.
+class Cartridge {
+  public:
+    // Maps the file read-only rather than reading it, so the image lives in the page
+    // cache once no matter how many processes load it.
+    // Throws on a missing, truncated or non-iNES file.
+    static std::shared_ptr<const Cartridge> FromFile(const std::string& file_path);
+    static std::shared_ptr<const Cartridge> FromBytes(std::vector<uint8_t> bytes);
+    ~Cartridge();
+
+    Cartridge(const Cartridge&) = delete;
+    Cartridge& operator=(const Cartridge&) = delete;
+
+    const uint8_t* PrgRom() const { return data_ + prg_rom_offset_; }
+    size_t PrgRomSize() const { return prg_rom_size_; }
+    // nullptr if the cartridge uses CHR-RAM instead.
+    const uint8_t* ChrRom() const { return chr_rom_size_ > 0 ? data_ + chr_rom_offset_ : nullptr; }
+    size_t ChrRomSize() const { return chr_rom_size_; }
+    ::MapperId MapperId() const { return mapper_id_; }
+    ::Mirroring Mirroring() const { return mirroring_; }
+    // Fnv1a64 of the whole file, header included.
+    uint64_t ContentHash() const { return content_hash_; }
+
+  private:
+    Cartridge() = default;
+    // Validates the header. Throws on anything we can't run.
+    void Parse();
+    // Loads an iNES 1.0 file
+    void LoadNes1File();
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    // Exactly one of these backs data_.
+    std::vector<uint8_t> bytes_;
+    void* mapping_ = nullptr;
+
+    size_t prg_rom_offset_ = 16;
+    size_t prg_rom_size_ = 0;
+    size_t chr_rom_offset_ = 0;
+    size_t chr_rom_size_ = 0;
+    ::MapperId mapper_id_ = ::MapperId::kUndefined;
+    ::Mirroring mirroring_ = ::Mirroring::kHorizontal;
+    uint64_t content_hash_ = 0;
+};
+
+#endif  // CARTRIDGE_H_
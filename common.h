@@ -1,6 +1,7 @@
 #ifndef C8_COMMON_H_
 #define C8_COMMON_H_
 
+#include <cassert>
 #include <cstdint>
 #include <memory>
 #include <cstdlib>
@@ -56,6 +57,31 @@ inline std::string StringMsSince(Clock::time_point start) {
   return string_format("%dms", std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
 }
 
+// 64-bit FNV-1a. Used for frame and RAM hashes, so it must be stable across builds.
+inline uint64_t Fnv1a64(const uint8_t* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Multiply-xorshift over 8-byte little-endian words, then any tail bytes. Much faster than
+// Fnv1a64 on large buffers and still stable across builds.
+inline uint64_t HashWords(const uint8_t* data, size_t size, uint64_t hash = 0x9E3779B97F4A7C15ULL) {
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+  }
+  for (; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0xFF51AFD7ED558CCDULL;
+  }
+  return hash;
+}
+
 inline uint8_t SetBit(uint8_t pos, uint8_t val, uint8_t new_bit_val) {
   if (new_bit_val) {
     return val | (1 << pos);
@@ -0,0 +1,60 @@
+#ifndef CONTROLLER_H_
+#define CONTROLLER_H_
+
+#include "common.h"
+#include "state.h"
+
+// Standard NES controller, read serially through $4016 (port 0) and $4017 (port 1).
+// The shift register lives in a ControllerState owned by the console. Held buttons are
+// input, not state, so they stay here and survive loading a state.
+class Controller {
+  public:
+    explicit Controller(ControllerState* state) : state_(state) {}
+
+    // Bit positions in the byte passed to SetButtons, in the order the console reads them.
+    enum Button : uint8_t {
+      kA = 1 << 0,
+      kB = 1 << 1,
+      kSelect = 1 << 2,
+      kStart = 1 << 3,
+      kUp = 1 << 4,
+      kDown = 1 << 5,
+      kLeft = 1 << 6,
+      kRight = 1 << 7,
+    };
+
+    void SetButtons(uint8_t buttons) { buttons_ = buttons; }
+    uint8_t Buttons() { return buttons_; }
+
+    // Writing bit 0 high continuously reloads the shift register from the buttons.
+    void Write(uint8_t val) {
+      state_->strobe = val & 1;
+      if (state_->strobe) {
+        state_->shift = buttons_;
+      }
+    }
+
+    // Returns the next button, A first. Reads after the 8th return 1.
+    uint8_t Read() {
+      reads_++;
+      if (state_->strobe) {
+        state_->shift = buttons_;
+      }
+      uint8_t bit = state_->shift & 1;
+      state_->shift = (state_->shift >> 1) | 0x80;
+      return 0x40 | bit;  // upper bits are open bus, usually $40
+    }
+
+    // What Read() would return, without shifting.
+    uint8_t Peek() const { return 0x40 | ((state_->strobe ? buttons_ : state_->shift) & 1); }
+
+    // Reads since construction. Not part of the console state.
+    uint64_t Reads() { return reads_; }
+
+  private:
+    ControllerState* state_;
+    uint8_t buttons_ = 0;
+    uint64_t reads_ = 0;
+};
+
+#endif  // CONTROLLER_H_
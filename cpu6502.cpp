@@ -1,13 +1,14 @@
 #include "cpu6502.h"
 
-#include <fstream>
-#include <functional>
 #include <array>
+#include <cstddef>
 
+#include "cartridge.h"
 #include "common.h"
 #include "mappers/nrom_mapper.h"
 #include "mapper_id.h"
 #include "ppu.h"
+#include "state.h"
 
 namespace { 
 
@@ -19,52 +20,279 @@ namespace {
 #define NTLOGPAD(...) NTLOG("%-32s", string_format(__VA_ARGS__).c_str())
 #define NTLOGPADSINGLE(x) NTLOG("       "); NTLOGPAD("%s", x);
 
-#define WRITE(addr, val) cycle_ += mapper_->Set(addr, val, cycle_);
+#define WRITE(addr, val) Write(addr, val);
 
-// How many CPU cycles to add to next_ppu_update_at_.
+// How many CPU cycles to add to CpuState::next_ppu_update_at.
 const std::array<uint8_t, 3> kPpuUpdatePattern = {114, 114, 113};
 
 uint16_t StackAddr(uint8_t sp) {
   return ((0x01 << 8) | sp);
 }
 
+constexpr size_t kRamOffset = offsetof(ConsoleState, cpu) + offsetof(CpuState, internal_ram);
+constexpr size_t kApuRamOffset = offsetof(ConsoleState, cpu) + offsetof(CpuState, apu_ram);
+constexpr size_t kPpuOffset = offsetof(ConsoleState, ppu);
+constexpr size_t kPrgRamOffset = offsetof(ConsoleState, mapper) + offsetof(MapperState, prg_ram);
+constexpr size_t kChrRamOffset = offsetof(ConsoleState, chr_ram);
+
+// Pages holding the header, CPU registers, PPU registers and controllers. These change
+// without a memory write (and on nearly every frame), so they are always rehashed.
+Cpu6502::PageSet RegisterPages() {
+  Cpu6502::PageSet pages = {};
+  auto add = [&pages](size_t begin, size_t end) {
+    for (size_t page = begin / Cpu6502::kStatePageBytes; page <= (end - 1) / Cpu6502::kStatePageBytes; ++page) {
+      pages[page / 64] |= 1ULL << (page % 64);
+    }
+  };
+  add(0, kRamOffset);
+  add(kPpuOffset + offsetof(PpuState, latch), offsetof(ConsoleState, mapper));
+  return pages;
+}
+
+const Cpu6502::PageSet kRegisterPages = RegisterPages();
+
 } // namespace
 
-Cpu6502::Cpu6502(const std::string& file_path) {
-  Reset(file_path);
-  DBG("NES ready. PC: %#04x\n", program_counter_);
+Cpu6502::Cpu6502(const std::string& file_path) : Cpu6502(Cartridge::FromFile(file_path)) {}
+
+Cpu6502::Cpu6502(std::shared_ptr<const Cartridge> cartridge) {
+  Reset(std::move(cartridge));
+  DBG("NES ready. PC: %#04x\n", state_.cpu.program_counter);
+}
+
+Cpu6502::~Cpu6502() {
+      #ifdef PROFILE
+      profile_->Merge(mapper_.get());
+      #endif
 }
 
 // TODO: Rename to RunInstruction?
 void Cpu6502::RunCycle() {
       #ifdef NESTEST
       std::string prev_flags = string_format("A:%02X X:%02X Y:%02X P:%02X SP:%02X",
-        a_, x_, y_, p_, stack_pointer_);
-      uint64_t prev_cycle = cycle_;
+        state_.cpu.a, state_.cpu.x, state_.cpu.y, state_.cpu.p, state_.cpu.stack_pointer);
+      uint64_t prev_cycle = state_.cpu.cycle;
       #endif
-  uint8_t opcode = mapper_->Get(program_counter_);
+      #ifdef BUS_PROFILE
+      bus_profile_->BeginInstruction(state_.cpu.program_counter);
+      uint64_t bus_profile_cycle = state_.cpu.cycle;
+      #endif
+  uint8_t opcode = mapper_->Get(state_.cpu.program_counter);
       #ifdef NESTEST
-      NTLOG("%04X  %02X ", program_counter_, opcode);
+      NTLOG("%04X  %02X ", state_.cpu.program_counter, opcode);
+      #endif
+  if (trace_ != nullptr) {
+    BeginTrace(opcode);
+  }
+  state_.cpu.program_counter++;
+  const Instruction& instr = (*instructions_)[opcode];
+  if (instr.impl == nullptr) {
+    throw std::runtime_error(string_format("Unknown opcode %02X at %04X.", opcode,
+        static_cast<uint16_t>(state_.cpu.program_counter - 1)));
+  }
+      #ifdef PROFILE
+      uint16_t profile_pc = state_.cpu.program_counter - 1;
+      uint64_t profile_cycle = state_.cpu.cycle;
+      #endif
+  instr.impl(this);
+  state_.cpu.cycle += instr.cycles;
+  if (trace_record_ != nullptr) {
+    trace_record_ = nullptr;
+    trace_->Commit();
+  }
+  if (sampler_ != nullptr) {
+    sampler_->AfterInstruction(opcode, state_.cpu.program_counter, state_.cpu.stack_pointer, state_.cpu.cycle);
+  }
+      #ifdef PROFILE
+      profile_->Record(opcode, profile_pc, state_.cpu.cycle - profile_cycle);
       #endif
-  program_counter_++;
-  Instruction& instr = instructions_.at(opcode);
-  instr.impl();
-  cycle_ += instr.cycles;
       #ifdef NESTEST
       NTLOG("%s PPU:  0,  0 CYC:%llu\n", prev_flags.c_str(), prev_cycle);
       #endif
-  while (cycle_ >= next_ppu_update_at_) {
-    ppu_->Update();
-    next_ppu_update_at_ += kPpuUpdatePattern[ppu_update_pattern_position_];
-    ppu_update_pattern_position_ = (ppu_update_pattern_position_ + 1) % 3;
+      #ifdef BUS_PROFILE
+      bus_profile_->EndInstruction(state_.cpu.cycle - bus_profile_cycle);
+      #endif
+  if (state_.cpu.cycle >= state_.cpu.next_ppu_update_at) {
+    if (phases_ != nullptr) {
+      phases_->Switch(PhaseCounters::kPpu);
+    }
+    if (timeline_ != nullptr) {
+      timeline_->EndCpu(state_.cpu.cycle);
+    }
+    do {
+      uint64_t scanline_start = timeline_ != nullptr ? timeline_->Now() : 0;
+      ppu_->Update();
+      if (timeline_ != nullptr) {
+        timeline_->Span(Timeline::kScanline, scanline_start, state_.cpu.cycle, state_.ppu.scanline);
+      }
+      state_.cpu.next_ppu_update_at += kPpuUpdatePattern[state_.cpu.ppu_update_pattern_position];
+      state_.cpu.ppu_update_pattern_position = (state_.cpu.ppu_update_pattern_position + 1) % 3;
+    } while (state_.cpu.cycle >= state_.cpu.next_ppu_update_at);
+    if (phases_ != nullptr) {
+      phases_->Switch(PhaseCounters::kCpu);
+    }
+    if (timeline_ != nullptr) {
+      timeline_->BeginCpu(state_.cpu.cycle);
+    }
+  }
+  if (ppu_->PollNmi()) {
+      #ifdef BUS_PROFILE
+      bus_profile_->BeginInstruction(state_.cpu.program_counter);
+      bus_profile_cycle = state_.cpu.cycle;
+      #endif
+    Nmi();
+    if (sampler_ != nullptr) {
+      sampler_->Interrupt(state_.cpu.program_counter, state_.cpu.stack_pointer);
+    }
+    if (timeline_ != nullptr) {
+      timeline_->Instant(Timeline::kNmi, state_.cpu.cycle, state_.cpu.program_counter);
+    }
+      #ifdef BUS_PROFILE
+      bus_profile_->EndInstruction(state_.cpu.cycle - bus_profile_cycle);
+      #endif
   }
 }
 
-void Cpu6502::Reset(const std::string& file_path) {
-  LoadCartrtidgeFile(file_path);
+void Cpu6502::SetSampler(StackSampler* sampler) {
+  if (sampler != nullptr) {
+    sampler->Start(state_.cpu.cycle);
+  }
+  sampler_ = sampler;
+}
+
+void Cpu6502::SetTimeline(Timeline* timeline) {
+  if (timeline_ != nullptr) {
+    timeline_->EndCpu(state_.cpu.cycle);
+  }
+  if (timeline != nullptr) {
+    timeline->BeginCpu(state_.cpu.cycle);
+  }
+  timeline_ = timeline;
+}
+
+void Cpu6502::Write(uint16_t addr, uint8_t val) {
+  NoteWrite(addr);
+  uint16_t stall = mapper_->Set(addr, val, state_.cpu.cycle);
+  state_.cpu.cycle += stall;
+  if (timeline_ != nullptr) {
+    if (stall != 0) {  // OAMDMA
+      timeline_->Instant(Timeline::kOamDma, state_.cpu.cycle - stall, stall);
+    } else if (addr == 0x4016) {
+      timeline_->Strobe(val & 1, state_.cpu.cycle, controllers_[0].Buttons());
+    }
+  }
+}
+
+void Cpu6502::NoteWrite(uint16_t addr) {
+  if (addr < 0x2000) {
+    MarkDirty(kRamOffset + addr % 0x800);
+  } else if (addr < 0x4000) {
+    if (addr % 8 == 4) {  // OAMDATA
+      MarkDirty(kPpuOffset + offsetof(PpuState, oam) + state_.ppu.oamaddr);
+    } else if (addr % 8 == 7) {  // PPUDATA
+      uint16_t ppu_addr = state_.ppu.ppuaddr % 0x4000;
+      if (ppu_addr < 0x2000) {
+        MarkDirty(kChrRamOffset + ppu_addr);
+      } else if (ppu_addr < 0x3F00) {
+        MarkDirty(kPpuOffset + offsetof(PpuState, nametable_ram) + (ppu_addr - 0x2000) % 0x800);
+      } else {
+        MarkDirty(kPpuOffset + offsetof(PpuState, palette_ram) + ppu_addr % 0x20);
+      }
+    }
+  } else if (addr == 0x4014) {  // OAMDMA
+    MarkDirty(kPpuOffset + offsetof(PpuState, oam));
+    MarkDirty(kPpuOffset + offsetof(PpuState, oam) + 0xFF);
+  } else if (addr < 0x4020) {
+    MarkDirty(kApuRamOffset + addr % 0x4000);
+  } else if (addr >= 0x6000 && addr < 0x8000) {
+    MarkDirty(kPrgRamOffset + addr - 0x6000);
+  }
+}
+
+Cpu6502::PageSet Cpu6502::ChangedPages() {
+  PageSet pages;
+  for (size_t w = 0; w < kDirtyWords; ++w) {
+    pages[w] = dirty_pages_[w] | kRegisterPages[w];
+  }
+  // The padding bits past the last page.
+  if (kNumStatePages % 64 != 0) {
+    pages[kDirtyWords - 1] &= (1ULL << (kNumStatePages % 64)) - 1;
+  }
+  return pages;
+}
+
+uint64_t Cpu6502::StateHash() {
+  PageSet pages = ChangedPages();
+  for (size_t w = 0; w < kDirtyWords; ++w) {
+    for (uint64_t bits = pages[w]; bits != 0; bits &= bits - 1) {
+      size_t page = w * 64 + __builtin_ctzll(bits);
+      page_hashes_[page] = HashWords(StatePage(page), StatePageSize(page), page);
+    }
+  }
+  dirty_pages_.fill(0);
+  return HashWords(reinterpret_cast<const uint8_t*>(page_hashes_.data()),
+                   page_hashes_.size() * sizeof(uint64_t));
+}
+
+void Cpu6502::SetStatePage(size_t page, const uint8_t* data) {
+  memcpy(reinterpret_cast<uint8_t*>(&state_) + page * kStatePageBytes, data, StatePageSize(page));
+  dirty_pages_[page / 64] |= 1ULL << (page % 64);
+}
+
+void Cpu6502::RunFrame() {
+  uint64_t frame = ppu_->FrameCount();
+  while (ppu_->FrameCount() == frame) {
+    RunCycle();
+  }
+}
+
+void Cpu6502::Nmi() {
+  PushStack16(state_.cpu.program_counter);
+  PushStack((state_.cpu.p | 0b0010'0000) & ~0b0001'0000);  // B=0b10
+  SetFlag(Flag::I, true);
+  state_.cpu.program_counter = mapper_->Get16(0xFFFA);
+  state_.cpu.cycle += 7;
+}
+
+void Cpu6502::BeginTrace(uint8_t opcode) {
+  TraceRecord* record = trace_->Begin();
+  uint16_t pc = state_.cpu.program_counter;
+  record->cycle = state_.cpu.cycle;
+  record->pc = pc;
+  record->addr = 0;
+  record->opcode = opcode;
+  // Peeking at I/O registers has side effects and $4020-$5FFF throws, so leave those out.
+  for (int i = 0; i < 2; ++i) {
+    uint16_t addr = pc + 1 + i;
+    record->operands[i] = addr >= 0x2000 && addr < 0x6000 ? 0 : mapper_->Get(addr);
+  }
+  record->a = state_.cpu.a;
+  record->x = state_.cpu.x;
+  record->y = state_.cpu.y;
+  record->p = state_.cpu.p;
+  record->sp = state_.cpu.stack_pointer;
+  record->val = 0;
+  // After each instruction the PPU is caught up to the CPU's scanline; the dot is how far
+  // into it the CPU is.
+  record->scanline = state_.ppu.scanline;
+  record->dot = std::min<uint64_t>(state_.cpu.cycle * 3 - state_.ppu.cycle, 340);
+  trace_record_ = record;
+}
+
+void Cpu6502::Reset(std::shared_ptr<const Cartridge> cartridge) {
+  memset(&state_, 0, sizeof(state_));
+  MarkAllDirty();
+  state_.magic = ConsoleState::kMagic;
+  state_.version = ConsoleState::kVersion;
+  state_.size = sizeof(ConsoleState);
+  state_.cpu.ppu_update_pattern_position = 1;
+  state_.cpu.next_ppu_update_at = 114;
+  LoadCartridge(std::move(cartridge));
+  state_.has_chr_ram = ppu_->HasChrRam();
+  state_.cartridge_hash = cartridge_->ContentHash();
   // nestest wants APU ram FF'd. TODO: Do this in APU
   for (int i = 0; i < 0x20; i++) {
-    apu_ram_[i] = 0xFF;
+    state_.cpu.apu_ram[i] = 0xFF;
   }
   assert(ppu_);
   assert(mapper_);
@@ -82,104 +310,74 @@ void Cpu6502::Reset(const std::string& file_path) {
 
   // nestest should start at 0xC000 till I get input working
   // C000 is start of PRG_ROM's mirror (so 0x10 in .nes)
-  if (file_path == "/Users/river/code/nes/roms/nestest.nes") {
-    program_counter_ = 0xC000;
-  } else {
-    program_counter_ =  mapper_->Get16(0xFFFC);
-  }
+  #ifdef NESTEST
+  state_.cpu.program_counter = 0xC000;
+  #else
+  state_.cpu.program_counter = mapper_->Get16(0xFFFC);
+  #endif
 
   // not realistic -- programs should set these
-  a_ = x_ = y_ = 0;
+  state_.cpu.a = state_.cpu.x = state_.cpu.y = 0;
 
-  p_ = 0x24;  // for nestest golden
-  stack_pointer_ = 0xFD;
-  cycle_ = 7;
+  state_.cpu.p = 0x24;  // for nestest golden
+  state_.cpu.stack_pointer = 0xFD;
+  state_.cpu.cycle = 7;
 
   // TODO: Do the rest: https://wiki.nesdev.com/w/index.php?title=Init_code
 
-  BuildInstructionSet();
+  instructions_ = &InstructionSet();
 }
 
-void Cpu6502::LoadCartrtidgeFile(const std::string& file_path) {
-  std::ifstream input(file_path, std::ios::in | std::ios::binary);
-  std::vector<uint8_t> bytes(
-         (std::istreambuf_iterator<char>(input)),
-         (std::istreambuf_iterator<char>()));
-  if (bytes.size() <= 0) {
-    throw std::runtime_error("No file or empty file.");
-  } else if (bytes.size() < 8) {
-    throw std::runtime_error("Invalid file format.");
-  }
-
-  bool is_ines = false;
-  if (bytes[0] == 'N' && bytes[1] == 'E' && bytes[2] == 'S' && bytes[3] == 0x1A) {
-    is_ines = true;
-  }
-
-  bool is_nes2 = false;
-  if (is_ines == true && (bytes[7]&0x0C)==0x08) {
-    is_nes2 = true;
-  }
-
-  if (is_nes2) {
-    DBG("Found %llu byte NES 2.0 file.\n", static_cast<uint64_t>(bytes.size()));
-    // TODO: Load NES 2.0 specific
-    // Back-compat with ines 1.0
-    LoadNes1File(bytes);
-  } else if (is_ines) {
-    DBG("Found %llu byte iNES 1.0 file.\n", static_cast<uint64_t>(bytes.size()));
-    LoadNes1File(bytes);
-  } else {
-    throw std::runtime_error("Rom file is not iNES format.");
-  }
+void Cpu6502::LoadCartridge(std::shared_ptr<const Cartridge> cartridge) {
+  cartridge_ = std::move(cartridge);
+  ppu_ = std::make_unique<Ppu>(cartridge_->ChrRom(), cartridge_->ChrRomSize(), cartridge_->Mirroring(),
+      &state_.ppu, state_.chr_ram);
+  mapper_ = std::make_unique<NromMapper>(state_.cpu.internal_ram, ppu_.get(), state_.cpu.apu_ram, controllers_,
+      cartridge_->PrgRom(), cartridge_->PrgRomSize(), state_.mapper.prg_ram);
+      #ifdef BUS_PROFILE
+      auto bus_profile = std::make_unique<BusProfile>(std::move(mapper_), cartridge_->ContentHash());
+      bus_profile_ = bus_profile.get();
+      mapper_ = std::move(bus_profile);
+      #endif
+      #ifdef PROFILE
+      profile_ = std::make_unique<ExecProfile>(cartridge_->ContentHash());
+      #endif
 }
 
-void Cpu6502::LoadNes1File(std::vector<uint8_t> bytes) {
-  if (bytes.size() < 16) {
-    throw std::runtime_error("Incomplete iNes header.");
-  }
-
-  uint32_t prg_rom_size = static_cast<uint32_t>(bytes[4]) * 0x4000;
-  uint32_t chr_rom_size = static_cast<uint32_t>(bytes[5]) * 0x2000;
+void Cpu6502::SaveState(ConsoleState* state) {
+  memcpy(state, &state_, sizeof(ConsoleState));
+}
 
-  if (bytes.size() < (prg_rom_size + chr_rom_size + 16)) {
-    throw std::runtime_error("Rom file size less than header suggests.");
+void Cpu6502::LoadState(const ConsoleState& state) {
+  // Check everything before touching anything, so a bad state leaves the console as it was.
+  if (state.magic != ConsoleState::kMagic || state.version != ConsoleState::kVersion ||
+      state.size != sizeof(ConsoleState)) {
+    throw std::runtime_error(string_format("Not a version %u save state.", ConsoleState::kVersion));
+  } else if (state.cartridge_hash != state_.cartridge_hash) {
+    throw std::runtime_error("Save state is from a different cartridge.");
   }
+  memcpy(&state_, &state, sizeof(ConsoleState));
+  MarkAllDirty();
+}
 
-  // TODO: Handle flags as needed.
-  uint8_t flags6 = bytes[6];  // msb are lower nybble of mapper num
-  if (flags6 & 0b0010'0000) {
-    throw std::runtime_error("Rom has a trainer!");
+void Cpu6502::CopyFrom(const Cpu6502& other) {
+  if (other.cartridge_ != cartridge_) {
+    throw std::runtime_error("Can only copy a console running the same cartridge.");
   }
-
-      #ifdef DEBUG
-      // TODO: These things are probably more than just for debug...
-      uint8_t flags7 = bytes[7];  // lsb are upper nybble of mapper num
-      uint8_t mapper_number = ((flags7 >> 4) << 4) | (flags6 >> 4); 
-      uint8_t prg_ram_size = bytes[8] == 0x0 ? static_cast<uint8_t>(0x2000) : bytes[8] * 0x2000;
-      DBG("Mapper ID %d PRG_ROM sz %d CHAR_ROM sz %d PRG_RAM sz %d\n",
-          mapper_number, prg_rom_size, chr_rom_size, prg_ram_size);
-      #endif
-  
-  if (chr_rom_size > 0) {
-    ppu_ = std::make_unique<Ppu>(bytes.data() + 16 + prg_rom_size, chr_rom_size);
-  } else {
-    ppu_ = std::make_unique<Ppu>(nullptr, 0);
-  }
-
-  mapper_ = std::make_unique<NromMapper>(internal_ram_, ppu_.get(), apu_ram_, bytes.data() + 16, prg_rom_size);
+  memcpy(&state_, &other.state_, sizeof(ConsoleState));
+  MarkAllDirty();
 }
 
 bool Cpu6502::GetFlag(Cpu6502::Flag flag) {
-  return Bit(static_cast<uint8_t>(flag), p_) == 1;
+  return Bit(static_cast<uint8_t>(flag), state_.cpu.p) == 1;
 }
 
 void Cpu6502::SetFlag(Cpu6502::Flag flag, bool val) {
-  p_ = SetBit(static_cast<uint8_t>(flag), p_, val);
+  state_.cpu.p = SetBit(static_cast<uint8_t>(flag), state_.cpu.p, val);
 }
 
 void Cpu6502::SetPIgnoreB(uint8_t new_p) {
-  uint8_t old_p = p_;
+  uint8_t old_p = state_.cpu.p;
 
   // Need to preserve bits 4 and 5 from original p
   // There's probably a better way to do this...
@@ -194,89 +392,89 @@ void Cpu6502::SetPIgnoreB(uint8_t new_p) {
   } else {
     new_p &= ~(1 << 5);
   }
-  p_ = new_p;
+  state_.cpu.p = new_p;
 }
 
 uint8_t Cpu6502::NextImmediate() {
-  uint8_t val = mapper_->Get(program_counter_++);
+  uint8_t val = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", val);
   return val;
 }
 uint16_t Cpu6502::NextZeroPage() {
-  uint16_t addr = mapper_->Get(program_counter_++);
+  uint16_t addr = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", static_cast<uint8_t>(addr));
   return addr;
 }
 uint16_t Cpu6502::NextZeroPageX() {
-  uint16_t addr = mapper_->Get(program_counter_++);
+  uint16_t addr = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", static_cast<uint8_t>(addr));
-  addr = (addr + x_) % 0x100;  // Add X to LSB of ZP
+  addr = (addr + state_.cpu.x) % 0x100;  // Add X to LSB of ZP
   return addr;
 }
 uint16_t Cpu6502::NextZeroPageY() {
-  uint16_t addr = mapper_->Get(program_counter_++);
+  uint16_t addr = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", static_cast<uint8_t>(addr));
-  addr = (addr + y_) % 0x100;  // Add Y to LSB of ZP
+  addr = (addr + state_.cpu.y) % 0x100;  // Add Y to LSB of ZP
   return addr;
 }
 uint16_t Cpu6502::NextAbsolute() {
-  uint16_t addr = mapper_->Get16(program_counter_);
+  uint16_t addr = mapper_->Get16(state_.cpu.program_counter);
   NTLOG("%02X %02X ", static_cast<uint8_t>(addr), static_cast<uint8_t>(addr >> 8)); // low first
-  program_counter_ += 2;
+  state_.cpu.program_counter += 2;
   return addr;
 }
 uint16_t Cpu6502::NextAbsoluteX(bool* page_crossed) {
-  uint16_t addr = mapper_->Get16(program_counter_);
+  uint16_t addr = mapper_->Get16(state_.cpu.program_counter);
   NTLOG("%02X %02X ", static_cast<uint8_t>(addr), static_cast<uint8_t>(addr >> 8));
-  program_counter_ += 2;
-  *page_crossed = CrossedPage(addr, addr + x_);
-  return addr + x_;
+  state_.cpu.program_counter += 2;
+  *page_crossed = CrossedPage(addr, addr + state_.cpu.x);
+  return addr + state_.cpu.x;
 }
 uint16_t Cpu6502::NextAbsoluteY(bool* page_crossed) {
-  uint16_t addr = mapper_->Get16(program_counter_);
+  uint16_t addr = mapper_->Get16(state_.cpu.program_counter);
   NTLOG("%02X %02X ", static_cast<uint8_t>(addr), static_cast<uint8_t>(addr >> 8));
-  program_counter_ += 2;
-  *page_crossed = CrossedPage(addr, addr + y_);
-  return addr + y_;
+  state_.cpu.program_counter += 2;
+  *page_crossed = CrossedPage(addr, addr + state_.cpu.y);
+  return addr + state_.cpu.y;
 }
 uint16_t Cpu6502::NextIndirectX() {
   // Get ZP, add X_ to LSB, then read full addr
-  uint16_t zero_addr = mapper_->Get(program_counter_++);
+  uint16_t zero_addr = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", static_cast<uint8_t>(zero_addr));
-  zero_addr = (zero_addr + x_) % 0x100;
+  zero_addr = (zero_addr + state_.cpu.x) % 0x100;
   return mapper_->Get16(zero_addr, /*page_wrap=*/true);
 }
 uint16_t Cpu6502::NextIndirectY(bool* page_crossed) {
   // get ZP addr, then read full addr from it and add Y
-  uint16_t zero_addr = mapper_->Get(program_counter_++);
+  uint16_t zero_addr = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", static_cast<uint8_t>(zero_addr));
   uint16_t addr = mapper_->Get16(zero_addr, /*page_wrap=*/true);
-  *page_crossed = CrossedPage(addr, addr + y_);
-  return addr + y_;
+  *page_crossed = CrossedPage(addr, addr + state_.cpu.y);
+  return addr + state_.cpu.y;
 }
 
 uint16_t Cpu6502::NextAbsoluteIndirect() {
-  uint16_t indirect = mapper_->Get16(program_counter_);
+  uint16_t indirect = mapper_->Get16(state_.cpu.program_counter);
   NTLOG("%02X %02X ", static_cast<uint8_t>(indirect), static_cast<uint8_t>(indirect >> 8));
-  program_counter_ += 2;
+  state_.cpu.program_counter += 2;
 
   return mapper_->Get16(indirect, /*page_wrap=*/true);
 }
 
 uint16_t Cpu6502::NextRelativeAddr(bool* page_crossed) {
-  uint8_t offset_uint = mapper_->Get(program_counter_++);
+  uint8_t offset_uint = mapper_->Get(state_.cpu.program_counter++);
   NTLOG("%02X    ", static_cast<uint8_t>(offset_uint));
   // https://stackoverflow.com/questions/14623266/why-cant-i-reinterpret-cast-uint-to-int
   int8_t tmp;
   std::memcpy(&tmp, &offset_uint, sizeof(tmp));
   const int8_t offset = tmp;
 
-  *page_crossed = CrossedPage(program_counter_, program_counter_ + offset);
-  return program_counter_ + offset;
+  *page_crossed = CrossedPage(state_.cpu.program_counter, state_.cpu.program_counter + offset);
+  return state_.cpu.program_counter + offset;
 }
 
 void Cpu6502::PushStack(uint8_t val) {
-  WRITE(StackAddr(stack_pointer_--), val);
+  WRITE(StackAddr(state_.cpu.stack_pointer--), val);
 }
 void Cpu6502::PushStack16(uint16_t val) {
   // Store MSB then LSB so that we can read back little-endian.
@@ -284,11 +482,12 @@ void Cpu6502::PushStack16(uint16_t val) {
   PushStack(static_cast<uint8_t>(val));
 }
 uint8_t Cpu6502::PopStack() {
-  return mapper_->Get(StackAddr(++stack_pointer_));
+  return mapper_->Get(StackAddr(++state_.cpu.stack_pointer));
 }
 uint16_t Cpu6502::PopStack16() {
   // Value was stored little-endian in top-down stack, so get LSB then MSB
-  return (PopStack() | (PopStack() << 8));
+  uint8_t lsb = PopStack();
+  return lsb | (PopStack() << 8);
 }
 
 void Cpu6502::DbgMem() {
@@ -313,67 +512,67 @@ void Cpu6502::DbgStack() {
 
 std::string Cpu6502::Status() {
   return string_format("[PC: %#06x, A: %#04x, X: %#04x, Y: %#04x, P: %#04x, SP: %#04x]",
-    program_counter_, a_, x_, y_, p_, stack_pointer_);
+    state_.cpu.program_counter, state_.cpu.a, state_.cpu.x, state_.cpu.y, state_.cpu.p, state_.cpu.stack_pointer);
 }
 
 void Cpu6502::ADC(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   uint8_t val = addrval.val;
   NTLOGPAD("ADC %s", AddrValString(addrval, mode).c_str());
-  uint16_t new_a = a_ + val + GetFlag(Flag::C);
+  uint16_t new_a = state_.cpu.a + val + GetFlag(Flag::C);
   SetFlag(Flag::C, new_a > 0xFF);
-  SetFlag(Flag::V, Pos(a_) && Pos(val) && !Pos(new_a));
-  a_ = new_a;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  SetFlag(Flag::V, Pos(state_.cpu.a) && Pos(val) && !Pos(new_a));
+  state_.cpu.a = new_a;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::JMP(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
   uint16_t addr = addrval.addr;
   NTLOGPAD("JMP %s", AddrValString(addrval, mode, /*is_jmp=*/true).c_str());
-  program_counter_ = addr;
+  state_.cpu.program_counter = addr;
 }
 
 void Cpu6502::BRK(AddressingMode mode) {
-  PushStack16(program_counter_);  // PC is already +1 from reading instr.
-  PushStack(p_ | 0b0011'0000);  // B=0b11
-  program_counter_ = mapper_->Get16(0xFFFE);
+  PushStack16(state_.cpu.program_counter);  // PC is already +1 from reading instr.
+  PushStack(state_.cpu.p | 0b0011'0000);  // B=0b11
+  state_.cpu.program_counter = mapper_->Get16(0xFFFE);
   SetFlag(Flag::I, true);
   NTLOGPADSINGLE("BRK");
 }
 
 void Cpu6502::RTI(AddressingMode mode) {
   SetPIgnoreB(PopStack());
-  program_counter_ = PopStack16();
+  state_.cpu.program_counter = PopStack16();
   NTLOGPADSINGLE("RTI");
 }
 
 void Cpu6502::LDX(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   uint8_t val = addrval.val;
   NTLOGPAD("LDX %s", AddrValString(addrval, mode).c_str());
   SetFlag(Flag::Z, val == 0);
   SetFlag(Flag::N, !Pos(val));
-  x_ = val;
+  state_.cpu.x = val;
 }
 
 void Cpu6502::STX(AddressingMode mode) {
-  AddrVal addrval = NextAddrVal(mode);
+  AddrVal addrval = NextAddrVal(mode, /*unofficial=*/false, /*store=*/true);
   uint16_t addr = addrval.addr;
   NTLOGPAD("STX %s", AddrValString(addrval, mode).c_str());
-  WRITE(addr, x_);
+  WRITE(addr, state_.cpu.x);
 }
 
 void Cpu6502::JSR(AddressingMode mode) {
-  uint16_t pc_to_return_to = program_counter_ + 1;
+  uint16_t pc_to_return_to = state_.cpu.program_counter + 1;
   AddrVal addrval = NextAddrVal(mode);
   uint16_t new_pc = addrval.addr;
   NTLOGPAD("JSR %s", AddrValString(addrval, mode, /*is_jmp=*/true).c_str());
   PushStack16(pc_to_return_to);
-  program_counter_ = new_pc;
+  state_.cpu.program_counter = new_pc;
 }
 
 void Cpu6502::SEC(AddressingMode mode) {
@@ -386,8 +585,8 @@ void Cpu6502::BCS(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BCS %s", AddrValString(addrval, mode).c_str());
   if (GetFlag(Flag::C)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
@@ -401,19 +600,19 @@ void Cpu6502::BCC(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BCC %s", AddrValString(addrval, mode).c_str());
   if (!GetFlag(Flag::C)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
 void Cpu6502::LDA(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   uint8_t val = addrval.val;
   NTLOGPAD("LDA %s", AddrValString(addrval, mode).c_str());
   SetFlag(Flag::Z, val == 0);
   SetFlag(Flag::N, !Pos(val));
-  a_ = val;
+  state_.cpu.a = val;
 }
 
 void Cpu6502::BEQ(AddressingMode mode) {
@@ -421,8 +620,8 @@ void Cpu6502::BEQ(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BEQ %s", AddrValString(addrval, mode).c_str());
   if (GetFlag(Flag::Z)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
@@ -431,23 +630,23 @@ void Cpu6502::BNE(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BNE %s", AddrValString(addrval, mode).c_str());
   if (!GetFlag(Flag::Z)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
 void Cpu6502::STA(AddressingMode mode) {
-  AddrVal addrval = NextAddrVal(mode);
+  AddrVal addrval = NextAddrVal(mode, /*unofficial=*/false, /*store=*/true);
   uint16_t addr = addrval.addr;
   NTLOGPAD("STA %s", AddrValString(addrval, mode).c_str());
-  WRITE(addr, a_);
+  WRITE(addr, state_.cpu.a);
 }
 
 void Cpu6502::BIT(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
   uint8_t val = addrval.val;
   NTLOGPAD("BIT %s", AddrValString(addrval, mode).c_str());
-  uint8_t res = val & a_;
+  uint8_t res = val & state_.cpu.a;
   SetFlag(Flag::Z, res == 0);
   SetFlag(Flag::V, Bit(6, val) == 1);
   SetFlag(Flag::N, Bit(7, val) == 1);
@@ -458,8 +657,8 @@ void Cpu6502::BVS(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BVS %s", AddrValString(addrval, mode).c_str());
   if (GetFlag(Flag::V)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
@@ -468,8 +667,8 @@ void Cpu6502::BVC(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BVC %s", AddrValString(addrval, mode).c_str());
   if (!GetFlag(Flag::V)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
@@ -478,13 +677,13 @@ void Cpu6502::BPL(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BPL %s", AddrValString(addrval, mode).c_str());
   if (!GetFlag(Flag::N)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
 void Cpu6502::RTS(AddressingMode mode) {
-  program_counter_ = PopStack16() + 1;
+  state_.cpu.program_counter = PopStack16() + 1;
   NTLOGPADSINGLE("RTS");
 }
 
@@ -503,32 +702,32 @@ void Cpu6502::SEI(AddressingMode mode) {
  }
 
  void Cpu6502::PHP(AddressingMode mode) {
-  PushStack(p_ | 0b0011'0000);  // B=0b11
+  PushStack(state_.cpu.p | 0b0011'0000);  // B=0b11
   NTLOGPADSINGLE("PHP");
  }
 
 void Cpu6502::PLA(AddressingMode mode) {
   NTLOGPADSINGLE("PLA");
-  a_ = PopStack();
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.a = PopStack();
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
  }
 
 void Cpu6502::AND(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
-  a_ &= addrval.val;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.cycle += addrval.page_crossed;
+  state_.cpu.a &= addrval.val;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
   NTLOGPAD("AND %s", AddrValString(addrval, mode).c_str());
 }
 
 void Cpu6502::CMP(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
-  SetFlag(Flag::C, a_ >= addrval.val);
-  SetFlag(Flag::Z, a_ == addrval.val);
-  SetFlag(Flag::N, !Pos(a_ - addrval.val));
+  state_.cpu.cycle += addrval.page_crossed;
+  SetFlag(Flag::C, state_.cpu.a >= addrval.val);
+  SetFlag(Flag::Z, state_.cpu.a == addrval.val);
+  SetFlag(Flag::N, !Pos(state_.cpu.a - addrval.val));
   NTLOGPAD("CMP %s", AddrValString(addrval, mode).c_str());
 }
 
@@ -538,7 +737,7 @@ void Cpu6502::CLD(AddressingMode mode) {
 }
 
 void Cpu6502::PHA(AddressingMode mode) {
-  PushStack(a_);
+  PushStack(state_.cpu.a);
   NTLOGPADSINGLE("PHA");
 }
 
@@ -552,17 +751,17 @@ void Cpu6502::BMI(AddressingMode mode) {
   uint16_t addr = addrval.addr;
   NTLOGPAD("BMI %s", AddrValString(addrval, mode).c_str());
   if (GetFlag(Flag::N)) {
-    program_counter_ = addr;
-    cycle_ += addrval.page_crossed + 1;
+    state_.cpu.program_counter = addr;
+    state_.cpu.cycle += addrval.page_crossed + 1;
   }
 }
 
 void Cpu6502::ORA(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
-  a_ |= addrval.val;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.cycle += addrval.page_crossed;
+  state_.cpu.a |= addrval.val;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
   NTLOGPAD("ORA %s", AddrValString(addrval, mode).c_str());
 }
 
@@ -573,38 +772,38 @@ void Cpu6502::CLV(AddressingMode mode) {
 
 void Cpu6502::EOR(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
-  a_ ^= addrval.val;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.cycle += addrval.page_crossed;
+  state_.cpu.a ^= addrval.val;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
   NTLOGPAD("EOR %s", AddrValString(addrval, mode).c_str());
 }
 
 void Cpu6502::LDY(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   uint8_t val = addrval.val;
   NTLOGPAD("LDY %s", AddrValString(addrval, mode).c_str());
   SetFlag(Flag::Z, val == 0);
   SetFlag(Flag::N, !Pos(val));
-  y_ = val;
+  state_.cpu.y = val;
 }
 
 void Cpu6502::CPX(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
-  SetFlag(Flag::C, x_ >= addrval.val);
-  SetFlag(Flag::Z, x_ == addrval.val);
-  SetFlag(Flag::N, !Pos(x_ - addrval.val));
+  state_.cpu.cycle += addrval.page_crossed;
+  SetFlag(Flag::C, state_.cpu.x >= addrval.val);
+  SetFlag(Flag::Z, state_.cpu.x == addrval.val);
+  SetFlag(Flag::N, !Pos(state_.cpu.x - addrval.val));
   NTLOGPAD("CPX %s", AddrValString(addrval, mode).c_str());
 }
 
 void Cpu6502::CPY(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode);
-  cycle_ += addrval.page_crossed;
-  SetFlag(Flag::C, y_ >= addrval.val);
-  SetFlag(Flag::Z, y_ == addrval.val);
-  SetFlag(Flag::N, !Pos(y_ - addrval.val));
+  state_.cpu.cycle += addrval.page_crossed;
+  SetFlag(Flag::C, state_.cpu.y >= addrval.val);
+  SetFlag(Flag::Z, state_.cpu.y == addrval.val);
+  SetFlag(Flag::N, !Pos(state_.cpu.y - addrval.val));
   NTLOGPAD("CPY %s", AddrValString(addrval, mode).c_str());
 }
 
@@ -613,87 +812,87 @@ void Cpu6502::SBC(AddressingMode mode, bool unofficial) {
   uint8_t val = addrval.val;
   val = ~val;
   NTLOGPAD("SBC %s", AddrValString(addrval, mode).c_str());
-  uint16_t new_a = a_ + val + GetFlag(Flag::C);
+  uint16_t new_a = state_.cpu.a + val + GetFlag(Flag::C);
   SetFlag(Flag::C, new_a > 0xFF);
-  if (Pos(a_) && !Pos(addrval.val) && !Pos(new_a)) {
+  if (Pos(state_.cpu.a) && !Pos(addrval.val) && !Pos(new_a)) {
     SetFlag(Flag::V, true);
-  } else if (!Pos(a_) && Pos(addrval.val) && Pos(new_a)) {
+  } else if (!Pos(state_.cpu.a) && Pos(addrval.val) && Pos(new_a)) {
     SetFlag(Flag::V, true);
   } else {
     SetFlag(Flag::V, false);
   }
-  a_ = new_a;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.a = new_a;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::INX(AddressingMode mode) {
   NTLOGPADSINGLE("INX");
-  x_ += 1;
-  SetFlag(Flag::Z, x_ == 0);
-  SetFlag(Flag::N, !Pos(x_));
+  state_.cpu.x += 1;
+  SetFlag(Flag::Z, state_.cpu.x == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.x));
 }
 
 void Cpu6502::INY(AddressingMode mode) {
   NTLOGPADSINGLE("INY");
-  y_ += 1;
-  SetFlag(Flag::Z, y_ == 0);
-  SetFlag(Flag::N, !Pos(y_));
+  state_.cpu.y += 1;
+  SetFlag(Flag::Z, state_.cpu.y == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.y));
 }
 
 void Cpu6502::DEX(AddressingMode mode) {
   NTLOGPADSINGLE("DEX");
-  x_ -= 1;
-  SetFlag(Flag::Z, x_ == 0);
-  SetFlag(Flag::N, !Pos(x_));
+  state_.cpu.x -= 1;
+  SetFlag(Flag::Z, state_.cpu.x == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.x));
 }
 
 void Cpu6502::DEY(AddressingMode mode) {
   NTLOGPADSINGLE("DEY");
-  y_ -= 1;
-  SetFlag(Flag::Z, y_ == 0);
-  SetFlag(Flag::N, !Pos(y_));
+  state_.cpu.y -= 1;
+  SetFlag(Flag::Z, state_.cpu.y == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.y));
 }
 
 void Cpu6502::TAX(AddressingMode mode) {
   NTLOGPADSINGLE("TAX");
-  x_ = a_;
-  SetFlag(Flag::Z, x_ == 0);
-  SetFlag(Flag::N, !Pos(x_));
+  state_.cpu.x = state_.cpu.a;
+  SetFlag(Flag::Z, state_.cpu.x == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.x));
 }
 
 void Cpu6502::TAY(AddressingMode mode) {
   NTLOGPADSINGLE("TAY");
-  y_ = a_;
-  SetFlag(Flag::Z, y_ == 0);
-  SetFlag(Flag::N, !Pos(y_));
+  state_.cpu.y = state_.cpu.a;
+  SetFlag(Flag::Z, state_.cpu.y == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.y));
 }
 
 void Cpu6502::TXA(AddressingMode mode) {
   NTLOGPADSINGLE("TXA");
-  a_ = x_;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.a = state_.cpu.x;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::TYA(AddressingMode mode) {
   NTLOGPADSINGLE("TYA");
-  a_ = y_;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.a = state_.cpu.y;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::TSX(AddressingMode mode) {
   NTLOGPADSINGLE("TSX");
-  x_ = stack_pointer_;
-  SetFlag(Flag::Z, x_ == 0);
-  SetFlag(Flag::N, !Pos(x_));
+  state_.cpu.x = state_.cpu.stack_pointer;
+  SetFlag(Flag::Z, state_.cpu.x == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.x));
 }
 
 void Cpu6502::TXS(AddressingMode mode) {
   // Weirdly enough this doesn't set flags.
   NTLOGPADSINGLE("TXS");
-  stack_pointer_ = x_;
+  state_.cpu.stack_pointer = state_.cpu.x;
 }
 
 void Cpu6502::LSR(AddressingMode mode) {
@@ -703,9 +902,9 @@ void Cpu6502::LSR(AddressingMode mode) {
   uint8_t result = 0;
   uint8_t initial_val = 0;
   if (mode == AddressingMode::kAccumulator) {
-    initial_val = a_;
+    initial_val = state_.cpu.a;
     result = initial_val >> 1;
-    a_ = result;
+    state_.cpu.a = result;
   } else {
     initial_val = addrval.val;
     result = initial_val >> 1;
@@ -723,9 +922,9 @@ void Cpu6502::ASL(AddressingMode mode) {
   uint8_t result = 0;
   uint8_t initial_val = 0;
   if (mode == AddressingMode::kAccumulator) {
-    initial_val = a_;
+    initial_val = state_.cpu.a;
     result = initial_val << 1;
-    a_ = result;
+    state_.cpu.a = result;
   } else {
     initial_val = addrval.val;
     result = initial_val << 1;
@@ -743,10 +942,10 @@ void Cpu6502::ROR(AddressingMode mode) {
   uint8_t result = 0;
   uint8_t initial_val = 0;
   if (mode == AddressingMode::kAccumulator) {
-    initial_val = a_;
+    initial_val = state_.cpu.a;
     result = initial_val >> 1;
     result = SetBit(7, result, GetFlag(Flag::C));
-    a_ = result;
+    state_.cpu.a = result;
   } else {
     initial_val = addrval.val;
     result = initial_val >> 1;
@@ -765,10 +964,10 @@ void Cpu6502::ROL(AddressingMode mode) {
   uint8_t result = 0;
   uint8_t initial_val = 0;
   if (mode == AddressingMode::kAccumulator) {
-    initial_val = a_;
+    initial_val = state_.cpu.a;
     result = initial_val << 1;
     result = SetBit(0, result, GetFlag(Flag::C));
-    a_ = result;
+    state_.cpu.a = result;
   } else {
     initial_val = addrval.val;
     result = initial_val << 1;
@@ -781,10 +980,10 @@ void Cpu6502::ROL(AddressingMode mode) {
 }
 
 void Cpu6502::STY(AddressingMode mode) {
-  AddrVal addrval = NextAddrVal(mode);
+  AddrVal addrval = NextAddrVal(mode, /*unofficial=*/false, /*store=*/true);
   uint16_t addr = addrval.addr;
   NTLOGPAD("STY %s", AddrValString(addrval, mode).c_str());
-  WRITE(addr, y_);
+  WRITE(addr, state_.cpu.y);
 }
 
 void Cpu6502::INC(AddressingMode mode) {
@@ -811,28 +1010,28 @@ void Cpu6502::DEC(AddressingMode mode) {
 
 void Cpu6502::UN_NOP(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unoficial=*/true);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("NOP %s", AddrValString(addrval, mode).c_str());
 }
 
 void Cpu6502::UN_LAX(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unoficial=*/true);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("LAX %s", AddrValString(addrval, mode).c_str());
   // LDA then TAX. So just load into both.
   uint8_t val = addrval.val;
   SetFlag(Flag::Z, val == 0);
   SetFlag(Flag::N, !Pos(val));
-  x_ = val;
-  a_ = val;
+  state_.cpu.x = val;
+  state_.cpu.a = val;
 }
 
 void Cpu6502::UN_SAX(AddressingMode mode) {
-  AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
+  AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true, /*store=*/true);
   uint16_t addr = addrval.addr;
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("SAX %s", AddrValString(addrval, mode).c_str());
-  WRITE(addr, a_ & x_);
+  WRITE(addr, state_.cpu.a & state_.cpu.x);
 }
 
 void Cpu6502::UN_SBC(AddressingMode mode) {
@@ -842,20 +1041,20 @@ void Cpu6502::UN_SBC(AddressingMode mode) {
 void Cpu6502::UN_DCP(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
   uint16_t addr = addrval.addr;
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("DCP %s", AddrValString(addrval, mode).c_str());
   // DEC then CMP the value.
   uint8_t result = mapper_->Get(addr) - 1;
   WRITE(addr, result);
-  SetFlag(Flag::C, a_ >= result);
-  SetFlag(Flag::Z, a_ == result);
-  SetFlag(Flag::N, !Pos(a_ - result));
+  SetFlag(Flag::C, state_.cpu.a >= result);
+  SetFlag(Flag::Z, state_.cpu.a == result);
+  SetFlag(Flag::N, !Pos(state_.cpu.a - result));
 }
 
 void Cpu6502::UN_ISB(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
   uint16_t addr = addrval.addr;
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("ISB %s", AddrValString(addrval, mode).c_str());
 
   // INC then SBC the value.
@@ -863,38 +1062,38 @@ void Cpu6502::UN_ISB(AddressingMode mode) {
   WRITE(addr, val);
 
   val = ~val;
-  uint16_t new_a = a_ + val + GetFlag(Flag::C);
+  uint16_t new_a = state_.cpu.a + val + GetFlag(Flag::C);
   SetFlag(Flag::C, new_a > 0xFF);
-  if (Pos(a_) && !Pos(addrval.val) && !Pos(new_a)) {
+  if (Pos(state_.cpu.a) && !Pos(addrval.val) && !Pos(new_a)) {
     SetFlag(Flag::V, true);
-  } else if (!Pos(a_) && Pos(addrval.val) && Pos(new_a)) {
+  } else if (!Pos(state_.cpu.a) && Pos(addrval.val) && Pos(new_a)) {
     SetFlag(Flag::V, true);
   } else {
     SetFlag(Flag::V, false);
   }
-  a_ = new_a;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  state_.cpu.a = new_a;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::UN_SLO(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("SLO %s", AddrValString(addrval, mode).c_str());
   // ASL val then ORA it into A.
   uint8_t initial_val = addrval.val;
   uint8_t result = initial_val << 1;
   WRITE(addrval.addr, result);
 
-  a_ |= result;
+  state_.cpu.a |= result;
   SetFlag(Flag::C, Bit(7, initial_val));
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::UN_RLA(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("RLA %s", AddrValString(addrval, mode).c_str());
   // ROL val then AND it into A.
   uint8_t initial_val = addrval.val;
@@ -902,30 +1101,30 @@ void Cpu6502::UN_RLA(AddressingMode mode) {
   result = SetBit(0, result, GetFlag(Flag::C));
   WRITE(addrval.addr, result);
 
-  a_ &= result;
+  state_.cpu.a &= result;
   SetFlag(Flag::C, Bit(7, initial_val));
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::UN_SRE(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("SRE %s", AddrValString(addrval, mode).c_str());
   // LSR val then EOR it into A.
   uint8_t initial_val = addrval.val;
   uint8_t result = initial_val >> 1;
   WRITE(addrval.addr, result);
 
-  a_ ^= result;
+  state_.cpu.a ^= result;
   SetFlag(Flag::C, Bit(0, initial_val));
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 void Cpu6502::UN_RRA(AddressingMode mode) {
   AddrVal addrval = NextAddrVal(mode, /*unofficial=*/true);
-  cycle_ += addrval.page_crossed;
+  state_.cpu.cycle += addrval.page_crossed;
   NTLOGPAD("RRA %s", AddrValString(addrval, mode).c_str());
   // ROR val then ADC it into A.
   uint8_t initial_val = addrval.val;
@@ -934,12 +1133,12 @@ void Cpu6502::UN_RRA(AddressingMode mode) {
   WRITE(addrval.addr, result);
   SetFlag(Flag::C, Bit(0, initial_val));
 
-  uint16_t new_a = a_ + result + GetFlag(Flag::C);
+  uint16_t new_a = state_.cpu.a + result + GetFlag(Flag::C);
   SetFlag(Flag::C, new_a > 0xFF);
-  SetFlag(Flag::V, Pos(a_) && Pos(result) && !Pos(new_a));
-  a_ = new_a;
-  SetFlag(Flag::Z, a_ == 0);
-  SetFlag(Flag::N, !Pos(a_));
+  SetFlag(Flag::V, Pos(state_.cpu.a) && Pos(result) && !Pos(new_a));
+  state_.cpu.a = new_a;
+  SetFlag(Flag::Z, state_.cpu.a == 0);
+  SetFlag(Flag::N, !Pos(state_.cpu.a));
 }
 
 uint16_t Cpu6502::NextAddr(AddressingMode mode, bool* page_crossed) {
@@ -969,21 +1168,30 @@ uint16_t Cpu6502::NextAddr(AddressingMode mode, bool* page_crossed) {
   }
 }
 
-Cpu6502::AddrVal Cpu6502::NextAddrVal(AddressingMode mode, bool unofficial) {
+Cpu6502::AddrVal Cpu6502::NextAddrVal(AddressingMode mode, bool unofficial, bool store) {
   if (mode == AddressingMode::kImmediate) {
     uint8_t imm = NextImmediate();
+    if (trace_record_ != nullptr) {
+      trace_record_->val = imm;
+    }
     if (unofficial) { NTLOG("*"); } else { NTLOG(" "); }
     return {0, imm};
   } else if (mode == AddressingMode::kAccumulator) {
     NTLOG("      "); if (unofficial) { NTLOG("*"); } else { NTLOG(" "); }
-    return {0, a_};
+    return {0, state_.cpu.a};
   } else if (mode == AddressingMode::kNone) {
     NTLOG("      "); if (unofficial) { NTLOG("*"); } else { NTLOG(" "); }
-    return {0, a_};
+    return {0, state_.cpu.a};
   }
   AddrVal addrval;
   addrval.addr = NextAddr(mode, &addrval.page_crossed);
-  addrval.val = mapper_->Get(addrval.addr);
+  if (trace_record_ != nullptr) {
+    trace_record_->addr = addrval.addr;  // before the read, which may throw
+  }
+  addrval.val = store ? mapper_->Peek(addrval.addr) : mapper_->Get(addrval.addr);
+  if (trace_record_ != nullptr) {
+    trace_record_->val = addrval.val;
+  }
   if (unofficial) { NTLOG("*"); } else { NTLOG(" "); }
   return addrval;
 }
@@ -995,11 +1203,11 @@ std::string Cpu6502::AddrValString(AddrVal addrval, AddressingMode mode, bool is
     case AddressingMode::kZeroPage:
       return string_format("$%02X = %02X", addrval.addr, addrval.val);
     case AddressingMode::kZeroPageX: {
-      uint8_t target = mapper_->Get(program_counter_ - 1);
+      uint8_t target = mapper_->Get(state_.cpu.program_counter - 1);
       return string_format("$%02X,X @ %02X = %02X", target, addrval.addr, addrval.val);
     }
     case AddressingMode::kZeroPageY: {
-      uint8_t target = mapper_->Get(program_counter_ - 1);
+      uint8_t target = mapper_->Get(state_.cpu.program_counter - 1);
       return string_format("$%02X,Y @ %02X = %02X", target, addrval.addr, addrval.val);
     }
     case AddressingMode::kAbsolute:
@@ -1010,24 +1218,24 @@ std::string Cpu6502::AddrValString(AddrVal addrval, AddressingMode mode, bool is
         return string_format("$%04X = %02X", addrval.addr, addrval.val);
       }
     case AddressingMode::kAbsoluteX: {
-      uint16_t target = mapper_->Get16(program_counter_ - 2);
+      uint16_t target = mapper_->Get16(state_.cpu.program_counter - 2);
       return string_format("$%04X,X @ %04X = %02X", target, addrval.addr, addrval.val);
     }
     case AddressingMode::kAbsoluteY: {
-      uint16_t target = mapper_->Get16(program_counter_ - 2);
+      uint16_t target = mapper_->Get16(state_.cpu.program_counter - 2);
       return string_format("$%04X,Y @ %04X = %02X", target, addrval.addr, addrval.val);
     }
     case AddressingMode::kIndirectX: {
-      uint8_t target = mapper_->Get(program_counter_ - 1);
-      return string_format("($%02X,X) @ %02X = %04X = %02X", target, (target + x_) % 0x100, addrval.addr, addrval.val);
+      uint8_t target = mapper_->Get(state_.cpu.program_counter - 1);
+      return string_format("($%02X,X) @ %02X = %04X = %02X", target, (target + state_.cpu.x) % 0x100, addrval.addr, addrval.val);
     }
     case AddressingMode::kIndirectY: {
-      uint8_t target = mapper_->Get(program_counter_ - 1);
-      uint16_t indirect = addrval.addr - y_;
+      uint8_t target = mapper_->Get(state_.cpu.program_counter - 1);
+      uint16_t indirect = addrval.addr - state_.cpu.y;
       return string_format("($%02X),Y = %04X @ %04X = %02X", target, indirect, addrval.addr, addrval.val);
     }
     case AddressingMode::kAbsoluteIndirect: {
-      uint16_t target = mapper_->Get16(program_counter_ - 2);
+      uint16_t target = mapper_->Get16(state_.cpu.program_counter - 2);
       return string_format("($%04X) = %04X", target, addrval.addr);
     }
     case AddressingMode::kRelative:
@@ -1041,240 +1249,14 @@ std::string Cpu6502::AddrValString(AddrVal addrval, AddressingMode mode, bool is
   }
 }
 
-void Cpu6502::BuildInstructionSet() {
-  #define ADD_INSTR(op, name, mode, cycles) instructions_[op] = {#name, [this]() { name(mode); }, cycles};
-  ADD_INSTR(0x69, ADC, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0x65, ADC, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x75, ADC, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0x6D, ADC, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x7D, ADC, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0x79, ADC, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0x61, ADC, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0x71, ADC, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0x4C, JMP, AddressingMode::kAbsolute, 3);
-  ADD_INSTR(0x6C, JMP, AddressingMode::kAbsoluteIndirect, 5);
-  ADD_INSTR(0x00, BRK, AddressingMode::kNone, 7);
-  ADD_INSTR(0x40, RTI, AddressingMode::kNone, 6);
-  ADD_INSTR(0xA2, LDX, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xA6, LDX, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xB6, LDX, AddressingMode::kZeroPageY, 4);
-  ADD_INSTR(0xAE, LDX, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xBE, LDX, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0x86, STX, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x96, STX, AddressingMode::kZeroPageY, 4);
-  ADD_INSTR(0x8E, STX, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x20, JSR, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0xEA, NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0x38, SEC, AddressingMode::kNone, 2);
-  ADD_INSTR(0xB0, BCS, AddressingMode::kRelative, 2);
-  ADD_INSTR(0x18, CLC, AddressingMode::kNone, 2);
-  ADD_INSTR(0x90, BCC, AddressingMode::kRelative, 2);
-  ADD_INSTR(0xA9, LDA, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xA5, LDA, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xB5, LDA, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0xAD, LDA, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xBD, LDA, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0xB9, LDA, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0xA1, LDA, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0xB1, LDA, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0xF0, BEQ, AddressingMode::kRelative, 2);
-  ADD_INSTR(0xD0, BNE, AddressingMode::kRelative, 2);
-  ADD_INSTR(0x85, STA, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x95, STA, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0x8D, STA, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x9D, STA, AddressingMode::kAbsoluteX, 5);
-  ADD_INSTR(0x99, STA, AddressingMode::kAbsoluteY, 5);
-  ADD_INSTR(0x81, STA, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0x91, STA, AddressingMode::kIndirectY, 6);
-  ADD_INSTR(0x24, BIT, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x2C, BIT, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x70, BVS, AddressingMode::kRelative, 2);
-  ADD_INSTR(0x50, BVC, AddressingMode::kRelative, 2);
-  ADD_INSTR(0x10, BPL, AddressingMode::kRelative, 2);
-  ADD_INSTR(0x60, RTS, AddressingMode::kNone, 6);
-  ADD_INSTR(0x78, SEI, AddressingMode::kNone, 2);
-  ADD_INSTR(0xF8, SED, AddressingMode::kNone, 2);
-  ADD_INSTR(0x08, PHP, AddressingMode::kNone, 3);
-  ADD_INSTR(0x68, PLA, AddressingMode::kNone, 4);
-  ADD_INSTR(0x29, AND, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0x25, AND, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x35, AND, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0x2D, AND, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x3D, AND, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0x39, AND, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0x21, AND, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0x31, AND, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0xC9, CMP, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xC5, CMP, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xD5, CMP, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0xCD, CMP, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xDD, CMP, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0xD9, CMP, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0xC1, CMP, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0xD1, CMP, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0xD8, CLD, AddressingMode::kNone, 2);
-  ADD_INSTR(0x48, PHA, AddressingMode::kNone, 3);
-  ADD_INSTR(0x28, PLP, AddressingMode::kNone, 4);
-  ADD_INSTR(0x30, BMI, AddressingMode::kRelative, 2);
-  ADD_INSTR(0x09, ORA, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0x05, ORA, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x15, ORA, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0x0D, ORA, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x1D, ORA, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0x19, ORA, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0x01, ORA, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0x11, ORA, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0xB8, CLV, AddressingMode::kNone, 2);
-  ADD_INSTR(0x49, EOR, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0x45, EOR, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x55, EOR, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0x4D, EOR, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x5D, EOR, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0x59, EOR, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0x41, EOR, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0x51, EOR, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0xA0, LDY, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xA4, LDY, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xB4, LDY, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0xAC, LDY, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xBC, LDY, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0xE0, CPX, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xE4, CPX, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xEC, CPX, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xC0, CPY, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xC4, CPY, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xCC, CPY, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xE9, SBC, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xE5, SBC, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0xF5, SBC, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0xED, SBC, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xFD, SBC, AddressingMode::kAbsoluteX, 4);
-  ADD_INSTR(0xF9, SBC, AddressingMode::kAbsoluteY, 4);
-  ADD_INSTR(0xE1, SBC, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0xF1, SBC, AddressingMode::kIndirectY, 5);
-  ADD_INSTR(0xE8, INX, AddressingMode::kNone, 2);
-  ADD_INSTR(0xC8, INY, AddressingMode::kNone, 2);
-  ADD_INSTR(0xCA, DEX, AddressingMode::kNone, 2);
-  ADD_INSTR(0x88, DEY, AddressingMode::kNone, 2);
-  ADD_INSTR(0xAA, TAX, AddressingMode::kNone, 2);
-  ADD_INSTR(0xA8, TAY, AddressingMode::kNone, 2);
-  ADD_INSTR(0x8A, TXA, AddressingMode::kNone, 2);
-  ADD_INSTR(0x98, TYA, AddressingMode::kNone, 2);
-  ADD_INSTR(0x9A, TXS, AddressingMode::kNone, 2);
-  ADD_INSTR(0xBA, TSX, AddressingMode::kNone, 2);
-  ADD_INSTR(0x4A, LSR, AddressingMode::kAccumulator, 2);
-  ADD_INSTR(0x46, LSR, AddressingMode::kZeroPage, 5);
-  ADD_INSTR(0x56, LSR, AddressingMode::kZeroPageX, 6);
-  ADD_INSTR(0x4E, LSR, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0x5E, LSR, AddressingMode::kAbsoluteX, 7);
-  ADD_INSTR(0x0A, ASL, AddressingMode::kAccumulator, 2);
-  ADD_INSTR(0x06, ASL, AddressingMode::kZeroPage, 5);
-  ADD_INSTR(0x16, ASL, AddressingMode::kZeroPageX, 6);
-  ADD_INSTR(0x0E, ASL, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0x1E, ASL, AddressingMode::kAbsoluteX, 7);
-  ADD_INSTR(0x6A, ROR, AddressingMode::kAccumulator, 2);
-  ADD_INSTR(0x66, ROR, AddressingMode::kZeroPage, 5);
-  ADD_INSTR(0x76, ROR, AddressingMode::kZeroPageX, 6);
-  ADD_INSTR(0x6E, ROR, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0x7E, ROR, AddressingMode::kAbsoluteX, 7);
-  ADD_INSTR(0x2A, ROL, AddressingMode::kAccumulator, 2);
-  ADD_INSTR(0x26, ROL, AddressingMode::kZeroPage, 5);
-  ADD_INSTR(0x36, ROL, AddressingMode::kZeroPageX, 6);
-  ADD_INSTR(0x2E, ROL, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0x3E, ROL, AddressingMode::kAbsoluteX, 7);
-  ADD_INSTR(0x84, STY, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x94, STY, AddressingMode::kZeroPageX, 4);
-  ADD_INSTR(0x8C, STY, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0xE6, INC, AddressingMode::kZeroPage, 5);
-  ADD_INSTR(0xF6, INC, AddressingMode::kZeroPageX, 6);
-  ADD_INSTR(0xEE, INC, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0xFE, INC, AddressingMode::kAbsoluteX, 7);
-  ADD_INSTR(0xC6, DEC, AddressingMode::kZeroPage, 5);
-  ADD_INSTR(0xD6, DEC, AddressingMode::kZeroPageX, 6);
-  ADD_INSTR(0xCE, DEC, AddressingMode::kAbsolute, 6);
-  ADD_INSTR(0xDE, DEC, AddressingMode::kAbsoluteX, 7);
-
-  // Unofficial
-  ADD_INSTR(0x04, UN_NOP, AddressingMode::kZeroPage, 3);  // d = zero page
-  ADD_INSTR(0x44, UN_NOP, AddressingMode::kZeroPage, 3);  // d
-  ADD_INSTR(0x64, UN_NOP, AddressingMode::kZeroPage, 3);  // d
-  ADD_INSTR(0x0C, UN_NOP, AddressingMode::kAbsolute, 4);  // probably absolute not accum
-  ADD_INSTR(0x14, UN_NOP, AddressingMode::kZeroPageX, 4);  // d,x = zero page, x
-  ADD_INSTR(0x34, UN_NOP, AddressingMode::kZeroPageX, 4);  // d,x
-  ADD_INSTR(0x54, UN_NOP, AddressingMode::kZeroPageX, 4);  // d,x
-  ADD_INSTR(0x74, UN_NOP, AddressingMode::kZeroPageX, 4);  // d,x
-  ADD_INSTR(0xD4, UN_NOP, AddressingMode::kZeroPageX, 4);  // d,x
-  ADD_INSTR(0xF4, UN_NOP, AddressingMode::kZeroPageX, 4);  // d,x
-  ADD_INSTR(0x1C, UN_NOP, AddressingMode::kAbsoluteX, 4);  // a,x
-  ADD_INSTR(0x3C, UN_NOP, AddressingMode::kAbsoluteX, 4);  // a,x
-  ADD_INSTR(0x5C, UN_NOP, AddressingMode::kAbsoluteX, 4);  // a,x
-  ADD_INSTR(0x7C, UN_NOP, AddressingMode::kAbsoluteX, 4);  // a,x
-  ADD_INSTR(0xDC, UN_NOP, AddressingMode::kAbsoluteX, 4);  // a,x
-  ADD_INSTR(0xFC, UN_NOP, AddressingMode::kAbsoluteX, 4);  // a,x
-  ADD_INSTR(0x80, UN_NOP, AddressingMode::kImmediate, 2);  // #i = immediate
-  ADD_INSTR(0x89, UN_NOP, AddressingMode::kImmediate, 2);  // #i
-  ADD_INSTR(0x82, UN_NOP, AddressingMode::kImmediate, 2);  // #i
-  ADD_INSTR(0xC2, UN_NOP, AddressingMode::kImmediate, 2);  // #i
-  ADD_INSTR(0xE2, UN_NOP, AddressingMode::kImmediate, 2);  // #i
-  ADD_INSTR(0x1A, UN_NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0x3A, UN_NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0x5A, UN_NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0x7A, UN_NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0xDA, UN_NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0xFA, UN_NOP, AddressingMode::kNone, 2);
-  ADD_INSTR(0xA3, UN_LAX, AddressingMode::kIndirectX, 6); // (d,x)
-  ADD_INSTR(0xA7, UN_LAX, AddressingMode::kZeroPage, 3); // d
-  ADD_INSTR(0xAF, UN_LAX, AddressingMode::kAbsolute, 4); // a
-  ADD_INSTR(0xB3, UN_LAX, AddressingMode::kIndirectY, 5); // (d),Y 
-  ADD_INSTR(0xB7, UN_LAX, AddressingMode::kZeroPageY, 4); // d,Y
-  ADD_INSTR(0xBF, UN_LAX, AddressingMode::kAbsoluteY, 4); // a,Y
-  ADD_INSTR(0x83, UN_SAX, AddressingMode::kIndirectX, 6);
-  ADD_INSTR(0x87, UN_SAX, AddressingMode::kZeroPage, 3);
-  ADD_INSTR(0x8F, UN_SAX, AddressingMode::kAbsolute, 4);
-  ADD_INSTR(0x97, UN_SAX, AddressingMode::kZeroPageY, 4);
-  ADD_INSTR(0xEB, UN_SBC, AddressingMode::kImmediate, 2);
-  ADD_INSTR(0xC3, UN_DCP, AddressingMode::kIndirectX, 8); // (d,x)
-  ADD_INSTR(0xC7, UN_DCP, AddressingMode::kZeroPage, 5); // d
-  ADD_INSTR(0xCF, UN_DCP, AddressingMode::kAbsolute, 6); // a
-  ADD_INSTR(0xD3, UN_DCP, AddressingMode::kIndirectY, 7); // (d),Y 
-  ADD_INSTR(0xD7, UN_DCP, AddressingMode::kZeroPageX, 6); // d,X
-  ADD_INSTR(0xDB, UN_DCP, AddressingMode::kAbsoluteY, 6); // a,Y
-  ADD_INSTR(0xDF, UN_DCP, AddressingMode::kAbsoluteX, 6); // a,X
-  ADD_INSTR(0xE3, UN_ISB, AddressingMode::kIndirectX, 8); // (d,x)
-  ADD_INSTR(0xE7, UN_ISB, AddressingMode::kZeroPage, 5); // d
-  ADD_INSTR(0xEF, UN_ISB, AddressingMode::kAbsolute, 6); // a
-  ADD_INSTR(0xF3, UN_ISB, AddressingMode::kIndirectY, 7); // (d),Y 
-  ADD_INSTR(0xF7, UN_ISB, AddressingMode::kZeroPageX, 6); // d,X
-  ADD_INSTR(0xFB, UN_ISB, AddressingMode::kAbsoluteY, 6); // a,Y
-  ADD_INSTR(0xFF, UN_ISB, AddressingMode::kAbsoluteX, 6); // a,X
-  ADD_INSTR(0x03, UN_SLO, AddressingMode::kIndirectX, 8); // (d,x)
-  ADD_INSTR(0x07, UN_SLO, AddressingMode::kZeroPage, 5); // d
-  ADD_INSTR(0x0F, UN_SLO, AddressingMode::kAbsolute, 6); // a
-  ADD_INSTR(0x13, UN_SLO, AddressingMode::kIndirectY, 7); // (d),Y 
-  ADD_INSTR(0x17, UN_SLO, AddressingMode::kZeroPageX, 6); // d,X
-  ADD_INSTR(0x1B, UN_SLO, AddressingMode::kAbsoluteY, 6); // a,Y
-  ADD_INSTR(0x1F, UN_SLO, AddressingMode::kAbsoluteX, 6); // a,X
-  ADD_INSTR(0x23, UN_RLA, AddressingMode::kIndirectX, 8); // (d,x)
-  ADD_INSTR(0x27, UN_RLA, AddressingMode::kZeroPage, 5); // d
-  ADD_INSTR(0x2F, UN_RLA, AddressingMode::kAbsolute, 6); // a
-  ADD_INSTR(0x33, UN_RLA, AddressingMode::kIndirectY, 7); // (d),Y 
-  ADD_INSTR(0x37, UN_RLA, AddressingMode::kZeroPageX, 6); // d,X
-  ADD_INSTR(0x3B, UN_RLA, AddressingMode::kAbsoluteY, 6); // a,Y
-  ADD_INSTR(0x3F, UN_RLA, AddressingMode::kAbsoluteX, 6); // a,X
-  ADD_INSTR(0x43, UN_SRE, AddressingMode::kIndirectX, 8); // (d,x)
-  ADD_INSTR(0x47, UN_SRE, AddressingMode::kZeroPage, 5); // d
-  ADD_INSTR(0x4F, UN_SRE, AddressingMode::kAbsolute, 6); // a
-  ADD_INSTR(0x53, UN_SRE, AddressingMode::kIndirectY, 7); // (d),Y 
-  ADD_INSTR(0x57, UN_SRE, AddressingMode::kZeroPageX, 6); // d,X
-  ADD_INSTR(0x5B, UN_SRE, AddressingMode::kAbsoluteY, 6); // a,Y
-  ADD_INSTR(0x5F, UN_SRE, AddressingMode::kAbsoluteX, 6); // a,X
-  ADD_INSTR(0x63, UN_RRA, AddressingMode::kIndirectX, 8); // (d,x)
-  ADD_INSTR(0x67, UN_RRA, AddressingMode::kZeroPage, 5); // d
-  ADD_INSTR(0x6F, UN_RRA, AddressingMode::kAbsolute, 6); // a
-  ADD_INSTR(0x73, UN_RRA, AddressingMode::kIndirectY, 7); // (d),Y 
-  ADD_INSTR(0x77, UN_RRA, AddressingMode::kZeroPageX, 6); // d,X
-  ADD_INSTR(0x7B, UN_RRA, AddressingMode::kAbsoluteY, 6); // a,Y
-  ADD_INSTR(0x7F, UN_RRA, AddressingMode::kAbsoluteX, 6); // a,X
-
-  DBG("Instruction set built -- contains %llu instructions.\n", static_cast<uint64_t>(instructions_.size()));
+const std::array<Cpu6502::Instruction, 256>& Cpu6502::InstructionSet() {
+  static const std::array<Instruction, 256> instructions = []() {
+    std::array<Instruction, 256> set = {};
+    #define OPCODE(op, name, mode, cycles) \
+      set[op] = {#name, [](Cpu6502* cpu) { cpu->name(AddressingMode::mode); }, cycles};
+    #include "cpu6502_opcodes.h"
+    #undef OPCODE
+    return set;
+  }();
+  return instructions;
 }
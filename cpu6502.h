@@ -1,29 +1,96 @@
 #ifndef NES_CPU6502_H_
 #define NES_CPU6502_H_
 
-#include <unordered_map>
+#include <algorithm>
+#include <array>
 
+#include "bus_profile.h"
+#include "cartridge.h"
 #include "common.h"
+#include "controller.h"
+#include "exec_profile.h"
 #include "mapper.h"
+#include "opcode_info.h"
+#include "perf_counters.h"
 #include "ppu.h"
+#include "stack_sampler.h"
+#include "state.h"
+#include "timeline.h"
+#include "trace.h"
 
 // Implements the NES's MOS 6502 CPU.
 class Cpu6502 {
   public:
     Cpu6502(const std::string& file_path);
+    // Runs a cartridge that is already in memory. It may be shared with other instances.
+    explicit Cpu6502(std::shared_ptr<const Cartridge> cartridge);
+    // With -D PROFILE, adds this console's ExecProfile to its ROM's total.
+    ~Cpu6502();
 
     // Executes the next instruction.
     void RunCycle();
+    // Executes instructions until the PPU enters vblank, i.e. one full frame has been rendered.
+    void RunFrame();
+
+    uint64_t Cycle() { return state_.cpu.cycle; }
+    uint64_t FrameCount() { return ppu_->FrameCount(); }
+    // The 2kb of internal RAM at $0000-$07FF.
+    const uint8_t* Ram() { return state_.cpu.internal_ram; }
+    Image* FrameBuffer() { return ppu_->FrameBuffer(); }
+    // Sets the buttons held on controller port 0 or 1. See Controller::Button.
+    void SetButtons(int port, uint8_t buttons) { controllers_[port].SetButtons(buttons); }
+    // Times the game has read either controller so far.
+    uint64_t ControllerReads() { return controllers_[0].Reads() + controllers_[1].Reads(); }
+    // See Ppu::SetRenderingEnabled.
+    void SetRenderingEnabled(bool enabled) { ppu_->SetRenderingEnabled(enabled); }
+    bool RenderingEnabled() { return ppu_->RenderingEnabled(); }
+    // Records every instruction into buffer from now on, or stops recording if null.
+    // Tracing is not part of the state.
+    void SetTrace(TraceBuffer* buffer) { trace_ = buffer; trace_record_ = nullptr; }
+    // Keeps sampler's shadow call stack and samples it from now on, or stops if null.
+    void SetSampler(StackSampler* sampler);
+    // Switches phases to kPpu around PPU updates from now on, or stops if null.
+    void SetPhaseCounters(PhaseCounters* phases) { phases_ = phases; }
+    // Records CPU spans, scanlines, OAM DMAs, NMIs and input polls into timeline from now on,
+    // or stops if null.
+    void SetTimeline(Timeline* timeline);
+
+    // Snapshots the whole console into a caller-owned state. Only valid for the same cartridge.
+    void SaveState(ConsoleState* state);
+    // Throws, without changing anything, if the state is from another version or cartridge.
+    // Pointers from Ram() and FrameBuffer() stay valid.
+    void LoadState(const ConsoleState& state);
+    // Makes this console a copy of other, which must be running the same Cartridge object.
+    // All mutable state is in one arena, so this is a single memcpy; held buttons and the
+    // frame buffer are not copied.
+    void CopyFrom(const Cpu6502& other);
+
+    // The state split into pages, for hashing it incrementally and applying memoized frames.
+    static constexpr size_t kStatePageBytes = 256;
+    static constexpr size_t kNumStatePages = (sizeof(ConsoleState) + kStatePageBytes - 1) / kStatePageBytes;
+    static constexpr size_t kDirtyWords = (kNumStatePages + 63) / 64;
+    using PageSet = std::array<uint64_t, kDirtyWords>;
+    // Hash of the whole ConsoleState. Every write is noted against the page it lands in, so
+    // only pages written since the last call are rehashed, plus the few holding registers,
+    // which change on reads and every PPU update too.
+    uint64_t StateHash();
+    // Pages that may have changed since the last StateHash(), register pages included.
+    PageSet ChangedPages();
+    const uint8_t* StatePage(size_t page) { return reinterpret_cast<const uint8_t*>(&state_) + page * kStatePageBytes; }
+    // kStatePageBytes, except for the last page.
+    static size_t StatePageSize(size_t page) {
+      return std::min(kStatePageBytes, sizeof(ConsoleState) - page * kStatePageBytes);
+    }
+    // Overwrites one page of the state, e.g. with a memoized frame's result.
+    void SetStatePage(size_t page, const uint8_t* data);
 
   private:
     // Resets the CPU state, loads the cartridge,
     // sets the next instruction baded on reset vector.
-    void Reset(const std::string& file_path);
-    void BuildInstructionSet();
+    void Reset(std::shared_ptr<const Cartridge> cartridge);
 
-    void LoadCartrtidgeFile(const std::string& file_path);
-    // Loads an iNES 1.0 file
-    void LoadNes1File(std::vector<uint8_t> bytes);
+    // Creates the PPU and mapper for the cartridge. ROM is referenced, not copied.
+    void LoadCartridge(std::shared_ptr<const Cartridge> cartridge);
 
     // D has no effect. 
     enum class Flag {
@@ -32,6 +99,18 @@ class Cpu6502 {
     bool GetFlag(Flag flag);
     void SetFlag(Flag flag, bool val);
     void SetPIgnoreB(uint8_t new_p);
+    // Every memory write goes through here, so StateHash() knows what to rehash.
+    void Write(uint16_t addr, uint8_t val);
+    void NoteWrite(uint16_t addr);
+    void MarkDirty(size_t offset) {
+      size_t page = offset / kStatePageBytes;
+      dirty_pages_[page / 64] |= 1ULL << (page % 64);
+    }
+    void MarkAllDirty() { dirty_pages_.fill(~0ULL); }
+    // Pushes PC and P then jumps through the NMI vector at $FFFA.
+    void Nmi();
+    // Starts the trace record for the instruction at the PC, before it runs.
+    void BeginTrace(uint8_t opcode);
 
     struct AddrVal {
       uint16_t addr = 0;  // unused for kImmediate
@@ -55,23 +134,10 @@ class Cpu6502 {
     // For branching, decodes next offset into an address.
     uint16_t NextRelativeAddr(bool* page_crossed);
 
-    enum class AddressingMode {
-      kImmediate,
-      kZeroPage,
-      kZeroPageX,
-      kZeroPageY,
-      kAbsolute,
-      kAbsoluteX,
-      kAbsoluteY,
-      kIndirectX,
-      kIndirectY,
-      kAbsoluteIndirect,
-      kRelative,
-      kAccumulator,
-      kNone // needed?
-    };
     uint16_t NextAddr(AddressingMode mode, bool* page_crossed);
-    AddrVal NextAddrVal(AddressingMode mode, bool unofficial=false);
+    // store: the operand is only written, so its value (for the log and trace) is peeked
+    // rather than read, and registers like $4016 are not disturbed.
+    AddrVal NextAddrVal(AddressingMode mode, bool unofficial=false, bool store=false);
 
     void PushStack(uint8_t val);
     void PushStack16(uint16_t val);
@@ -154,44 +220,44 @@ class Cpu6502 {
     DEF_INSTR(UN_SRE);  // LSR then EOR
     DEF_INSTR(UN_RRA);  // ROR then ADC
 
-    // Instruction set keyed on opcode.
+    // Instruction set indexed by opcode, built once and shared by every instance.
     struct Instruction {
-      std::string name = "";
-      std::function<void(void)> impl = nullptr; // addressing mode was bound
+      const char* name = nullptr;
+      void (*impl)(Cpu6502* cpu) = nullptr;  // addressing mode is baked in; null if unknown
       // Base number of cycles. Impl can add more (ex. page crossing)
       uint8_t cycles = 0;
     };
-    std::unordered_map<uint8_t, Instruction> instructions_;
+    static const std::array<Instruction, 256>& InstructionSet();
+
+    // All mutable state: registers first, then internal RAM (nestest wants this 0'd), APU
+    // and I/O memory at 0x4000-0x401F, PPU, controllers, PRG-RAM and CHR-RAM. The PPU,
+    // mapper and controllers below point into it. See state.h.
+    ConsoleState state_;
 
-    // Points to next address to execute
-    uint16_t program_counter_ = 0;
+    const std::array<Instruction, 256>* instructions_;
 
-    // 2kb of internal memory -- nestest wants this 0'd
-    uint8_t internal_ram_[2048] = {};
-    // 0x4000-0x401F -- APU and I/O memory. Owned by the CPU since we need it for I/O too.
-    uint8_t apu_ram_[0x20] = {};
+    // Not part of the state: bookkeeping for StateHash().
+    PageSet dirty_pages_;
+    std::array<uint64_t, kNumStatePages> page_hashes_;
 
+    Controller controllers_[2] = {Controller(&state_.controllers[0]), Controller(&state_.controllers[1])};
+
+    std::shared_ptr<const Cartridge> cartridge_;
     std::unique_ptr<Ppu> ppu_;
+    #ifdef PROFILE
+    std::unique_ptr<ExecProfile> profile_;
+    #endif
+    #ifdef BUS_PROFILE
+    BusProfile* bus_profile_ = nullptr;  // wraps the real mapper; owned by mapper_
+    #endif
+    TraceBuffer* trace_ = nullptr;
+    TraceRecord* trace_record_ = nullptr;  // the running instruction's, while tracing
+    StackSampler* sampler_ = nullptr;
+    PhaseCounters* phases_ = nullptr;
+    Timeline* timeline_ = nullptr;
 
     // NOTE: This needs to be last!
     std::unique_ptr<Mapper> mapper_;
-
-    /// Registers
-    uint8_t a_;
-    uint8_t x_;
-    uint8_t y_;
-    // Bit order MSb (NVxx DIZC) LSb -> Bits 4 and 5 only set when copied to stack.
-    uint8_t p_;
-    uint8_t stack_pointer_;
-
-    uint8_t ppu_update_pattern_position_ = 1;
-    // Trigger a PPU scanline's worth of updates once we reach this cycle.
-    // May trigger many times per CPU update for longer CPU updates (like DMA).
-    uint64_t next_ppu_update_at_ = 114;
-
-    // Current cycle number. Cycle 7 means 7 cycles have elapsed.
-    uint64_t cycle_ = 0;
-
 };
 
 // notes:
@@ -0,0 +1,236 @@
+// Opcode table shared by Cpu6502 and BatchCpu6502. No include guard: define
+// OPCODE(opcode, name, addressing mode, base cycles) before including.
+// Impl can add more cycles than the base (ex. page crossing).
+
+OPCODE(0x69, ADC, kImmediate, 2)
+OPCODE(0x65, ADC, kZeroPage, 3)
+OPCODE(0x75, ADC, kZeroPageX, 4)
+OPCODE(0x6D, ADC, kAbsolute, 4)
+OPCODE(0x7D, ADC, kAbsoluteX, 4)
+OPCODE(0x79, ADC, kAbsoluteY, 4)
+OPCODE(0x61, ADC, kIndirectX, 6)
+OPCODE(0x71, ADC, kIndirectY, 5)
+OPCODE(0x4C, JMP, kAbsolute, 3)
+OPCODE(0x6C, JMP, kAbsoluteIndirect, 5)
+OPCODE(0x00, BRK, kNone, 7)
+OPCODE(0x40, RTI, kNone, 6)
+OPCODE(0xA2, LDX, kImmediate, 2)
+OPCODE(0xA6, LDX, kZeroPage, 3)
+OPCODE(0xB6, LDX, kZeroPageY, 4)
+OPCODE(0xAE, LDX, kAbsolute, 4)
+OPCODE(0xBE, LDX, kAbsoluteY, 4)
+OPCODE(0x86, STX, kZeroPage, 3)
+OPCODE(0x96, STX, kZeroPageY, 4)
+OPCODE(0x8E, STX, kAbsolute, 4)
+OPCODE(0x20, JSR, kAbsolute, 6)
+OPCODE(0xEA, NOP, kNone, 2)
+OPCODE(0x38, SEC, kNone, 2)
+OPCODE(0xB0, BCS, kRelative, 2)
+OPCODE(0x18, CLC, kNone, 2)
+OPCODE(0x90, BCC, kRelative, 2)
+OPCODE(0xA9, LDA, kImmediate, 2)
+OPCODE(0xA5, LDA, kZeroPage, 3)
+OPCODE(0xB5, LDA, kZeroPageX, 4)
+OPCODE(0xAD, LDA, kAbsolute, 4)
+OPCODE(0xBD, LDA, kAbsoluteX, 4)
+OPCODE(0xB9, LDA, kAbsoluteY, 4)
+OPCODE(0xA1, LDA, kIndirectX, 6)
+OPCODE(0xB1, LDA, kIndirectY, 5)
+OPCODE(0xF0, BEQ, kRelative, 2)
+OPCODE(0xD0, BNE, kRelative, 2)
+OPCODE(0x85, STA, kZeroPage, 3)
+OPCODE(0x95, STA, kZeroPageX, 4)
+OPCODE(0x8D, STA, kAbsolute, 4)
+OPCODE(0x9D, STA, kAbsoluteX, 5)
+OPCODE(0x99, STA, kAbsoluteY, 5)
+OPCODE(0x81, STA, kIndirectX, 6)
+OPCODE(0x91, STA, kIndirectY, 6)
+OPCODE(0x24, BIT, kZeroPage, 3)
+OPCODE(0x2C, BIT, kAbsolute, 4)
+OPCODE(0x70, BVS, kRelative, 2)
+OPCODE(0x50, BVC, kRelative, 2)
+OPCODE(0x10, BPL, kRelative, 2)
+OPCODE(0x60, RTS, kNone, 6)
+OPCODE(0x78, SEI, kNone, 2)
+OPCODE(0xF8, SED, kNone, 2)
+OPCODE(0x08, PHP, kNone, 3)
+OPCODE(0x68, PLA, kNone, 4)
+OPCODE(0x29, AND, kImmediate, 2)
+OPCODE(0x25, AND, kZeroPage, 3)
+OPCODE(0x35, AND, kZeroPageX, 4)
+OPCODE(0x2D, AND, kAbsolute, 4)
+OPCODE(0x3D, AND, kAbsoluteX, 4)
+OPCODE(0x39, AND, kAbsoluteY, 4)
+OPCODE(0x21, AND, kIndirectX, 6)
+OPCODE(0x31, AND, kIndirectY, 5)
+OPCODE(0xC9, CMP, kImmediate, 2)
+OPCODE(0xC5, CMP, kZeroPage, 3)
+OPCODE(0xD5, CMP, kZeroPageX, 4)
+OPCODE(0xCD, CMP, kAbsolute, 4)
+OPCODE(0xDD, CMP, kAbsoluteX, 4)
+OPCODE(0xD9, CMP, kAbsoluteY, 4)
+OPCODE(0xC1, CMP, kIndirectX, 6)
+OPCODE(0xD1, CMP, kIndirectY, 5)
+OPCODE(0xD8, CLD, kNone, 2)
+OPCODE(0x48, PHA, kNone, 3)
+OPCODE(0x28, PLP, kNone, 4)
+OPCODE(0x30, BMI, kRelative, 2)
+OPCODE(0x09, ORA, kImmediate, 2)
+OPCODE(0x05, ORA, kZeroPage, 3)
+OPCODE(0x15, ORA, kZeroPageX, 4)
+OPCODE(0x0D, ORA, kAbsolute, 4)
+OPCODE(0x1D, ORA, kAbsoluteX, 4)
+OPCODE(0x19, ORA, kAbsoluteY, 4)
+OPCODE(0x01, ORA, kIndirectX, 6)
+OPCODE(0x11, ORA, kIndirectY, 5)
+OPCODE(0xB8, CLV, kNone, 2)
+OPCODE(0x49, EOR, kImmediate, 2)
+OPCODE(0x45, EOR, kZeroPage, 3)
+OPCODE(0x55, EOR, kZeroPageX, 4)
+OPCODE(0x4D, EOR, kAbsolute, 4)
+OPCODE(0x5D, EOR, kAbsoluteX, 4)
+OPCODE(0x59, EOR, kAbsoluteY, 4)
+OPCODE(0x41, EOR, kIndirectX, 6)
+OPCODE(0x51, EOR, kIndirectY, 5)
+OPCODE(0xA0, LDY, kImmediate, 2)
+OPCODE(0xA4, LDY, kZeroPage, 3)
+OPCODE(0xB4, LDY, kZeroPageX, 4)
+OPCODE(0xAC, LDY, kAbsolute, 4)
+OPCODE(0xBC, LDY, kAbsoluteX, 4)
+OPCODE(0xE0, CPX, kImmediate, 2)
+OPCODE(0xE4, CPX, kZeroPage, 3)
+OPCODE(0xEC, CPX, kAbsolute, 4)
+OPCODE(0xC0, CPY, kImmediate, 2)
+OPCODE(0xC4, CPY, kZeroPage, 3)
+OPCODE(0xCC, CPY, kAbsolute, 4)
+OPCODE(0xE9, SBC, kImmediate, 2)
+OPCODE(0xE5, SBC, kZeroPage, 3)
+OPCODE(0xF5, SBC, kZeroPageX, 4)
+OPCODE(0xED, SBC, kAbsolute, 4)
+OPCODE(0xFD, SBC, kAbsoluteX, 4)
+OPCODE(0xF9, SBC, kAbsoluteY, 4)
+OPCODE(0xE1, SBC, kIndirectX, 6)
+OPCODE(0xF1, SBC, kIndirectY, 5)
+OPCODE(0xE8, INX, kNone, 2)
+OPCODE(0xC8, INY, kNone, 2)
+OPCODE(0xCA, DEX, kNone, 2)
+OPCODE(0x88, DEY, kNone, 2)
+OPCODE(0xAA, TAX, kNone, 2)
+OPCODE(0xA8, TAY, kNone, 2)
+OPCODE(0x8A, TXA, kNone, 2)
+OPCODE(0x98, TYA, kNone, 2)
+OPCODE(0x9A, TXS, kNone, 2)
+OPCODE(0xBA, TSX, kNone, 2)
+OPCODE(0x4A, LSR, kAccumulator, 2)
+OPCODE(0x46, LSR, kZeroPage, 5)
+OPCODE(0x56, LSR, kZeroPageX, 6)
+OPCODE(0x4E, LSR, kAbsolute, 6)
+OPCODE(0x5E, LSR, kAbsoluteX, 7)
+OPCODE(0x0A, ASL, kAccumulator, 2)
+OPCODE(0x06, ASL, kZeroPage, 5)
+OPCODE(0x16, ASL, kZeroPageX, 6)
+OPCODE(0x0E, ASL, kAbsolute, 6)
+OPCODE(0x1E, ASL, kAbsoluteX, 7)
+OPCODE(0x6A, ROR, kAccumulator, 2)
+OPCODE(0x66, ROR, kZeroPage, 5)
+OPCODE(0x76, ROR, kZeroPageX, 6)
+OPCODE(0x6E, ROR, kAbsolute, 6)
+OPCODE(0x7E, ROR, kAbsoluteX, 7)
+OPCODE(0x2A, ROL, kAccumulator, 2)
+OPCODE(0x26, ROL, kZeroPage, 5)
+OPCODE(0x36, ROL, kZeroPageX, 6)
+OPCODE(0x2E, ROL, kAbsolute, 6)
+OPCODE(0x3E, ROL, kAbsoluteX, 7)
+OPCODE(0x84, STY, kZeroPage, 3)
+OPCODE(0x94, STY, kZeroPageX, 4)
+OPCODE(0x8C, STY, kAbsolute, 4)
+OPCODE(0xE6, INC, kZeroPage, 5)
+OPCODE(0xF6, INC, kZeroPageX, 6)
+OPCODE(0xEE, INC, kAbsolute, 6)
+OPCODE(0xFE, INC, kAbsoluteX, 7)
+OPCODE(0xC6, DEC, kZeroPage, 5)
+OPCODE(0xD6, DEC, kZeroPageX, 6)
+OPCODE(0xCE, DEC, kAbsolute, 6)
+OPCODE(0xDE, DEC, kAbsoluteX, 7)
+
+// Unofficial
+OPCODE(0x04, UN_NOP, kZeroPage, 3)  // d = zero page
+OPCODE(0x44, UN_NOP, kZeroPage, 3)  // d
+OPCODE(0x64, UN_NOP, kZeroPage, 3)  // d
+OPCODE(0x0C, UN_NOP, kAbsolute, 4)  // probably absolute not accum
+OPCODE(0x14, UN_NOP, kZeroPageX, 4)  // d,x = zero page, x
+OPCODE(0x34, UN_NOP, kZeroPageX, 4)  // d,x
+OPCODE(0x54, UN_NOP, kZeroPageX, 4)  // d,x
+OPCODE(0x74, UN_NOP, kZeroPageX, 4)  // d,x
+OPCODE(0xD4, UN_NOP, kZeroPageX, 4)  // d,x
+OPCODE(0xF4, UN_NOP, kZeroPageX, 4)  // d,x
+OPCODE(0x1C, UN_NOP, kAbsoluteX, 4)  // a,x
+OPCODE(0x3C, UN_NOP, kAbsoluteX, 4)  // a,x
+OPCODE(0x5C, UN_NOP, kAbsoluteX, 4)  // a,x
+OPCODE(0x7C, UN_NOP, kAbsoluteX, 4)  // a,x
+OPCODE(0xDC, UN_NOP, kAbsoluteX, 4)  // a,x
+OPCODE(0xFC, UN_NOP, kAbsoluteX, 4)  // a,x
+OPCODE(0x80, UN_NOP, kImmediate, 2)  // #i = immediate
+OPCODE(0x89, UN_NOP, kImmediate, 2)  // #i
+OPCODE(0x82, UN_NOP, kImmediate, 2)  // #i
+OPCODE(0xC2, UN_NOP, kImmediate, 2)  // #i
+OPCODE(0xE2, UN_NOP, kImmediate, 2)  // #i
+OPCODE(0x1A, UN_NOP, kNone, 2)
+OPCODE(0x3A, UN_NOP, kNone, 2)
+OPCODE(0x5A, UN_NOP, kNone, 2)
+OPCODE(0x7A, UN_NOP, kNone, 2)
+OPCODE(0xDA, UN_NOP, kNone, 2)
+OPCODE(0xFA, UN_NOP, kNone, 2)
+OPCODE(0xA3, UN_LAX, kIndirectX, 6) // (d,x)
+OPCODE(0xA7, UN_LAX, kZeroPage, 3) // d
+OPCODE(0xAF, UN_LAX, kAbsolute, 4) // a
+OPCODE(0xB3, UN_LAX, kIndirectY, 5) // (d),Y 
+OPCODE(0xB7, UN_LAX, kZeroPageY, 4) // d,Y
+OPCODE(0xBF, UN_LAX, kAbsoluteY, 4) // a,Y
+OPCODE(0x83, UN_SAX, kIndirectX, 6)
+OPCODE(0x87, UN_SAX, kZeroPage, 3)
+OPCODE(0x8F, UN_SAX, kAbsolute, 4)
+OPCODE(0x97, UN_SAX, kZeroPageY, 4)
+OPCODE(0xEB, UN_SBC, kImmediate, 2)
+OPCODE(0xC3, UN_DCP, kIndirectX, 8) // (d,x)
+OPCODE(0xC7, UN_DCP, kZeroPage, 5) // d
+OPCODE(0xCF, UN_DCP, kAbsolute, 6) // a
+OPCODE(0xD3, UN_DCP, kIndirectY, 7) // (d),Y 
+OPCODE(0xD7, UN_DCP, kZeroPageX, 6) // d,X
+OPCODE(0xDB, UN_DCP, kAbsoluteY, 6) // a,Y
+OPCODE(0xDF, UN_DCP, kAbsoluteX, 6) // a,X
+OPCODE(0xE3, UN_ISB, kIndirectX, 8) // (d,x)
+OPCODE(0xE7, UN_ISB, kZeroPage, 5) // d
+OPCODE(0xEF, UN_ISB, kAbsolute, 6) // a
+OPCODE(0xF3, UN_ISB, kIndirectY, 7) // (d),Y 
+OPCODE(0xF7, UN_ISB, kZeroPageX, 6) // d,X
+OPCODE(0xFB, UN_ISB, kAbsoluteY, 6) // a,Y
+OPCODE(0xFF, UN_ISB, kAbsoluteX, 6) // a,X
+OPCODE(0x03, UN_SLO, kIndirectX, 8) // (d,x)
+OPCODE(0x07, UN_SLO, kZeroPage, 5) // d
+OPCODE(0x0F, UN_SLO, kAbsolute, 6) // a
+OPCODE(0x13, UN_SLO, kIndirectY, 7) // (d),Y 
+OPCODE(0x17, UN_SLO, kZeroPageX, 6) // d,X
+OPCODE(0x1B, UN_SLO, kAbsoluteY, 6) // a,Y
+OPCODE(0x1F, UN_SLO, kAbsoluteX, 6) // a,X
+OPCODE(0x23, UN_RLA, kIndirectX, 8) // (d,x)
+OPCODE(0x27, UN_RLA, kZeroPage, 5) // d
+OPCODE(0x2F, UN_RLA, kAbsolute, 6) // a
+OPCODE(0x33, UN_RLA, kIndirectY, 7) // (d),Y 
+OPCODE(0x37, UN_RLA, kZeroPageX, 6) // d,X
+OPCODE(0x3B, UN_RLA, kAbsoluteY, 6) // a,Y
+OPCODE(0x3F, UN_RLA, kAbsoluteX, 6) // a,X
+OPCODE(0x43, UN_SRE, kIndirectX, 8) // (d,x)
+OPCODE(0x47, UN_SRE, kZeroPage, 5) // d
+OPCODE(0x4F, UN_SRE, kAbsolute, 6) // a
+OPCODE(0x53, UN_SRE, kIndirectY, 7) // (d),Y 
+OPCODE(0x57, UN_SRE, kZeroPageX, 6) // d,X
+OPCODE(0x5B, UN_SRE, kAbsoluteY, 6) // a,Y
+OPCODE(0x5F, UN_SRE, kAbsoluteX, 6) // a,X
+OPCODE(0x63, UN_RRA, kIndirectX, 8) // (d,x)
+OPCODE(0x67, UN_RRA, kZeroPage, 5) // d
+OPCODE(0x6F, UN_RRA, kAbsolute, 6) // a
+OPCODE(0x73, UN_RRA, kIndirectY, 7) // (d),Y 
+OPCODE(0x77, UN_RRA, kZeroPageX, 6) // d,X
+OPCODE(0x7B, UN_RRA, kAbsoluteY, 6) // a,Y
+OPCODE(0x7F, UN_RRA, kAbsoluteX, 6) // a,X
@@ -0,0 +1,128 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <string>
+
+#include "common.h"
+#include "env_protocol.h"
+
+// Client-side benchmark for nes2x_env_server. Steps the server at batch sizes
+// 1, 2, 4... up to its env count and reports steps per second for each.
+//
+// Usage: nes2x_env_bench [--socket PATH] [--steps N] [--frames N]
+
+using namespace env_protocol;
+
+namespace {
+
+struct Client {
+  int fd = -1;
+  EnvInfo info = {};
+  const uint8_t* shm = nullptr;
+  std::vector<uint8_t> actions;
+  std::vector<uint8_t> results;  // done flags then rewards
+};
+
+void Connect(const std::string& socket_path, Client* c) {
+  c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  if (c->fd < 0 || connect(c->fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    throw std::runtime_error("Could not connect to " + socket_path + ": " + strerror(errno));
+  }
+  if (!ReadFull(c->fd, &c->info, sizeof(c->info)) || c->info.magic != kMagic ||
+      c->info.version != kVersion) {
+    throw std::runtime_error("Server speaks a different protocol.");
+  }
+  int shm_fd = shm_open(c->info.shm_name, O_RDONLY, 0);
+  void* mem = shm_fd >= 0 ? mmap(nullptr, c->info.shm_bytes, PROT_READ, MAP_SHARED, shm_fd, 0) : MAP_FAILED;
+  if (shm_fd >= 0) {
+    close(shm_fd);
+  }
+  if (mem == MAP_FAILED) {
+    throw std::runtime_error(std::string("Could not map ") + c->info.shm_name);
+  }
+  c->shm = static_cast<const uint8_t*>(mem);
+  c->actions.resize(c->info.num_envs);
+  c->results.resize(c->info.num_envs * (1 + c->info.num_reward_addrs));
+}
+
+// Sends one request and waits for its response. Returns the ring slot.
+uint32_t Request(Client* c, RequestType type, uint32_t num_envs, uint32_t frames) {
+  EnvRequest req = {kMagic, type, num_envs, frames};
+  EnvResponse resp;
+  size_t result_bytes = num_envs * (1 + c->info.num_reward_addrs);
+  if (!WriteFull(c->fd, &req, sizeof(req)) || !WriteFull(c->fd, c->actions.data(), num_envs) ||
+      !ReadFull(c->fd, &resp, sizeof(resp)) || !ReadFull(c->fd, c->results.data(), result_bytes)) {
+    throw std::runtime_error("Server hung up.");
+  }
+  return resp.slot;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    std::string socket_path = "/tmp/nes2x_env.sock";
+    int num_steps = 200;
+    uint32_t frames = 1;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (arg == "--socket" && has_value) {
+        socket_path = argv[++i];
+      } else if (arg == "--steps" && has_value) {
+        num_steps = std::stoi(argv[++i]);
+      } else if (arg == "--frames" && has_value) {
+        frames = std::stoul(argv[++i]);
+      } else {
+        std::cerr << "Usage: nes2x_env_bench [--socket PATH] [--steps N] [--frames N]" << std::endl;
+        return 1;
+      }
+    }
+
+    Client c;
+    Connect(socket_path, &c);
+    printf("server envs=%u ring=%u reward_addrs=%u\n", c.info.num_envs, c.info.ring_slots,
+        c.info.num_reward_addrs);
+
+    uint64_t checksum = 0;
+    uint32_t rng = 1;
+    std::vector<uint32_t> batches;
+    for (uint32_t batch = 1; batch < c.info.num_envs; batch *= 2) {
+      batches.push_back(batch);
+    }
+    batches.push_back(c.info.num_envs);  // always finish with the full batch
+    for (uint32_t batch : batches) {
+      Request(&c, RequestType::kReset, batch, frames);
+      auto start_time = Clock::now();
+      for (int s = 0; s < num_steps; ++s) {
+        for (uint32_t e = 0; e < batch; ++e) {
+          rng = rng * 1103515245 + 12345;
+          c.actions[e] = rng >> 24;
+        }
+        uint32_t slot = Request(&c, RequestType::kStep, batch, frames);
+        // Touch each observation the way a consumer would, straight from the ring.
+        const uint8_t* obs = c.shm + kShmHeaderBytes + slot * c.info.slot_bytes;
+        for (uint32_t e = 0; e < batch; ++e) {
+          const uint8_t* env_obs = obs + e * (kFrameBytes + kRamBytes);
+          checksum += env_obs[kFrameBytes / 2] + env_obs[kFrameBytes];
+        }
+      }
+      double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+      printf("batch=%-4u requests/s=%9.1f env_steps/s=%9.1f frames/s=%9.1f\n", batch,
+          num_steps / seconds, num_steps * batch / seconds, num_steps * batch * frames / seconds);
+    }
+    printf("checksum=%llu\n", static_cast<unsigned long long>(checksum));
+    close(c.fd);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+}
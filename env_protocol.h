@@ -0,0 +1,100 @@
+#ifndef ENV_PROTOCOL_H_
+#define ENV_PROTOCOL_H_
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "common.h"
+
+// Wire format between nes2x_env_server and its clients. Everything is native-endian and
+// only meant for processes on the same machine.
+//
+// On connect the server sends an EnvInfo. The client then mmaps the shared-memory ring
+// named in it and sends requests; each EnvRequest (plus its action bytes) gets exactly
+// one EnvResponse (plus its done and reward bytes).
+//
+// The ring holds ring_slots slots. A response names the slot the step was written to;
+// every active env has a kFrameBytes frame followed by kRamBytes of RAM at
+//   shm + kShmHeaderBytes + slot * slot_bytes + env * (kFrameBytes + kRamBytes).
+// A slot is only rewritten ring_slots steps later, so clients can read one step's
+// observations while asking for the next.
+namespace env_protocol {
+
+constexpr uint32_t kMagic = 0x564E4558;  // "XENV"
+constexpr uint32_t kVersion = 1;
+
+constexpr size_t kFrameBytes = 256 * 240 * 3;  // RGB24, see Ppu::FrameBuffer()
+constexpr size_t kRamBytes = 0x800;
+constexpr size_t kShmHeaderBytes = 4096;  // first page holds a copy of EnvInfo
+constexpr int kMaxRewardAddrs = 16;
+
+struct EnvInfo {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_envs;
+  uint32_t num_reward_addrs;
+  uint32_t ring_slots;
+  uint32_t reserved;
+  uint64_t slot_bytes;
+  uint64_t shm_bytes;
+  char shm_name[64];  // for shm_open
+};
+
+enum class RequestType : uint32_t {
+  kStep = 1,   // run frames with actions, auto-resetting envs that finish
+  kReset = 2,  // restore envs to their post-boot state; actions are ignored and the
+               // frame in the slot is the last one drawn
+};
+
+// Followed by num_envs action bytes (controller 1 buttons, see Controller::Button).
+// Only envs [0, num_envs) take part, so one server can be driven at any batch size.
+struct EnvRequest {
+  uint32_t magic;
+  RequestType type;
+  uint32_t num_envs;
+  uint32_t frames;  // frames to run per step, at least 1
+};
+
+// Followed by num_envs done flags and then num_envs * num_reward_addrs reward bytes,
+// env-major. Done envs were reset after the step; their observations in the slot are
+// from the final frame of the episode.
+struct EnvResponse {
+  uint32_t magic;
+  uint32_t slot;
+  uint64_t step;
+};
+
+// Blocking helpers for stream sockets. Return false on EOF or error.
+inline bool ReadFull(int fd, void* data, size_t size) {
+  uint8_t* p = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool WriteFull(int fd, const void* data, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n <= 0) {
+      return false;
+    }
+    p += n;
+    size -= n;
+  }
+  return true;
+}
+
+} // namespace env_protocol
+
+#endif  // ENV_PROTOCOL_H_
@@ -0,0 +1,202 @@
+#include "env_server.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "common.h"
+
+using namespace env_protocol;
+
+static_assert(kFrameBytes == kFrameX * kFrameY * 3, "Frame size must match the PPU.");
+
+EnvServer::EnvServer(std::shared_ptr<const Cartridge> cartridge, const Options& opts,
+                     const std::string& socket_path)
+    : opts_(opts), socket_path_(socket_path) {
+  if (opts_.num_envs < 1 || opts_.ring_slots < 1) {
+    throw std::runtime_error("Need at least one env and one ring slot.");
+  } else if (opts_.reward_addrs.size() > kMaxRewardAddrs) {
+    throw std::runtime_error(string_format("At most %d reward addresses.", kMaxRewardAddrs));
+  }
+  for (uint16_t addr : opts_.reward_addrs) {
+    if (addr >= kRamBytes) {
+      throw std::runtime_error(string_format("Reward address %04X is not in internal RAM.", addr));
+    }
+  }
+  if (opts_.has_done_addr && opts_.done_addr >= kRamBytes) {
+    throw std::runtime_error(string_format("Done address %04X is not in internal RAM.", opts_.done_addr));
+  }
+
+  envs_.resize(opts_.num_envs);
+  for (Env& env : envs_) {
+    env.cpu = std::make_unique<Cpu6502>(cartridge);
+  }
+  initial_state_ = std::make_unique<ConsoleState>();
+  envs_[0].cpu->SaveState(initial_state_.get());
+  pool_ = std::make_unique<JobPool>(std::min(opts_.threads > 0 ? opts_.threads : JobPool::NumCores(),
+                                             opts_.num_envs));
+  done_.resize(opts_.num_envs);
+  rewards_.resize(opts_.num_envs * opts_.reward_addrs.size());
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (socket_path_.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path is too long.");
+  }
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(socket_path_.c_str());
+  if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(listen_fd_, 1) != 0) {
+    std::string error = "Could not listen on " + socket_path_ + ": " + strerror(errno);
+    close(listen_fd_);
+    throw std::runtime_error(error);
+  }
+  try {
+    CreateSharedMemory();
+  } catch (...) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+    throw;
+  }
+  DBG("Serving %d envs on %s, ring %s\n", opts_.num_envs, socket_path_.c_str(), info_.shm_name);
+}
+
+EnvServer::~EnvServer() {
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+  }
+  if (shm_ != nullptr) {
+    munmap(shm_, info_.shm_bytes);
+    shm_unlink(info_.shm_name);
+  }
+}
+
+void EnvServer::CreateSharedMemory() {
+  info_.magic = kMagic;
+  info_.version = kVersion;
+  info_.num_envs = opts_.num_envs;
+  info_.num_reward_addrs = opts_.reward_addrs.size();
+  info_.ring_slots = opts_.ring_slots;
+  info_.slot_bytes = opts_.num_envs * (kFrameBytes + kRamBytes);
+  info_.shm_bytes = kShmHeaderBytes + info_.ring_slots * info_.slot_bytes;
+  snprintf(info_.shm_name, sizeof(info_.shm_name), "/nes2x-env-%d", static_cast<int>(getpid()));
+
+  int fd = shm_open(info_.shm_name, O_CREAT | O_RDWR | O_TRUNC, 0600);
+  if (fd < 0) {
+    throw std::runtime_error(string_format("shm_open(%s) failed: %s", info_.shm_name, strerror(errno)));
+  }
+  bool ok = ftruncate(fd, info_.shm_bytes) == 0;
+  void* mem = ok ? mmap(nullptr, info_.shm_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (mem == MAP_FAILED) {
+    shm_unlink(info_.shm_name);
+    throw std::runtime_error(string_format("Could not map %llu bytes of shared memory.",
+        static_cast<unsigned long long>(info_.shm_bytes)));
+  }
+  shm_ = static_cast<uint8_t*>(mem);
+  memcpy(shm_, &info_, sizeof(info_));
+}
+
+void EnvServer::Serve(const volatile sig_atomic_t* stop) {
+  while (!*stop) {
+    int fd = accept(listen_fd_, nullptr, nullptr);
+    if (fd < 0) {
+      continue;  // EINTR from a signal, or a client that gave up
+    }
+    DBG("Client connected\n");
+    ServeClient(fd);
+    close(fd);
+    DBG("Client disconnected\n");
+  }
+}
+
+void EnvServer::ServeClient(int fd) {
+  if (!WriteFull(fd, &info_, sizeof(info_))) {
+    return;
+  }
+  EnvRequest req;
+  std::vector<uint8_t> actions(opts_.num_envs);
+  while (ReadFull(fd, &req, sizeof(req))) {
+    if (req.magic != kMagic || req.num_envs < 1 || req.num_envs > info_.num_envs ||
+        (req.type != RequestType::kStep && req.type != RequestType::kReset)) {
+      fprintf(stderr, "Bad request, dropping client.\n");
+      return;
+    }
+    if (!ReadFull(fd, actions.data(), req.num_envs)) {
+      return;
+    }
+    Handle(req, actions.data());
+
+    EnvResponse resp = {kMagic, slot_, step_};
+    size_t num_rewards = req.num_envs * opts_.reward_addrs.size();
+    if (!WriteFull(fd, &resp, sizeof(resp)) || !WriteFull(fd, done_.data(), req.num_envs) ||
+        !WriteFull(fd, rewards_.data(), num_rewards)) {
+      return;
+    }
+  }
+}
+
+void EnvServer::Handle(const EnvRequest& req, const uint8_t* actions) {
+  step_++;
+  slot_ = step_ % info_.ring_slots;
+
+  // One job per worker, each taking a contiguous run of envs.
+  int num_jobs = std::min<int>(pool_->NumWorkers(), req.num_envs);
+  std::vector<JobPool::Job> jobs;
+  for (int j = 0; j < num_jobs; ++j) {
+    int first = req.num_envs * j / num_jobs;
+    int last = req.num_envs * (j + 1) / num_jobs;
+    jobs.push_back([this, &req, actions, first, last](int) {
+      for (int i = first; i < last; ++i) {
+        try {
+          RunEnv(i, req, actions);
+        } catch (const std::exception& e) {
+          // A crashed game ends its episode rather than the server.
+          fprintf(stderr, "env %d: %s\n", i, e.what());
+          envs_[i].cpu->LoadState(*initial_state_);
+          envs_[i].episode_frames = 0;
+          done_[i] = 1;
+        }
+      }
+    });
+  }
+  pool_->Run(std::move(jobs));
+}
+
+void EnvServer::RunEnv(int i, const EnvRequest& req, const uint8_t* actions) {
+  Env& env = envs_[i];
+  Cpu6502& cpu = *env.cpu;
+  if (req.type == RequestType::kReset) {
+    cpu.LoadState(*initial_state_);
+    env.episode_frames = 0;
+    done_[i] = 1;
+  } else {
+    cpu.SetButtons(0, actions[i]);
+    for (uint32_t f = 0; f < std::max<uint32_t>(req.frames, 1); ++f) {
+      cpu.RunFrame();
+    }
+    env.episode_frames += std::max<uint32_t>(req.frames, 1);
+    done_[i] = (opts_.has_done_addr && cpu.Ram()[opts_.done_addr] == opts_.done_value) ||
+               (opts_.max_episode_frames > 0 && env.episode_frames >= opts_.max_episode_frames);
+  }
+
+  uint8_t* out = SlotEnv(slot_, i);
+  memcpy(out, cpu.FrameBuffer()->Data(), kFrameBytes);
+  memcpy(out + kFrameBytes, cpu.Ram(), kRamBytes);
+  for (size_t r = 0; r < opts_.reward_addrs.size(); ++r) {
+    rewards_[i * opts_.reward_addrs.size() + r] = cpu.Ram()[opts_.reward_addrs[r]];
+  }
+
+  if (done_[i] && req.type == RequestType::kStep) {
+    cpu.LoadState(*initial_state_);
+    env.episode_frames = 0;
+  }
+}
+
+uint8_t* EnvServer::SlotEnv(uint32_t slot, int env) {
+  return shm_ + kShmHeaderBytes + slot * info_.slot_bytes + env * (kFrameBytes + kRamBytes);
+}
@@ -0,0 +1,71 @@
+#ifndef ENV_SERVER_H_
+#define ENV_SERVER_H_
+
+#include <csignal>
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+#include "env_protocol.h"
+#include "job_pool.h"
+
+// Hosts a batch of emulator instances ("envs") of one ROM for out-of-process consumers.
+// Step requests arrive over a Unix domain socket (see env_protocol.h). Frames and RAM are
+// copied from each Cpu6502's own buffers into a shared-memory ring that clients mmap, so
+// only actions, done flags and reward bytes go over the socket.
+class EnvServer {
+  public:
+    struct Options {
+      int num_envs = 8;
+      int ring_slots = 4;
+      int threads = 0;  // 0 means one per core
+      // RAM addresses whose values are returned as rewards every step.
+      std::vector<uint16_t> reward_addrs;
+      // An episode ends when RAM[done_addr] == done_value ...
+      bool has_done_addr = false;
+      uint16_t done_addr = 0;
+      uint8_t done_value = 0;
+      // ... or after this many frames, if non-zero.
+      uint64_t max_episode_frames = 0;
+    };
+
+    // Boots every env and creates the socket and shared memory. Throws on failure.
+    EnvServer(std::shared_ptr<const Cartridge> cartridge, const Options& opts,
+              const std::string& socket_path);
+    // Removes the socket and shared memory.
+    ~EnvServer();
+
+    // Serves one client at a time until *stop becomes non-zero (e.g. from a signal handler).
+    void Serve(const volatile sig_atomic_t* stop);
+
+  private:
+    struct Env {
+      std::unique_ptr<Cpu6502> cpu;
+      uint64_t episode_frames = 0;
+    };
+
+    void CreateSharedMemory();
+    void ServeClient(int fd);
+    // Steps or resets envs [0, num_envs) and writes their observations to the next slot.
+    void Handle(const env_protocol::EnvRequest& req, const uint8_t* actions);
+    void RunEnv(int i, const env_protocol::EnvRequest& req, const uint8_t* actions);
+    uint8_t* SlotEnv(uint32_t slot, int env);
+
+    Options opts_;
+    std::string socket_path_;
+    std::vector<Env> envs_;
+    // Post-boot state every env returns to on reset.
+    std::unique_ptr<ConsoleState> initial_state_;
+    std::unique_ptr<JobPool> pool_;
+
+    int listen_fd_ = -1;
+    env_protocol::EnvInfo info_ = {};
+    uint8_t* shm_ = nullptr;
+
+    uint64_t step_ = 0;
+    uint32_t slot_ = 0;
+    std::vector<uint8_t> done_;
+    std::vector<uint8_t> rewards_;
+};
+
+#endif  // ENV_SERVER_H_
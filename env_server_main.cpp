@@ -0,0 +1,86 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+
+#include "cartridge.h"
+#include "common.h"
+#include "env_server.h"
+
+// Vectorised-environment server. See env_protocol.h for the wire format.
+//
+// Usage: nes2x_env_server [--socket PATH] [--envs K] [--ring N] [--threads N]
+//                         [--reward ADDR]... [--done ADDR=VALUE] [--max-frames N] rom.nes
+// Addresses are internal RAM offsets and may be given in hex (0x..).
+
+namespace {
+
+volatile sig_atomic_t stop = 0;
+
+void HandleSignal(int) {
+  stop = 1;
+}
+
+void PrintUsage() {
+  std::cerr << "Usage: nes2x_env_server [--socket PATH] [--envs K] [--ring N] [--threads N] "
+               "[--reward ADDR]... [--done ADDR=VALUE] [--max-frames N] rom.nes" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    EnvServer::Options opts;
+    std::string socket_path = "/tmp/nes2x_env.sock";
+    std::string rom_path;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      bool has_value = i + 1 < argc;
+      if (arg == "--socket" && has_value) {
+        socket_path = argv[++i];
+      } else if (arg == "--envs" && has_value) {
+        opts.num_envs = std::stoi(argv[++i]);
+      } else if (arg == "--ring" && has_value) {
+        opts.ring_slots = std::stoi(argv[++i]);
+      } else if (arg == "--threads" && has_value) {
+        opts.threads = std::stoi(argv[++i]);
+      } else if (arg == "--reward" && has_value) {
+        opts.reward_addrs.push_back(std::stoi(argv[++i], nullptr, 0));
+      } else if (arg == "--done" && has_value) {
+        std::string spec = argv[++i];
+        size_t eq = spec.find('=');
+        if (eq == std::string::npos) {
+          throw std::runtime_error("--done wants ADDR=VALUE");
+        }
+        opts.has_done_addr = true;
+        opts.done_addr = std::stoi(spec.substr(0, eq), nullptr, 0);
+        opts.done_value = std::stoi(spec.substr(eq + 1), nullptr, 0);
+      } else if (arg == "--max-frames" && has_value) {
+        opts.max_episode_frames = std::stoull(argv[++i]);
+      } else if (arg.rfind("--", 0) == 0 || !rom_path.empty()) {
+        PrintUsage();
+        throw std::runtime_error("Unexpected argument " + arg);
+      } else {
+        rom_path = arg;
+      }
+    }
+    if (rom_path.empty()) {
+      PrintUsage();
+      throw std::runtime_error("No ROM given.");
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = HandleSignal;  // no SA_RESTART, so accept() returns on a signal
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);  // a vanished client shows up as a failed write instead
+
+    EnvServer server(Cartridge::FromFile(rom_path), opts, socket_path);
+    printf("Serving %d envs of %s on %s\n", opts.num_envs, rom_path.c_str(), socket_path.c_str());
+    fflush(stdout);
+    server.Serve(&stop);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+}
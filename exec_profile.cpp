@@ -0,0 +1,160 @@
+#include "exec_profile.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace {
+
+constexpr size_t kReportRows = 30;
+
+double Percent(uint64_t part, uint64_t whole) {
+  return whole == 0 ? 0 : 100.0 * part / whole;
+}
+
+} // namespace
+
+// Every merged profile, by ROM. Reports when destroyed at exit.
+class ExecProfileTotals {
+  public:
+    static ExecProfileTotals& Get() {
+      static ExecProfileTotals totals;
+      return totals;
+    }
+
+    void Add(const ExecProfile& profile) {
+      const std::lock_guard<std::mutex> lock(mu_);
+      auto inserted = by_rom_.emplace(profile.rom_hash_, profile);
+      if (inserted.second) {
+        return;
+      }
+      ExecProfile& total = inserted.first->second;
+      for (size_t i = 0; i < 256; ++i) {
+        ExecProfile::OpcodeStats& to = total.opcodes_[i];
+        const ExecProfile::OpcodeStats& from = profile.opcodes_[i];
+        to.count += from.count;
+        to.cycles += from.cycles;
+        to.page_crosses += from.page_crosses;
+        to.taken += from.taken;
+        to.dma_cycles += from.dma_cycles;
+      }
+      for (size_t pc = 0; pc < total.pcs_.size(); ++pc) {
+        ExecProfile::PcStats& to = total.pcs_[pc];
+        const ExecProfile::PcStats& from = profile.pcs_[pc];
+        if (from.count > 0) {
+          to.count += from.count;
+          to.cycles += from.cycles;
+          to.opcode = from.opcode;
+          to.prg_offset = from.prg_offset;
+        }
+      }
+    }
+
+    ~ExecProfileTotals() {
+      if (by_rom_.empty()) {
+        return;
+      }
+      FILE* csv = fopen("nes2x_profile.csv", "w");
+      if (csv != nullptr) {
+        fprintf(csv, "rom,kind,opcode,name,mode,pc,prg_offset,file_offset,count,cycles,page_crosses,"
+                     "branches_taken,dma_cycles\n");
+      }
+      for (const auto& rom : by_rom_) {
+        Report(rom.first, rom.second, csv);
+      }
+      if (csv != nullptr) {
+        fclose(csv);
+        fprintf(stderr, "Profile written to nes2x_profile.csv\n");
+      }
+    }
+
+  private:
+    ExecProfileTotals() = default;
+
+    static void Report(uint64_t rom_hash, const ExecProfile& profile, FILE* csv) {
+      const std::array<OpcodeInfo, 256>& infos = OpcodeInfos();
+      uint64_t instructions = 0;
+      uint64_t cycles = 0;
+      std::vector<int> opcodes;
+      for (int op = 0; op < 256; ++op) {
+        instructions += profile.opcodes_[op].count;
+        cycles += profile.opcodes_[op].cycles;
+        if (profile.opcodes_[op].count > 0) {
+          opcodes.push_back(op);
+        }
+      }
+      std::sort(opcodes.begin(), opcodes.end(), [&](int a, int b) {
+        return profile.opcodes_[a].cycles > profile.opcodes_[b].cycles;
+      });
+      std::vector<uint32_t> pcs;
+      for (uint32_t pc = 0; pc < profile.pcs_.size(); ++pc) {
+        if (profile.pcs_[pc].count > 0) {
+          pcs.push_back(pc);
+        }
+      }
+      std::sort(pcs.begin(), pcs.end(), [&](uint32_t a, uint32_t b) {
+        return profile.pcs_[a].cycles > profile.pcs_[b].cycles;
+      });
+
+      fprintf(stderr, "PROFILE rom=%016llx instructions=%llu cycles=%llu\n",
+              static_cast<unsigned long long>(rom_hash), static_cast<unsigned long long>(instructions),
+              static_cast<unsigned long long>(cycles));
+      fprintf(stderr, "  %-2s %-7s %-16s %12s %7s %13s %7s %6s %7s %7s %7s\n", "OP", "NAME", "MODE", "COUNT",
+              "%INSTR", "CYCLES", "%CYC", "CYC/OP", "PAGEX%", "TAKEN%", "DMA%");
+      for (size_t i = 0; i < opcodes.size() && i < kReportRows; ++i) {
+        const ExecProfile::OpcodeStats& s = profile.opcodes_[opcodes[i]];
+        bool branch = infos[opcodes[i]].mode == AddressingMode::kRelative;
+        fprintf(stderr, "  %02X %-7s %-16s %12llu %7.2f %13llu %7.2f %6.2f %7.2f %7s %7.2f\n", opcodes[i],
+                infos[opcodes[i]].name, infos[opcodes[i]].mode_name, static_cast<unsigned long long>(s.count),
+                Percent(s.count, instructions), static_cast<unsigned long long>(s.cycles),
+                Percent(s.cycles, cycles), static_cast<double>(s.cycles) / s.count,
+                Percent(s.page_crosses, s.count),
+                branch ? string_format("%.2f", Percent(s.taken, s.count)).c_str() : "-",
+                Percent(s.dma_cycles, s.cycles));
+      }
+      fprintf(stderr, "  %-4s %-9s %-2s %-7s %12s %13s %7s\n", "PC", "FILE_OFF", "OP", "NAME", "COUNT",
+              "CYCLES", "%CYC");
+      for (size_t i = 0; i < pcs.size() && i < kReportRows; ++i) {
+        const ExecProfile::PcStats& s = profile.pcs_[pcs[i]];
+        std::string offset = s.prg_offset < 0 ? "-" : string_format("0x%05llx",
+            static_cast<long long>(s.prg_offset + 16));
+        fprintf(stderr, "  %04X %-9s %02X %-7s %12llu %13llu %7.2f\n", pcs[i], offset.c_str(), s.opcode,
+                infos[s.opcode].name, static_cast<unsigned long long>(s.count),
+                static_cast<unsigned long long>(s.cycles), Percent(s.cycles, cycles));
+      }
+
+      if (csv == nullptr) {
+        return;
+      }
+      for (int op : opcodes) {
+        const ExecProfile::OpcodeStats& s = profile.opcodes_[op];
+        fprintf(csv, "%016llx,opcode,%02X,%s,%s,,,,%llu,%llu,%llu,%llu,%llu\n",
+                static_cast<unsigned long long>(rom_hash), op, infos[op].name, infos[op].mode_name,
+                static_cast<unsigned long long>(s.count), static_cast<unsigned long long>(s.cycles),
+                static_cast<unsigned long long>(s.page_crosses), static_cast<unsigned long long>(s.taken),
+                static_cast<unsigned long long>(s.dma_cycles));
+      }
+      for (uint32_t pc : pcs) {
+        const ExecProfile::PcStats& s = profile.pcs_[pc];
+        std::string offsets = s.prg_offset < 0 ? "," : string_format("%lld,%lld",
+            static_cast<long long>(s.prg_offset), static_cast<long long>(s.prg_offset + 16));
+        fprintf(csv, "%016llx,pc,%02X,%s,%s,%04X,%s,%llu,%llu,,,\n", static_cast<unsigned long long>(rom_hash),
+                s.opcode, infos[s.opcode].name, infos[s.opcode].mode_name, pc, offsets.c_str(),
+                static_cast<unsigned long long>(s.count), static_cast<unsigned long long>(s.cycles));
+      }
+    }
+
+    std::mutex mu_;
+    std::map<uint64_t, ExecProfile> by_rom_;
+};
+
+ExecProfile::ExecProfile(uint64_t rom_hash) : rom_hash_(rom_hash), opcodes_(256), pcs_(0x10000) {}
+
+void ExecProfile::Merge(Mapper* mapper) {
+  for (size_t pc = 0; pc < pcs_.size(); ++pc) {
+    if (pcs_[pc].count > 0) {
+      pcs_[pc].prg_offset = mapper->PrgRomOffset(static_cast<uint16_t>(pc));
+    }
+  }
+  ExecProfileTotals::Get().Add(*this);
+}
@@ -0,0 +1,76 @@
+#ifndef EXEC_PROFILE_H_
+#define EXEC_PROFILE_H_
+
+#include <array>
+
+#include "common.h"
+#include "mapper.h"
+#include "opcode_info.h"
+
+// Counts what a console executes, for finding the guest code and opcodes that cost the most.
+// Only built into Cpu6502 with -D PROFILE (make ... TEST_DEFINES="-U DEBUG -D PROFILE"), so
+// other builds pay nothing.
+//
+// Each console records into its own ExecProfile and merges it into a per-ROM total when it
+// is destroyed. At exit the totals are reported to stderr, hottest first, and written to
+// nes2x_profile.csv in the working directory.
+class ExecProfile {
+  public:
+    struct OpcodeStats {
+      uint64_t count = 0;
+      uint64_t cycles = 0;
+      uint64_t page_crosses = 0;  // executions that paid a page-cross cycle
+      uint64_t taken = 0;         // branches only
+      uint64_t dma_cycles = 0;
+    };
+
+    explicit ExecProfile(uint64_t rom_hash);
+
+    // One instruction: its opcode, the PC it was fetched from and every cycle it took,
+    // page-cross penalties and DMA stalls included.
+    void Record(uint8_t opcode, uint16_t pc, uint64_t cycles) {
+      OpcodeStats& op = opcodes_[opcode];
+      op.count++;
+      op.cycles += cycles;
+      const OpcodeInfo& info = OpcodeInfos()[opcode];
+      uint64_t extra = cycles - info.cycles;
+      if (info.mode == AddressingMode::kRelative) {
+        // A taken branch costs one cycle more, and another if it lands on a different page.
+        // Taken branches can land on the next instruction, so the PC can not tell.
+        op.taken += extra > 0;
+        op.page_crosses += extra > 1;
+      } else if (extra >= kMinDmaCycles) {
+        op.dma_cycles += extra;
+      } else {
+        op.page_crosses += extra > 0;
+      }
+      PcStats& at = pcs_[pc];
+      at.count++;
+      at.cycles += cycles;
+      at.opcode = opcode;
+    }
+
+    const OpcodeStats& Opcode(uint8_t opcode) const { return opcodes_[opcode]; }
+
+    // Adds this profile to its ROM's total. mapper maps PCs to PRG-ROM offsets.
+    void Merge(Mapper* mapper);
+
+  private:
+    friend class ExecProfileTotals;
+
+    // OAM DMA stalls the CPU for 513 or 514 cycles.
+    static constexpr uint64_t kMinDmaCycles = 513;
+
+    struct PcStats {
+      uint64_t count = 0;
+      uint64_t cycles = 0;
+      uint8_t opcode = 0;  // last opcode run here, which only varies for code in RAM
+      int64_t prg_offset = -1;  // filled in by Merge()
+    };
+
+    uint64_t rom_hash_;
+    std::vector<OpcodeStats> opcodes_;
+    std::vector<PcStats> pcs_;
+};
+
+#endif  // EXEC_PROFILE_H_
@@ -0,0 +1,80 @@
+#include "frame_memo.h"
+
+static_assert(Cpu6502::kNumStatePages <= 256, "FrameMemo stores page indices as bytes.");
+
+FrameMemo::FrameMemo(size_t capacity_bytes) {
+  stats_.capacity_bytes = capacity_bytes;
+}
+
+FrameMemo::Key FrameMemo::KeyFor(Cpu6502* cpu, uint8_t buttons0, uint8_t buttons1) {
+  Key key;
+  key.state_hash = cpu->StateHash();
+  key.buttons[0] = buttons0;
+  key.buttons[1] = buttons1;
+  key.rendered = cpu->RenderingEnabled();
+  return key;
+}
+
+bool FrameMemo::Apply(const Key& key, Cpu6502* cpu, uint64_t* frame_hash) {
+  const std::lock_guard<std::mutex> lock(mu_);
+  stats_.lookups++;
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return false;
+  }
+  stats_.hits++;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  const Entry& entry = *it->second;
+  const uint8_t* data = entry.data.data();
+  for (uint8_t page : entry.pages) {
+    cpu->SetStatePage(page, data);
+    data += Cpu6502::StatePageSize(page);
+  }
+  *frame_hash = entry.frame_hash;
+  return true;
+}
+
+void FrameMemo::Insert(const Key& key, Cpu6502* cpu, uint64_t frame_hash) {
+  Entry entry;
+  entry.key = key;
+  entry.frame_hash = frame_hash;
+  Cpu6502::PageSet changed = cpu->ChangedPages();
+  for (size_t w = 0; w < changed.size(); ++w) {
+    for (uint64_t bits = changed[w]; bits != 0; bits &= bits - 1) {
+      size_t page = w * 64 + __builtin_ctzll(bits);
+      entry.pages.push_back(static_cast<uint8_t>(page));
+      const uint8_t* bytes = cpu->StatePage(page);
+      entry.data.insert(entry.data.end(), bytes, bytes + Cpu6502::StatePageSize(page));
+    }
+  }
+  size_t bytes = EntryBytes(entry);
+  if (bytes > stats_.capacity_bytes) {
+    return;
+  }
+
+  const std::lock_guard<std::mutex> lock(mu_);
+  if (index_.count(key) > 0) {
+    return;  // another thread got there first
+  }
+  while (stats_.bytes + bytes > stats_.capacity_bytes) {
+    stats_.bytes -= EntryBytes(lru_.back());
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+    stats_.evicted++;
+  }
+  lru_.push_front(std::move(entry));
+  index_[key] = lru_.begin();
+  stats_.bytes += bytes;
+}
+
+FrameMemo::Stats FrameMemo::GetStats() {
+  const std::lock_guard<std::mutex> lock(mu_);
+  Stats stats = stats_;
+  stats.entries = lru_.size();
+  return stats;
+}
+
+size_t FrameMemo::EntryBytes(const Entry& entry) {
+  // Page data and indices, plus roughly a list node and a hash map node.
+  return entry.data.size() + entry.pages.size() + sizeof(Entry) + 64;
+}
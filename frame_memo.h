@@ -0,0 +1,72 @@
+#ifndef FRAME_MEMO_H_
+#define FRAME_MEMO_H_
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "common.h"
+#include "cpu6502.h"
+
+// Remembers what whole frames did, so replaying many movies that share a prefix (the same
+// boot and opening inputs) emulates each shared frame once. Entries are keyed by the
+// console's StateHash() before the frame and the buttons held during it, and hold the
+// pages the frame wrote, as they were after it, plus the caller's hash of the frame.
+// Safe to share between threads; least recently used entries are evicted past the budget.
+//
+// A hit trusts the 64-bit state hash, and does not draw the frame buffer.
+class FrameMemo {
+  public:
+    struct Key {
+      uint64_t state_hash = 0;
+      uint8_t buttons[2] = {};
+      uint8_t rendered = 0;  // frame hashes differ with rendering off
+
+      bool operator==(const Key& other) const {
+        return state_hash == other.state_hash && buttons[0] == other.buttons[0] &&
+               buttons[1] == other.buttons[1] && rendered == other.rendered;
+      }
+    };
+
+    struct Stats {
+      uint64_t lookups = 0;
+      uint64_t hits = 0;
+      uint64_t entries = 0;
+      uint64_t evicted = 0;
+      uint64_t bytes = 0;
+      uint64_t capacity_bytes = 0;
+    };
+
+    explicit FrameMemo(size_t capacity_bytes);
+
+    // Keys the frame cpu is about to run. Hashing resets cpu's changed pages, so call this
+    // right before Apply() and, on a miss, RunFrame() and Insert().
+    static Key KeyFor(Cpu6502* cpu, uint8_t buttons0, uint8_t buttons1);
+    // On a hit, writes the frame's result into cpu, sets *frame_hash and returns true.
+    bool Apply(const Key& key, Cpu6502* cpu, uint64_t* frame_hash);
+    // Remembers the frame cpu has run since KeyFor().
+    void Insert(const Key& key, Cpu6502* cpu, uint64_t frame_hash);
+
+    Stats GetStats();
+
+  private:
+    struct KeyHash {
+      size_t operator()(const Key& key) const {
+        return key.state_hash ^ (key.buttons[0] | key.buttons[1] << 8 | key.rendered << 16);
+      }
+    };
+    struct Entry {
+      Key key;
+      uint64_t frame_hash;
+      std::vector<uint8_t> pages;  // page indices, in order
+      std::vector<uint8_t> data;   // their contents, back to back
+    };
+    static size_t EntryBytes(const Entry& entry);
+
+    std::mutex mu_;
+    std::list<Entry> lru_;  // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    Stats stats_;
+};
+
+#endif  // FRAME_MEMO_H_
@@ -0,0 +1,178 @@
+#include "frame_telemetry.h"
+
+#include <cstdio>
+
+namespace {
+
+const std::array<const char*, FrameTelemetry::kNumPhases> kPhaseNames = {
+  "emulate", "render", "frame",
+};
+
+// Quantiles exported per phase, over the last interval.
+const std::array<std::pair<const char*, double>, 2> kQuantiles = {{{"0.5", 0.5}, {"0.99", 0.99}}};
+
+double Seconds(uint64_t ns) {
+  return ns / 1e9;
+}
+
+double Ms(uint64_t ns) {
+  return ns / 1e6;
+}
+
+} // namespace
+
+uint64_t DurationHistogram::UpperBound(int bucket) {
+  if (bucket == 0) {
+    return (1ULL << kMinShift) - 1;
+  } else if (bucket == kNumBuckets - 1) {
+    return UINT64_MAX;
+  }
+  int shift = kMinShift + (bucket - 1) / kSubBuckets;
+  uint64_t sub = (bucket - 1) % kSubBuckets;
+  return ((kSubBuckets + sub + 1) << (shift - 2)) - 1;
+}
+
+uint64_t DurationHistogram::PercentileNs(double p) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  // Nearest rank.
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * count_ + 0.999999));
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(UpperBound(i), max_ns_);
+    }
+  }
+  return max_ns_;
+}
+
+uint64_t DurationHistogram::CountAtMost(uint64_t bound_ns) const {
+  uint64_t count = 0;
+  for (int i = 0; i < kNumBuckets && UpperBound(i) < bound_ns; ++i) {
+    count += buckets_[i];
+  }
+  return count;
+}
+
+const char* FrameTelemetry::Name(Phase phase) {
+  return kPhaseNames[phase];
+}
+
+FrameTelemetry::FrameTelemetry() : start_(Clock::now()), last_frame_(start_) {}
+
+FrameTelemetry::~FrameTelemetry() {
+  if (!export_path_.empty() && frames_ != exported_frames_) {
+    try {
+      Export();
+    } catch (const std::exception& e) {
+      fprintf(stderr, "%s\n", e.what());
+    }
+  }
+}
+
+void FrameTelemetry::EndFrame() {
+  Clock::time_point now = Clock::now();
+  Record(kFrame, std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_frame_).count());
+  last_frame_ = now;
+  frames_++;
+  if (!export_path_.empty() && now >= next_export_) {
+    Export();
+  }
+}
+
+void FrameTelemetry::SetExport(const std::string& path, double interval_seconds) {
+  export_path_ = path;
+  export_interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval_seconds));
+  next_export_ = Clock::now() + export_interval_;
+}
+
+void FrameTelemetry::Export() {
+  bool json = export_path_.size() >= 5 && export_path_.compare(export_path_.size() - 5, 5, ".json") == 0;
+  std::string text = json ? Json() : Prometheus();
+  std::string tmp = export_path_ + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "w");
+  bool ok = f != nullptr && fwrite(text.data(), 1, text.size(), f) == text.size();
+  ok = f != nullptr && fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), export_path_.c_str()) != 0) {
+    throw std::runtime_error("Could not write " + export_path_ + ": " + strerror(errno));
+  }
+  for (DurationHistogram& window : window_) {
+    window.Clear();
+  }
+  exported_frames_ = frames_;
+  next_export_ = Clock::now() + export_interval_;
+}
+
+std::string FrameTelemetry::Prometheus() const {
+  std::string out;
+  out += "# HELP nes2x_frames_total Frames run.\n# TYPE nes2x_frames_total counter\n";
+  out += string_format("nes2x_frames_total %llu\n", static_cast<unsigned long long>(frames_));
+  out += "# HELP nes2x_frame_phase_seconds Time per frame spent in each phase of the frame loop.\n"
+         "# TYPE nes2x_frame_phase_seconds histogram\n";
+  for (int p = 0; p < kNumPhases; ++p) {
+    const DurationHistogram& h = total_[p];
+    if (h.Count() == 0) {
+      continue;
+    }
+    for (int shift = DurationHistogram::kMinShift; shift <= DurationHistogram::kMaxShift; ++shift) {
+      out += string_format("nes2x_frame_phase_seconds_bucket{phase=\"%s\",le=\"%.9g\"} %llu\n", kPhaseNames[p],
+                           Seconds(1ULL << shift), static_cast<unsigned long long>(h.CountAtMost(1ULL << shift)));
+    }
+    out += string_format("nes2x_frame_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %llu\n", kPhaseNames[p],
+                         static_cast<unsigned long long>(h.Count()));
+    out += string_format("nes2x_frame_phase_seconds_sum{phase=\"%s\"} %.9f\n", kPhaseNames[p], Seconds(h.SumNs()));
+    out += string_format("nes2x_frame_phase_seconds_count{phase=\"%s\"} %llu\n", kPhaseNames[p],
+                         static_cast<unsigned long long>(h.Count()));
+  }
+  out += "# HELP nes2x_frame_phase_window_seconds Quantiles and maximum of each phase over the last export "
+         "interval.\n# TYPE nes2x_frame_phase_window_seconds gauge\n";
+  for (int p = 0; p < kNumPhases; ++p) {
+    const DurationHistogram& h = window_[p];
+    if (h.Count() == 0) {
+      continue;
+    }
+    for (const auto& q : kQuantiles) {
+      out += string_format("nes2x_frame_phase_window_seconds{phase=\"%s\",quantile=\"%s\"} %.9f\n", kPhaseNames[p],
+                           q.first, Seconds(h.PercentileNs(q.second)));
+    }
+    out += string_format("nes2x_frame_phase_window_seconds{phase=\"%s\",quantile=\"1\"} %.9f\n", kPhaseNames[p],
+                         Seconds(h.MaxNs()));
+  }
+  return out;
+}
+
+std::string FrameTelemetry::Json() const {
+  auto stats = [](const DurationHistogram& h) {
+    return string_format("{\"count\": %llu, \"sum_ms\": %.3f, \"p50_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}",
+                         static_cast<unsigned long long>(h.Count()), Ms(h.SumNs()), Ms(h.PercentileNs(0.5)),
+                         Ms(h.PercentileNs(0.99)), Ms(h.MaxNs()));
+  };
+  std::string out = string_format("{\n  \"frames\": %llu,\n  \"uptime_s\": %.3f,\n  \"phases\": {",
+      static_cast<unsigned long long>(frames_), std::chrono::duration<double>(Clock::now() - start_).count());
+  bool first = true;
+  for (int p = 0; p < kNumPhases; ++p) {
+    if (total_[p].Count() == 0) {
+      continue;
+    }
+    out += string_format("%s\n    \"%s\": {\"total\": %s, \"window\": %s}", first ? "" : ",", kPhaseNames[p],
+                         stats(total_[p]).c_str(), stats(window_[p]).c_str());
+    first = false;
+  }
+  return out + (first ? "}\n}\n" : "\n  }\n}\n");
+}
+
+std::vector<std::string> FrameTelemetry::Describe() const {
+  std::vector<std::string> lines;
+  for (int p = 0; p < kNumPhases; ++p) {
+    const DurationHistogram& h = total_[p];
+    if (h.Count() == 0) {
+      continue;
+    }
+    lines.push_back(string_format("telemetry %-7s count=%llu p50=%.1fus p99=%.1fus max=%.1fus", kPhaseNames[p],
+        static_cast<unsigned long long>(h.Count()), h.PercentileNs(0.5) / 1e3, h.PercentileNs(0.99) / 1e3,
+        h.MaxNs() / 1e3));
+  }
+  return lines;
+}
@@ -0,0 +1,111 @@
+#ifndef FRAME_TELEMETRY_H_
+#define FRAME_TELEMETRY_H_
+
+#include <algorithm>
+#include <array>
+
+#include "common.h"
+
+// Histogram of durations in fixed log-spaced buckets, 4 per power of two from 1us to about
+// 4s, so recording is a few instructions with no allocation. Percentiles are the upper
+// bound of the bucket they fall in (at most 25% high), capped at the exact maximum.
+class DurationHistogram {
+  public:
+    static constexpr int kMinShift = 10;  // the first bucket holds everything under 1024ns
+    static constexpr int kMaxShift = 32;
+    static constexpr int kSubBuckets = 4;
+    static constexpr int kNumBuckets = 1 + (kMaxShift - kMinShift) * kSubBuckets + 1;
+
+    void Record(uint64_t ns) {
+      buckets_[Bucket(ns)]++;
+      count_++;
+      sum_ns_ += ns;
+      max_ns_ = std::max(max_ns_, ns);
+    }
+    void Clear() { *this = DurationHistogram(); }
+
+    uint64_t Count() const { return count_; }
+    uint64_t SumNs() const { return sum_ns_; }
+    uint64_t MaxNs() const { return max_ns_; }
+    // p in (0, 1]. 0 if nothing was recorded.
+    uint64_t PercentileNs(double p) const;
+    // Recorded durations below bound_ns, which should be a power of two, as for a Prometheus
+    // "le" bucket.
+    uint64_t CountAtMost(uint64_t bound_ns) const;
+
+  private:
+    static int Bucket(uint64_t ns) {
+      if (ns < (1ULL << kMinShift)) {
+        return 0;
+      }
+      int shift = 63 - __builtin_clzll(ns);
+      if (shift >= kMaxShift) {
+        return kNumBuckets - 1;
+      }
+      int sub = static_cast<int>(ns >> (shift - 2)) & (kSubBuckets - 1);
+      return 1 + (shift - kMinShift) * kSubBuckets + sub;
+    }
+    // The largest duration bucket holds.
+    static uint64_t UpperBound(int bucket);
+
+    std::array<uint64_t, kNumBuckets> buckets_ = {};
+    uint64_t count_ = 0;
+    uint64_t sum_ns_ = 0;
+    uint64_t max_ns_ = 0;
+};
+
+// Per-frame timings of each phase of a frontend's frame loop, for tracking tail latency
+// rather than average fps. Each phase keeps a histogram since the start and one for the
+// current export interval, which gives p50, p99 and max.
+//
+// With SetExport(), EndFrame() rewrites a metrics file every interval: Prometheus text
+// (for node_exporter's textfile collector) or, for a .json path, JSON. The file is
+// replaced by a rename, so readers never see half of it. Only exporting allocates.
+class FrameTelemetry {
+  public:
+    enum Phase {
+      kEmulate,  // running the CPU, minus PPU updates where the runner can split them out
+      kRender,   // PPU updates: drawing scanlines, which converts palette indices to RGB
+      kFrame,    // one whole frame, from EndFrame() to EndFrame()
+      kNumPhases,
+    };
+    static const char* Name(Phase phase);
+
+    FrameTelemetry();
+
+    void Record(Phase phase, uint64_t ns) {
+      total_[phase].Record(ns);
+      window_[phase].Record(ns);
+    }
+    // Records the time since the last EndFrame() as kFrame, and exports if it is due.
+    void EndFrame();
+
+    // Writes to path every interval_seconds of host time, and when destroyed if frames have
+    // run since the last write.
+    void SetExport(const std::string& path, double interval_seconds);
+    // Writes the file now. Throws if it can not.
+    void Export();
+
+    uint64_t Frames() const { return frames_; }
+    const DurationHistogram& Total(Phase phase) const { return total_[phase]; }
+    // One line per phase with any samples: count, p50, p99 and max since the start.
+    std::vector<std::string> Describe() const;
+
+    ~FrameTelemetry();
+
+  private:
+    std::string Prometheus() const;
+    std::string Json() const;
+
+    std::array<DurationHistogram, kNumPhases> total_;
+    std::array<DurationHistogram, kNumPhases> window_;  // since the last export
+    Clock::time_point start_;
+    Clock::time_point last_frame_;
+    uint64_t frames_ = 0;
+    uint64_t exported_frames_ = 0;
+    std::string export_path_;
+    Clock::duration export_interval_ = {};
+    Clock::time_point next_export_;
+};
+
+#endif  // FRAME_TELEMETRY_H_
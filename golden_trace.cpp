@@ -0,0 +1,212 @@
+#include "golden_trace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace {
+
+// Columns of a nestest.log line. The PPU column, when there is one, follows SP and
+// the cycle count runs to the end of the line.
+constexpr size_t kRegistersEnd = 73;
+constexpr size_t kPpuEnd = kRegistersEnd + 12;  // " PPU:%3d,%3d"
+
+struct Field {
+  const char* name;
+  size_t begin;
+  size_t end;
+};
+
+std::vector<Field> Fields(size_t length, bool has_ppu) {
+  std::vector<Field> fields = {
+    {"PC", 0, 4}, {"OPCODE", 6, 8}, {"OPERANDS", 9, 14}, {"INSTRUCTION", 15, 48}, {"A", 48, 52},
+    {"X", 53, 57}, {"Y", 58, 62}, {"P", 63, 67}, {"SP", 68, 73},
+  };
+  if (has_ppu) {
+    fields.push_back({"PPU", kRegistersEnd + 1, kPpuEnd});
+  }
+  fields.push_back({"CYC", (has_ppu ? kPpuEnd : kRegistersEnd) + 1, std::max(length, kPpuEnd + 1)});
+  return fields;
+}
+
+std::string Column(const std::string& line, const Field& field) {
+  return field.begin < line.size() ? line.substr(field.begin, field.end - field.begin) : "";
+}
+
+// line with the fields in differs wrapped in red.
+std::string Highlight(const std::string& line, const std::vector<Field>& fields,
+                      const std::vector<bool>& differs) {
+  std::string out;
+  size_t pos = 0;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (!differs[i] || fields[i].begin >= line.size()) {
+      continue;
+    }
+    size_t end = std::min(fields[i].end, line.size());
+    out += line.substr(pos, fields[i].begin - pos) + "\033[31m" + line.substr(fields[i].begin, end - fields[i].begin) +
+        "\033[0m";
+    pos = end;
+  }
+  return out + line.substr(std::min(pos, line.size()));
+}
+
+} // namespace
+
+GoldenTrace::GoldenTrace(const std::string& path, bool compare_ppu, size_t context)
+    : path_(path), compare_ppu_(compare_ppu), context_(context), buffer_(1 << 14, TraceBuffer::Mode::kStream) {
+  int fd = open(path.c_str(), O_RDONLY);
+  struct stat st = {};
+  if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mem != MAP_FAILED) {
+      // Read once, front to back.
+      madvise(mem, st.st_size, MADV_SEQUENTIAL);
+      mapping_ = mem;
+      size_ = st.st_size;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (mapping_ == nullptr) {
+    throw std::runtime_error("Could not read golden log " + path);
+  }
+  next_ = static_cast<const char*>(mapping_);
+  end_ = next_ + size_;
+  ScanLine();
+  if (Done() || next_length_ < kRegistersEnd) {
+    throw std::runtime_error(path + " is not a nestest.log-format trace.");
+  }
+  start_pc_ = std::stoul(std::string(next_, 4), nullptr, 16);
+  checker_ = std::thread(&GoldenTrace::CheckerLoop, this);
+}
+
+GoldenTrace::~GoldenTrace() {
+  Stop();
+  munmap(mapping_, size_);
+}
+
+bool GoldenTrace::Stop() {
+  if (checker_.joinable()) {
+    stop_ = true;
+    checker_.join();
+  }
+  return !diverged_ && Done();
+}
+
+void GoldenTrace::CheckerLoop() {
+  std::vector<TraceRecord> batch(4096);
+  while (true) {
+    // Check before reading so records committed before Stop() are never left behind.
+    bool stopping = stop_;
+    size_t count = buffer_.Read(batch.data(), batch.size());
+    for (size_t i = 0; i < count && !Finished(); ++i) {
+      if (!Check(batch[i])) {
+        diverged_ = true;
+        actual_ = batch[i];
+        finished_ = true;
+      } else if (Done()) {
+        finished_ = true;
+      }
+    }
+    // Once finished, keep draining so the CPU never waits on a full buffer.
+    if (count == 0 && stopping) {
+      return;
+    } else if (count == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+  }
+}
+
+bool GoldenTrace::Check(const TraceRecord& record) {
+  if (Done()) {
+    return false;
+  }
+  size_t length = FormatNestestTo(record, next_has_ppu_, line_);
+  if (length != next_length_) {
+    return false;
+  } else if (next_has_ppu_ && !compare_ppu_) {
+    if (memcmp(line_, next_, kRegistersEnd) != 0 ||
+        memcmp(line_ + kPpuEnd, next_ + kPpuEnd, length - kPpuEnd) != 0) {
+      return false;
+    }
+  } else if (memcmp(line_, next_, length) != 0) {
+    return false;
+  }
+  if (!context_.empty()) {
+    context_[matched_ % context_.size()] = record;
+  }
+  matched_++;
+  next_ += next_length_;
+  ScanLine();
+  return true;
+}
+
+void GoldenTrace::ScanLine() {
+  // Skip the line break ending the previous line, and any blank lines.
+  while (next_ < end_ && (*next_ == '\n' || *next_ == '\r')) {
+    next_++;
+  }
+  const char* newline = static_cast<const char*>(memchr(next_, '\n', end_ - next_));
+  next_length_ = (newline == nullptr ? end_ : newline) - next_;
+  if (next_length_ > 0 && next_[next_length_ - 1] == '\r') {
+    next_length_--;
+  }
+  next_has_ppu_ = next_length_ > kPpuEnd && memcmp(next_ + kRegistersEnd, " PPU:", 5) == 0;
+}
+
+std::string GoldenTrace::Describe(bool color) const {
+  std::string out = string_format("Diverged from %s at instruction %llu:\n", path_.c_str(),
+      static_cast<unsigned long long>(matched_ + 1));
+  for (uint64_t i = matched_ - std::min<uint64_t>(matched_, context_.size()); i < matched_; ++i) {
+    out += "       " + FormatNestest(context_[i % context_.size()], next_has_ppu_) + "\n";
+  }
+  if (Done()) {
+    return out + "  want (end of log)\n";
+  }
+
+  std::string want(next_, next_length_);
+  if (!diverged_) {
+    return out + "  want " + want + "\n";
+  }
+  std::string got = FormatNestest(actual_, next_has_ppu_);
+  std::vector<Field> fields = Fields(std::max(want.size(), got.size()), next_has_ppu_);
+  std::vector<bool> differs(fields.size());
+  std::string marks(std::max(want.size(), got.size()), ' ');
+  std::string names;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    differs[i] = (compare_ppu_ || strcmp(fields[i].name, "PPU") != 0) &&
+        Column(want, fields[i]) != Column(got, fields[i]);
+    if (differs[i] && fields[i].begin < marks.size()) {
+      marks.replace(fields[i].begin, std::min(fields[i].end, marks.size()) - fields[i].begin,
+          std::min(fields[i].end, marks.size()) - fields[i].begin, '^');
+      names += std::string(names.empty() ? "" : " ") + fields[i].name;
+    }
+  }
+  out += "  want " + (color ? Highlight(want, fields, differs) : want) + "\n";
+  out += "  got  " + (color ? Highlight(got, fields, differs) : got) + "\n";
+  out += "       " + marks.substr(0, marks.find_last_not_of(' ') + 1) + "\n";
+  out += "  differs: " + names + "\n";
+
+  // What the log expected to happen next.
+  const char* line = next_ + next_length_;
+  for (int i = 0; i < 3 && line < end_; ++i) {
+    while (line < end_ && (*line == '\n' || *line == '\r')) {
+      line++;
+    }
+    const char* newline = static_cast<const char*>(memchr(line, '\n', end_ - line));
+    const char* line_end = newline == nullptr ? end_ : newline;
+    std::string text(line, line_end - line);
+    if (!text.empty() && text.back() == '\r') {
+      text.pop_back();
+    }
+    if (!text.empty()) {
+      out += "  then " + text + "\n";
+    }
+    line = line_end;
+  }
+  return out;
+}
@@ -0,0 +1,75 @@
+#ifndef GOLDEN_TRACE_H_
+#define GOLDEN_TRACE_H_
+
+#include <atomic>
+#include <thread>
+
+#include "common.h"
+#include "trace.h"
+
+// A known-good trace in the nestest.log format, such as test/nestest_golden.log, checked
+// against a run as it executes. The log is memory-mapped and read in place, so nothing
+// waits for a whole trace to be written and diffed.
+//
+// The CPU records into Buffer() and a background thread formats each record with
+// FormatNestestTo() and compares it with the next line as text, so the emulation thread
+// only pays for tracing. The PPU column is compared only if the line has one and
+// compare_ppu is set.
+class GoldenTrace {
+  public:
+    // context is how many matching instructions Describe() shows before a divergence.
+    GoldenTrace(const std::string& path, bool compare_ppu, size_t context);
+    // Calls Stop().
+    ~GoldenTrace();
+    GoldenTrace(const GoldenTrace&) = delete;
+    GoldenTrace& operator=(const GoldenTrace&) = delete;
+
+    // Where the log starts, e.g. $C000 for nestest's automation mode.
+    uint16_t StartPc() const { return start_pc_; }
+    TraceBuffer* Buffer() { return &buffer_; }
+    // True once the checker has matched the whole log or found a divergence, so the run
+    // can stop. The CPU may have run a little past that point.
+    bool Finished() const { return finished_.load(std::memory_order_relaxed); }
+    // Waits for the checker to compare every committed record. Returns true if the whole
+    // log matched.
+    bool Stop();
+    // Lines matched so far.
+    uint64_t Matched() const { return matched_; }
+
+    // After Stop() returns false: the matching instructions before the first that differs,
+    // the expected and actual lines with the differing fields marked (in red too, if color)
+    // and the lines the log expected next. If the run ended early instead, e.g. because an
+    // instruction threw, only the expected line.
+    std::string Describe(bool color) const;
+
+  private:
+    void CheckerLoop();
+    // Compares the record with the next line and moves past it if they match.
+    bool Check(const TraceRecord& record);
+    // Moves next_ past any line breaks and finds the length and columns of the line there.
+    void ScanLine();
+    bool Done() const { return next_ == end_; }
+
+    std::string path_;
+    bool compare_ppu_;
+    void* mapping_ = nullptr;
+    size_t size_ = 0;
+    const char* next_ = nullptr;  // start of the line to compare next
+    const char* end_ = nullptr;
+    size_t next_length_ = 0;  // without the line break
+    bool next_has_ppu_ = false;
+    uint16_t start_pc_ = 0;
+    uint64_t matched_ = 0;
+    char line_[kMaxNestestLine];
+
+    std::vector<TraceRecord> context_;  // ring of the last matched records
+    bool diverged_ = false;
+    TraceRecord actual_ = {};  // the first record that differed
+
+    TraceBuffer buffer_;
+    std::atomic<bool> finished_{false};
+    std::atomic<bool> stop_{false};
+    std::thread checker_;
+};
+
+#endif  // GOLDEN_TRACE_H_
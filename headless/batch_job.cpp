@@ -0,0 +1,40 @@
+#include "headless/runner.h"
+
+#include "batch_cpu6502.h"
+
+namespace headless {
+
+JobResult RunBatchJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts) {
+  JobResult result;
+  try {
+    BatchCpu6502 batch(carts->Get(rom_path), opts.batch);
+    batch.SetRenderingEnabled(opts.render);
+    auto start_time = Clock::now();
+    for (uint64_t i = 0; i < opts.frames; ++i) {
+      for (int l = 0; opts.has_input_seed && l < batch.NumLanes(); ++l) {
+        batch.SetButtons(l, 0, InputFor(opts.input_seed + l, batch.FrameCount(l)));
+      }
+      batch.RunFrame();
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    uint8_t ram[0x800];
+    for (int l = 0; l < batch.NumLanes(); ++l) {
+      batch.CopyRam(l, ram);
+      Image* frame = batch.FrameBuffer(l);
+      result.lanes.push_back({Fnv1a64(ram, sizeof(ram)),
+                              Fnv1a64(frame->Data(), frame->Rows() * frame->RowWidth())});
+      result.frames += opts.frames;
+      result.cycles += batch.Cycle(l);
+    }
+    result.ram_hash = result.lanes[0].ram_hash;
+    result.frame_hash = result.lanes[0].frame_hash;
+    result.group_width = static_cast<double>(batch.NumLaneSteps()) / batch.NumGroupSteps();
+    result.ok = true;
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  return result;
+}
+
+} // namespace headless
@@ -0,0 +1,54 @@
+#include "headless/runner.h"
+
+#include "cpu6502.h"
+#include "job_pool.h"
+
+namespace headless {
+
+JobResult ReplayMovieJob(const std::string& rom_path, const std::string& movie_path,
+                         const Options& opts, CartridgeCache* carts, FrameMemo* memo) {
+  JobResult result;
+  try {
+    std::shared_ptr<const Cartridge> cartridge = carts->Get(rom_path);
+    Movie movie = Movie::FromFile(movie_path);
+    Cpu6502 cpu(cartridge);
+    movie.Start(*cartridge, &cpu);
+    uint64_t start_frame = cpu.FrameCount();
+    uint64_t start_cycle = cpu.Cycle();
+    auto start_time = Clock::now();
+    Movie::Divergence divergence;
+    if (opts.replay_movies.size() == 1) {
+      // The job pool running this job has no other work, so segments get a pool of their own.
+      JobPool pool(opts.jobs, opts.pin);
+      divergence = movie.ReplaySegments(cartridge, &cpu, &pool, memo);
+    } else {
+      divergence = movie.Replay(*cartridge, &cpu, memo);
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    if (divergence.diverged) {
+      throw std::runtime_error(string_format(
+          "Diverged from movie at frame %llu (console frame %llu): %s %016llx, expected %016llx.",
+          static_cast<unsigned long long>(divergence.frame),
+          static_cast<unsigned long long>(divergence.console_frame),
+          divergence.at_checkpoint ? "checkpoint" : "state",
+          static_cast<unsigned long long>(divergence.actual),
+          static_cast<unsigned long long>(divergence.expected)));
+    }
+    result.frames = cpu.FrameCount() - start_frame;
+    result.cycles = cpu.Cycle() - start_cycle;
+    result.ram_hash = Fnv1a64(cpu.Ram(), 0x800);
+    // Memo hits don't draw, so the frame buffer may be behind the state.
+    result.frame_stale = divergence.memo_hits > 0;
+    if (!result.frame_stale) {
+      Image* frame = cpu.FrameBuffer();
+      result.frame_hash = Fnv1a64(frame->Data(), frame->Rows() * frame->RowWidth());
+    }
+    result.movie_checkpoints = movie.NumCheckpoints();
+    result.ok = true;
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  return result;
+}
+
+} // namespace headless
@@ -0,0 +1,59 @@
+#include "headless/runner.h"
+
+#include "cpu6502.h"
+
+namespace headless {
+
+JobResult NetplayJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts) {
+  // Frames each player holds their buttons for.
+  const uint64_t kHoldFrames = 12;
+  JobResult result;
+  try {
+    std::shared_ptr<const Cartridge> cartridge = carts->Get(rom_path);
+    std::unique_ptr<NetTransport> transport = NetTransport::Open(opts.netplay);
+    if (opts.latency_ms > 0 || opts.jitter_ms > 0) {
+      transport = std::make_unique<LaggyTransport>(std::move(transport), opts.latency_ms, opts.jitter_ms);
+    }
+    RollbackSession session(cartridge, opts.player - 1, transport.get(), opts.rollback);
+    Cpu6502* cpu = session.Console();
+    cpu->SetRenderingEnabled(opts.render);
+
+    // NTSC runs at 60.0988 frames per second.
+    const auto kFramePeriod = std::chrono::nanoseconds(static_cast<int64_t>(1e9 / 60.0988));
+    auto start_time = Clock::now();
+    auto next_frame = start_time;
+    for (uint64_t i = 0; i < opts.frames; ++i) {
+      session.AdvanceFrame(InputFor(opts.input_seed + opts.player, i / kHoldFrames));
+      next_frame += kFramePeriod;
+      session.WaitUntil(next_frame);
+    }
+    session.Finish(std::chrono::milliseconds(static_cast<int64_t>(2 * (opts.latency_ms + opts.jitter_ms) + 100)));
+    result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    // Both peers must have ended exactly where a plain run of the same inputs ends.
+    std::vector<uint8_t> inputs = session.ConfirmedInputs();
+    Cpu6502 reference(cartridge);
+    reference.SetRenderingEnabled(false);
+    for (size_t f = 0; f < inputs.size() / 2; ++f) {
+      reference.SetButtons(0, inputs[f * 2]);
+      reference.SetButtons(1, inputs[f * 2 + 1]);
+      reference.RunFrame();
+    }
+    if (reference.StateHash() != cpu->StateHash()) {
+      throw std::runtime_error("Netplay ended in a different state than a plain run of its inputs.");
+    }
+
+    result.frames = cpu->FrameCount();
+    result.cycles = cpu->Cycle();
+    Image* frame = cpu->FrameBuffer();
+    result.ram_hash = Fnv1a64(cpu->Ram(), 0x800);
+    result.frame_hash = Fnv1a64(frame->Data(), frame->Rows() * frame->RowWidth());
+    result.netplay = session.GetStats();
+    result.ok = true;
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  return result;
+}
+
+} // namespace headless
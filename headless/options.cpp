@@ -0,0 +1,192 @@
+#include "headless/runner.h"
+
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+void PrintUsage() {
+  std::cerr << "Usage: nes2x_headless [--frames N | --cycles N] [--jobs N] [--pin] "
+               "[--batch LANES] [--no-render] [--input-seed S] [--rewind MB] "
+               "[--run-ahead N [--second-instance]] [--snapshot-store] "
+               "[--boot-cache DIR [--boot-at N|poll]] "
+               "[--record-movie FILE [--checkpoint-every N] | --replay-movie FILE... [--memo MB]] "
+               "[--netplay udp:PORT:PORT|unix:PATH:PATH [--player 1|2] [--latency MS] [--jitter MS] "
+               "[--rollback N]] [--trace FILE | --flight-recorder N] "
+               "[--sample-profile FILE [--sample-every N] [--labels FILE]] [--perf-counters] "
+               "[--telemetry FILE [--telemetry-every S]] [--timeline FILE [--timeline-events N]] "
+               "[--manifest FILE] rom.nes..."
+            << std::endl;
+}
+
+void ReadManifest(const std::string& path, std::vector<std::string>* roms) {
+  std::ifstream input(path);
+  if (!input) {
+    throw std::runtime_error("Could not open manifest " + path);
+  }
+  std::string line;
+  while (std::getline(input, line)) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#') {
+      continue;
+    }
+    size_t end = line.find_last_not_of(" \t\r");
+    roms->push_back(line.substr(start, end - start + 1));
+  }
+}
+
+} // namespace
+
+namespace headless {
+
+Options ParseOptions(int argc, char* argv[]) {
+  Options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--frames" && has_value) {
+      opts.frames = std::stoull(argv[++i]);
+    } else if (arg == "--cycles" && has_value) {
+      opts.cycles = std::stoull(argv[++i]);
+    } else if (arg == "--jobs" && has_value) {
+      opts.jobs = std::stoi(argv[++i]);
+    } else if (arg == "--pin") {
+      opts.pin = true;
+    } else if (arg == "--batch" && has_value) {
+      opts.batch = std::stoi(argv[++i]);
+    } else if (arg == "--no-render") {
+      opts.render = false;
+    } else if (arg == "--input-seed" && has_value) {
+      opts.has_input_seed = true;
+      opts.input_seed = std::stoull(argv[++i]);
+    } else if (arg == "--rewind" && has_value) {
+      opts.rewind_bytes = std::stod(argv[++i]) * 1024 * 1024;
+    } else if (arg == "--run-ahead" && has_value) {
+      opts.run_ahead = std::stoi(argv[++i]);
+    } else if (arg == "--second-instance") {
+      opts.second_instance = true;
+    } else if (arg == "--snapshot-store") {
+      opts.snapshot_store = true;
+    } else if (arg == "--boot-cache" && has_value) {
+      opts.boot_cache_dir = argv[++i];
+    } else if (arg == "--boot-at" && has_value) {
+      std::string point = argv[++i];
+      opts.boot_point.at_first_poll = point == "poll";
+      if (!opts.boot_point.at_first_poll) {
+        opts.boot_point.frames = std::stoull(point);
+      }
+    } else if (arg == "--record-movie" && has_value) {
+      opts.record_movie = argv[++i];
+    } else if (arg == "--checkpoint-every" && has_value) {
+      opts.checkpoint_interval = std::stoul(argv[++i]);
+    } else if (arg == "--replay-movie" && has_value) {
+      opts.replay_movies.push_back(argv[++i]);
+    } else if (arg == "--memo" && has_value) {
+      opts.memo_bytes = std::stod(argv[++i]) * 1024 * 1024;
+    } else if (arg == "--netplay" && has_value) {
+      opts.netplay = argv[++i];
+    } else if (arg == "--player" && has_value) {
+      opts.player = std::stoi(argv[++i]);
+    } else if (arg == "--latency" && has_value) {
+      opts.latency_ms = std::stod(argv[++i]);
+    } else if (arg == "--jitter" && has_value) {
+      opts.jitter_ms = std::stod(argv[++i]);
+    } else if (arg == "--rollback" && has_value) {
+      opts.rollback = std::stoi(argv[++i]);
+    } else if (arg == "--trace" && has_value) {
+      opts.trace = argv[++i];
+    } else if (arg == "--flight-recorder" && has_value) {
+      opts.flight_recorder = std::stoull(argv[++i]);
+    } else if (arg == "--sample-profile" && has_value) {
+      opts.sample_profile = argv[++i];
+    } else if (arg == "--sample-every" && has_value) {
+      opts.sample_period = std::stoull(argv[++i]);
+    } else if (arg == "--labels" && has_value) {
+      opts.labels = ReadLabels(argv[++i]);
+    } else if (arg == "--perf-counters") {
+      opts.perf_counters = true;
+    } else if (arg == "--telemetry" && has_value) {
+      opts.telemetry = argv[++i];
+    } else if (arg == "--telemetry-every" && has_value) {
+      opts.telemetry_seconds = std::stod(argv[++i]);
+    } else if (arg == "--timeline" && has_value) {
+      opts.timeline = argv[++i];
+    } else if (arg == "--timeline-events" && has_value) {
+      opts.timeline_events = std::stoull(argv[++i]);
+    } else if (arg == "--manifest" && has_value) {
+      ReadManifest(argv[++i], &opts.roms);
+    } else if (arg.rfind("--", 0) == 0) {
+      PrintUsage();
+      throw std::runtime_error("Unknown or incomplete flag " + arg);
+    } else {
+      opts.roms.push_back(arg);
+    }
+  }
+  if (opts.roms.empty()) {
+    PrintUsage();
+    throw std::runtime_error("No ROMs given.");
+  }
+  if (opts.batch > 0 && opts.cycles > 0) {
+    throw std::runtime_error("--batch runs whole frames; --cycles is not supported.");
+  }
+  if (opts.rewind_bytes > 0 && (opts.batch > 0 || opts.cycles > 0)) {
+    throw std::runtime_error("--rewind needs a plain run of whole frames.");
+  }
+  if (opts.run_ahead >= 0 && (opts.batch > 0 || opts.cycles > 0 || opts.rewind_bytes > 0)) {
+    throw std::runtime_error("--run-ahead needs a plain run of whole frames.");
+  }
+  if (opts.snapshot_store && (opts.batch > 0 || opts.cycles > 0 || opts.rewind_bytes > 0 ||
+                              opts.run_ahead >= 0)) {
+    throw std::runtime_error("--snapshot-store needs a plain run of whole frames.");
+  }
+  if (!opts.boot_cache_dir.empty() && (opts.batch > 0 || opts.run_ahead >= 0)) {
+    throw std::runtime_error("--boot-cache needs a plain run.");
+  }
+  bool movie = !opts.record_movie.empty() || !opts.replay_movies.empty();
+  if (movie && (opts.roms.size() != 1 || opts.batch > 0 || opts.cycles > 0 || opts.run_ahead >= 0)) {
+    throw std::runtime_error("Movies need a plain run of whole frames on one ROM.");
+  }
+  if (!opts.replay_movies.empty() && (!opts.record_movie.empty() || opts.has_input_seed ||
+                                     !opts.boot_cache_dir.empty() || opts.rewind_bytes > 0 ||
+                                     opts.snapshot_store)) {
+    throw std::runtime_error("--replay-movie takes its start state and input from the movie.");
+  }
+  if (opts.memo_bytes > 0 && opts.replay_movies.empty()) {
+    throw std::runtime_error("--memo only applies to --replay-movie.");
+  }
+  if (!opts.netplay.empty() && (opts.roms.size() != 1 || opts.batch > 0 || opts.cycles > 0 ||
+                                opts.run_ahead >= 0 || opts.rewind_bytes > 0 || opts.snapshot_store ||
+                                !opts.boot_cache_dir.empty() || movie)) {
+    throw std::runtime_error("--netplay needs a plain run of whole frames on one ROM.");
+  }
+  bool tracing = !opts.trace.empty() || opts.flight_recorder > 0;
+  if (tracing && (opts.batch > 0 || opts.run_ahead >= 0 || !opts.netplay.empty() ||
+                  !opts.replay_movies.empty())) {
+    throw std::runtime_error("--trace and --flight-recorder need a plain run.");
+  }
+  if (!opts.trace.empty() && (opts.roms.size() != 1 || opts.flight_recorder > 0)) {
+    throw std::runtime_error("--trace takes a single ROM and already keeps every instruction.");
+  }
+  if (!opts.sample_profile.empty() && (opts.batch > 0 || opts.run_ahead >= 0 || !opts.netplay.empty() ||
+                                       !opts.replay_movies.empty())) {
+    throw std::runtime_error("--sample-profile needs a plain run.");
+  }
+  if (opts.perf_counters && (opts.batch > 0 || opts.run_ahead >= 0 || !opts.netplay.empty() ||
+                             !opts.replay_movies.empty())) {
+    throw std::runtime_error("--perf-counters needs a plain run.");
+  }
+  if (!opts.telemetry.empty() && (opts.roms.size() != 1 || opts.batch > 0 || opts.cycles > 0 ||
+                                  opts.run_ahead >= 0 || !opts.netplay.empty() || !opts.replay_movies.empty())) {
+    throw std::runtime_error("--telemetry needs a plain run of whole frames on one ROM.");
+  }
+  if (!opts.timeline.empty() && (opts.roms.size() != 1 || opts.batch > 0 || opts.run_ahead >= 0 ||
+                                 !opts.netplay.empty() || !opts.replay_movies.empty())) {
+    throw std::runtime_error("--timeline needs a plain run on one ROM.");
+  }
+  if (opts.player != 1 && opts.player != 2) {
+    throw std::runtime_error("--player must be 1 or 2.");
+  }
+  return opts;
+}
+
+} // namespace headless
@@ -0,0 +1,222 @@
+#include "headless/runner.h"
+
+#include "cpu6502.h"
+#include "frame_telemetry.h"
+#include "perf_counters.h"
+#include "timeline.h"
+#include "trace.h"
+
+namespace {
+
+// Instructions of a flight recording printed when a job fails.
+const size_t kFlightTailLines = 16;
+
+// Rewinds as far back as the buffer goes, loading each state and checking its RAM against
+// ram_hashes, which is indexed by frame count. Returns the number of frames rewound.
+uint64_t RewindAndVerify(Cpu6502* cpu, RewindBuffer* rewind, const std::vector<uint64_t>& ram_hashes) {
+  auto state = std::make_unique<ConsoleState>();
+  uint64_t rewound = 0;
+  while (rewind->Rewind(state.get())) {
+    cpu->LoadState(*state);
+    uint64_t frame = cpu->FrameCount();
+    if (frame >= ram_hashes.size() || Fnv1a64(cpu->Ram(), 0x800) != ram_hashes[frame]) {
+      throw std::runtime_error(string_format("Rewind to frame %llu does not match.",
+          static_cast<unsigned long long>(frame)));
+    }
+    rewound++;
+  }
+  return rewound;
+}
+
+// Writes the last instructions before a failure to the working directory and keeps the final
+// few as text for the report.
+void DumpFlightRecording(const std::string& rom_path, const TraceBuffer& flight, size_t count,
+                         headless::JobResult* result) {
+  std::vector<TraceRecord> records = flight.Last(count);
+  result->trace_records = records.size();
+  std::string path = headless::BaseName(rom_path) + ".flight.trace";
+  try {
+    WriteTraceFile(path, records);
+    result->flight_trace = path;
+  } catch (const std::exception& e) {
+    result->error += string_format(" (%s)", e.what());
+  }
+  size_t first = records.size() - std::min(records.size(), kFlightTailLines);
+  for (size_t i = first; i < records.size(); ++i) {
+    result->flight_tail.push_back(FormatNestest(records[i]));
+  }
+}
+
+} // namespace
+
+namespace headless {
+
+JobResult RunJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts,
+                 SnapshotStore* store) {
+  if (opts.batch > 0) {
+    return RunBatchJob(rom_path, opts, carts);
+  } else if (opts.run_ahead >= 0) {
+    return RunAheadJob(rom_path, opts, carts);
+  } else if (!opts.netplay.empty()) {
+    return NetplayJob(rom_path, opts, carts);
+  }
+  JobResult result;
+  // Outlive the console so the flight recording can be dumped after it throws.
+  std::unique_ptr<TraceWriter> trace;
+  std::unique_ptr<TraceBuffer> flight;
+  try {
+    std::shared_ptr<const Cartridge> cartridge = carts->Get(rom_path);
+    Cpu6502 cpu(cartridge);
+    cpu.SetRenderingEnabled(opts.render);
+    if (!opts.boot_cache_dir.empty()) {
+      auto boot_start = Clock::now();
+      result.boot_hit = BootCache(opts.boot_cache_dir, opts.boot_point).Boot(*cartridge, &cpu);
+      result.boot_seconds = std::chrono::duration<double>(Clock::now() - boot_start).count();
+      result.boot_frame = cpu.FrameCount();
+    }
+    if (!opts.trace.empty()) {
+      trace = std::make_unique<TraceWriter>(opts.trace);
+      cpu.SetTrace(trace->Buffer());
+    } else if (opts.flight_recorder > 0) {
+      flight = std::make_unique<TraceBuffer>(opts.flight_recorder, TraceBuffer::Mode::kFlightRecorder);
+      cpu.SetTrace(flight.get());
+    }
+    std::unique_ptr<StackSampler> sampler;
+    if (!opts.sample_profile.empty()) {
+      sampler = std::make_unique<StackSampler>(opts.sample_period, &opts.labels);
+      cpu.SetSampler(sampler.get());
+    }
+    // Opened on this job's thread, which they count. Telemetry only needs the phase timings.
+    std::unique_ptr<PerfCounters> counters;
+    std::unique_ptr<PhaseCounters> phases;
+    std::unique_ptr<FrameTelemetry> telemetry;
+    if (opts.perf_counters || !opts.telemetry.empty()) {
+      counters = std::make_unique<PerfCounters>(opts.perf_counters);
+      phases = std::make_unique<PhaseCounters>(counters.get());
+      cpu.SetPhaseCounters(phases.get());
+    }
+    if (!opts.telemetry.empty()) {
+      telemetry = std::make_unique<FrameTelemetry>();
+      telemetry->SetExport(opts.telemetry, opts.telemetry_seconds);
+    }
+    std::unique_ptr<Timeline> timeline;
+    if (!opts.timeline.empty()) {
+      timeline = std::make_unique<Timeline>(opts.timeline_events);
+      cpu.SetTimeline(timeline.get());
+    }
+    uint64_t start_frame = cpu.FrameCount();
+    uint64_t start_cycle = cpu.Cycle();
+    std::unique_ptr<Movie> movie;
+    if (!opts.record_movie.empty()) {
+      movie = std::make_unique<Movie>(*cartridge, &cpu, 1, opts.checkpoint_interval);
+    }
+    std::unique_ptr<RewindBuffer> rewind;
+    std::unique_ptr<ConsoleState> state;
+    std::vector<uint64_t> ram_hashes;
+    if (opts.rewind_bytes > 0 || store != nullptr) {
+      state = std::make_unique<ConsoleState>();
+    }
+    if (opts.rewind_bytes > 0) {
+      rewind = std::make_unique<RewindBuffer>(opts.rewind_bytes);
+      ram_hashes.resize(start_frame + opts.frames + 1);
+    }
+    auto start_time = Clock::now();
+    if (opts.cycles > 0) {
+      while (cpu.Cycle() - start_cycle < opts.cycles) {
+        cpu.RunCycle();
+      }
+    } else {
+      for (uint64_t i = 0; i < opts.frames; ++i) {
+        uint8_t buttons = opts.has_input_seed ? InputFor(opts.input_seed, cpu.FrameCount()) : 0;
+        cpu.SetButtons(0, buttons);
+        if (phases) {
+          phases->StartFrame();
+        }
+        cpu.RunFrame();
+        if (phases) {
+          phases->EndFrame();
+        }
+        if (timeline) {
+          timeline->Instant(Timeline::kPresent, cpu.Cycle(), static_cast<uint32_t>(cpu.FrameCount()));
+        }
+        if (telemetry) {
+          telemetry->Record(FrameTelemetry::kEmulate, phases->LastFrame(PhaseCounters::kCpu).ns);
+          telemetry->Record(FrameTelemetry::kRender, phases->LastFrame(PhaseCounters::kPpu).ns);
+          telemetry->EndFrame();
+        }
+        if (movie) {
+          movie->AddFrame(&buttons, &cpu);
+        }
+        if (rewind) {
+          auto push_start = Clock::now();
+          cpu.SaveState(state.get());
+          rewind->Push(*state);
+          result.push_seconds += std::chrono::duration<double>(Clock::now() - push_start).count();
+          ram_hashes[cpu.FrameCount()] = Fnv1a64(cpu.Ram(), 0x800);
+        }
+        if (store != nullptr) {
+          cpu.SaveState(state.get());
+          auto insert_start = Clock::now();
+          result.snapshots.push_back(store->Insert(*state));
+          result.insert_seconds += std::chrono::duration<double>(Clock::now() - insert_start).count();
+          result.snapshot_hashes.push_back(
+              Fnv1a64(reinterpret_cast<const uint8_t*>(state.get()), sizeof(ConsoleState)));
+        }
+      }
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    if (phases) {
+      cpu.SetPhaseCounters(nullptr);
+      phases->Switch(PhaseCounters::kHost);
+    }
+    if (opts.perf_counters) {
+      result.perf = phases->Describe();
+    }
+    if (telemetry) {
+      telemetry->Export();
+      result.telemetry = telemetry->Describe();
+    }
+    result.frames = cpu.FrameCount() - start_frame;
+    result.cycles = cpu.Cycle() - start_cycle;
+    if (movie) {
+      movie->WriteFile(opts.record_movie);
+    }
+    if (trace) {
+      cpu.SetTrace(nullptr);
+      result.trace_records = trace->Finish();
+    }
+    if (timeline) {
+      cpu.SetTimeline(nullptr);
+      timeline->WriteJson(opts.timeline, BaseName(rom_path));
+      result.timeline_events = timeline->Events();
+      result.timeline_dropped = timeline->Dropped();
+    }
+    if (sampler) {
+      cpu.SetSampler(nullptr);
+      result.samples = sampler->Samples();
+      sampler->AppendFolded(BaseName(rom_path), &result.folded);
+    }
+
+    result.ram_hash = Fnv1a64(cpu.Ram(), 0x800);
+    // A cached boot doesn't bring its frame buffer; the first whole frame redraws it.
+    result.frame_stale = result.boot_hit && result.frames == 0;
+    if (!result.frame_stale) {
+      Image* frame = cpu.FrameBuffer();
+      result.frame_hash = Fnv1a64(frame->Data(), frame->Rows() * frame->RowWidth());
+    }
+    if (rewind) {
+      // Stats first: rewinding consumes the buffer.
+      result.rewind = rewind->GetStats();
+      result.rewound = RewindAndVerify(&cpu, rewind.get(), ram_hashes);
+    }
+    result.ok = true;
+  } catch (const std::exception& e) {
+    result.error = e.what();
+    if (flight) {
+      DumpFlightRecording(rom_path, *flight, opts.flight_recorder, &result);
+    }
+  }
+  return result;
+}
+
+} // namespace headless
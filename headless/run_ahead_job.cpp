@@ -0,0 +1,35 @@
+#include "headless/runner.h"
+
+#include "cpu6502.h"
+
+namespace headless {
+
+JobResult RunAheadJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts) {
+  JobResult result;
+  try {
+    RunAhead run_ahead(carts->Get(rom_path), opts.run_ahead, opts.second_instance);
+    Cpu6502* cpu = run_ahead.Main();
+    uint64_t start_frame = cpu->FrameCount();
+    uint64_t start_cycle = cpu->Cycle();
+    Image* frame = nullptr;
+    auto start_time = Clock::now();
+    for (uint64_t i = 0; i < opts.frames; ++i) {
+      uint8_t buttons = opts.has_input_seed ? InputFor(opts.input_seed, cpu->FrameCount()) : 0;
+      frame = run_ahead.RunHostFrame(buttons, 0);
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    result.frames = cpu->FrameCount() - start_frame;
+    result.cycles = cpu->Cycle() - start_cycle;
+    result.ram_hash = Fnv1a64(cpu->Ram(), 0x800);
+    if (frame != nullptr) {
+      result.frame_hash = Fnv1a64(frame->Data(), frame->Rows() * frame->RowWidth());
+    }
+    result.run_ahead = run_ahead.GetStats();
+    result.ok = true;
+  } catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  return result;
+}
+
+} // namespace headless
@@ -0,0 +1,165 @@
+#ifndef HEADLESS_RUNNER_H_
+#define HEADLESS_RUNNER_H_
+
+#include <map>
+#include <mutex>
+
+#include "boot_cache.h"
+#include "cartridge.h"
+#include "common.h"
+#include "movie.h"
+#include "netplay.h"
+#include "rewind_buffer.h"
+#include "run_ahead.h"
+#include "snapshot_store.h"
+#include "stack_sampler.h"
+
+// The jobs nes2x_headless runs (see headless_main.cpp for the flags), one file each:
+// plain_job.cpp runs a Cpu6502 with whatever it was asked to record or check, and
+// batch_job.cpp, run_ahead_job.cpp, netplay_job.cpp and movie_job.cpp run the other modes.
+// options.cpp parses and checks the flags.
+namespace headless {
+
+const uint64_t kDefaultNumFrames = 600;
+
+struct Options {
+  std::vector<std::string> roms;
+  uint64_t frames = kDefaultNumFrames;
+  uint64_t cycles = 0;  // if non-zero, run for cycles instead of frames
+  int jobs = 0;         // 0 means one per core
+  bool pin = false;
+  int batch = 0;        // lanes per ROM; 0 runs a plain Cpu6502
+  bool render = true;
+  bool has_input_seed = false;
+  uint64_t input_seed = 0;
+  size_t rewind_bytes = 0;  // 0 disables rewind
+  int run_ahead = -1;       // < 0 disables run-ahead
+  bool second_instance = false;
+  bool snapshot_store = false;
+  std::string boot_cache_dir;  // empty disables the boot cache
+  BootCache::BootPoint boot_point;
+  std::string record_movie;  // empty unless recording
+  uint32_t checkpoint_interval = Movie::kDefaultCheckpointInterval;
+  std::vector<std::string> replay_movies;
+  size_t memo_bytes = 0;  // 0 disables the frame memo
+  std::string netplay;    // transport spec; empty disables netplay
+  int player = 1;
+  double latency_ms = 0;
+  double jitter_ms = 0;
+  int rollback = RollbackSession::kMaxRollback;
+  std::string trace;          // empty disables tracing
+  size_t flight_recorder = 0;  // instructions kept for failed jobs; 0 disables
+  std::string sample_profile;  // empty disables the stack sampler
+  uint64_t sample_period = 1000;
+  Labels labels;
+  bool perf_counters = false;
+  std::string telemetry;  // empty disables telemetry
+  double telemetry_seconds = 10;
+  std::string timeline;  // empty disables the timeline
+  size_t timeline_events = 1 << 20;
+};
+
+// Parses the command line. Prints usage and throws on unknown flags, and throws on
+// combinations that can not run together.
+Options ParseOptions(int argc, char* argv[]);
+
+struct LaneResult {
+  uint64_t ram_hash = 0;
+  uint64_t frame_hash = 0;
+};
+
+struct JobResult {
+  bool ok = false;
+  std::string error;
+  uint64_t frames = 0;
+  uint64_t cycles = 0;
+  double seconds = 0;
+  uint64_t ram_hash = 0;
+  uint64_t frame_hash = 0;
+  // The frame buffer was not drawn (--memo hits, or a --boot-cache hit with no frames run
+  // after it), so frame_hash is left at 0.
+  bool frame_stale = false;
+  std::vector<LaneResult> lanes;  // batch runs only
+  double group_width = 0;
+  // --rewind runs only.
+  RewindBuffer::Stats rewind;
+  double push_seconds = 0;
+  uint64_t rewound = 0;
+  // --run-ahead runs only.
+  RunAhead::Stats run_ahead;
+  // --snapshot-store runs only: one snapshot per frame and a hash of the state it holds.
+  std::vector<SnapshotStore::Snapshot> snapshots;
+  std::vector<uint64_t> snapshot_hashes;
+  double insert_seconds = 0;
+  // --boot-cache runs only.
+  bool boot_hit = false;
+  uint64_t boot_frame = 0;
+  double boot_seconds = 0;
+  // --replay-movie runs only.
+  size_t movie_checkpoints = 0;
+  // --netplay runs only.
+  RollbackSession::Stats netplay;
+  // --trace and --flight-recorder runs only.
+  uint64_t trace_records = 0;
+  std::string flight_trace;  // where a failed job's last instructions were written
+  std::vector<std::string> flight_tail;
+  // --sample-profile runs only.
+  uint64_t samples = 0;
+  std::string folded;
+  // --perf-counters runs only.
+  std::vector<std::string> perf;
+  // --telemetry runs only.
+  std::vector<std::string> telemetry;
+  // --timeline runs only.
+  size_t timeline_events = 0;
+  uint64_t timeline_dropped = 0;
+};
+
+// Loads each ROM once; every job running it shares the same mapped Cartridge.
+class CartridgeCache {
+  public:
+    std::shared_ptr<const Cartridge> Get(const std::string& path) {
+      const std::lock_guard<std::mutex> lock(mu_);
+      std::shared_ptr<const Cartridge>& cart = carts_[path];
+      if (!cart) {
+        cart = Cartridge::FromFile(path);
+      }
+      return cart;
+    }
+
+  private:
+    std::mutex mu_;
+    std::map<std::string, std::shared_ptr<const Cartridge>> carts_;
+};
+
+// Buttons held during the given frame for an input stream.
+inline uint8_t InputFor(uint64_t seed, uint64_t frame) {
+  uint64_t key[2] = {seed, frame};
+  return static_cast<uint8_t>(Fnv1a64(reinterpret_cast<const uint8_t*>(key), sizeof(key)));
+}
+
+// The file name without its directory.
+inline std::string BaseName(const std::string& path) {
+  size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Each job runs one ROM as opts asks and reports in its result rather than throwing.
+// RunJob hands --batch, --run-ahead and --netplay runs to their own jobs and runs the rest
+// on a plain Cpu6502, inserting a snapshot per frame into store if it is not null.
+JobResult RunJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts,
+                 SnapshotStore* store);
+JobResult RunBatchJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts);
+JobResult RunAheadJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts);
+JobResult NetplayJob(const std::string& rom_path, const Options& opts, CartridgeCache* carts);
+// Replays movie_path on rom_path, through memo if it is not null.
+JobResult ReplayMovieJob(const std::string& rom_path, const std::string& movie_path,
+                         const Options& opts, CartridgeCache* carts, FrameMemo* memo);
+
+// Prints dedup stats, then restores every snapshot, checks it against the hash taken when it
+// was inserted and releases it. Throws on a mismatch or if any page outlives its snapshots.
+void ReportSnapshotStore(SnapshotStore* store, std::vector<JobResult>* results);
+
+} // namespace headless
+
+#endif  // HEADLESS_RUNNER_H_
@@ -0,0 +1,42 @@
+#include "headless/runner.h"
+
+namespace headless {
+
+void ReportSnapshotStore(SnapshotStore* store, std::vector<JobResult>* results) {
+  SnapshotStore::Stats stats = store->GetStats();
+  double insert_seconds = 0;
+  for (const JobResult& r : *results) {
+    insert_seconds += r.insert_seconds;
+  }
+  auto state = std::make_unique<ConsoleState>();
+  uint64_t verified = 0;
+  auto restore_start = Clock::now();
+  for (JobResult& r : *results) {
+    for (size_t i = 0; i < r.snapshots.size(); ++i) {
+      store->Restore(r.snapshots[i], state.get());
+      if (Fnv1a64(reinterpret_cast<const uint8_t*>(state.get()), sizeof(ConsoleState)) !=
+          r.snapshot_hashes[i]) {
+        throw std::runtime_error("Restored snapshot does not match what was inserted.");
+      }
+      store->Release(r.snapshots[i]);
+      verified++;
+    }
+  }
+  double restore_seconds = std::chrono::duration<double>(Clock::now() - restore_start).count();
+  if (store->GetStats().unique_pages != 0) {
+    throw std::runtime_error("Snapshot store kept pages after every snapshot was released.");
+  }
+  double logical_mb = stats.snapshots * sizeof(ConsoleState) / (1024.0 * 1024.0);
+  printf("SNAPSHOTS count=%llu pages=%llu unique=%llu dedup=%.1fx resident=%.1fMB logical=%.1fMB "
+         "insert=%.2fus restore+check=%.2fus verified=%llu\n",
+      static_cast<unsigned long long>(stats.snapshots),
+      static_cast<unsigned long long>(stats.logical_pages),
+      static_cast<unsigned long long>(stats.unique_pages),
+      stats.unique_pages > 0 ? static_cast<double>(stats.logical_pages) / stats.unique_pages : 0.0,
+      stats.resident_bytes / (1024.0 * 1024.0), logical_mb,
+      stats.snapshots > 0 ? insert_seconds * 1e6 / stats.snapshots : 0.0,
+      verified > 0 ? restore_seconds * 1e6 / verified : 0.0,
+      static_cast<unsigned long long>(verified));
+}
+
+} // namespace headless
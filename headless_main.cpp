@@ -0,0 +1,238 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "frame_memo.h"
+#include "headless/runner.h"
+#include "job_pool.h"
+#include "snapshot_store.h"
+
+// Headless batch runner. No SDL. Runs every ROM for a fixed number of frames
+// (or CPU cycles) spread across all cores, then reports speed and state hashes.
+//
+// Usage: nes2x_headless [--frames N | --cycles N] [--jobs N] [--pin] [--batch LANES]
+//                       [--no-render] [--input-seed S] [--rewind MB]
+//                       [--run-ahead N [--second-instance]] [--snapshot-store]
+//                       [--boot-cache DIR [--boot-at N|poll]]
+//                       [--record-movie FILE [--checkpoint-every N] |
+//                        --replay-movie FILE... [--memo MB]]
+//                       [--netplay udp:PORT:PORT|unix:PATH:PATH [--player 1|2] [--latency MS]
+//                        [--jitter MS] [--rollback N]] [--trace FILE | --flight-recorder N]
+//                       [--sample-profile FILE [--sample-every N] [--labels FILE]]
+//                       [--perf-counters] [--telemetry FILE [--telemetry-every S]]
+//                       [--timeline FILE [--timeline-events N]] [--manifest FILE] rom.nes...
+// A manifest lists one ROM path per line. Blank lines and lines starting with # are skipped.
+//
+// --batch runs each ROM as LANES lockstep consoles on a BatchCpu6502 and prints hashes per lane.
+// --input-seed feeds pseudo-random controller 1 input each frame; batch lane i uses seed S + i,
+// so lane i can be checked against a plain run with --input-seed S + i.
+// --rewind pushes a save state into a RewindBuffer of MB megabytes after every frame, then
+// rewinds all the way back, checking each restored RAM against the hash seen going forward.
+// --run-ahead presents the frame N frames ahead of the real one (see RunAhead) and reports the
+// host time each frame takes against the 60Hz budget. The RAM hash is the real console's and
+// should match a plain run; the frame hash is of the last presented frame.
+// --snapshot-store inserts a save state after every frame of every job into one shared
+// SnapshotStore, reports how well the pages deduplicate, then restores and checks each one.
+// --boot-cache starts each plain run from a cached post-boot state in DIR (see BootCache),
+// creating it on a miss. The boot point is after N frames or, by default, the first frame
+// that reads a controller. --frames then counts from the boot point. A hit has no frame
+// buffer to go with it, so --frames 0 prints frame=stale.
+// --record-movie saves the run (from the boot point, if any) as a Movie with a state hash per
+// frame and a checkpoint every N frames (600 by default). --replay-movie plays one back
+// instead of running --frames, each checkpointed segment on its own core, and fails at the
+// first frame whose hash differs. Given more than once, each movie is one job instead.
+// Both take a single ROM. --memo shares a FrameMemo of MB megabytes between replays, so
+// frames that several movies have in common are emulated once. Those frames aren't drawn,
+// so a replay that used any prints frame=stale instead of a frame hash.
+// --netplay plays one side of a two-player RollbackSession against another nes2x_headless
+// over the given local transport, at 60Hz, with --latency and --jitter added to every
+// datagram this side sends. Each player's input comes from --input-seed plus the player
+// number and is held for a few frames at a time, like a person's. At the end the state is
+// checked against a plain run of the confirmed inputs and the rollback costs are printed.
+// --trace records every instruction of a plain run on one ROM to FILE as binary records (see
+// trace.h); nes2x_trace prints them as nestest.log lines. --flight-recorder keeps only the
+// last N instructions of each plain run and, if the job fails, writes them to
+// <rom name>.flight.trace in the working directory and prints the final few.
+// --sample-profile samples each plain run's guest call stack every N cycles (1000 by default,
+// see StackSampler) and writes every job's stacks to FILE in the folded format flamegraph
+// tools read, rooted at the ROM's file name. --labels names subroutines from a label file.
+// --perf-counters reads hardware counters (see PerfCounters) for each plain run and reports
+// them per phase (CPU, PPU and the runner's own work between frames) and per frame. Where
+// the counters are unavailable it reports the timings alone.
+// --telemetry keeps histograms of each frame's emulate and render (PPU) time and the whole
+// frame for a plain run on one ROM (see FrameTelemetry), prints their p50, p99 and max, and
+// rewrites FILE every S seconds (10 by default) as Prometheus text, or JSON for a .json FILE.
+// --timeline records the CPU spans between PPU catch-ups, each scanline, OAM DMAs, NMIs, input
+// polls and frame ends of a plain run on one ROM (see Timeline), up to N events (1M by
+// default), and writes them to FILE as a Chrome trace for Perfetto.
+
+namespace {
+
+double PerSecond(uint64_t count, double seconds) {
+  return seconds > 0 ? count / seconds : 0;
+}
+
+} // namespace
+
+using headless::CartridgeCache;
+using headless::JobResult;
+using headless::Options;
+
+int main(int argc, char* argv[]) {
+  try {
+    Options opts = headless::ParseOptions(argc, argv);
+    JobPool pool(opts.jobs, opts.pin);
+
+    CartridgeCache carts;
+    std::unique_ptr<SnapshotStore> store;
+    if (opts.snapshot_store) {
+      store = std::make_unique<SnapshotStore>();
+    }
+    std::unique_ptr<FrameMemo> memo;
+    if (opts.memo_bytes > 0) {
+      memo = std::make_unique<FrameMemo>(opts.memo_bytes);
+    }
+    // One job per ROM, or per movie when replaying.
+    const std::vector<std::string>& names = opts.replay_movies.empty() ? opts.roms : opts.replay_movies;
+    std::vector<JobResult> results(names.size());
+    std::vector<JobPool::Job> jobs;
+    for (size_t i = 0; i < names.size(); ++i) {
+      jobs.push_back([&opts, &names, &results, &carts, &store, &memo, i](int) {
+        if (opts.replay_movies.empty()) {
+          results[i] = headless::RunJob(names[i], opts, &carts, store.get());
+        } else {
+          results[i] = headless::ReplayMovieJob(opts.roms[0], names[i], opts, &carts, memo.get());
+        }
+      });
+    }
+
+    auto start_time = Clock::now();
+    pool.Run(std::move(jobs));
+    double wall_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    uint64_t total_frames = 0;
+    int num_failed = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+      const JobResult& r = results[i];
+      if (!r.ok) {
+        printf("FAIL %s: %s\n", names[i].c_str(), r.error.c_str());
+        if (!r.flight_tail.empty()) {
+          printf("     flight_recorder records=%llu file=%s\n",
+              static_cast<unsigned long long>(r.trace_records),
+              r.flight_trace.empty() ? "-" : r.flight_trace.c_str());
+          for (const std::string& line : r.flight_tail) {
+            printf("     %s\n", line.c_str());
+          }
+        }
+        num_failed++;
+        continue;
+      }
+      total_frames += r.frames;
+      std::string frame_hash = r.frame_stale
+          ? "stale" : string_format("%016llx", static_cast<unsigned long long>(r.frame_hash));
+      printf("OK   %s frames=%llu cycles=%llu time=%.3fs fps=%.1f ram=%016llx frame=%s\n",
+          names[i].c_str(), static_cast<unsigned long long>(r.frames),
+          static_cast<unsigned long long>(r.cycles), r.seconds, PerSecond(r.frames, r.seconds),
+          static_cast<unsigned long long>(r.ram_hash), frame_hash.c_str());
+      if (!r.lanes.empty()) {
+        printf("     lanes=%zu group_width=%.1f\n", r.lanes.size(), r.group_width);
+      }
+      if (opts.rewind_bytes > 0) {
+        const RewindBuffer::Stats& rw = r.rewind;
+        printf("     rewind frames=%llu seconds=%.1f bytes=%llu/%llu ratio=%.1fx waits=%llu "
+               "evicted=%llu push=%.2fus encode=%.2fus verified=%llu\n",
+            static_cast<unsigned long long>(rw.frames), rw.frames / 60.0,
+            static_cast<unsigned long long>(rw.encoded_bytes),
+            static_cast<unsigned long long>(rw.capacity_bytes),
+            rw.encoded_bytes > 0 ? static_cast<double>(rw.raw_bytes) / rw.encoded_bytes : 0.0,
+            static_cast<unsigned long long>(rw.waits), static_cast<unsigned long long>(rw.evicted),
+            r.frames > 0 ? r.push_seconds * 1e6 / r.frames : 0.0,
+            r.frames > 0 ? rw.encode_seconds * 1e6 / r.frames : 0.0,
+            static_cast<unsigned long long>(r.rewound));
+      }
+      if (!opts.trace.empty()) {
+        printf("     trace records=%llu file=%s\n", static_cast<unsigned long long>(r.trace_records),
+            opts.trace.c_str());
+      }
+      for (const std::string& line : r.perf) {
+        printf("     %s\n", line.c_str());
+      }
+      for (const std::string& line : r.telemetry) {
+        printf("     %s\n", line.c_str());
+      }
+      if (!opts.timeline.empty()) {
+        printf("     timeline events=%zu dropped=%llu file=%s\n", r.timeline_events,
+            static_cast<unsigned long long>(r.timeline_dropped), opts.timeline.c_str());
+      }
+      if (!opts.sample_profile.empty()) {
+        printf("     samples=%llu every=%llu file=%s\n", static_cast<unsigned long long>(r.samples),
+            static_cast<unsigned long long>(opts.sample_period), opts.sample_profile.c_str());
+      }
+      if (!opts.boot_cache_dir.empty()) {
+        printf("     boot %s frame=%llu time=%.3fms\n", r.boot_hit ? "hit" : "miss",
+            static_cast<unsigned long long>(r.boot_frame), r.boot_seconds * 1e3);
+      }
+      if (opts.replay_movies.size() == 1) {
+        printf("     movie checkpoints=%zu workers=%d\n", r.movie_checkpoints,
+            opts.jobs > 0 ? opts.jobs : JobPool::NumCores());
+      }
+      if (!opts.netplay.empty()) {
+        const RollbackSession::Stats& np = r.netplay;
+        printf("     netplay player=%d rollbacks=%llu resim_frames=%llu max_depth=%d "
+               "resim=%.1fus/frame %.1fus/rollback snapshot=%.2fus stalls=%llu stall=%.1fms\n",
+            opts.player, static_cast<unsigned long long>(np.rollbacks),
+            static_cast<unsigned long long>(np.resim_frames), np.max_depth,
+            np.resim_frames > 0 ? np.resim_seconds * 1e6 / np.resim_frames : 0.0,
+            np.rollbacks > 0 ? np.resim_seconds * 1e6 / np.rollbacks : 0.0,
+            np.frames > 0 ? np.snapshot_seconds * 1e6 / (np.frames + np.resim_frames) : 0.0,
+            static_cast<unsigned long long>(np.stalls), np.stall_seconds * 1e3);
+      }
+      if (opts.run_ahead >= 0 && r.frames > 0) {
+        // NTSC runs at 60.0988 frames per second.
+        const double kHostFrameSeconds = 1 / 60.0988;
+        double host_frame_seconds = r.seconds / r.frames;
+        printf("     run_ahead depth=%d mode=%s host_frame=%.1fus headroom=%.1f%% "
+               "emulated_per_host=%.2f resyncs=%llu\n",
+            opts.run_ahead, opts.second_instance ? "second-instance" : "single",
+            host_frame_seconds * 1e6, 100 * (1 - host_frame_seconds / kHostFrameSeconds),
+            static_cast<double>(r.run_ahead.emulated_frames) / r.run_ahead.host_frames,
+            static_cast<unsigned long long>(r.run_ahead.resyncs));
+      }
+      for (size_t l = 0; l < r.lanes.size(); ++l) {
+        printf("     lane=%zu ram=%016llx frame=%016llx\n", l,
+            static_cast<unsigned long long>(r.lanes[l].ram_hash),
+            static_cast<unsigned long long>(r.lanes[l].frame_hash));
+      }
+    }
+    if (!opts.sample_profile.empty()) {
+      std::ofstream folded(opts.sample_profile);
+      for (const JobResult& r : results) {
+        folded << r.folded;
+      }
+      if (!folded) {
+        throw std::runtime_error("Could not write " + opts.sample_profile);
+      }
+    }
+    if (memo) {
+      FrameMemo::Stats stats = memo->GetStats();
+      printf("MEMO lookups=%llu hits=%llu hit_rate=%.1f%% entries=%llu evicted=%llu bytes=%llu/%llu\n",
+          static_cast<unsigned long long>(stats.lookups), static_cast<unsigned long long>(stats.hits),
+          stats.lookups > 0 ? 100.0 * stats.hits / stats.lookups : 0.0,
+          static_cast<unsigned long long>(stats.entries), static_cast<unsigned long long>(stats.evicted),
+          static_cast<unsigned long long>(stats.bytes),
+          static_cast<unsigned long long>(stats.capacity_bytes));
+    }
+    if (store) {
+      headless::ReportSnapshotStore(store.get(), &results);
+    }
+    printf("TOTAL jobs=%zu failed=%d workers=%d frames=%llu wall=%.3fs fps=%.1f\n",
+        results.size(), num_failed, pool.NumWorkers(), static_cast<unsigned long long>(total_frames),
+        wall_seconds, PerSecond(total_frames, wall_seconds));
+    return num_failed == 0 ? 0 : 1;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+}
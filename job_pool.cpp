@@ -0,0 +1,116 @@
+#include "job_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "common.h"
+
+namespace {
+
+void PinCurrentThread(int core) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    DBG("Failed to pin worker to core %d\n", core);
+  }
+#endif
+}
+
+} // namespace
+
+JobPool::JobPool(int num_workers, bool pin_workers) : pin_workers_(pin_workers) {
+  num_workers_ = num_workers > 0 ? num_workers : NumCores();
+  for (int i = 0; i < num_workers_; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (int i = 0; i < num_workers_; ++i) {
+    threads_.emplace_back(&JobPool::WorkerLoop, this, i);
+  }
+}
+
+JobPool::~JobPool() {
+  {
+    const std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  start_cv_.notify_all();
+  for (std::thread& t : threads_) {
+    t.join();
+  }
+}
+
+int JobPool::NumCores() {
+  int cores = static_cast<int>(std::thread::hardware_concurrency());
+  return cores > 0 ? cores : 1;
+}
+
+void JobPool::Run(std::vector<Job> jobs) {
+  if (jobs.empty()) {
+    return;
+  }
+  // The workers are all waiting, so nothing else touches the deques until they are woken.
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    queues_[i % num_workers_]->jobs.push_back(std::move(jobs[i]));
+  }
+
+  std::unique_lock<std::mutex> lock(mu_);
+  busy_ = num_workers_;
+  generation_++;
+  start_cv_.notify_all();
+  done_cv_.wait(lock, [this]() { return busy_ == 0; });
+}
+
+void JobPool::WorkerLoop(int worker) {
+  if (pin_workers_) {
+    PinCurrentThread(worker % NumCores());
+  }
+  uint64_t seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      start_cv_.wait(lock, [this, seen]() { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+    }
+    Job job;
+    // No job ever enqueues another, so once every deque is empty this Run() is done.
+    while (PopOwn(worker, &job) || Steal(worker, &job)) {
+      job(worker);
+      job = nullptr;  // release what it captured before waiting
+    }
+    const std::lock_guard<std::mutex> lock(mu_);
+    if (--busy_ == 0) {
+      done_cv_.notify_one();
+    }
+  }
+}
+
+bool JobPool::PopOwn(int worker, Job* job) {
+  Queue& q = *queues_[worker];
+  const std::lock_guard<std::mutex> lock(q.mu);
+  if (q.jobs.empty()) {
+    return false;
+  }
+  *job = std::move(q.jobs.back());
+  q.jobs.pop_back();
+  return true;
+}
+
+bool JobPool::Steal(int worker, Job* job) {
+  for (int i = 1; i < num_workers_; ++i) {
+    Queue& q = *queues_[(worker + i) % num_workers_];
+    const std::lock_guard<std::mutex> lock(q.mu);
+    if (!q.jobs.empty()) {
+      *job = std::move(q.jobs.front());
+      q.jobs.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
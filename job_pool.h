@@ -0,0 +1,58 @@
+#ifndef JOB_POOL_H_
+#define JOB_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+
+// Work-stealing pool for running a batch of independent jobs to completion.
+// Jobs are dealt round-robin onto per-worker deques. Each worker pops from the
+// back of its own deque and steals from the front of the others once it runs dry.
+// The workers are started once and wait between Run() calls, so a Run() costs a wake-up
+// rather than creating threads, which matters for callers that run small batches often.
+class JobPool {
+  public:
+    // The int passed to a job is the index of the worker running it.
+    using Job = std::function<void(int)>;
+
+    // num_workers <= 0 means one worker per hardware thread.
+    // If pin_workers is set, worker i is pinned to core i % NumCores() (Linux only).
+    JobPool(int num_workers, bool pin_workers = false);
+    // Stops and joins the workers.
+    ~JobPool();
+
+    // Runs all jobs and blocks until every one has finished. One caller at a time, and not
+    // from inside a job. Jobs must not throw; catch inside the job and record the error instead.
+    void Run(std::vector<Job> jobs);
+
+    int NumWorkers() { return num_workers_; }
+    static int NumCores();
+
+  private:
+    struct Queue {
+      std::mutex mu;
+      std::deque<Job> jobs;
+    };
+
+    void WorkerLoop(int worker);
+    bool PopOwn(int worker, Job* job);
+    bool Steal(int worker, Job* job);
+
+    int num_workers_;
+    bool pin_workers_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mu_;
+    std::condition_variable start_cv_;  // a new Run() or shutdown
+    std::condition_variable done_cv_;   // the last busy worker ran dry
+    uint64_t generation_ = 0;           // Run() calls so far
+    int busy_ = 0;                      // workers still draining the current Run()
+    bool stop_ = false;
+};
+
+#endif  // JOB_POOL_H_
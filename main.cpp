@@ -7,7 +7,7 @@
 // doc: https://www.qmtpro.com/~nes/misc/nestest.txt
 // good log: https://www.qmtpro.com/~nes/misc/nestest.log
 // start execution at $C000
-const std::string kTestRomPath = "/Users/river/code/nes/roms/nestest.nes";
+const std::string kTestRomPath = "roms/nestest.nes";
 const uint64_t kDefaultNumInstrs = 8991; // nestest
 
 void Run(const std::string& rom_path, uint64_t num_instrs) {
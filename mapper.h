@@ -1,6 +1,7 @@
 #ifndef MAPPER_H_
 #define MAPPER_H_
 
+#include "controller.h"
 #include "mapper_id.h"
 #include "ppu.h"
 #include "common.h"
@@ -8,19 +9,24 @@
 // Handles memory 0x4020 - 0xFFFF
 class Mapper {
   public:
-    Mapper(uint8_t* cpu_ram, Ppu* ppu, uint8_t* apu_ram, uint8_t* prg_rom, size_t prg_rom_size);
+    // prg_rom is owned by the Cartridge and must outlive the mapper. The RAM and controllers
+    // belong to the console; prg_ram is 8k.
+    Mapper(uint8_t* cpu_ram, Ppu* ppu, uint8_t* apu_ram, Controller* controllers,
+           const uint8_t* prg_rom, size_t prg_rom_size, uint8_t* prg_ram);
 
     virtual uint8_t Get(uint16_t addr) = 0;
+    // Get() without its side effects, for operands that are only written: registers read as
+    // they would without being consumed, and unmapped addresses read as 0.
+    virtual uint8_t Peek(uint16_t addr) = 0;
     // Returns 513 or 514 if we perform OAMDMA, else 0.
     virtual uint16_t Set(uint16_t addr, uint8_t val, uint64_t current_cycle) = 0;
     uint16_t Get16(uint16_t addr, bool page_wrap = false);
+    // Offset into PRG-ROM that a read of addr returns, or -1 if addr isn't PRG-ROM.
+    virtual int64_t PrgRomOffset(uint16_t addr) = 0;
 
     ::MapperId MapperId() { return mapper_id_; }
 
-    virtual ~Mapper() {
-      free(prg_rom_);
-      free(prg_ram_);
-    }
+    virtual ~Mapper() {}
 
     // For some reason private inheritence wont work here...
     ::MapperId mapper_id_ = ::MapperId::kUndefined;
@@ -28,9 +34,10 @@ class Mapper {
     uint8_t* cpu_ram_ = nullptr;  // points to start of the 2kb internal ram.
     Ppu* ppu_ = nullptr;
     uint8_t* apu_ram_ = nullptr;  // 32-byte APU ram owned by CPU
-    uint8_t* prg_rom_ = nullptr;
+    Controller* controllers_ = nullptr;  // 2 controllers owned by CPU
+    const uint8_t* prg_rom_ = nullptr;
     size_t prg_rom_size_ = 0;
-    uint8_t* prg_ram_ = nullptr;
+    uint8_t* prg_ram_ = nullptr;  // 8k at $6000-$7FFF
 };
 
 #endif // MAPPER_H_
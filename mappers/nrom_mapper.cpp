@@ -2,8 +2,9 @@
 
 #include "mapper_id.h"
 
-NromMapper::NromMapper(uint8_t* cpu_ram, Ppu* ppu, uint8_t* apu_ram_, uint8_t* prg_rom, size_t prg_rom_size)
-      : Mapper(cpu_ram, ppu, apu_ram_, prg_rom, prg_rom_size) {
+NromMapper::NromMapper(uint8_t* cpu_ram, Ppu* ppu, uint8_t* apu_ram_, Controller* controllers,
+                       const uint8_t* prg_rom, size_t prg_rom_size, uint8_t* prg_ram)
+      : Mapper(cpu_ram, ppu, apu_ram_, controllers, prg_rom, prg_rom_size, prg_ram) {
   assert(prg_rom_size_ == 0x4000 || prg_rom_size_ == 0x8000);
   DBG("Created NROM mapper with %llu byte PRG_ROM and 8k PRG_RAM\n", static_cast<uint64_t>(prg_rom_size_));
 }
@@ -34,7 +35,9 @@ uint8_t NromMapper::Get(uint16_t addr) {
       default:
         throw std::runtime_error("Invalid CPU->PPU addr -- default.");
     }
-  } else if (addr <= 0x4020) {
+  } else if (addr == 0x4016 || addr == 0x4017) {
+    return controllers_[addr - 0x4016].Read();
+  } else if (addr < 0x4020) {
     return apu_ram_[addr % 0x4000];
   } else if (addr < 0x6000) {
     throw std::runtime_error("Invalid read addr");  // Battery Backed Save or Work RAM
@@ -53,6 +56,19 @@ uint8_t NromMapper::Get(uint16_t addr) {
   }
 }
 
+uint8_t NromMapper::Peek(uint16_t addr) {
+  if (addr < 0x2000 || addr >= 0x6000) {
+    return Get(addr);
+  } else if (addr < 0x4000) {
+    return ppu_->GetLatch();
+  } else if (addr == 0x4016 || addr == 0x4017) {
+    return controllers_[addr - 0x4016].Peek();
+  } else if (addr < 0x4020) {
+    return apu_ram_[addr % 0x4000];
+  }
+  return 0;
+}
+
 uint16_t NromMapper::Set(uint16_t addr, uint8_t val, uint64_t current_cycle) {
   if (addr < 0x2000) {
     cpu_ram_[addr % 0x800] = val;
@@ -89,7 +105,7 @@ uint16_t NromMapper::Set(uint16_t addr, uint8_t val, uint64_t current_cycle) {
   } else if (addr == 0x4014) {  // OAMDMA
     // TODO: Make this easier somehow. -> GetDataPointer() then just read/write there?
     uint16_t new_addr = static_cast<uint16_t>(val) << 8;
-    uint8_t* data = nullptr;
+    const uint8_t* data = nullptr;
     {
       if (new_addr < 0x2000) {
         data = cpu_ram_ + (new_addr % 0x800);
@@ -111,11 +127,20 @@ uint16_t NromMapper::Set(uint16_t addr, uint8_t val, uint64_t current_cycle) {
     }
     ppu_->SetOAMDMA(data);
     return 513 + (current_cycle % 2 == 0 ? 0 : 1);
-  } else if (addr <= 0x4020) {
+  } else if (addr < 0x4020) {
+    if (addr == 0x4016) {  // strobes both controllers
+      controllers_[0].Write(val);
+      controllers_[1].Write(val);
+    }
     apu_ram_[addr % 0x4000] = val;
   } else if (addr < 0x6000 || addr >= 0x8000) {
     throw std::runtime_error("Invalid write addr");
-  } 
-  prg_ram_[addr - 0x6000] = val;
+  } else {
+    prg_ram_[addr - 0x6000] = val;
+  }
   return 0;
-}
\ No newline at end of file
+}
+
+int64_t NromMapper::PrgRomOffset(uint16_t addr) {
+  return addr < 0x8000 ? -1 : (addr - 0x8000) % prg_rom_size_;
+}
@@ -8,10 +8,13 @@
 
 class NromMapper : public Mapper {
   public:
-    NromMapper(uint8_t* cpu_ram, Ppu* ppu, uint8_t* apu_ram_, uint8_t* prg_rom, size_t prg_rom_size);
+    NromMapper(uint8_t* cpu_ram, Ppu* ppu, uint8_t* apu_ram_, Controller* controllers,
+               const uint8_t* prg_rom, size_t prg_rom_size, uint8_t* prg_ram);
 
     uint8_t Get(uint16_t addr) override;
+    uint8_t Peek(uint16_t addr) override;
     uint16_t Set(uint16_t addr, uint8_t val, uint64_t current_cycle) override;
+    int64_t PrgRomOffset(uint16_t addr) override;
 };
 
 #endif
\ No newline at end of file
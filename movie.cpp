@@ -0,0 +1,233 @@
+#include "movie.h"
+
+namespace {
+
+void ReadExactly(FILE* file, void* data, size_t size, const std::string& path) {
+  if (size > 0 && fread(data, size, 1, file) != 1) {
+    fclose(file);
+    throw std::runtime_error("Movie " + path + " is truncated.");
+  }
+}
+
+uint64_t HashState(const ConsoleState& state) {
+  return Fnv1a64(reinterpret_cast<const uint8_t*>(&state), sizeof(ConsoleState));
+}
+
+} // namespace
+
+Movie::Movie(const Cartridge& cartridge, Cpu6502* cpu, int num_ports, uint32_t checkpoint_interval)
+    : rom_hash_(cartridge.ContentHash()), num_ports_(num_ports),
+      checkpoint_interval_(checkpoint_interval), rendered_(cpu->RenderingEnabled()) {
+  if (num_ports < 1 || num_ports > kMaxPorts) {
+    throw std::runtime_error("A movie records 1 or 2 controller ports.");
+  }
+  checkpoints_.push_back(std::make_unique<ConsoleState>());
+  cpu->SaveState(checkpoints_.back().get());
+}
+
+Movie Movie::FromFile(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    throw std::runtime_error("Could not open movie " + path);
+  }
+  Header header;
+  ReadExactly(file, &header, sizeof(header), path);
+  if (header.magic != Header::kMagic || header.version != Header::kVersion) {
+    fclose(file);
+    throw std::runtime_error(string_format("%s is not a version %u movie.", path.c_str(), Header::kVersion));
+  }
+  uint64_t expected_checkpoints =
+      1 + (header.checkpoint_interval > 0 ? header.num_frames / header.checkpoint_interval : 0);
+  if (header.state_size != sizeof(ConsoleState) || header.num_ports < 1 ||
+      header.num_ports > kMaxPorts || header.num_checkpoints != expected_checkpoints) {
+    fclose(file);
+    throw std::runtime_error("Movie " + path + " was recorded by an incompatible build.");
+  }
+  Movie movie;
+  movie.rom_hash_ = header.rom_hash;
+  movie.num_ports_ = header.num_ports;
+  movie.checkpoint_interval_ = header.checkpoint_interval;
+  movie.rendered_ = (header.flags & Header::kRendered) != 0;
+  for (uint32_t i = 0; i < header.num_checkpoints; ++i) {
+    movie.checkpoints_.push_back(std::make_unique<ConsoleState>());
+    ReadExactly(file, movie.checkpoints_.back().get(), sizeof(ConsoleState), path);
+  }
+  movie.input_.resize(header.num_frames * header.num_ports);
+  movie.hashes_.resize(header.num_frames);
+  ReadExactly(file, movie.input_.data(), movie.input_.size(), path);
+  ReadExactly(file, movie.hashes_.data(), movie.hashes_.size() * sizeof(uint64_t), path);
+  fclose(file);
+  return movie;
+}
+
+void Movie::WriteFile(const std::string& path) const {
+  Header header = {};
+  header.magic = Header::kMagic;
+  header.version = Header::kVersion;
+  header.rom_hash = rom_hash_;
+  header.num_frames = NumFrames();
+  header.state_size = sizeof(ConsoleState);
+  header.num_ports = num_ports_;
+  header.checkpoint_interval = checkpoint_interval_;
+  header.num_checkpoints = checkpoints_.size();
+  header.flags = rendered_ ? Header::kRendered : 0;
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    throw std::runtime_error("Could not write movie " + path);
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (const std::unique_ptr<ConsoleState>& checkpoint : checkpoints_) {
+    ok = ok && fwrite(checkpoint.get(), sizeof(ConsoleState), 1, file) == 1;
+  }
+  ok = ok && (input_.empty() || fwrite(input_.data(), input_.size(), 1, file) == 1) &&
+      (hashes_.empty() || fwrite(hashes_.data(), hashes_.size() * sizeof(uint64_t), 1, file) == 1);
+  if (fclose(file) != 0 || !ok) {
+    throw std::runtime_error("Could not write movie " + path);
+  }
+}
+
+void Movie::AddFrame(const uint8_t* buttons, Cpu6502* cpu) {
+  input_.insert(input_.end(), buttons, buttons + num_ports_);
+  hashes_.push_back(FrameChecksum(cpu));
+  if (checkpoint_interval_ > 0 && NumFrames() % checkpoint_interval_ == 0) {
+    checkpoints_.push_back(std::make_unique<ConsoleState>());
+    cpu->SaveState(checkpoints_.back().get());
+  }
+}
+
+void Movie::Start(const Cartridge& cartridge, Cpu6502* cpu) const {
+  if (cartridge.ContentHash() != rom_hash_) {
+    throw std::runtime_error("Movie was recorded with a different ROM.");
+  }
+  cpu->LoadState(*checkpoints_[0]);
+  cpu->SetRenderingEnabled(rendered_);
+  for (int port = 0; port < kMaxPorts; ++port) {
+    cpu->SetButtons(port, 0);
+  }
+}
+
+size_t Movie::NumSegments() const {
+  if (checkpoint_interval_ == 0) {
+    return 1;
+  }
+  // The last checkpoint only starts a segment if frames follow it.
+  return (NumFrames() + checkpoint_interval_ - 1) / checkpoint_interval_;
+}
+
+Movie::Divergence Movie::ReplayFrames(Cpu6502* cpu, uint64_t first, uint64_t end,
+                                      FrameMemo* memo) const {
+  Divergence divergence;
+  for (uint64_t frame = first; frame < end; ++frame) {
+    uint8_t buttons[kMaxPorts] = {};
+    for (int port = 0; port < num_ports_; ++port) {
+      buttons[port] = Buttons(frame, port);
+      cpu->SetButtons(port, buttons[port]);
+    }
+    uint64_t hash;
+    if (memo == nullptr) {
+      cpu->RunFrame();
+      hash = FrameChecksum(cpu);
+    } else {
+      FrameMemo::Key key = FrameMemo::KeyFor(cpu, buttons[0], buttons[1]);
+      if (memo->Apply(key, cpu, &hash)) {
+        divergence.memo_hits++;
+      } else {
+        cpu->RunFrame();
+        hash = FrameChecksum(cpu);
+        memo->Insert(key, cpu, hash);
+      }
+    }
+    if (hash != hashes_[frame]) {
+      divergence.diverged = true;
+      divergence.frame = frame;
+      divergence.console_frame = cpu->FrameCount();
+      divergence.expected = hashes_[frame];
+      divergence.actual = hash;
+      break;
+    }
+  }
+  return divergence;
+}
+
+Movie::Divergence Movie::ReplaySegment(Cpu6502* cpu, size_t s, FrameMemo* memo) const {
+  uint64_t first = s * checkpoint_interval_;
+  uint64_t end = checkpoint_interval_ > 0 ? std::min(first + checkpoint_interval_, NumFrames())
+                                          : NumFrames();
+  Divergence divergence = ReplayFrames(cpu, first, end, memo);
+  if (divergence.diverged || s + 1 >= checkpoints_.size()) {
+    return divergence;
+  }
+  auto state = std::make_unique<ConsoleState>();
+  cpu->SaveState(state.get());
+  if (memcmp(state.get(), checkpoints_[s + 1].get(), sizeof(ConsoleState)) != 0) {
+    divergence.diverged = true;
+    divergence.at_checkpoint = true;
+    divergence.frame = end - 1;
+    divergence.console_frame = cpu->FrameCount();
+    divergence.expected = HashState(*checkpoints_[s + 1]);
+    divergence.actual = HashState(*state);
+  }
+  return divergence;
+}
+
+Movie::Divergence Movie::Replay(const Cartridge& cartridge, Cpu6502* cpu, FrameMemo* memo) const {
+  Start(cartridge, cpu);
+  Divergence divergence;
+  uint64_t memo_hits = 0;
+  for (size_t s = 0; s < NumSegments() && !divergence.diverged; ++s) {
+    divergence = ReplaySegment(cpu, s, memo);
+    memo_hits += divergence.memo_hits;
+  }
+  divergence.memo_hits = memo_hits;
+  return divergence;
+}
+
+Movie::Divergence Movie::ReplaySegments(std::shared_ptr<const Cartridge> cartridge, Cpu6502* cpu,
+                                        JobPool* pool, FrameMemo* memo) const {
+  Start(*cartridge, cpu);
+  size_t num_segments = NumSegments();
+  std::vector<Divergence> divergences(num_segments);
+  std::vector<JobPool::Job> jobs;
+  for (size_t s = 0; s < num_segments; ++s) {
+    jobs.push_back([this, &cartridge, cpu, memo, &divergences, num_segments, s](int) {
+      try {
+        if (s + 1 == num_segments) {
+          cpu->LoadState(*checkpoints_[s]);
+          divergences[s] = ReplaySegment(cpu, s, memo);
+          return;
+        }
+        Cpu6502 segment_cpu(cartridge);
+        Start(*cartridge, &segment_cpu);
+        segment_cpu.LoadState(*checkpoints_[s]);
+        divergences[s] = ReplaySegment(&segment_cpu, s, memo);
+      } catch (const std::exception& e) {
+        // Only a bad checkpoint can throw here; report it as diverging at its first frame.
+        DBG("Segment %zu failed: %s\n", s, e.what());
+        divergences[s].diverged = true;
+        divergences[s].at_checkpoint = true;
+        divergences[s].frame = s * checkpoint_interval_;
+      }
+    });
+  }
+  pool->Run(std::move(jobs));
+  // Segments after a divergence ran anyway; their hits still count.
+  uint64_t memo_hits = 0;
+  for (const Divergence& divergence : divergences) {
+    memo_hits += divergence.memo_hits;
+  }
+  for (Divergence& divergence : divergences) {
+    if (divergence.diverged) {
+      divergence.memo_hits = memo_hits;
+      return divergence;
+    }
+  }
+  Divergence divergence;
+  divergence.memo_hits = memo_hits;
+  return divergence;
+}
+
+uint64_t Movie::FrameChecksum(Cpu6502* cpu) {
+  Image* frame = cpu->FrameBuffer();
+  uint64_t hash = HashWords(cpu->Ram(), 0x800);
+  return HashWords(frame->Data(), frame->Rows() * frame->RowWidth(), hash);
+}
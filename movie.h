@@ -0,0 +1,114 @@
+#ifndef MOVIE_H_
+#define MOVIE_H_
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+#include "frame_memo.h"
+#include "job_pool.h"
+
+// A recorded run that can be replayed exactly: the ROM's content hash, the state it starts
+// from, and the buttons held on each port for every frame (one byte per port, with the
+// Controller::Button bits). Each frame also carries a FrameChecksum() of the console after it,
+// so a replay can say exactly where it stopped matching the recording.
+//
+// Every checkpoint_interval frames the recording also keeps a whole ConsoleState. The
+// frames between two checkpoints form a segment that can be replayed on its own, so long
+// movies verify on all cores at once (see ReplaySegments), and each segment's end state is
+// checked against the checkpoint that starts the next one.
+//
+// File layout, little-endian: a 48-byte Header, the checkpoints in order (the first is the
+// start state), the input bytes frame by frame, then one uint64_t hash per frame.
+class Movie {
+  public:
+    static constexpr int kMaxPorts = 2;
+    static constexpr uint32_t kDefaultCheckpointInterval = 600;
+    // Version of the file layout below. Part of EmulatorVersion() (see version.h).
+    static constexpr uint32_t kFormatVersion = 2;
+
+    // Where a replay first disagreed with the recording.
+    struct Divergence {
+      bool diverged = false;
+      // Every frame hash matched, but the state at the end of the segment is not the
+      // checkpoint after it. expected and actual are then Fnv1a64s of the two states.
+      bool at_checkpoint = false;
+      uint64_t frame = 0;          // movie frame, counting from 0
+      uint64_t console_frame = 0;  // Cpu6502::FrameCount() after that frame
+      uint64_t expected = 0;
+      uint64_t actual = 0;
+      // Frames applied from a FrameMemo rather than emulated, up to the divergence if any.
+      // Hits don't draw, so if there were any the frame buffer no longer matches the state.
+      uint64_t memo_hits = 0;
+    };
+
+    // Starts an empty movie from cpu's current state. checkpoint_interval 0 keeps only the
+    // start state. The recording's rendering setting is kept, since it affects the hashes.
+    Movie(const Cartridge& cartridge, Cpu6502* cpu, int num_ports,
+          uint32_t checkpoint_interval = kDefaultCheckpointInterval);
+    // Throws on a missing, truncated or foreign file.
+    static Movie FromFile(const std::string& path);
+    void WriteFile(const std::string& path) const;
+
+    // Appends the frame cpu just ran with buttons[port] held, checkpointing if one is due.
+    void AddFrame(const uint8_t* buttons, Cpu6502* cpu);
+
+    uint64_t NumFrames() const { return hashes_.size(); }
+    int NumPorts() const { return num_ports_; }
+    uint64_t RomHash() const { return rom_hash_; }
+    size_t NumCheckpoints() const { return checkpoints_.size(); }
+    uint8_t Buttons(uint64_t frame, int port) const { return input_[frame * num_ports_ + port]; }
+    uint64_t Hash(uint64_t frame) const { return hashes_[frame]; }
+
+    // Loads the start state into cpu. Throws if cpu is running a different ROM.
+    void Start(const Cartridge& cartridge, Cpu6502* cpu) const;
+    // Start()s cpu and plays every frame, stopping at the first divergence. Frames found in
+    // memo, if given, are applied rather than emulated and counted in memo_hits.
+    Divergence Replay(const Cartridge& cartridge, Cpu6502* cpu, FrameMemo* memo = nullptr) const;
+    // Replays every segment from its own checkpoint as a job on pool and returns the earliest
+    // divergence. cpu plays the last segment, so with no divergence it ends up where
+    // Replay() would leave it.
+    Divergence ReplaySegments(std::shared_ptr<const Cartridge> cartridge, Cpu6502* cpu,
+                              JobPool* pool, FrameMemo* memo = nullptr) const;
+
+    // Hash of the internal RAM and the frame buffer. Word at a time rather than Fnv1a64,
+    // since it runs every frame, but just as stable across builds. Unlike
+    // Cpu6502::StateHash() it leaves out the registers and the PPU, so it stays the same
+    // across save-state layout changes and recorded movies keep replaying.
+    static uint64_t FrameChecksum(Cpu6502* cpu);
+
+  private:
+    struct Header {
+      static constexpr uint32_t kMagic = 0x4D53454E;  // "NESM"
+      static constexpr uint32_t kVersion = kFormatVersion;
+      static constexpr uint32_t kRendered = 1 << 0;
+      uint32_t magic;
+      uint32_t version;
+      uint64_t rom_hash;
+      uint64_t num_frames;
+      uint32_t state_size;
+      uint32_t num_ports;
+      uint32_t checkpoint_interval;
+      uint32_t num_checkpoints;
+      uint32_t flags;
+      uint32_t reserved;
+    };
+    static_assert(sizeof(Header) == 48, "Movie header layout changed.");
+
+    Movie() = default;
+
+    // Plays frames [first, end) on cpu, which must be at the start of frame first.
+    Divergence ReplayFrames(Cpu6502* cpu, uint64_t first, uint64_t end, FrameMemo* memo) const;
+    // Plays segment s on cpu, already at its checkpoint, and checks the state it ends in.
+    Divergence ReplaySegment(Cpu6502* cpu, size_t s, FrameMemo* memo) const;
+    size_t NumSegments() const;
+
+    uint64_t rom_hash_ = 0;
+    int num_ports_ = 0;
+    uint32_t checkpoint_interval_ = 0;
+    bool rendered_ = true;
+    std::vector<std::unique_ptr<ConsoleState>> checkpoints_;
+    std::vector<uint8_t> input_;
+    std::vector<uint64_t> hashes_;
+};
+
+#endif  // MOVIE_H_
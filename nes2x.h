@@ -0,0 +1,60 @@
+#ifndef NES2X_H_
+#define NES2X_H_
+
+/* C API for embedding nes2x (libnes2x.so), e.g. from Python through ctypes or cffi.
+ *
+ * There is no global state. Each nes2x instance is independent and may be driven from
+ * its own thread; a single instance must not be used from two threads at once. The library
+ * is always built without the debug and profiling options (see the Makefile), so it writes
+ * nothing to stdout and keeps no process-wide totals.
+ *
+ * Functions returning int return 0 on success and -1 on failure, in which case
+ * nes2x_last_error() describes what went wrong.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nes2x nes2x;
+
+/* Creates an instance from an iNES image in memory. The image is copied, so the caller
+ * may free it afterwards. Returns NULL on failure and, if error is not NULL, writes a
+ * NUL-terminated message of at most error_size bytes to it. */
+nes2x* nes2x_create(const void* rom, size_t rom_size, char* error, size_t error_size);
+void nes2x_destroy(nes2x* nes);
+
+/* Message for the last failed call on this instance. Valid until the next call. */
+const char* nes2x_last_error(nes2x* nes);
+
+/* Buttons held on controller port 0 or 1, one bit each:
+ * A, B, Select, Start, Up, Down, Left, Right from bit 0 to bit 7. */
+void nes2x_set_buttons(nes2x* nes, int port, uint8_t buttons);
+
+/* Runs until num_frames more frames have completed. */
+int nes2x_step(nes2x* nes, int num_frames);
+uint64_t nes2x_frame_count(nes2x* nes);
+
+/* Pointers straight into emulator memory. They stay valid, and see every later change,
+ * until the instance is destroyed. Loading a state does not move them. */
+/* 256x240 RGB24, rows packed top to bottom, 768 bytes per row. */
+const uint8_t* nes2x_frame_buffer(nes2x* nes);
+/* The 2 KiB of internal RAM at $0000-$07FF. */
+const uint8_t* nes2x_ram(nes2x* nes);
+
+/* Save states are only valid for the ROM and library version that wrote them. Loading one
+ * from another ROM, version or build fails and leaves the instance as it was. */
+size_t nes2x_state_size(nes2x* nes);
+/* size must be at least nes2x_state_size(). */
+int nes2x_save_state(nes2x* nes, void* buffer, size_t size);
+/* size must be exactly nes2x_state_size(). */
+int nes2x_load_state(nes2x* nes, const void* buffer, size_t size);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* NES2X_H_ */
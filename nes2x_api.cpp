@@ -0,0 +1,101 @@
+#include "nes2x.h"
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+
+// Everything an instance needs lives here, so instances share nothing.
+struct nes2x {
+  std::unique_ptr<Cpu6502> cpu;
+  std::unique_ptr<ConsoleState> scratch;  // staging for save and load
+  std::string error;
+};
+
+namespace {
+
+// Runs f, turning any exception into a -1 return and nes->error.
+template <typename F>
+int Guard(nes2x* nes, F&& f) {
+  try {
+    f();
+    return 0;
+  } catch (const std::exception& e) {
+    nes->error = e.what();
+    return -1;
+  }
+}
+
+} // namespace
+
+nes2x* nes2x_create(const void* rom, size_t rom_size, char* error, size_t error_size) {
+  try {
+    const uint8_t* bytes = static_cast<const uint8_t*>(rom);
+    auto cartridge = Cartridge::FromBytes(std::vector<uint8_t>(bytes, bytes + rom_size));
+    auto nes = std::make_unique<nes2x>();
+    nes->cpu = std::make_unique<Cpu6502>(std::move(cartridge));
+    nes->scratch = std::make_unique<ConsoleState>();
+    return nes.release();
+  } catch (const std::exception& e) {
+    if (error != nullptr && error_size > 0) {
+      snprintf(error, error_size, "%s", e.what());
+    }
+    return nullptr;
+  }
+}
+
+void nes2x_destroy(nes2x* nes) {
+  delete nes;
+}
+
+const char* nes2x_last_error(nes2x* nes) {
+  return nes->error.c_str();
+}
+
+void nes2x_set_buttons(nes2x* nes, int port, uint8_t buttons) {
+  nes->cpu->SetButtons(port & 1, buttons);
+}
+
+int nes2x_step(nes2x* nes, int num_frames) {
+  return Guard(nes, [&]() {
+    for (int i = 0; i < num_frames; ++i) {
+      nes->cpu->RunFrame();
+    }
+  });
+}
+
+uint64_t nes2x_frame_count(nes2x* nes) {
+  return nes->cpu->FrameCount();
+}
+
+const uint8_t* nes2x_frame_buffer(nes2x* nes) {
+  return nes->cpu->FrameBuffer()->Data();
+}
+
+const uint8_t* nes2x_ram(nes2x* nes) {
+  return nes->cpu->Ram();
+}
+
+size_t nes2x_state_size(nes2x* nes) {
+  return sizeof(ConsoleState);
+}
+
+int nes2x_save_state(nes2x* nes, void* buffer, size_t size) {
+  return Guard(nes, [&]() {
+    if (size < sizeof(ConsoleState)) {
+      throw std::runtime_error(string_format("State buffer needs %zu bytes.", sizeof(ConsoleState)));
+    }
+    nes->cpu->SaveState(nes->scratch.get());
+    memcpy(buffer, nes->scratch.get(), sizeof(ConsoleState));
+  });
+}
+
+int nes2x_load_state(nes2x* nes, const void* buffer, size_t size) {
+  return Guard(nes, [&]() {
+    if (size != sizeof(ConsoleState)) {
+      throw std::runtime_error(string_format("State must be %zu bytes.", sizeof(ConsoleState)));
+    }
+    // The caller's buffer may not be aligned for ConsoleState.
+    memcpy(nes->scratch.get(), buffer, sizeof(ConsoleState));
+    nes->cpu->LoadState(*nes->scratch);
+  });
+}
@@ -0,0 +1,300 @@
+#include "netplay.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <thread>
+
+namespace {
+
+// How long a peer may go silent before the session gives up.
+constexpr std::chrono::seconds kPeerTimeout(5);
+// Peers stall within max_rollback frames of each other, so this is generous.
+constexpr uint64_t kMaxLead = 1024;
+
+class DatagramTransport : public NetTransport {
+  public:
+    DatagramTransport(int fd, const sockaddr_storage& remote, socklen_t remote_size,
+                      const std::string& unlink_path)
+        : fd_(fd), remote_(remote), remote_size_(remote_size), unlink_path_(unlink_path) {}
+
+    ~DatagramTransport() override {
+      close(fd_);
+      if (!unlink_path_.empty()) {
+        unlink(unlink_path_.c_str());
+      }
+    }
+
+    void Send(const void* data, size_t size) override {
+      // Errors here are a peer that isn't up yet or a full buffer; both look like loss.
+      sendto(fd_, data, size, 0, reinterpret_cast<const sockaddr*>(&remote_), remote_size_);
+    }
+
+    size_t Receive(void* data, size_t capacity) override {
+      ssize_t size = recv(fd_, data, capacity, 0);
+      return size > 0 ? static_cast<size_t>(size) : 0;
+    }
+
+  private:
+    int fd_;
+    sockaddr_storage remote_;
+    socklen_t remote_size_;
+    std::string unlink_path_;
+};
+
+} // namespace
+
+std::unique_ptr<NetTransport> NetTransport::Open(const std::string& spec) {
+  size_t first = spec.find(':');
+  size_t second = first == std::string::npos ? first : spec.find(':', first + 1);
+  if (second == std::string::npos) {
+    throw std::runtime_error("Transport must be udp:LOCAL:REMOTE or unix:LOCAL:REMOTE, not " + spec);
+  }
+  std::string kind = spec.substr(0, first);
+  std::string local = spec.substr(first + 1, second - first - 1);
+  std::string remote = spec.substr(second + 1);
+
+  sockaddr_storage local_addr = {};
+  sockaddr_storage remote_addr = {};
+  socklen_t addr_size = 0;
+  std::string unlink_path;
+  int family;
+  if (kind == "udp") {
+    family = AF_INET;
+    auto set = [](sockaddr_storage* storage, const std::string& port) {
+      sockaddr_in* addr = reinterpret_cast<sockaddr_in*>(storage);
+      addr->sin_family = AF_INET;
+      addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      addr->sin_port = htons(static_cast<uint16_t>(std::stoi(port)));
+    };
+    set(&local_addr, local);
+    set(&remote_addr, remote);
+    addr_size = sizeof(sockaddr_in);
+  } else if (kind == "unix") {
+    family = AF_UNIX;
+    auto set = [](sockaddr_storage* storage, const std::string& path) {
+      sockaddr_un* addr = reinterpret_cast<sockaddr_un*>(storage);
+      if (path.size() >= sizeof(addr->sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+      }
+      addr->sun_family = AF_UNIX;
+      strcpy(addr->sun_path, path.c_str());
+    };
+    set(&local_addr, local);
+    set(&remote_addr, remote);
+    addr_size = sizeof(sockaddr_un);
+    unlink(local.c_str());  // left over from an earlier run
+    unlink_path = local;
+  } else {
+    throw std::runtime_error("Unknown transport " + kind);
+  }
+
+  int fd = socket(family, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error(string_format("socket() failed: %s", strerror(errno)));
+  }
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&local_addr), addr_size) != 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+    std::string error = strerror(errno);
+    close(fd);
+    throw std::runtime_error("Could not bind " + spec + ": " + error);
+  }
+  return std::make_unique<DatagramTransport>(fd, remote_addr, addr_size, unlink_path);
+}
+
+LaggyTransport::LaggyTransport(std::unique_ptr<NetTransport> inner, double latency_ms, double jitter_ms)
+    : inner_(std::move(inner)), latency_ms_(latency_ms), jitter_ms_(jitter_ms), rng_(std::random_device()()) {}
+
+void LaggyTransport::Send(const void* data, size_t size) {
+  double delay_ms = latency_ms_ + std::uniform_real_distribution<double>(0, jitter_ms_)(rng_);
+  Pending pending;
+  pending.due = Clock::now() + std::chrono::microseconds(static_cast<int64_t>(delay_ms * 1000));
+  pending.data.assign(static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+  auto it = pending_.end();
+  while (it != pending_.begin() && std::prev(it)->due > pending.due) {
+    --it;
+  }
+  pending_.insert(it, std::move(pending));
+  Flush();
+}
+
+size_t LaggyTransport::Receive(void* data, size_t capacity) {
+  Flush();
+  return inner_->Receive(data, capacity);
+}
+
+void LaggyTransport::Flush() {
+  Clock::time_point now = Clock::now();
+  while (!pending_.empty() && pending_.front().due <= now) {
+    inner_->Send(pending_.front().data.data(), pending_.front().data.size());
+    pending_.pop_front();
+  }
+}
+
+RollbackSession::RollbackSession(std::shared_ptr<const Cartridge> cartridge, int local_port,
+                                 NetTransport* transport, int max_rollback)
+    : cpu_(std::move(cartridge)), local_port_(local_port), transport_(transport),
+      max_rollback_(max_rollback), last_heard_(Clock::now()) {
+  if (local_port < 0 || local_port > 1) {
+    throw std::runtime_error("Netplay port must be 0 or 1.");
+  } else if (max_rollback < 1 || max_rollback > kMaxRollback) {
+    throw std::runtime_error(string_format("Rollback must be 1 to %d frames.", kMaxRollback));
+  }
+  for (int i = 0; i <= max_rollback_; ++i) {
+    snapshots_.push_back(std::make_unique<ConsoleState>());
+  }
+}
+
+Image* RollbackSession::AdvanceFrame(uint8_t local_buttons) {
+  local_inputs_.push_back(local_buttons);
+  SendInputs();
+  Poll();
+  // The remote may be ahead, so remote_confirmed_ can exceed frame_.
+  if (frame_ > remote_confirmed_ + max_rollback_) {
+    stats_.stalls++;
+    auto stall_start = Clock::now();
+    while (frame_ > remote_confirmed_ + max_rollback_) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      SendInputs();
+      Poll();
+      if (Clock::now() - last_heard_ > kPeerTimeout) {
+        throw std::runtime_error("Netplay peer stopped responding.");
+      }
+    }
+    stats_.stall_seconds += std::chrono::duration<double>(Clock::now() - stall_start).count();
+  }
+  Rollback();
+  SimulateFrame(frame_++);
+  stats_.frames++;
+  return cpu_.FrameBuffer();
+}
+
+void RollbackSession::WaitUntil(Clock::time_point deadline) {
+  while (Clock::now() + std::chrono::milliseconds(1) < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Poll();
+  }
+  std::this_thread::sleep_until(deadline);
+}
+
+void RollbackSession::Finish(std::chrono::milliseconds linger) {
+  while (remote_confirmed_ < frame_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    SendInputs();
+    Poll();
+    if (Clock::now() - last_heard_ > kPeerTimeout) {
+      throw std::runtime_error("Netplay peer stopped responding.");
+    }
+  }
+  Rollback();
+  auto linger_end = Clock::now() + linger;
+  while (remote_ack_ < frame_ && Clock::now() < linger_end) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    SendInputs();
+    Poll();
+  }
+}
+
+std::vector<uint8_t> RollbackSession::ConfirmedInputs() const {
+  std::vector<uint8_t> inputs;
+  for (uint64_t f = 0; f < frame_; ++f) {
+    uint8_t remote = f < remote_confirmed_ ? static_cast<uint8_t>(remote_inputs_[f]) : 0;
+    inputs.push_back(local_port_ == 0 ? local_inputs_[f] : remote);
+    inputs.push_back(local_port_ == 0 ? remote : local_inputs_[f]);
+  }
+  return inputs;
+}
+
+void RollbackSession::SendInputs() {
+  Packet packet;
+  packet.magic = Packet::kMagic;
+  uint64_t first = std::max<uint64_t>(remote_ack_, local_inputs_.size() > Packet::kMaxInputs ?
+                                      local_inputs_.size() - Packet::kMaxInputs : 0);
+  packet.first_frame = static_cast<uint32_t>(first);
+  packet.ack = static_cast<uint32_t>(remote_confirmed_);
+  packet.count = static_cast<uint32_t>(local_inputs_.size() - first);
+  memcpy(packet.inputs, local_inputs_.data() + first, packet.count);
+  transport_->Send(&packet, offsetof(Packet, inputs) + packet.count);
+}
+
+void RollbackSession::Poll() {
+  Packet packet;
+  size_t size;
+  while ((size = transport_->Receive(&packet, sizeof(packet))) > 0) {
+    if (size < offsetof(Packet, inputs) || packet.magic != Packet::kMagic ||
+        packet.count > Packet::kMaxInputs || size < offsetof(Packet, inputs) + packet.count) {
+      continue;
+    }
+    last_heard_ = Clock::now();
+    remote_ack_ = std::max<uint64_t>(remote_ack_, packet.ack);
+    uint64_t end = static_cast<uint64_t>(packet.first_frame) + packet.count;
+    if (end > local_inputs_.size() + kMaxLead) {
+      continue;  // a peer can't legitimately be this far ahead
+    }
+    if (end > remote_inputs_.size()) {
+      remote_inputs_.resize(end, -1);
+    }
+    for (uint32_t i = 0; i < packet.count; ++i) {
+      uint64_t f = packet.first_frame + i;
+      if (remote_inputs_[f] >= 0) {
+        continue;
+      }
+      remote_inputs_[f] = packet.inputs[i];
+      if (f < frame_ && used_remote_[f] != packet.inputs[i]) {
+        rollback_from_ = std::min(rollback_from_, f);
+      }
+    }
+    while (remote_confirmed_ < remote_inputs_.size() && remote_inputs_[remote_confirmed_] >= 0) {
+      remote_confirmed_++;
+    }
+  }
+}
+
+void RollbackSession::Rollback() {
+  if (rollback_from_ >= frame_) {
+    rollback_from_ = UINT64_MAX;
+    return;
+  }
+  auto resim_start = Clock::now();
+  uint64_t from = rollback_from_;
+  rollback_from_ = UINT64_MAX;
+  cpu_.LoadState(*snapshots_[from % snapshots_.size()]);
+  bool rendering = cpu_.RenderingEnabled();
+  cpu_.SetRenderingEnabled(false);
+  for (uint64_t f = from; f < frame_; ++f) {
+    SimulateFrame(f);
+  }
+  cpu_.SetRenderingEnabled(rendering);
+  int depth = static_cast<int>(frame_ - from);
+  stats_.rollbacks++;
+  stats_.resim_frames += depth;
+  stats_.max_depth = std::max(stats_.max_depth, depth);
+  stats_.resim_seconds += std::chrono::duration<double>(Clock::now() - resim_start).count();
+}
+
+void RollbackSession::SimulateFrame(uint64_t f) {
+  auto snapshot_start = Clock::now();
+  cpu_.SaveState(snapshots_[f % snapshots_.size()].get());
+  stats_.snapshot_seconds += std::chrono::duration<double>(Clock::now() - snapshot_start).count();
+  uint8_t remote = RemoteInputFor(f);
+  if (f >= used_remote_.size()) {
+    used_remote_.resize(f + 1);
+  }
+  used_remote_[f] = remote;
+  cpu_.SetButtons(local_port_, local_inputs_[f]);
+  cpu_.SetButtons(1 - local_port_, remote);
+  cpu_.RunFrame();
+}
+
+uint8_t RollbackSession::RemoteInputFor(uint64_t f) {
+  if (f < remote_inputs_.size() && remote_inputs_[f] >= 0) {
+    return static_cast<uint8_t>(remote_inputs_[f]);
+  }
+  // Predict that the remote player is still holding what they last held.
+  return remote_confirmed_ > 0 ? static_cast<uint8_t>(remote_inputs_[remote_confirmed_ - 1]) : 0;
+}
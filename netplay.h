@@ -0,0 +1,130 @@
+#ifndef NETPLAY_H_
+#define NETPLAY_H_
+
+#include <deque>
+#include <random>
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+
+// Moves small datagrams between two netplay peers. Delivery may be late, reordered or
+// lost; RollbackSession copes with all three.
+class NetTransport {
+  public:
+    virtual ~NetTransport() {}
+    // Never blocks. A datagram that does not fit in the socket buffer is dropped.
+    virtual void Send(const void* data, size_t size) = 0;
+    // Copies one waiting datagram into data and returns its size, or 0 if none is waiting.
+    virtual size_t Receive(void* data, size_t capacity) = 0;
+
+    // "udp:LOCAL_PORT:REMOTE_PORT" on 127.0.0.1, or "unix:LOCAL_PATH:REMOTE_PATH" for
+    // datagram Unix sockets. Throws if the socket can't be set up.
+    static std::unique_ptr<NetTransport> Open(const std::string& spec);
+};
+
+// Holds each outgoing datagram back by latency plus up to jitter, uniformly at random, to
+// simulate a real network over loopback. Jitter can reorder datagrams.
+class LaggyTransport : public NetTransport {
+  public:
+    LaggyTransport(std::unique_ptr<NetTransport> inner, double latency_ms, double jitter_ms);
+
+    void Send(const void* data, size_t size) override;
+    size_t Receive(void* data, size_t capacity) override;
+
+  private:
+    struct Pending {
+      Clock::time_point due;
+      std::vector<uint8_t> data;
+    };
+    void Flush();
+
+    std::unique_ptr<NetTransport> inner_;
+    double latency_ms_;
+    double jitter_ms_;
+    std::mt19937_64 rng_;
+    std::deque<Pending> pending_;  // sorted by due
+};
+
+// Two-player rollback netplay. Every host frame the local input is sent to the peer and
+// the next frame runs at once, predicting that the remote player still holds whatever
+// they held last. When the real remote input for an earlier frame turns out different,
+// the console loads its save state from the start of that frame and re-simulates up to
+// the present with rendering off, so only the newest frame is drawn. A save state is
+// kept for each of the last max_rollback frames, and the session stalls rather than get
+// further than that ahead of the remote input.
+class RollbackSession {
+  public:
+    static constexpr int kMaxRollback = 8;
+
+    struct Stats {
+      uint64_t frames = 0;
+      uint64_t rollbacks = 0;
+      uint64_t resim_frames = 0;
+      double resim_seconds = 0;      // loading states and re-simulating
+      double snapshot_seconds = 0;   // saving the per-frame states
+      int max_depth = 0;             // most frames re-simulated in one host frame
+      uint64_t stalls = 0;           // host frames that waited for remote input
+      double stall_seconds = 0;
+    };
+
+    // local_port is the controller port (0 or 1) this peer plays.
+    RollbackSession(std::shared_ptr<const Cartridge> cartridge, int local_port,
+                    NetTransport* transport, int max_rollback = kMaxRollback);
+
+    // Runs one host frame with local_buttons held and returns the frame to show.
+    // Throws if the peer sends nothing for several seconds.
+    Image* AdvanceFrame(uint8_t local_buttons);
+    // Sleeps until deadline, meanwhile keeping the transport moving and taking in input.
+    void WaitUntil(Clock::time_point deadline);
+    // Waits for the remote input of every frame run so far, corrects the console if it was
+    // mispredicted, and keeps answering the peer until it has all our input too, or for at
+    // most linger. With no new frame to run, that correction can go one frame deeper than
+    // max_rollback.
+    void Finish(std::chrono::milliseconds linger);
+
+    Cpu6502* Console() { return &cpu_; }
+    // Both ports' buttons for each frame run, as finally confirmed. Only complete after Finish().
+    std::vector<uint8_t> ConfirmedInputs() const;
+    Stats GetStats() const { return stats_; }
+
+  private:
+    // A run of one peer's inputs, resent until acknowledged since datagrams can be lost.
+    struct Packet {
+      static constexpr uint32_t kMagic = 0x504E454E;  // "NENP"
+      static constexpr int kMaxInputs = 64;
+      uint32_t magic;
+      uint32_t first_frame;  // frame of inputs[0]
+      uint32_t ack;          // frames of the receiver's input the sender has, contiguously
+      uint32_t count;
+      uint8_t inputs[kMaxInputs];
+    };
+
+    void SendInputs();
+    // Takes in every waiting packet and notes the earliest mispredicted frame.
+    void Poll();
+    // Re-simulates from the earliest mispredicted frame up to the current one.
+    void Rollback();
+    // Runs frame f with the best input known for it, saving its start state first.
+    void SimulateFrame(uint64_t f);
+    uint8_t RemoteInputFor(uint64_t f);
+
+    Cpu6502 cpu_;
+    int local_port_;
+    NetTransport* transport_;
+    int max_rollback_;
+
+    uint64_t frame_ = 0;           // next frame to run
+    uint64_t remote_confirmed_ = 0;  // remote input is known for every frame before this
+    uint64_t remote_ack_ = 0;      // the peer has our input for every frame before this
+    uint64_t rollback_from_ = UINT64_MAX;
+    std::vector<uint8_t> local_inputs_;
+    std::vector<int16_t> remote_inputs_;   // -1 until it arrives
+    std::vector<uint8_t> used_remote_;     // what each frame last ran with
+    // Start-of-frame state of frame f is at f % size.
+    std::vector<std::unique_ptr<ConsoleState>> snapshots_;
+    Clock::time_point last_heard_;
+    Stats stats_;
+};
+
+#endif  // NETPLAY_H_
@@ -0,0 +1,27 @@
+#include "opcode_info.h"
+
+const std::array<OpcodeInfo, 256>& OpcodeInfos() {
+  static const std::array<OpcodeInfo, 256> infos = [] {
+    std::array<OpcodeInfo, 256> set = {};
+    for (int op = 0; op < 256; ++op) {
+      set[op].opcode = op;
+    }
+    // #mode + 1 drops the k.
+    #define OPCODE(op, name, mode, cycles) \
+      set[op] = {op, #name, strncmp(#name, "UN_", 3) == 0 ? #name + 3 : #name, AddressingMode::mode, #mode + 1, \
+                 cycles, strncmp(#name, "UN_", 3) == 0, true};
+    #include "cpu6502_opcodes.h"
+    #undef OPCODE
+    return set;
+  }();
+  return infos;
+}
+
+const std::vector<uint8_t>& ListedOpcodes() {
+  static const std::vector<uint8_t> opcodes = {
+    #define OPCODE(op, name, mode, cycles) op,
+    #include "cpu6502_opcodes.h"
+    #undef OPCODE
+  };
+  return opcodes;
+}
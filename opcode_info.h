@@ -0,0 +1,60 @@
+#ifndef OPCODE_INFO_H_
+#define OPCODE_INFO_H_
+
+#include <array>
+
+#include "common.h"
+
+// The 6502's addressing modes, as cpu6502_opcodes.h names them.
+enum class AddressingMode : uint8_t {
+  kImmediate,
+  kZeroPage,
+  kZeroPageX,
+  kZeroPageY,
+  kAbsolute,
+  kAbsoluteX,
+  kAbsoluteY,
+  kIndirectX,
+  kIndirectY,
+  kAbsoluteIndirect,
+  kRelative,
+  kAccumulator,
+  kNone
+};
+constexpr int kNumAddressingModes = static_cast<int>(AddressingMode::kNone) + 1;
+
+// Bytes of operand after the opcode.
+inline int OperandBytes(AddressingMode mode) {
+  switch (mode) {
+    case AddressingMode::kAbsolute:
+    case AddressingMode::kAbsoluteX:
+    case AddressingMode::kAbsoluteY:
+    case AddressingMode::kAbsoluteIndirect:
+      return 2;
+    case AddressingMode::kAccumulator:
+    case AddressingMode::kNone:
+      return 0;
+    default:
+      return 1;
+  }
+}
+
+// One opcode as cpu6502_opcodes.h lists it. Opcodes it does not list keep the defaults.
+struct OpcodeInfo {
+  uint8_t opcode = 0;
+  const char* name = "???";      // as listed, e.g. UN_SBC for an unofficial SBC
+  const char* mnemonic = "???";  // without the UN_
+  AddressingMode mode = AddressingMode::kNone;
+  const char* mode_name = "";    // without the k, e.g. ZeroPageX
+  uint8_t cycles = 0;            // base cycles; page crossings and taken branches add more
+  bool unofficial = false;
+  bool listed = false;
+};
+
+// Indexed by opcode. The tools that read, write or measure 6502 code share this rather than
+// each expanding cpu6502_opcodes.h; the cores expand it themselves to dispatch by name.
+const std::array<OpcodeInfo, 256>& OpcodeInfos();
+// The listed opcodes in the order cpu6502_opcodes.h lists them.
+const std::vector<uint8_t>& ListedOpcodes();
+
+#endif  // OPCODE_INFO_H_
@@ -0,0 +1,186 @@
+#include "perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
+namespace {
+
+struct CounterConfig {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr uint64_t CacheReadMiss(uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+const std::array<CounterConfig, PerfCounters::kNumCounters> kConfigs = {{
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {"l1d_misses", PERF_TYPE_HW_CACHE, CacheReadMiss(PERF_COUNT_HW_CACHE_L1D)},
+  {"llc_misses", PERF_TYPE_HW_CACHE, CacheReadMiss(PERF_COUNT_HW_CACHE_LL)},
+}};
+
+const std::array<const char*, PhaseCounters::kNumPhases> kPhaseNames = {"cpu", "ppu", "host"};
+
+// Nearest-rank percentile of values, which it sorts.
+uint64_t Percentile(std::vector<uint64_t>* values, double p) {
+  std::sort(values->begin(), values->end());
+  size_t rank = static_cast<size_t>(p * values->size() + 0.999999);
+  return (*values)[std::min(std::max<size_t>(rank, 1), values->size()) - 1];
+}
+
+} // namespace
+
+const char* PerfCounters::Name(Counter counter) {
+  return kConfigs[counter].name;
+}
+
+PerfCounters::Reading& PerfCounters::Reading::operator+=(const Reading& other) {
+  ns += other.ns;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    counts[i] += other.counts[i];
+  }
+  return *this;
+}
+
+PerfCounters::Reading PerfCounters::Reading::operator-(const Reading& other) const {
+  Reading out;
+  out.ns = ns - other.ns;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    // Scaling for multiplexing can move a total back slightly.
+    out.counts[i] = counts[i] > other.counts[i] ? counts[i] - other.counts[i] : 0;
+  }
+  return out;
+}
+
+PerfCounters::PerfCounters(bool hardware) : start_(Clock::now()) {
+  fds_.fill(-1);
+  slots_.fill(-1);
+  for (int i = 0; hardware && i < kNumCounters; ++i) {
+    perf_event_attr attr = {};
+    attr.size = sizeof(attr);
+    attr.type = kConfigs[i].type;
+    attr.config = kConfigs[i].config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+    if (fd < 0) {
+      if (error_.empty()) {
+        error_ = string_format("perf_event_open(%s): %s", kConfigs[i].name, strerror(errno));
+        if (errno == EACCES || errno == EPERM) {
+          error_ += " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+      }
+      continue;
+    }
+    if (leader_ < 0) {
+      leader_ = fd;
+    }
+    fds_[i] = fd;
+    slots_[i] = open_++;
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+PerfCounters::Reading PerfCounters::Read() const {
+  Reading reading;
+  reading.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+  if (leader_ < 0) {
+    return reading;
+  }
+  // nr, time_enabled, time_running, then one value per counter.
+  uint64_t data[3 + kNumCounters];
+  if (read(leader_, data, sizeof(data)) < static_cast<ssize_t>((3 + open_) * sizeof(uint64_t))) {
+    return reading;
+  }
+  double scale = data[2] > 0 && data[2] < data[1] ? static_cast<double>(data[1]) / data[2] : 1.0;
+  for (int i = 0; i < kNumCounters; ++i) {
+    if (slots_[i] >= 0) {
+      reading.counts[i] = static_cast<uint64_t>(data[3 + slots_[i]] * scale);
+    }
+  }
+  return reading;
+}
+
+const char* PhaseCounters::Name(Phase phase) {
+  return kPhaseNames[phase];
+}
+
+PhaseCounters::PhaseCounters(const PerfCounters* counters) : counters_(counters), last_(counters->Read()) {}
+
+void PhaseCounters::EndFrame() {
+  Switch(kHost);
+  PerfCounters::Reading frame;
+  for (int p = 0; p < kNumPhases; ++p) {
+    frame += frame_phases_[p];
+    last_frame_[p] = frame_phases_[p];
+    frame_phases_[p] = PerfCounters::Reading();
+  }
+  frames_.push_back(frame);
+}
+
+std::vector<std::string> PhaseCounters::Describe() const {
+  std::vector<std::string> lines;
+  const PerfCounters& c = *counters_;
+  uint64_t total_ns = 0;
+  for (const PerfCounters::Reading& phase : phases_) {
+    total_ns += phase.ns;
+  }
+  // Counters are per frame, or in total if no frame has ended.
+  size_t frames = std::max<size_t>(frames_.size(), 1);
+  for (int p = 0; p < kNumPhases; ++p) {
+    const PerfCounters::Reading& r = phases_[p];
+    std::string line = string_format("perf %-4s time=%.3fms (%.1f%%)", kPhaseNames[p], r.ns / 1e6,
+        total_ns > 0 ? 100.0 * r.ns / total_ns : 0.0);
+    if (!frames_.empty()) {
+      line += string_format(" per_frame: time=%.1fus", r.ns / 1e3 / frames);
+    }
+    for (int i = 0; i < PerfCounters::kNumCounters; ++i) {
+      if (c.Has(static_cast<PerfCounters::Counter>(i))) {
+        line += string_format(" %s=%llu", PerfCounters::Name(static_cast<PerfCounters::Counter>(i)),
+            static_cast<unsigned long long>(r.counts[i] / frames));
+      }
+    }
+    if (c.Has(PerfCounters::kCycles) && c.Has(PerfCounters::kInstructions) && r.counts[PerfCounters::kCycles] > 0) {
+      line += string_format(" ipc=%.2f", static_cast<double>(r.counts[PerfCounters::kInstructions]) /
+          r.counts[PerfCounters::kCycles]);
+    }
+    lines.push_back(line);
+  }
+  if (!frames_.empty()) {
+    std::vector<uint64_t> ns;
+    std::vector<uint64_t> cycles;
+    for (const PerfCounters::Reading& frame : frames_) {
+      ns.push_back(frame.ns);
+      cycles.push_back(frame.counts[PerfCounters::kCycles]);
+    }
+    std::string line = string_format("perf frames=%zu time median=%.1fus p99=%.1fus max=%.1fus", frames_.size(),
+        Percentile(&ns, 0.5) / 1e3, Percentile(&ns, 0.99) / 1e3, Percentile(&ns, 1.0) / 1e3);
+    if (c.Has(PerfCounters::kCycles)) {
+      line += string_format(" cycles median=%llu p99=%llu max=%llu",
+          static_cast<unsigned long long>(Percentile(&cycles, 0.5)),
+          static_cast<unsigned long long>(Percentile(&cycles, 0.99)),
+          static_cast<unsigned long long>(Percentile(&cycles, 1.0)));
+    }
+    lines.push_back(line);
+  }
+  if (!c.Error().empty()) {
+    lines.push_back(string_format("perf %s counters: %s", c.Any() ? "some" : "no", c.Error().c_str()));
+  }
+  return lines;
+}
@@ -0,0 +1,99 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <array>
+
+#include "common.h"
+
+// Hardware performance counters for the calling thread, from Linux perf_event_open, counted in
+// user space only so perf_event_paranoid 2 allows them. They are opened as one group and read
+// with a single read(), alongside the host clock.
+//
+// Counters the kernel or CPU does not offer (in most VMs and containers, none) are left out
+// and Error() says why, so callers fall back to timing alone.
+class PerfCounters {
+  public:
+    enum Counter { kCycles, kInstructions, kBranchMisses, kL1dMisses, kLlcMisses, kNumCounters };
+    static const char* Name(Counter counter);
+
+    // Counts since the counters were opened. Counters that are not open stay 0.
+    struct Reading {
+      uint64_t ns = 0;
+      std::array<uint64_t, kNumCounters> counts = {};
+
+      Reading& operator+=(const Reading& other);
+      Reading operator-(const Reading& other) const;
+    };
+
+    // With hardware false nothing is opened, for callers that only want the phase timings.
+    explicit PerfCounters(bool hardware = true);
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool Has(Counter counter) const { return fds_[counter] >= 0; }
+    // True if at least one counter is open.
+    bool Any() const { return leader_ >= 0; }
+    // Why counters are missing, or empty if all are open.
+    const std::string& Error() const { return error_; }
+    // Counts are scaled up if the kernel had to multiplex the group.
+    Reading Read() const;
+
+  private:
+    std::array<int, kNumCounters> fds_;
+    std::array<int, kNumCounters> slots_;  // position in the group's read() output
+    int leader_ = -1;
+    int open_ = 0;
+    std::string error_;
+    Clock::time_point start_;
+};
+
+// Splits a console's run into phases and accumulates counters for each phase and each frame.
+// Attach it with Cpu6502::SetPhaseCounters(); the CPU switches to kPpu around PPU updates,
+// which include rendering scanlines and converting palette indices to RGB.
+// The runner marks everything it does between frames as kHost with EndFrame().
+//
+// Every switch reads the counters, which costs a system call when they are open.
+class PhaseCounters {
+  public:
+    enum Phase { kCpu, kPpu, kHost, kNumPhases };
+    static const char* Name(Phase phase);
+
+    // counters must outlive this and belong to the running thread. Starts in kCpu.
+    explicit PhaseCounters(const PerfCounters* counters);
+
+    void Switch(Phase phase) {
+      PerfCounters::Reading now = counters_->Read();
+      PerfCounters::Reading delta = now - last_;
+      phases_[phase_] += delta;
+      frame_phases_[phase_] += delta;
+      phase_ = phase;
+      last_ = now;
+    }
+    // The console has finished a frame: switches to kHost, keeping the frame's total.
+    void EndFrame();
+    // The runner is done with the frame: switches back to kCpu, counting the time since
+    // EndFrame() in the next frame.
+    void StartFrame() { Switch(kCpu); }
+
+    const PerfCounters& Counters() const { return *counters_; }
+    const PerfCounters::Reading& Total(Phase phase) const { return phases_[phase]; }
+    // One Reading per frame ended, all phases together.
+    const std::vector<PerfCounters::Reading>& Frames() const { return frames_; }
+    // The phase's share of the last frame ended.
+    const PerfCounters::Reading& LastFrame(Phase phase) const { return last_frame_[phase]; }
+    // A line per phase with its total time and its time and counters per frame, then one with
+    // the median, p99 and max frame, and a note if counters were unavailable.
+    std::vector<std::string> Describe() const;
+
+  private:
+    const PerfCounters* counters_;
+    Phase phase_ = kCpu;
+    PerfCounters::Reading last_;
+    std::array<PerfCounters::Reading, kNumPhases> frame_phases_;  // the frame in progress
+    std::array<PerfCounters::Reading, kNumPhases> last_frame_;
+    std::array<PerfCounters::Reading, kNumPhases> phases_;
+    std::vector<PerfCounters::Reading> frames_;
+};
+
+#endif  // PERF_COUNTERS_H_
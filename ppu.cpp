@@ -9,31 +9,55 @@ bool IsVisibleScanline(uint16_t scanline) {
   return scanline <= 239;
 }
 
+// 2C02 palette, indexed by the 6-bit colour values in state_->palette_ram.
+const Image::Pixel kNesPalette[64] = {
+  {84, 84, 84}, {0, 30, 116}, {8, 16, 144}, {48, 0, 136}, {68, 0, 100}, {92, 0, 48}, {84, 4, 0}, {60, 24, 0},
+  {32, 42, 0}, {8, 58, 0}, {0, 64, 0}, {0, 60, 0}, {0, 50, 60}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+  {152, 150, 152}, {8, 76, 196}, {48, 50, 236}, {92, 30, 228}, {136, 20, 176}, {160, 20, 100}, {152, 34, 32}, {120, 60, 0},
+  {84, 90, 0}, {40, 114, 0}, {8, 124, 0}, {0, 118, 40}, {0, 102, 120}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+  {236, 238, 236}, {76, 154, 236}, {120, 124, 236}, {176, 98, 236}, {228, 84, 236}, {236, 88, 180}, {236, 106, 100}, {212, 136, 32},
+  {160, 170, 0}, {116, 196, 0}, {76, 208, 32}, {56, 204, 108}, {56, 180, 204}, {60, 60, 60}, {0, 0, 0}, {0, 0, 0},
+  {236, 238, 236}, {168, 204, 236}, {188, 188, 236}, {212, 178, 236}, {236, 174, 236}, {236, 174, 212}, {236, 180, 176}, {228, 196, 144},
+  {204, 210, 120}, {180, 222, 120}, {168, 226, 144}, {152, 226, 180}, {160, 214, 228}, {160, 162, 160}, {0, 0, 0}, {0, 0, 0},
+};
+
 } // namespace
 
-Ppu::Ppu(uint8_t* chr, size_t chr_size) {
+Ppu::Ppu(const uint8_t* chr, size_t chr_size, Mirroring mirroring, PpuState* state, uint8_t* chr_ram)
+    : state_(state), mirroring_(mirroring) {
+  memset(state_, 0, sizeof(PpuState));
+  state_->next_ppuscroll_write_is_x = true;
+  state_->next_ppuaddr_write_is_msb = true;
   if (chr == nullptr) {
-    chr_ = nullptr;
-    chr_size_ = 0;
+    chr_size_ = 0x2000;
+    chr_ram_ = chr_ram;
+    memset(chr_ram_, 0, chr_size_);
+    chr_ = chr_ram_;
   } else {
     chr_size_ = chr_size;
-    chr_ = (uint8_t*)malloc(chr_size_ * sizeof(uint8_t));
-    memcpy(chr_, chr, chr_size_);
+    chr_ = chr;
   }
   frame_buffer_ = std::make_unique<Image>(kFrameX, kFrameY);
+  frame_buffer_->SetAll(0);
   DBG("Created PPU with %llu byte CHR\n", static_cast<uint64_t>(chr_size));
 }
 
-Ppu::~Ppu() {
-  free(chr_);
-}
-
 void Ppu::Update() {
-  scanline_++;
-  cycle_ += 341;
+  state_->scanline = (state_->scanline + 1) % kNumScanlines;
+  state_->cycle += 341;
 
-  if (IsVisibleScanline(scanline_)) {
-    RenderScanline(scanline_);
+  if (IsVisibleScanline(state_->scanline)) {
+    if (rendering_enabled_) {
+      RenderScanline(state_->scanline);
+    }
+  } else if (state_->scanline == kVblankScanline) {
+    state_->ppustatus = SetBit(7, state_->ppustatus, 1);
+    state_->frame_count++;
+    if (Bit(7, state_->ppuctrl)) {
+      state_->nmi_pending = true;
+    }
+  } else if (state_->scanline == kPreRenderScanline) {
+    state_->ppustatus &= 0b0001'1111;  // clear vblank, sprite 0 hit and overflow
   }
 }
 
@@ -45,13 +69,11 @@ uint8_t Ppu::GetMMAP(uint16_t addr) {
     }
     return chr_[addr];
   } else if (addr < 0x3000) {
-    return nametable_ram_[addr - 0x2000];
+    return Nametable(addr);
   } else if (addr < 0x3F00) {
-    return nametable_ram_[addr - 0x3000];
-  } else if (addr < 0x3F20) {
-    return palette_ram_[addr - 0x3F00];
+    return Nametable(addr - 0x1000);
   } else if (addr < 0x4000) {
-    return palette_ram_[0x3F00 + (addr % 0x20)];
+    return state_->palette_ram[addr % 0x20];
   }
   throw std::runtime_error("PPU[addr] outside memory map range.");
 }
@@ -61,46 +83,52 @@ void Ppu::SetMMAP(uint16_t addr, uint8_t val) {
     if (addr >= chr_size_) {
       throw std::runtime_error("PPU[addr] access outside of CHR. Is this legal?");
     }
-    chr_[addr] = val;
+    if (chr_ram_) {
+      chr_ram_[addr] = val;
+    }  // else CHR-ROM, writes are ignored
   } else if (addr < 0x3000) {
-    nametable_ram_[addr - 0x2000] = val;
+    Nametable(addr) = val;
   } else if (addr < 0x3F00) {
-    nametable_ram_[addr - 0x3000] = val;
-  } else if (addr < 0x3F20) {
-    palette_ram_[addr - 0x3F00] = val;
+    Nametable(addr - 0x1000) = val;
   } else if (addr < 0x4000) {
-    palette_ram_[0x3F00 + (addr % 0x20)] = val;
+    state_->palette_ram[addr % 0x20] = val;
+  } else {
+    throw std::runtime_error("PPU[addr] outside memory map range.");
   }
-  throw std::runtime_error("PPU[addr] outside memory map range.");
 }
 
 void Ppu::SetPpuStatusLSBits(uint8_t val) {
-  for (int i = 0; i <= 4; ++i) {
-    SetBit(i, ppustatus_, Bit(i, val));
-  }
+  state_->ppustatus = (state_->ppustatus & 0b1110'0000) | (val & 0b0001'1111);
 }
 
 void Ppu::SetCTRL(uint8_t val) {
-  ppuctrl_ = val;
+  // Enabling NMI during vblank raises one immediately.
+  if (!Bit(7, state_->ppuctrl) && Bit(7, val) && Bit(7, state_->ppustatus)) {
+    state_->nmi_pending = true;
+  }
+  state_->ppuctrl = val;
   SetLatch(val);
 }
 
 void Ppu::SetMASK(uint8_t val) {
-  ppumask_= val;
+  state_->ppumask= val;
   SetLatch(val);
 }
 
 uint8_t Ppu::GetSTATUS() {
-  SetPpuStatusLSBits(latch_);
-  uint8_t res = ppustatus_;
-  SetBit(7, ppustatus_, 0); // reading clears bit 7 after read.
-  // TODO: Set bits 5, 6, 7. Potentially do this elsewhere.
+  SetPpuStatusLSBits(state_->latch);
+  uint8_t res = state_->ppustatus;
+  state_->ppustatus = SetBit(7, state_->ppustatus, 0); // reading clears bit 7 after read.
+  // Reading also resets the PPUSCROLL/PPUADDR write toggle.
+  state_->next_ppuscroll_write_is_x = true;
+  state_->next_ppuaddr_write_is_msb = true;
+  // TODO: Set bits 5, 6. Potentially do this elsewhere.
   SetLatch(res);
   return res;
 }
 
 void Ppu::SetOAMADDR(uint8_t val) {
-  oamaddr_ = val;
+  state_->oamaddr = val;
   SetLatch(val);
 }
 
@@ -108,7 +136,7 @@ uint8_t Ppu::GetOAMDATA() {
   // re: https://wiki.nesdev.com/w/index.php?title=PPU_registers
   // > reads during vertical or forced blanking return the value from OAM at that address but do not increment
   // so should we increment otherwise?
-  uint8_t val = oam_[oamaddr_];
+  uint8_t val = state_->oam[state_->oamaddr];
   SetLatch(val);
   return val;
 }
@@ -117,55 +145,95 @@ void Ppu::SetOAMDATA(uint8_t val) {
   // I don't think this counts as a register for ppustatus.
   // TODO: ignore writes/increments during rendering
   //  (on the pre-render line and the visible lines 0-239, provided either sprite or background rendering is enabled) 
-  oam_[oamaddr_++] = val;
+  state_->oam[state_->oamaddr++] = val;
   SetLatch(val);
 }
 
 void Ppu::SetPPUSCROLL(uint8_t val) {
-  if (next_ppuscroll_write_is_x_) {
-    ppuscroll_x_ = val;
+  if (state_->next_ppuscroll_write_is_x) {
+    state_->ppuscroll_x = val;
   } else {
-    ppuscroll_y_ = val;
+    state_->ppuscroll_y = val;
   }
-  next_ppuscroll_write_is_x_ = !next_ppuscroll_write_is_x_;
+  state_->next_ppuscroll_write_is_x = !state_->next_ppuscroll_write_is_x;
   SetLatch(val);
 }
 
 void Ppu::SetPPUADDR(uint8_t val) {
-  if (next_ppuaddr_write_is_msb_) {
-    ppuaddr_ &= 0x00FF;
-    ppuaddr_ |= (static_cast<uint16_t>(val) << 8);
+  if (state_->next_ppuaddr_write_is_msb) {
+    state_->ppuaddr &= 0x00FF;
+    state_->ppuaddr |= (static_cast<uint16_t>(val) << 8);
   } else {
-    ppuaddr_ &= 0xFF00;
-    ppuaddr_ |= val;
+    state_->ppuaddr &= 0xFF00;
+    state_->ppuaddr |= val;
   }
-  next_ppuaddr_write_is_msb_ = !next_ppuaddr_write_is_msb_;
+  state_->next_ppuaddr_write_is_msb = !state_->next_ppuaddr_write_is_msb;
   SetLatch(val);
 }
 
 void Ppu::SetPPUDATA(uint8_t val) {
-  SetMMAP(ppuaddr_, val);
-  uint8_t inc_amt = Bit(2, GetMMAP(0x2000));
-  ppuaddr_ += inc_amt;
+  SetMMAP(state_->ppuaddr % 0x4000, val);
+  uint8_t inc_amt = Bit(2, state_->ppuctrl) ? 32 : 1;
+  state_->ppuaddr += inc_amt;
   SetLatch(val);
 }
 
 uint8_t Ppu::GetPPUDATA() {
-  uint8_t res = GetMMAP(ppuaddr_);
-  uint8_t inc_amt = Bit(2, GetMMAP(0x2000));
-  ppuaddr_ += inc_amt;
+  uint8_t res = GetMMAP(state_->ppuaddr % 0x4000);
+  uint8_t inc_amt = Bit(2, state_->ppuctrl) ? 32 : 1;
+  state_->ppuaddr += inc_amt;
   SetLatch(res);
   return res;
 }
 
-void Ppu::SetOAMDMA(uint8_t* data) {
+void Ppu::SetOAMDMA(const uint8_t* data) {
   // Upload arbitrary data to the PPU.
   assert(data);
-  memcpy(oam_, data, 256);
+  memcpy(state_->oam, data, 256);
 }
 
 void Ppu::RenderScanline(int line) {
-  throw std::runtime_error("Cannot render yet!");
+  uint8_t* row = frame_buffer_->Row(line);
+  if (!Bit(3, state_->ppumask)) {
+    // Background disabled, fill with the universal background colour.
+    const Image::Pixel& pix = kNesPalette[state_->palette_ram[0] % 64];
+    for (int x = 0; x < kFrameX; ++x) {
+      row[x * 3] = pix.r;
+      row[x * 3 + 1] = pix.g;
+      row[x * 3 + 2] = pix.b;
+    }
+    return;
+  }
+
+  uint16_t pattern_base = Bit(4, state_->ppuctrl) ? 0x1000 : 0x0000;
+  int y = line + state_->ppuscroll_y;
+  int nt_y = Bit(1, state_->ppuctrl);
+  if (y >= kFrameY) {
+    y -= kFrameY;
+    nt_y ^= 1;
+  }
+  for (int x = 0; x < kFrameX; ++x) {
+    int sx = x + state_->ppuscroll_x;
+    int nt_x = Bit(0, state_->ppuctrl);
+    if (sx >= kFrameX) {
+      sx -= kFrameX;
+      nt_x ^= 1;
+    }
+    uint16_t nt_base = 0x2000 + (nt_y << 11) + (nt_x << 10);
+    uint8_t tile = Nametable(nt_base + (y / 8) * 32 + sx / 8);
+    uint8_t attr = Nametable(nt_base + 0x3C0 + (y / 32) * 8 + sx / 32);
+    uint8_t palette = (attr >> ((((y / 16) % 2) << 2) | (((sx / 16) % 2) << 1))) & 0b11;
+
+    uint16_t pattern_addr = (pattern_base + tile * 16 + (y % 8)) % chr_size_;
+    uint8_t bit = 7 - (sx % 8);
+    uint8_t pix = Bit(bit, chr_[pattern_addr]) | (Bit(bit, chr_[(pattern_addr + 8) % chr_size_]) << 1);
+    uint8_t color = pix == 0 ? state_->palette_ram[0] : state_->palette_ram[palette * 4 + pix];
+
+    const Image::Pixel& rgb = kNesPalette[color % 64];
+    row[x * 3] = rgb.r;
+    row[x * 3 + 1] = rgb.g;
+    row[x * 3 + 2] = rgb.b;
+  }
 }
 
 void Ppu::DbgChr() {
@@ -1,8 +1,10 @@
 #ifndef PPU_H_
 #define PPU_H_
 
+#include "cartridge.h"
 #include "common.h"
 #include "image.h"
+#include "state.h"
 
 // https://wiki.nesdev.com/w/images/d/d1/Ntsc_timing.png
 // https://www.reddit.com/r/EmuDev/comments/7k08b9/not_sure_where_to_start_with_the_nes_ppu/
@@ -12,17 +14,31 @@
 
 constexpr int kFrameX = 256;
 constexpr int kFrameY = 240;
+constexpr int kNumScanlines = 262;
+// First scanline of vblank. The frame buffer is complete once we get here.
+constexpr int kVblankScanline = 241;
+constexpr int kPreRenderScanline = 261;
 
 class Ppu {
   public:
-    // Copies chr into chr_  if not null.
-    Ppu(uint8_t* chr, size_t chr_size);
-    ~Ppu();
+    // chr is CHR-ROM owned by the Cartridge and is not copied. If null, the 8k at chr_ram is
+    // used as CHR-RAM instead. state and chr_ram belong to the caller (usually they are part
+    // of a ConsoleState) and are reset here. mirroring is the cartridge's.
+    Ppu(const uint8_t* chr, size_t chr_size, Mirroring mirroring, PpuState* state, uint8_t* chr_ram);
 
     // Runs a scanline's worth of cycles.
     // TODO: Figure out HBlank
     void Update();
 
+    // Number of frames completed, incremented when vblank starts.
+    uint64_t FrameCount() { return state_->frame_count; }
+    // Returns true (once) if an NMI should be raised on the CPU.
+    bool PollNmi() {
+      bool nmi = state_->nmi_pending;
+      state_->nmi_pending = false;
+      return nmi;
+    }
+
     uint8_t GetMMAP(uint16_t addr);
     void SetMMAP(uint16_t addr, uint8_t val);
 
@@ -38,48 +54,47 @@ class Ppu {
     void SetPPUADDR(uint8_t val);
     void SetPPUDATA(uint8_t val);
     uint8_t GetPPUDATA();
-    void SetOAMDMA(uint8_t* data);
+    void SetOAMDMA(const uint8_t* data);
 
     // Set the contents of the latch.
-    void SetLatch(uint8_t val) { latch_ = val; }
+    void SetLatch(uint8_t val) { state_->latch = val; }
     // Returns the contents of the latch. Used when reading write-only ports.
-    uint8_t GetLatch() { return latch_; }
+    uint8_t GetLatch() { return state_->latch; }
 
     Image* FrameBuffer() { return frame_buffer_.get(); }
+    // When disabled, scanlines are not drawn. Timing, vblank and NMI are unaffected.
+    void SetRenderingEnabled(bool enabled) { rendering_enabled_ = enabled; }
+    bool RenderingEnabled() { return rendering_enabled_; }
+
+    bool HasChrRam() { return chr_ram_ != nullptr; }
   
     void DbgChr();
 
   private:
     void SetPpuStatusLSBits(uint8_t val); // sets bits 0-4 of ppustatus
 
-    // Writes to the frame_buffer_.
+    // Writes to the frame_buffer_. Background only for now.
     void RenderScanline(int line);
-
-    uint8_t* chr_;  // CHR_ROM or CHR_RAM -> pattern tables?
+    // Nametable memory is 2kB, and mirroring_ picks the 1kB half each of the four nametables
+    // at $2000-$2FFF uses.
+    uint8_t& Nametable(uint16_t addr) {
+      uint16_t offset = addr & 0xFFF;
+      if (mirroring_ == Mirroring::kHorizontal) {
+        offset = ((offset & 0x800) >> 1) | (offset & 0x3FF);
+      }
+      return state_->nametable_ram[offset & 0x7FF];
+    }
+
+    // Registers, 2kB of VRAM, palette and OAM. PpuState::cycle counts PPU cycles:
+    // 1 CPU cycle = 3 PPU cycles and each scanline is 341 PPU cycles (113.667 CPU cycles).
+    PpuState* state_;
+
+    const uint8_t* chr_;  // CHR_ROM or CHR_RAM -> pattern tables?
     size_t chr_size_;
+    uint8_t* chr_ram_ = nullptr;  // Set (and aliased by chr_) only when there is no CHR-ROM.
+    Mirroring mirroring_;
 
-    uint8_t nametable_ram_[2048] = {}; // 2kB of VRAM
-    uint8_t palette_ram_[32] = {};
-    uint8_t oam_[256] = {};
-
-    uint8_t latch_ = 0;
-
-    bool next_ppuscroll_write_is_x_ = true; // otherwise y
-    bool next_ppuaddr_write_is_msb_ = true; // otherwise lsb
-
-    uint8_t ppuctrl_ = 0;
-    uint8_t ppumask_ = 0;
-    uint8_t ppustatus_ = 0;
-    uint8_t oamaddr_ = 0;
-    uint8_t ppuscroll_x_ = 0;
-    uint8_t ppuscroll_y_ = 0;
-    uint16_t ppuaddr_ = 0;
-
-    // Current cycle number. Cycle 7 means 7 cycles have elapsed.
-    // 1 CPU cycle = 3 PPU cycles. Each scanline is 341 PPU cycles (113.667 CPU cycles).
-    uint64_t cycle_ = 0;
-    // Current scanline. May not be a visible scanline.
-    uint16_t scanline_ = 0;
+    bool rendering_enabled_ = true;
 
     // 256x240 RGB24 frame buffer. We render to this, then upload to the GPU for display.
     // After overscan we crop to 256x224 for display.
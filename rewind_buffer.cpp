@@ -0,0 +1,242 @@
+#include "rewind_buffer.h"
+
+namespace {
+
+// States Push() can hold while the encoder catches up.
+const int kNumSlots = 8;
+// Equal bytes needed to end a literal run. Shorter gaps are cheaper left in the literal.
+const size_t kMinZeroRun = 4;
+// Worst case for one encoded delta: every 5 bytes of input cost at most 2 token bytes.
+const size_t kMaxEncodedBytes = sizeof(ConsoleState) * 2 + 16;
+
+uint8_t* PutVarint(size_t value, uint8_t* out) {
+  while (value >= 0x80) {
+    *out++ = static_cast<uint8_t>(value) | 0x80;
+    value >>= 7;
+  }
+  *out++ = static_cast<uint8_t>(value);
+  return out;
+}
+
+const uint8_t* GetVarint(const uint8_t* in, size_t* value) {
+  size_t result = 0;
+  int shift = 0;
+  while (*in & 0x80) {
+    result |= static_cast<size_t>(*in++ & 0x7F) << shift;
+    shift += 7;
+  }
+  *value = result | (static_cast<size_t>(*in++) << shift);
+  return in;
+}
+
+// First index at or after i where a and b differ, or size.
+size_t SkipEqual(const uint8_t* a, const uint8_t* b, size_t i, size_t size) {
+  while (i + 8 <= size) {
+    uint64_t wa, wb;
+    memcpy(&wa, a + i, 8);
+    memcpy(&wb, b + i, 8);
+    if (wa != wb) {
+      break;
+    }
+    i += 8;
+  }
+  while (i < size && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+} // namespace
+
+RewindBuffer::RewindBuffer(size_t capacity_bytes) {
+  if (capacity_bytes < kMaxEncodedBytes * 2) {
+    throw std::runtime_error(string_format("Rewind buffer needs at least %zu bytes.", kMaxEncodedBytes * 2));
+  }
+  ring_.resize(capacity_bytes);
+  scratch_.resize(kMaxEncodedBytes);
+  head_ = std::make_unique<ConsoleState>();
+  for (int i = 0; i < kNumSlots; ++i) {
+    slots_.push_back(std::make_unique<ConsoleState>());
+    free_.push_back(slots_.back().get());
+  }
+  stats_.capacity_bytes = capacity_bytes;
+  encoder_ = std::thread(&RewindBuffer::EncoderLoop, this);
+}
+
+RewindBuffer::~RewindBuffer() {
+  {
+    const std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  work_cv_.notify_one();
+  encoder_.join();
+}
+
+void RewindBuffer::Push(const ConsoleState& state) {
+  ConsoleState* slot;
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    if (free_.empty()) {
+      stats_.waits++;
+      free_cv_.wait(lock, [this]() { return !free_.empty(); });
+    }
+    slot = free_.back();
+    free_.pop_back();
+  }
+  // The slot is ours until it is queued, so copy without holding the lock.
+  memcpy(slot, &state, sizeof(ConsoleState));
+  {
+    const std::lock_guard<std::mutex> lock(mu_);
+    queued_.push_back(slot);
+  }
+  work_cv_.notify_one();
+}
+
+bool RewindBuffer::Rewind(ConsoleState* state) {
+  std::unique_lock<std::mutex> lock(mu_);
+  WaitIdle(lock);
+  if (entries_.empty()) {
+    return false;
+  }
+  Entry entry = entries_.back();
+  entries_.pop_back();
+  ApplyXor(&ring_[entry.offset], entry.size, reinterpret_cast<uint8_t*>(head_.get()));
+  ring_end_ = entries_.empty() ? 0 : entries_.back().offset + entries_.back().size;
+  stats_.frames--;
+  stats_.encoded_bytes -= entry.size;
+  stats_.raw_bytes -= sizeof(ConsoleState);
+  memcpy(state, head_.get(), sizeof(ConsoleState));
+  return true;
+}
+
+void RewindBuffer::Clear() {
+  std::unique_lock<std::mutex> lock(mu_);
+  WaitIdle(lock);
+  entries_.clear();
+  ring_end_ = 0;
+  has_head_ = false;
+  stats_.frames = 0;
+  stats_.encoded_bytes = 0;
+  stats_.raw_bytes = 0;
+}
+
+RewindBuffer::Stats RewindBuffer::GetStats() {
+  const std::lock_guard<std::mutex> lock(mu_);
+  return stats_;
+}
+
+void RewindBuffer::WaitIdle(std::unique_lock<std::mutex>& lock) {
+  idle_cv_.wait(lock, [this]() { return queued_.empty() && !busy_; });
+}
+
+void RewindBuffer::EncoderLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    work_cv_.wait(lock, [this]() { return stop_ || !queued_.empty(); });
+    if (stop_) {
+      return;
+    }
+    ConsoleState* state = queued_.front();
+    queued_.pop_front();
+    busy_ = true;
+    lock.unlock();
+
+    // Only this thread touches head_ and ring_ while busy_; Rewind and Clear wait for idle.
+    auto start_time = Clock::now();
+    Append(*state);
+    double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    lock.lock();
+    stats_.encode_seconds += seconds;
+    free_.push_back(state);
+    free_cv_.notify_one();
+    busy_ = !queued_.empty();
+    if (!busy_) {
+      idle_cv_.notify_all();
+    }
+  }
+}
+
+void RewindBuffer::Append(const ConsoleState& state) {
+  if (!has_head_) {
+    memcpy(head_.get(), &state, sizeof(ConsoleState));
+    has_head_ = true;
+    const std::lock_guard<std::mutex> lock(mu_);
+    stats_.frames = 1;
+    return;
+  }
+  // The delta turns the new head back into the old one.
+  size_t size = EncodeXor(reinterpret_cast<const uint8_t*>(&state),
+                          reinterpret_cast<const uint8_t*>(head_.get()), sizeof(ConsoleState),
+                          scratch_.data());
+  memcpy(head_.get(), &state, sizeof(ConsoleState));
+
+  // Deltas never wrap, so each one can be decoded in place. Make room by dropping the
+  // oldest: first anything between the write position and the end of the ring if we
+  // have to go back to the start, then whatever the new delta would overwrite.
+  uint64_t evicted = 0;
+  uint64_t evicted_bytes = 0;
+  auto evict_front = [&]() {
+    evicted++;
+    evicted_bytes += entries_.front().size;
+    entries_.pop_front();
+  };
+  if (ring_end_ + size > ring_.size()) {
+    while (!entries_.empty() && entries_.front().offset >= ring_end_) {
+      evict_front();
+    }
+    ring_end_ = 0;
+  }
+  while (!entries_.empty() && entries_.front().offset < ring_end_ + size &&
+         entries_.front().offset + entries_.front().size > ring_end_) {
+    evict_front();
+  }
+  memcpy(&ring_[ring_end_], scratch_.data(), size);
+  entries_.push_back({ring_end_, size});
+  ring_end_ += size;
+
+  const std::lock_guard<std::mutex> lock(mu_);
+  stats_.frames = entries_.size() + 1;
+  stats_.evicted += evicted;
+  stats_.encoded_bytes += size;
+  stats_.encoded_bytes -= evicted_bytes;
+  stats_.raw_bytes = entries_.size() * sizeof(ConsoleState);
+}
+
+// Encoding: repeated (varint equal_run, varint literal_len, literal_len bytes of a ^ b)
+// until the whole state is covered.
+size_t RewindBuffer::EncodeXor(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out) {
+  uint8_t* start = out;
+  size_t i = 0;
+  while (i < size) {
+    size_t literal_start = SkipEqual(a, b, i, size);
+    size_t literal_end = literal_start;
+    for (size_t j = literal_start; j < size; ++j) {
+      if (a[j] != b[j]) {
+        literal_end = j + 1;
+      } else if (j + 1 - literal_end >= kMinZeroRun) {
+        break;
+      }
+    }
+    out = PutVarint(literal_start - i, out);
+    out = PutVarint(literal_end - literal_start, out);
+    for (size_t j = literal_start; j < literal_end; ++j) {
+      *out++ = a[j] ^ b[j];
+    }
+    i = literal_end > literal_start ? literal_end : size;
+  }
+  return out - start;
+}
+
+void RewindBuffer::ApplyXor(const uint8_t* in, size_t in_size, uint8_t* dst) {
+  const uint8_t* end = in + in_size;
+  while (in < end) {
+    size_t equal_run, literal_len;
+    in = GetVarint(in, &equal_run);
+    in = GetVarint(in, &literal_len);
+    dst += equal_run;
+    for (size_t j = 0; j < literal_len; ++j) {
+      *dst++ ^= *in++;
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef REWIND_BUFFER_H_
+#define REWIND_BUFFER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "common.h"
+#include "state.h"
+
+// Keeps the most recent save states within a fixed memory budget so play can be stepped
+// backwards a frame at a time.
+//
+// Only the newest state is kept whole. Each older one is stored as the XOR of it and the
+// state after it, zero-run encoded: most of the console's RAM, VRAM, OAM and PRG-RAM is
+// unchanged between frames, so the XOR is mostly zeros. Once the budget is full the oldest
+// deltas are dropped, which needs no keyframes since nothing newer depends on them.
+//
+// Push() only copies the state into a free slot; diffing and encoding happen on a
+// background thread. If every slot is busy Push() waits for the encoder to free one, so
+// every pushed frame is kept and one Rewind() always steps back exactly one frame.
+class RewindBuffer {
+  public:
+    struct Stats {
+      uint64_t frames = 0;           // states that can be rewound to, including the newest
+      uint64_t waits = 0;            // pushes that waited because the encoder was behind
+      uint64_t evicted = 0;          // deltas discarded to stay within the budget
+      uint64_t encoded_bytes = 0;    // bytes of deltas currently stored
+      uint64_t raw_bytes = 0;        // what the stored deltas would take as whole states
+      uint64_t capacity_bytes = 0;
+      double encode_seconds = 0;     // total time the background thread spent encoding
+    };
+
+    // Deltas are stored in a ring of capacity_bytes, allocated up front.
+    explicit RewindBuffer(size_t capacity_bytes);
+    ~RewindBuffer();
+
+    // Queues a copy of the state. Only waits on encoding when the encoder is a few frames
+    // behind.
+    void Push(const ConsoleState& state);
+    // Discards the newest state and writes the one before it to *state. Returns false,
+    // leaving *state alone, if there is nothing older. Waits for queued pushes first.
+    bool Rewind(ConsoleState* state);
+    // Forgets everything, e.g. after loading an unrelated state.
+    void Clear();
+
+    Stats GetStats();
+
+  private:
+    struct Entry {
+      size_t offset;
+      size_t size;
+    };
+
+    void EncoderLoop();
+    // Diffs state against head_, stores the delta and makes state the new head_.
+    void Append(const ConsoleState& state);
+    void WaitIdle(std::unique_lock<std::mutex>& lock);
+
+    // Zero-run encodes a ^ b into out and returns its size.
+    static size_t EncodeXor(const uint8_t* a, const uint8_t* b, size_t size, uint8_t* out);
+    // XORs an encoded delta into dst.
+    static void ApplyXor(const uint8_t* in, size_t in_size, uint8_t* dst);
+
+    std::mutex mu_;  // protects everything below
+    std::condition_variable work_cv_;
+    std::condition_variable idle_cv_;
+    std::condition_variable free_cv_;  // a slot was freed
+    bool stop_ = false;
+    bool busy_ = false;
+
+    // Push() fills free slots, the encoder drains queued ones in order.
+    std::vector<std::unique_ptr<ConsoleState>> slots_;
+    std::vector<ConsoleState*> free_;
+    std::deque<ConsoleState*> queued_;
+
+    std::unique_ptr<ConsoleState> head_;  // the newest state, whole
+    bool has_head_ = false;
+    std::vector<uint8_t> ring_;
+    size_t ring_end_ = 0;  // where the next delta starts
+    std::deque<Entry> entries_;  // oldest first
+    std::vector<uint8_t> scratch_;  // one encoded delta, before it goes into the ring
+
+    Stats stats_;
+    std::thread encoder_;
+};
+
+#endif  // REWIND_BUFFER_H_
@@ -0,0 +1,107 @@
+#include "run_ahead.h"
+
+RunAhead::RunAhead(std::shared_ptr<const Cartridge> cartridge, int frames, bool second_instance)
+    : frames_(frames), second_instance_(second_instance && frames > 0) {
+  if (frames < 0) {
+    throw std::runtime_error("Run-ahead needs a frame count of 0 or more.");
+  }
+  main_ = std::make_unique<Cpu6502>(cartridge);
+  state_ = std::make_unique<ConsoleState>();
+  // Only look-ahead frames are ever shown.
+  main_->SetRenderingEnabled(frames_ == 0);
+  if (second_instance_) {
+    ahead_ = std::make_unique<Cpu6502>(cartridge);
+    ahead_thread_ = std::thread(&RunAhead::AheadLoop, this);
+  }
+}
+
+RunAhead::~RunAhead() {
+  if (ahead_thread_.joinable()) {
+    {
+      const std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    ahead_thread_.join();
+  }
+}
+
+Image* RunAhead::RunHostFrame(uint8_t buttons0, uint8_t buttons1) {
+  stats_.host_frames++;
+  main_->SetButtons(0, buttons0);
+  main_->SetButtons(1, buttons1);
+  if (frames_ == 0) {
+    main_->RunFrame();
+    stats_.emulated_frames++;
+    return main_->FrameBuffer();
+  }
+
+  if (!second_instance_) {
+    main_->RunFrame();
+    main_->SaveState(state_.get());
+    for (int i = 0; i < frames_; ++i) {
+      main_->SetRenderingEnabled(i == frames_ - 1);
+      main_->RunFrame();
+    }
+    main_->SetRenderingEnabled(false);
+    main_->LoadState(*state_);
+    stats_.emulated_frames += 1 + frames_;
+    // Loading a state leaves the frame buffer alone, so it still holds the last look-ahead frame.
+    return main_->FrameBuffer();
+  }
+
+  // The ahead instance only has to start over if its prediction, the input it has been
+  // holding, is now wrong. It then starts from where main_ is now, before this frame.
+  bool resync = resync_ || buttons0 != buttons_[0] || buttons1 != buttons_[1];
+  if (resync) {
+    main_->SaveState(state_.get());
+    stats_.resyncs++;
+  }
+  {
+    const std::lock_guard<std::mutex> lock(mu_);
+    resync_ = resync;
+    buttons_[0] = buttons0;
+    buttons_[1] = buttons1;
+    has_work_ = true;
+  }
+  cv_.notify_all();
+  main_->RunFrame();
+  {
+    std::unique_lock<std::mutex> lock(mu_);
+    cv_.wait(lock, [this]() { return !has_work_; });
+  }
+  stats_.emulated_frames += 1 + (resync ? 1 + frames_ : 1);
+  return ahead_->FrameBuffer();
+}
+
+void RunAhead::AheadLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    cv_.wait(lock, [this]() { return stop_ || has_work_; });
+    if (stop_) {
+      return;
+    }
+    // The host thread leaves state_, resync_ and buttons_ alone until has_work_ clears.
+    lock.unlock();
+    StepAhead();
+    lock.lock();
+    has_work_ = false;
+    resync_ = false;
+    cv_.notify_all();
+  }
+}
+
+void RunAhead::StepAhead() {
+  ahead_->SetButtons(0, buttons_[0]);
+  ahead_->SetButtons(1, buttons_[1]);
+  if (resync_) {
+    // Catch up on the real frame main_ is running now, then look ahead from there.
+    ahead_->LoadState(*state_);
+    ahead_->SetRenderingEnabled(false);
+    for (int i = 0; i < frames_; ++i) {
+      ahead_->RunFrame();
+    }
+  }
+  ahead_->SetRenderingEnabled(true);
+  ahead_->RunFrame();
+}
@@ -0,0 +1,68 @@
+#ifndef RUN_AHEAD_H_
+#define RUN_AHEAD_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "cartridge.h"
+#include "common.h"
+#include "cpu6502.h"
+
+// Run-ahead input latency reduction. Each host frame the console advances one frame with
+// the current input, but what gets presented is the frame `frames` further on, predicted
+// by holding that input. Games that react to input a frame or two late then appear to
+// react immediately.
+//
+// Single instance: run the real frame without drawing, save state, run the look-ahead
+// frames (drawing only the last), present, load state. Costs frames + 1 emulated frames
+// plus a save and a load per host frame.
+//
+// Second instance: a second console on its own thread is kept `frames` ahead of the real
+// one. While input is unchanged its prediction still holds, so it just runs one more
+// frame in parallel with the real one. When input changes it reloads the real console's
+// state and runs ahead again.
+//
+// There is no audio yet, so skipping A/V on look-ahead frames means not drawing them.
+class RunAhead {
+  public:
+    struct Stats {
+      uint64_t host_frames = 0;
+      uint64_t emulated_frames = 0;  // real and look-ahead, over both instances
+      uint64_t resyncs = 0;          // second instance reloads after an input change
+    };
+
+    RunAhead(std::shared_ptr<const Cartridge> cartridge, int frames, bool second_instance);
+    ~RunAhead();
+
+    // Runs one host frame holding the given buttons on both ports. Returns the frame to present.
+    Image* RunHostFrame(uint8_t buttons0, uint8_t buttons1);
+
+    // The console that is not ahead, i.e. the one whose state is the real game state.
+    Cpu6502* Main() { return main_.get(); }
+    Stats GetStats() { return stats_; }
+
+  private:
+    void AheadLoop();
+    // Brings ahead_ to `frames_` frames past main_ for the current input. Runs on the ahead thread.
+    void StepAhead();
+
+    int frames_;
+    bool second_instance_;
+    std::unique_ptr<Cpu6502> main_;
+    std::unique_ptr<ConsoleState> state_;
+    Stats stats_;
+
+    // Second instance only.
+    std::unique_ptr<Cpu6502> ahead_;
+    std::thread ahead_thread_;
+    std::mutex mu_;  // protects the handshake below
+    std::condition_variable cv_;
+    bool has_work_ = false;
+    bool stop_ = false;
+    // Set by the host thread before handing over work.
+    bool resync_ = true;
+    uint8_t buttons_[2] = {};
+};
+
+#endif  // RUN_AHEAD_H_
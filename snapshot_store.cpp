@@ -0,0 +1,129 @@
+#include "snapshot_store.h"
+
+namespace {
+
+// Word-at-a-time page hash. Not stable across builds, unlike Fnv1a64; it only has to be
+// fast and spread well since hashes never leave the process.
+uint64_t HashPage(const uint8_t* data) {
+  uint64_t hash = 0x9E3779B97F4A7C15ULL;
+  for (size_t i = 0; i < SnapshotStore::kPageBytes; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+} // namespace
+
+SnapshotStore::SnapshotStore(PageHasher hasher)
+    : hasher_(hasher != nullptr ? hasher : HashPage), shards_(new Shard[kNumShards]) {}
+
+SnapshotStore::Snapshot SnapshotStore::Insert(const ConsoleState& state) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+  Snapshot snapshot;
+  for (size_t p = 0; p < kPagesPerState; ++p) {
+    const uint8_t* page = bytes + p * kPageBytes;
+    uint8_t tail[kPageBytes];
+    size_t size = std::min(kPageBytes, sizeof(ConsoleState) - p * kPageBytes);
+    if (size < kPageBytes) {
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, page, size);
+      page = tail;
+    }
+    snapshot.pages[p] = AddPage(page, hasher_(page));
+  }
+  snapshots_++;
+  return snapshot;
+}
+
+uint32_t SnapshotStore::AddPage(const uint8_t* data, uint64_t hash) {
+  Shard& shard = shards_[hash % kNumShards];
+  int shard_index = static_cast<int>(hash % kNumShards);
+  const std::lock_guard<std::mutex> lock(shard.mu);
+  // Two different pages may (rarely) share a hash, so every page filed under it is checked.
+  auto range = shard.by_hash.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (memcmp(PageData(shard, it->second), data, kPageBytes) == 0) {
+      shard.refs[it->second]++;
+      return PageId(shard_index, it->second);
+    }
+  }
+
+  uint32_t index;
+  if (!shard.free.empty()) {
+    index = shard.free.back();
+    shard.free.pop_back();
+  } else {
+    if (shard.num_pages == kPagesPerChunk * kMaxChunks) {
+      throw std::runtime_error("Snapshot store is full.");
+    }
+    index = shard.num_pages++;
+    if (index % kPagesPerChunk == 0) {
+      shard.chunks[index / kPagesPerChunk].reset(new uint8_t[kPagesPerChunk * kPageBytes]);
+    }
+    shard.hashes.push_back(0);
+    shard.refs.push_back(0);
+  }
+  memcpy(PageData(shard, index), data, kPageBytes);
+  shard.hashes[index] = hash;
+  shard.refs[index] = 1;
+  shard.by_hash.emplace(hash, index);
+  return PageId(shard_index, index);
+}
+
+void SnapshotStore::Restore(const Snapshot& snapshot, ConsoleState* state) const {
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(state);
+  for (size_t p = 0; p < kPagesPerState; ++p) {
+    uint32_t id = snapshot.pages[p];
+    size_t size = std::min(kPageBytes, sizeof(ConsoleState) - p * kPageBytes);
+    memcpy(bytes + p * kPageBytes, PageData(shards_[ShardOf(id)], IndexOf(id)), size);
+  }
+}
+
+void SnapshotStore::Share(const Snapshot& snapshot) {
+  for (uint32_t id : snapshot.pages) {
+    Shard& shard = shards_[ShardOf(id)];
+    const std::lock_guard<std::mutex> lock(shard.mu);
+    shard.refs[IndexOf(id)]++;
+  }
+  snapshots_++;
+}
+
+void SnapshotStore::Release(const Snapshot& snapshot) {
+  for (uint32_t id : snapshot.pages) {
+    Shard& shard = shards_[ShardOf(id)];
+    uint32_t index = IndexOf(id);
+    const std::lock_guard<std::mutex> lock(shard.mu);
+    if (--shard.refs[index] == 0) {
+      auto range = shard.by_hash.equal_range(shard.hashes[index]);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == index) {
+          shard.by_hash.erase(it);
+          break;
+        }
+      }
+      shard.free.push_back(index);
+    }
+  }
+  snapshots_--;
+}
+
+SnapshotStore::Stats SnapshotStore::GetStats() {
+  Stats stats;
+  stats.snapshots = snapshots_;
+  stats.logical_pages = stats.snapshots * kPagesPerState;
+  for (int s = 0; s < kNumShards; ++s) {
+    Shard& shard = shards_[s];
+    const std::lock_guard<std::mutex> lock(shard.mu);
+    stats.unique_pages += shard.num_pages - shard.free.size();
+    size_t num_chunks = (shard.num_pages + kPagesPerChunk - 1) / kPagesPerChunk;
+    // Chunks, the hash and refcount arrays, and roughly one hash map node per page.
+    stats.resident_bytes += num_chunks * kPagesPerChunk * kPageBytes +
+        shard.hashes.capacity() * sizeof(uint64_t) + shard.refs.capacity() * sizeof(uint32_t) +
+        shard.free.capacity() * sizeof(uint32_t) + shard.by_hash.size() * 32 +
+        shard.by_hash.bucket_count() * sizeof(void*);
+  }
+  return stats;
+}
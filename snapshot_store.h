@@ -0,0 +1,86 @@
+#ifndef SNAPSHOT_STORE_H_
+#define SNAPSHOT_STORE_H_
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include "common.h"
+#include "state.h"
+
+// Content-addressed store for many save states that are mostly alike, e.g. the nodes of
+// a search tree. Each ConsoleState is split into 256-byte pages and every distinct page
+// is kept once, refcounted. A Snapshot is just the ids of its pages.
+//
+// Insert, Restore, Share and Release may be called from any number of threads. Pages
+// are spread over shards by hash, each with its own lock. Restore takes no lock; the
+// caller's reference keeps its pages alive and unchanged.
+class SnapshotStore {
+  public:
+    static constexpr size_t kPageBytes = 256;
+    static constexpr size_t kPagesPerState = (sizeof(ConsoleState) + kPageBytes - 1) / kPageBytes;
+
+    struct Snapshot {
+      uint32_t pages[kPagesPerState];
+    };
+
+    struct Stats {
+      uint64_t snapshots = 0;       // live references, counting each Share
+      uint64_t logical_pages = 0;   // snapshots * kPagesPerState
+      uint64_t unique_pages = 0;    // distinct pages actually stored
+      uint64_t resident_bytes = 0;  // page storage plus per-page bookkeeping
+    };
+
+    // Hashes one kPageBytes page. Pages with equal hashes are still compared byte for byte.
+    using PageHasher = uint64_t (*)(const uint8_t* page);
+
+    // hasher defaults to a fast word-at-a-time hash; tests pass a weak one to force
+    // collisions.
+    explicit SnapshotStore(PageHasher hasher = nullptr);
+
+    // Adds a reference to each of the state's pages, storing the ones not seen before.
+    Snapshot Insert(const ConsoleState& state);
+    // Rebuilds the state from its pages.
+    void Restore(const Snapshot& snapshot, ConsoleState* state) const;
+    // Takes another reference to the same pages. Each reference needs its own Release.
+    void Share(const Snapshot& snapshot);
+    // Drops a reference. Pages nobody refers to any more are freed for reuse.
+    void Release(const Snapshot& snapshot);
+
+    Stats GetStats();
+
+  private:
+    static constexpr int kNumShards = 16;
+    static constexpr size_t kPagesPerChunk = 1024;
+    static constexpr size_t kMaxChunks = 4096;  // per shard, 1GB of pages each
+
+    struct Shard {
+      std::mutex mu;  // protects everything but the chunk contents of live pages
+      // Page storage. Chunks are never moved or freed, so a page's bytes can be read
+      // without the lock while someone holds a reference to it.
+      std::unique_ptr<uint8_t[]> chunks[kMaxChunks];
+      size_t num_pages = 0;  // pages ever allocated
+      // hash -> local page index, one entry per page even when hashes collide.
+      std::unordered_multimap<uint64_t, uint32_t> by_hash;
+      std::vector<uint64_t> hashes;  // local index -> hash it is filed under
+      std::vector<uint32_t> refs;  // local index -> refcount, 0 if free
+      std::vector<uint32_t> free;  // local indices ready for reuse
+    };
+
+    // Page ids carry their shard in the low bits.
+    static uint32_t PageId(int shard, uint32_t index) { return index * kNumShards + shard; }
+    static int ShardOf(uint32_t id) { return id % kNumShards; }
+    static uint32_t IndexOf(uint32_t id) { return id / kNumShards; }
+    static uint8_t* PageData(Shard& shard, uint32_t index) {
+      return shard.chunks[index / kPagesPerChunk].get() + (index % kPagesPerChunk) * kPageBytes;
+    }
+
+    // Returns the id of a page with these bytes, adding it if needed, with one more reference.
+    uint32_t AddPage(const uint8_t* data, uint64_t hash);
+
+    PageHasher hasher_;
+    std::unique_ptr<Shard[]> shards_;
+    std::atomic<uint64_t> snapshots_{0};
+};
+
+#endif  // SNAPSHOT_STORE_H_
@@ -0,0 +1,133 @@
+#include "stack_sampler.h"
+
+#include <fstream>
+#include <sstream>
+
+Labels ReadLabels(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    throw std::runtime_error("Could not read label file " + path);
+  }
+  Labels labels;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string addr;
+    std::string name;
+    if (!(fields >> addr) || addr[0] == '#') {
+      continue;
+    }
+    if (addr == "al") {
+      // ld65 -Ln: al 00C000 .name
+      fields >> addr >> name;
+      if (!name.empty() && name[0] == '.') {
+        name.erase(0, 1);
+      }
+    } else {
+      fields >> name;
+    }
+    if (!addr.empty() && addr[0] == '$') {
+      addr.erase(0, 1);
+    }
+    size_t end = 0;
+    unsigned long value = 0;
+    try {
+      value = std::stoul(addr, &end, 16);
+    } catch (const std::exception&) {
+      end = 0;
+    }
+    if (name.empty() || end != addr.size() || value > 0xFFFF) {
+      throw std::runtime_error("Bad line in label file " + path + ": " + line);
+    }
+    labels.emplace(static_cast<uint16_t>(value), name);
+  }
+  return labels;
+}
+
+const std::array<bool, 256> StackSampler::kStackOpcodes = [] {
+  std::array<bool, 256> set = {};
+  for (uint8_t op : {0x20, 0x60, 0x00, 0x40, 0x9A}) {
+    set[op] = true;
+  }
+  return set;
+}();
+
+StackSampler::StackSampler(uint64_t period, const Labels* labels)
+    : period_(std::max<uint64_t>(period, 1)), labels_(labels), nodes_{{0, 0, kRoot}}, counts_(1) {
+  frames_.reserve(kMaxDepth);
+}
+
+void StackSampler::StackChanged(uint8_t opcode, uint16_t pc, uint8_t sp) {
+  if (opcode == 0x20) {  // JSR pushed 2 bytes
+    Push(pc, kJsr, sp + 2);
+  } else if (opcode == 0x00) {  // BRK pushed 3
+    Push(pc, kBrk, sp + 3);
+  } else {
+    // RTS, RTI or TXS: drop the frames the guest's stack pointer has moved back past.
+    while (!frames_.empty() && frames_.back().sp <= sp) {
+      frames_.pop_back();
+    }
+    node_ = frames_.empty() ? 0 : frames_.back().node;
+  }
+}
+
+void StackSampler::Push(uint16_t pc, Kind kind, uint8_t sp) {
+  // A call made with less stack than the innermost frame is nested inside it; one made
+  // with as much or more replaces the frames it has abandoned.
+  while (!frames_.empty() && frames_.back().sp <= sp) {
+    frames_.pop_back();
+  }
+  node_ = frames_.empty() ? 0 : frames_.back().node;
+  if (frames_.size() == kMaxDepth) {
+    return;
+  }
+  uint64_t key = static_cast<uint64_t>(node_) << 24 | static_cast<uint64_t>(kind) << 16 | pc;
+  auto inserted = children_.emplace(key, static_cast<uint32_t>(nodes_.size()));
+  if (inserted.second) {
+    nodes_.push_back({node_, pc, kind});
+    counts_.push_back(0);
+  }
+  node_ = inserted.first->second;
+  frames_.push_back({node_, sp});
+}
+
+void StackSampler::Sample(uint64_t cycle) {
+  // An OAM DMA can span several periods; each counts.
+  uint64_t count = (cycle - next_sample_) / period_ + 1;
+  counts_[node_] += count;
+  samples_ += count;
+  next_sample_ += count * period_;
+}
+
+std::string StackSampler::Name(const Node& node) const {
+  if (labels_ != nullptr) {
+    auto label = labels_->find(node.addr);
+    if (label != labels_->end()) {
+      return label->second;
+    }
+  }
+  const char* prefix = node.kind == kNmi ? "nmi" : node.kind == kBrk ? "brk" : "sub";
+  return string_format("%s_%04X", prefix, node.addr);
+}
+
+void StackSampler::AppendFolded(const std::string& root, std::string* out) const {
+  std::vector<std::string> names(nodes_.size());
+  for (size_t i = 1; i < nodes_.size(); ++i) {
+    names[i] = Name(nodes_[i]);
+  }
+  std::vector<uint32_t> path;
+  for (uint32_t i = 0; i < nodes_.size(); ++i) {
+    if (counts_[i] == 0) {
+      continue;
+    }
+    path.clear();
+    for (uint32_t node = i; node != 0; node = nodes_[node].parent) {
+      path.push_back(node);
+    }
+    *out += root;
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+      *out += ";" + names[*it];
+    }
+    *out += string_format(" %llu\n", static_cast<unsigned long long>(counts_[i]));
+  }
+}
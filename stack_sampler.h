@@ -0,0 +1,84 @@
+#ifndef STACK_SAMPLER_H_
+#define STACK_SAMPLER_H_
+
+#include <array>
+#include <unordered_map>
+
+#include "common.h"
+
+// Names for guest addresses, e.g. from nes2x_asm --symbols.
+using Labels = std::unordered_map<uint16_t, std::string>;
+
+// Reads a label file. Each line is "ADDR name" with ADDR in hex, optionally with a $, as
+// nes2x_asm --symbols prints, or "al ADDR .name" as ld65 -Ln writes. The first name given
+// for an address wins; blank lines and lines starting with # are skipped.
+Labels ReadLabels(const std::string& path);
+
+// Samples which guest subroutine is running every N emulated cycles, for flamegraphs.
+//
+// The CPU calls AfterInstruction() for every instruction and Interrupt() for every NMI while
+// the sampler is attached with Cpu6502::SetSampler(). A shadow call stack is pushed by JSR, BRK
+// and interrupts, and unwound by RTS, RTI and TXS to the frames whose stack pointer is still
+// below the guest's. Code that returns with a pushed address instead of a JSR, or resets the
+// stack from an interrupt handler, therefore does not leave frames behind.
+//
+// Each distinct stack is a node in a tree, so a sample is one increment.
+class StackSampler {
+  public:
+    // period is in CPU cycles. labels may be null and must outlive the sampler.
+    StackSampler(uint64_t period, const Labels* labels);
+
+    // Starts sampling period cycles after cycle. Called by Cpu6502::SetSampler().
+    void Start(uint64_t cycle) { next_sample_ = cycle + period_; }
+    // The instruction with this opcode has run, leaving these PC and SP, and the CPU is now at cycle.
+    void AfterInstruction(uint8_t opcode, uint16_t pc, uint8_t sp, uint64_t cycle) {
+      if (kStackOpcodes[opcode]) {
+        StackChanged(opcode, pc, sp);
+      }
+      if (cycle >= next_sample_) {
+        Sample(cycle);
+      }
+    }
+    // An NMI has pushed the PC and P and jumped to pc.
+    void Interrupt(uint16_t pc, uint8_t sp) { Push(pc, kNmi, sp + 3); }
+
+    uint64_t Samples() const { return samples_; }
+    // Appends one "root;outer;inner count" line per sampled stack, the folded format
+    // flamegraph.pl and speedscope read. Frames are labels where there are any, and
+    // otherwise sub_XXXX, nmi_XXXX or brk_XXXX.
+    void AppendFolded(const std::string& root, std::string* out) const;
+
+  private:
+    enum Kind : uint8_t { kRoot, kJsr, kNmi, kBrk };
+    struct Node {
+      uint32_t parent;
+      uint16_t addr;
+      Kind kind;
+    };
+    struct Frame {
+      uint32_t node;
+      uint8_t sp;  // SP before the call, and again once it has returned
+    };
+
+    // Deeper stacks are still sampled, as their deepest kept frame.
+    static constexpr size_t kMaxDepth = 256;
+    // JSR, RTS, BRK, RTI and TXS.
+    static const std::array<bool, 256> kStackOpcodes;
+
+    void StackChanged(uint8_t opcode, uint16_t pc, uint8_t sp);
+    void Push(uint16_t pc, Kind kind, uint8_t sp);
+    void Sample(uint64_t cycle);
+    std::string Name(const Node& node) const;
+
+    uint64_t period_;
+    const Labels* labels_;
+    uint64_t next_sample_ = 0;
+    uint64_t samples_ = 0;
+    std::vector<Node> nodes_;
+    std::vector<uint64_t> counts_;  // samples per node
+    std::unordered_map<uint64_t, uint32_t> children_;  // parent, kind and addr to node
+    std::vector<Frame> frames_;
+    uint32_t node_ = 0;  // the innermost frame's, or the root
+};
+
+#endif  // STACK_SAMPLER_H_
@@ -0,0 +1,87 @@
+#ifndef STATE_H_
+#define STATE_H_
+
+#include <type_traits>
+
+#include "common.h"
+
+// Console state layout. A running Cpu6502 keeps all of its mutable state in one ConsoleState,
+// with the Ppu, Mapper and Controllers pointing into it, so saving, loading and cloning the
+// whole console are each a single memcpy. Every part is plain data with a fixed size and the
+// raw bytes of a ConsoleState are also the on-disk/wire format. Immutable ROM stays in the
+// Cartridge and the frame buffer, being output, stays in the Ppu.
+//
+// Hot CPU registers come first so they share a cache line with the header.
+//
+// Bump kVersion whenever any of these structs change.
+
+struct CpuState {
+  uint8_t a;
+  uint8_t x;
+  uint8_t y;
+  // Bit order MSb (NVxx DIZC) LSb -> Bits 4 and 5 only set when copied to stack.
+  uint8_t p;
+  uint8_t stack_pointer;
+  uint8_t ppu_update_pattern_position;
+  uint16_t program_counter;  // next address to execute
+  // Current cycle number. Cycle 7 means 7 cycles have elapsed.
+  uint64_t cycle;
+  // Trigger a PPU scanline's worth of updates once we reach this cycle.
+  // May trigger many times per CPU update for longer CPU updates (like DMA).
+  uint64_t next_ppu_update_at;
+  uint8_t internal_ram[0x800];
+  uint8_t apu_ram[0x20];  // owned by the CPU since we need it for I/O too
+};
+
+struct PpuState {
+  uint8_t nametable_ram[0x800];
+  uint8_t palette_ram[0x20];
+  uint8_t oam[0x100];
+  uint8_t latch;
+  uint8_t next_ppuscroll_write_is_x;
+  uint8_t next_ppuaddr_write_is_msb;
+  uint8_t ppuctrl;
+  uint8_t ppumask;
+  uint8_t ppustatus;
+  uint8_t oamaddr;
+  uint8_t ppuscroll_x;
+  uint8_t ppuscroll_y;
+  uint8_t nmi_pending;
+  uint16_t ppuaddr;
+  uint16_t scanline;
+  uint64_t cycle;
+  uint64_t frame_count;
+};
+
+struct ControllerState {
+  uint8_t shift;
+  uint8_t strobe;
+};
+
+// NROM has no bank registers, only PRG-RAM. Banking mappers add their registers here.
+struct MapperState {
+  uint8_t prg_ram[0x2000];
+};
+
+struct alignas(64) ConsoleState {
+  static constexpr uint32_t kMagic = 0x5353454E;  // "NESS"
+  static constexpr uint32_t kVersion = 4;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;     // sizeof(ConsoleState), guards against layout drift between builds
+  uint8_t has_chr_ram;
+  uint8_t reserved[3];
+  uint64_t cartridge_hash;  // Cartridge::ContentHash() of the ROM that wrote the state
+
+  CpuState cpu;
+  PpuState ppu;
+  ControllerState controllers[2];
+  MapperState mapper;
+  // Unused unless has_chr_ram. The frame buffer is never saved; the next frame redraws it.
+  uint8_t chr_ram[0x2000];
+};
+
+static_assert(std::is_trivially_copyable<ConsoleState>::value, "Save states must be plain data.");
+
+#endif  // STATE_H_
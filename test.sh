@@ -4,24 +4,88 @@ RED='\033[0;31m'
 GREEN='\033[0;32m'
 NC='\033[0m' # No Color
 
+# Usage: ./test.sh [nestest.nes]
+#
+# nes2x_test runs the behaviour tests in test/*_test.cpp (see test/test.h).
+# The synthetic ROMs in bench_roms/ are assembled in-tree and checked against the first
+# instructions of their recorded traces in test/bench_roms/, so these checks need no extra
+# files. Regenerate a log only for an intended change in behaviour:
+#   ./nes2x_headless --cycles 20000 --trace x.trace bench_roms/alu.nes
+#   ./nes2x_trace x.trace | head -1000 > test/bench_roms/alu_golden.log
+# nestest.nes is not in the tree; pass its path, or put it at roms/nestest.nes.
+
+ROM="${1:-roms/nestest.nes}"
 
 make clean
-make nes2x TEST_DEFINES="-U DEBUG -D NESTEST"
-./nes2x /Users/river/code/nes/roms/nestest.nes 2>&1 | tee test/out.log
+make nes2x_headless nes2x_trace nes2x_test bench_roms TEST_DEFINES="-U DEBUG" || exit 1
 
-## Ignore PPU:
-sed 's/PPU:.*C/CYC/g' test/out.log > test/out-noppu.log
-diff --brief test/out-noppu.log test/nestest_golden-noppu.log
+status=0
+
+pass() {
+  echo -e "${GREEN}PASSED${NC} -- $1"
+}
+
+fail() {
+  echo -e "${RED}FAILED${NC} -- $1"
+  status=1
+}
+
+if ./nes2x_test; then
+  pass "behaviour tests"
+else
+  fail "behaviour tests"
+fi
+
+# Each instruction is checked against the golden log as it runs, stopping at the first
+# difference. See nes2x_trace --golden.
+for log in test/bench_roms/*_golden.log; do
+  name=$(basename "$log" _golden.log)
+  if ./nes2x_trace --golden "$log" "bench_roms/$name.nes"; then
+    pass "$name.nes matches its golden log"
+  else
+    fail "$name.nes differs from its golden log"
+  fi
+done
 
-if [[ $? -eq 1 ]]; then
-  code --diff test/out-noppu.log test/nestest_golden-noppu.log
+## A binary trace from nes2x_headless --trace must print as the same log:
+trace_file=$(mktemp)
+if ./nes2x_headless --cycles 20000 --trace "$trace_file" bench_roms/alu.nes > /dev/null &&
+   ./nes2x_trace "$trace_file" | head -1000 | cmp -s - test/bench_roms/alu_golden.log; then
+  pass "nes2x_headless --trace of alu.nes prints as its golden log"
 else
-  echo -e "${GREEN}PASSED${NC} -- nes2x output matches nestest.nes golden (cpu-only)"
+  fail "nes2x_headless --trace of alu.nes does not print as its golden log"
+fi
+rm -f "$trace_file"
+
+## A changed register must be reported as a divergence, at the right instruction:
+bad_log=$(mktemp)
+sed '500s/A:../A:EE/' test/bench_roms/alu_golden.log > "$bad_log"
+output=$(./nes2x_trace --golden "$bad_log" bench_roms/alu.nes)
+if [ $? -ne 0 ] && grep -q "at instruction 500:" <<< "$output" && grep -q "differs: A" <<< "$output"; then
+  pass "--golden reports a divergence in A at instruction 500"
+else
+  fail "--golden did not report the divergence planted at instruction 500"
+  echo "$output"
+fi
+rm -f "$bad_log"
+
+if [ ! -f "$ROM" ]; then
+  fail "ROM not found: $ROM (nestest.nes is not in the tree; pass its path as the first argument)"
+  exit $status
+fi
+
+## Ignore PPU:
+if ./nes2x_trace --golden test/nestest_golden-noppu.log "$ROM"; then
+  pass "nes2x output matches nestest.nes golden (cpu-only)"
+else
+  fail "nes2x output differs from nestest.nes golden (cpu-only)"
 fi
 
 ## Don't ignore PPU:
-# diff --brief test/out.log test/nestest_golden.log
+if ./nes2x_trace --golden test/nestest_golden.log "$ROM"; then
+  pass "nes2x output matches nestest.nes golden (with PPU)"
+else
+  fail "nes2x output differs from nestest.nes golden (with PPU)"
+fi
 
-# if [ $? ]; then
-#   code --diff test/out.log test/nestest_golden.log
-# fi
+exit $status
@@ -0,0 +1,78 @@
+#include "assembler.h"
+#include "opcode_info.h"
+#include "test/test.h"
+
+namespace {
+
+// An operand for mode whose bytes are $12, or $34 $12, and for a branch at $8000 an
+// offset of $10.
+std::string OperandText(AddressingMode mode) {
+  switch (mode) {
+    case AddressingMode::kImmediate: return "#$12";
+    case AddressingMode::kZeroPage: return "$12";
+    case AddressingMode::kZeroPageX: return "$12,X";
+    case AddressingMode::kZeroPageY: return "$12,Y";
+    case AddressingMode::kAbsolute: return "$1234";
+    case AddressingMode::kAbsoluteX: return "$1234,X";
+    case AddressingMode::kAbsoluteY: return "$1234,Y";
+    case AddressingMode::kIndirectX: return "($12,X)";
+    case AddressingMode::kIndirectY: return "($12),Y";
+    case AddressingMode::kAbsoluteIndirect: return "($1234)";
+    case AddressingMode::kRelative: return "$8012";
+    case AddressingMode::kAccumulator: return "A";
+    case AddressingMode::kNone: return "";
+  }
+  return "";
+}
+
+std::vector<uint8_t> Assemble(const std::string& source) {
+  Assembler assembler(0x8000, 0x100);
+  assembler.Assemble(source);
+  return assembler.Output();
+}
+
+} // namespace
+
+TEST(AssemblerRoundTripsEveryListedOpcode) {
+  for (uint8_t opcode : ListedOpcodes()) {
+    const OpcodeInfo& info = OpcodeInfos()[opcode];
+    std::string line = std::string(info.mnemonic) + " " + OperandText(info.mode);
+    std::vector<uint8_t> out = Assemble(".org $8000\n" + line);
+    // Where an unofficial opcode shares its name and mode with another, the assembler
+    // picks one of them; it must still decode as what was written.
+    const OpcodeInfo& decoded = OpcodeInfos()[out[0]];
+    CHECK_EQ(std::string(decoded.mnemonic) + " " + OperandText(decoded.mode), line);
+    if (!info.unofficial) {
+      CHECK_EQ(out[0], opcode);
+    }
+    int bytes = OperandBytes(info.mode);
+    if (bytes >= 1) {
+      CHECK_EQ(out[1], info.mode == AddressingMode::kRelative ? 0x10 : bytes == 2 ? 0x34 : 0x12);
+    }
+    if (bytes == 2) {
+      CHECK_EQ(out[2], 0x12);
+    }
+    CHECK_EQ(out[1 + bytes], 0xFF);  // nothing assembled past the instruction
+  }
+}
+
+TEST(AssemblerLabelsAndDirectives) {
+  std::vector<uint8_t> out = Assemble(R"(
+        .org $8000
+VALUE = $40 + 2
+start:  lda #<table     ; $A9 $0A
+        ldx table+1     ; absolute, since table is not yet known
+        bne start       ; back 7 bytes
+        .byte 1, "ab"
+table:  .word start, VALUE
+)");
+  std::vector<uint8_t> expected = {0xA9, 0x0A, 0xAE, 0x0B, 0x80, 0xD0, 0xF9, 0x01, 0x61, 0x62,
+                                   0x00, 0x80, 0x42, 0x00};
+  CHECK(std::vector<uint8_t>(out.begin(), out.begin() + expected.size()) == expected);
+}
+
+TEST(AssemblerReportsTheFailingLine) {
+  CHECK_THROWS(Assemble("  .org $8000\n  lda #1\n  bogus\n"), "<source>:3: Unknown instruction");
+  CHECK_THROWS(Assemble("  .org $8000\nspin: .fill 200\n  bne spin\n"), "<source>:3: Branch is");
+  CHECK_THROWS(Assemble("  .org $8000\n  lda ($1234),y\n"), "not a zero page address");
+}
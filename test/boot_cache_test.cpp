@@ -0,0 +1,161 @@
+#include <dirent.h>
+#include <unistd.h>
+
+#include "boot_cache.h"
+#include "cpu6502.h"
+#include "test/test.h"
+
+namespace {
+
+// Draws a backdrop that changes every frame, and reads controller 1 from the fourth NMI on.
+const char* kLatePollRom = R"(
+        .org $8000
+reset:  sei
+        ldx #$FF
+        txs
+        lda #$80
+        sta $2000       ; NMI on
+        lda #$0A
+        sta $2001       ; background on
+spin:   inc $10
+        jmp spin
+nmi:    inc $12
+        lda #$3F
+        sta $2006
+        lda #$00
+        sta $2006
+        lda $12
+        and #$3F
+        sta $2007       ; backdrop colour
+        lda #0
+        sta $2005
+        sta $2005
+        lda $12
+        cmp #4
+        bcc done
+        lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        lda $4016
+        sta $13
+done:   rti
+        .org $FFFA
+        .word nmi, reset, reset
+)";
+
+// A fresh directory for the test's entries, removed with everything in it.
+class TempDir {
+  public:
+    TempDir() {
+      char path[] = "/tmp/nes2x_boot_test_XXXXXX";
+      if (mkdtemp(path) == nullptr) {
+        throw std::runtime_error("Could not make a temporary directory.");
+      }
+      path_ = path;
+    }
+
+    ~TempDir() {
+      for (const std::string& file : Files()) {
+        unlink(file.c_str());
+      }
+      rmdir(path_.c_str());
+    }
+
+    const std::string& Path() const { return path_; }
+
+    std::vector<std::string> Files() const {
+      std::vector<std::string> files;
+      DIR* dir = opendir(path_.c_str());
+      while (dir != nullptr) {
+        dirent* entry = readdir(dir);
+        if (entry == nullptr) {
+          closedir(dir);
+          break;
+        } else if (entry->d_name[0] != '.') {
+          files.push_back(path_ + "/" + entry->d_name);
+        }
+      }
+      return files;
+    }
+
+  private:
+    std::string path_;
+};
+
+bool SameFrame(Cpu6502* a, Cpu6502* b) {
+  Image* image = a->FrameBuffer();
+  return memcmp(image->Data(), b->FrameBuffer()->Data(), image->Rows() * image->RowWidth()) == 0;
+}
+
+} // namespace
+
+TEST(BootCacheMissesThenHits) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kLatePollRom);
+  TempDir dir;
+  BootCache cache(dir.Path(), BootCache::BootPoint());
+
+  Cpu6502 booted(cart);
+  CHECK(!cache.Boot(*cart, &booted));
+  // The fourth NMI polls, and RunFrame() stops at the vblank that raises it.
+  CHECK_EQ(booted.FrameCount(), 4u);
+  CHECK_EQ(dir.Files().size(), 1u);
+
+  Cpu6502 cached(cart);
+  CHECK(cache.Boot(*cart, &cached));
+  CHECK_EQ(cached.StateHash(), booted.StateHash());
+  CHECK_EQ(cached.Cycle(), booted.Cycle());
+  // The frame buffer is not cached, but the next frame draws all of it.
+  CHECK(!SameFrame(&cached, &booted));
+  booted.RunFrame();
+  cached.RunFrame();
+  CHECK(SameFrame(&cached, &booted));
+  CHECK_EQ(cached.StateHash(), booted.StateHash());
+
+  // Another boot point is another entry.
+  BootCache::BootPoint two_frames;
+  two_frames.at_first_poll = false;
+  two_frames.frames = 2;
+  BootCache fixed(dir.Path(), two_frames);
+  Cpu6502 early(cart);
+  CHECK(!fixed.Boot(*cart, &early));
+  CHECK_EQ(early.FrameCount(), 2u);
+  CHECK(fixed.Boot(*cart, &early));
+  CHECK_EQ(dir.Files().size(), 2u);
+}
+
+TEST(BootCacheIgnoresEntriesFromAnotherVersion) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kLatePollRom);
+  TempDir dir;
+  BootCache cache(dir.Path(), BootCache::BootPoint());
+  Cpu6502 booted(cart);
+  CHECK(!cache.Boot(*cart, &booted));
+  CHECK_EQ(dir.Files().size(), 1u);
+  std::string entry = dir.Files()[0];
+
+  // Change the header's EmulatorVersion() hash, as an older build would have written it.
+  FILE* file = fopen(entry.c_str(), "r+b");
+  CHECK(file != nullptr);
+  fseek(file, 16, SEEK_SET);
+  int changed = fgetc(file) ^ 1;
+  fseek(file, 16, SEEK_SET);
+  fputc(changed, file);
+  fclose(file);
+
+  Cpu6502 stale(cart);
+  CHECK(!cache.Boot(*cart, &stale));
+  CHECK_EQ(stale.StateHash(), booted.StateHash());
+  // The miss replaced the entry, so the next boot hits.
+  file = fopen(entry.c_str(), "rb");
+  fseek(file, 16, SEEK_SET);
+  CHECK(fgetc(file) != changed);
+  fclose(file);
+  Cpu6502 fresh(cart);
+  CHECK(cache.Boot(*cart, &fresh));
+
+  // So does a truncated entry.
+  CHECK_EQ(truncate(entry.c_str(), 100), 0);
+  Cpu6502 truncated(cart);
+  CHECK(!cache.Boot(*cart, &truncated));
+  CHECK_EQ(truncated.StateHash(), booted.StateHash());
+}
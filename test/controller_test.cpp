@@ -0,0 +1,73 @@
+#include "batch_cpu6502.h"
+#include "cpu6502.h"
+#include "test/test.h"
+
+namespace {
+
+// Strobes the controllers once, then reads nine bits from each port: $4016 into $20-$28
+// and $4017 into $30-$38.
+const char* kReadPadsRom = R"(
+        .org $8000
+reset:  lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        ldx #0
+read:   lda $4016
+        and #1
+        sta $20,x
+        lda $4017
+        and #1
+        sta $30,x
+        inx
+        cpx #9
+        bne read
+spin:   jmp spin
+        .org $FFFA
+        .word reset, reset, reset
+)";
+
+// The nine bits a port should read with only button bit held, or nothing if bit is -1:
+// A first, then 1 once all eight are out.
+std::vector<uint8_t> Expected(int bit) {
+  std::vector<uint8_t> bits(9);
+  for (int i = 0; i < 8; ++i) {
+    bits[i] = i == bit;
+  }
+  bits[8] = 1;
+  return bits;
+}
+
+std::vector<uint8_t> Bits(const uint8_t* ram, uint16_t addr) {
+  return std::vector<uint8_t>(ram + addr, ram + addr + 9);
+}
+
+} // namespace
+
+TEST(ControllerReadsEachButtonInOrder) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kReadPadsRom);
+  for (int port = 0; port < 2; ++port) {
+    for (int bit = 0; bit < 8; ++bit) {
+      Cpu6502 cpu(cart);
+      cpu.SetButtons(port, 1 << bit);
+      cpu.RunFrame();
+      CHECK(Bits(cpu.Ram(), 0x20) == Expected(port == 0 ? bit : -1));
+      CHECK(Bits(cpu.Ram(), 0x30) == Expected(port == 1 ? bit : -1));
+    }
+  }
+}
+
+TEST(BatchControllerReadsEachButtonInOrder) {
+  // Lane i holds button i % 8 on port i / 8.
+  BatchCpu6502 batch(test::AssembleRom(kReadPadsRom), 16);
+  for (int lane = 0; lane < 16; ++lane) {
+    batch.SetButtons(lane, lane / 8, 1 << (lane % 8));
+  }
+  batch.RunFrame();
+  uint8_t ram[0x800];
+  for (int lane = 0; lane < 16; ++lane) {
+    batch.CopyRam(lane, ram);
+    CHECK(Bits(ram, 0x20) == Expected(lane < 8 ? lane % 8 : -1));
+    CHECK(Bits(ram, 0x30) == Expected(lane >= 8 ? lane % 8 : -1));
+  }
+}
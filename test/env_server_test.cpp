@@ -0,0 +1,209 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "cpu6502.h"
+#include "env_server.h"
+#include "test/test.h"
+
+using namespace env_protocol;
+
+namespace {
+
+// Counts NMIs at $12 and sums controller 1's buttons into $13.
+const char* kButtonSumRom = R"(
+        .org $8000
+reset:  sei
+        ldx #$FF
+        txs
+        lda #$80
+        sta $2000       ; NMI on
+spin:   inc $10
+        jmp spin
+nmi:    inc $12
+        lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        ldx #8
+read:   lda $4016
+        and #1
+        adc $13
+        sta $13
+        dex
+        bne read
+        rti
+        .org $FFFA
+        .word nmi, reset, reset
+)";
+
+std::string SocketPath() {
+  return string_format("/tmp/nes2x_env_test_%d.sock", static_cast<int>(getpid()));
+}
+
+int Connect(const std::string& socket_path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    throw std::runtime_error("Could not connect to " + socket_path);
+  }
+  return fd;
+}
+
+// Serves on a thread for as long as it is in scope.
+class ServerThread {
+  public:
+    ServerThread(EnvServer* server, const std::string& socket_path)
+        : socket_path_(socket_path), thread_([this, server]() { server->Serve(&stop_); }) {}
+
+    ~ServerThread() {
+      stop_ = 1;
+      // Wakes the server if it is waiting in accept().
+      try {
+        close(Connect(socket_path_));
+      } catch (const std::exception&) {
+      }
+      thread_.join();
+    }
+
+  private:
+    volatile sig_atomic_t stop_ = 0;
+    std::string socket_path_;
+    std::thread thread_;
+};
+
+struct Client {
+  int fd = -1;
+  EnvInfo info = {};
+  const uint8_t* shm = nullptr;
+  EnvResponse resp = {};
+  std::vector<uint8_t> done;
+  std::vector<uint8_t> rewards;
+
+  explicit Client(const std::string& socket_path) : fd(Connect(socket_path)) {
+    if (!ReadFull(fd, &info, sizeof(info))) {
+      throw std::runtime_error("No EnvInfo.");
+    }
+    int shm_fd = shm_open(info.shm_name, O_RDONLY, 0);
+    void* mem = shm_fd >= 0 ? mmap(nullptr, info.shm_bytes, PROT_READ, MAP_SHARED, shm_fd, 0) : MAP_FAILED;
+    if (shm_fd >= 0) {
+      close(shm_fd);
+    }
+    if (mem == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error(std::string("Could not map ") + info.shm_name);
+    }
+    shm = static_cast<const uint8_t*>(mem);
+  }
+
+  ~Client() {
+    munmap(const_cast<uint8_t*>(shm), info.shm_bytes);
+    close(fd);
+  }
+
+  void Request(RequestType type, const std::vector<uint8_t>& actions, uint32_t frames) {
+    EnvRequest req = {kMagic, type, static_cast<uint32_t>(actions.size()), frames};
+    done.resize(actions.size());
+    rewards.resize(actions.size() * info.num_reward_addrs);
+    if (!WriteFull(fd, &req, sizeof(req)) || !WriteFull(fd, actions.data(), actions.size()) ||
+        !ReadFull(fd, &resp, sizeof(resp)) || !ReadFull(fd, done.data(), done.size()) ||
+        !ReadFull(fd, rewards.data(), rewards.size())) {
+      throw std::runtime_error("Server hung up.");
+    }
+  }
+
+  const uint8_t* Ram(int env) const {
+    return shm + kShmHeaderBytes + resp.slot * info.slot_bytes + env * (kFrameBytes + kRamBytes) +
+           kFrameBytes;
+  }
+};
+
+} // namespace
+
+TEST(EnvServerStepsLikeLocalConsoles) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kButtonSumRom);
+  EnvServer::Options opts;
+  opts.num_envs = 3;
+  opts.ring_slots = 2;
+  opts.threads = 2;
+  opts.reward_addrs = {0x12, 0x13};
+  opts.max_episode_frames = 5;
+  EnvServer server(cart, opts, SocketPath());
+  ServerThread serving(&server, SocketPath());
+  Client client(SocketPath());
+  CHECK_EQ(client.info.magic, kMagic);
+  CHECK_EQ(client.info.num_envs, 3u);
+  CHECK_EQ(client.info.num_reward_addrs, 2u);
+  CHECK_EQ(memcmp(client.shm, &client.info, sizeof(client.info)), 0);
+
+  // The same games run here, reset whenever the server says an episode is done.
+  std::vector<std::unique_ptr<Cpu6502>> local;
+  std::vector<uint64_t> episode_frames(3);
+  for (int e = 0; e < 3; ++e) {
+    local.push_back(std::make_unique<Cpu6502>(cart));
+  }
+  const uint32_t kFrames = 2;
+  for (uint64_t step = 1; step <= 8; ++step) {
+    // Every third step drives only the first two envs.
+    std::vector<uint8_t> actions(step % 3 == 0 ? 2 : 3);
+    for (size_t e = 0; e < actions.size(); ++e) {
+      actions[e] = static_cast<uint8_t>(step * 29 + e * 83);
+    }
+    client.Request(RequestType::kStep, actions, kFrames);
+    CHECK_EQ(client.resp.magic, kMagic);
+    CHECK_EQ(client.resp.step, step);
+    CHECK_EQ(client.resp.slot, step % 2);
+    for (size_t e = 0; e < actions.size(); ++e) {
+      Cpu6502& cpu = *local[e];
+      cpu.SetButtons(0, actions[e]);
+      for (uint32_t f = 0; f < kFrames; ++f) {
+        cpu.RunFrame();
+      }
+      episode_frames[e] += kFrames;
+      CHECK_EQ(memcmp(client.Ram(e), cpu.Ram(), kRamBytes), 0);
+      CHECK_EQ(client.rewards[e * 2], cpu.Ram()[0x12]);
+      CHECK_EQ(client.rewards[e * 2 + 1], cpu.Ram()[0x13]);
+      CHECK_EQ(client.done[e], episode_frames[e] >= 5 ? 1 : 0);
+      if (client.done[e]) {
+        local[e] = std::make_unique<Cpu6502>(cart);
+        episode_frames[e] = 0;
+      }
+    }
+  }
+
+  // A reset puts every env back to its post-boot RAM and reports it done.
+  client.Request(RequestType::kReset, std::vector<uint8_t>(3), 1);
+  Cpu6502 booted(cart);
+  for (int e = 0; e < 3; ++e) {
+    CHECK_EQ(client.done[e], 1);
+    CHECK_EQ(memcmp(client.Ram(e), booted.Ram(), kRamBytes), 0);
+  }
+}
+
+TEST(EnvServerRejectsBadOptions) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kButtonSumRom);
+  EnvServer::Options opts;
+  opts.reward_addrs = {0x800};
+  CHECK_THROWS(EnvServer(cart, opts, SocketPath()), "not in internal RAM");
+  opts.reward_addrs.assign(kMaxRewardAddrs + 1, 0);
+  CHECK_THROWS(EnvServer(cart, opts, SocketPath()), "At most");
+  opts.reward_addrs.clear();
+  opts.num_envs = 0;
+  CHECK_THROWS(EnvServer(cart, opts, SocketPath()), "at least one env");
+
+  // A path that doesn't fit must not leak the socket: the lowest free descriptor is the
+  // one a leak would take.
+  opts.num_envs = 1;
+  int lowest_free = dup(0);
+  close(lowest_free);
+  CHECK_THROWS(EnvServer(cart, opts, "/tmp/" + std::string(200, 'x')), "too long");
+  int after = dup(0);
+  close(after);
+  CHECK_EQ(after, lowest_free);
+}
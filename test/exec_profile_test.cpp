@@ -0,0 +1,73 @@
+#include "cpu6502.h"
+#include "exec_profile.h"
+#include "test/test.h"
+
+namespace {
+
+const uint8_t kBne = 0xD0;
+const uint8_t kLdaAbsoluteX = 0xBD;
+const uint8_t kStaAbsolute = 0x8D;
+
+// Runs the cartridge's first n instructions, recording each into profile with the cycles
+// the core charged for it, as Cpu6502 does with -D PROFILE.
+ExecProfile RunProfiled(const std::string& source, int n) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(source);
+  Cpu6502 cpu(cart);
+  ExecProfile profile(cart->ContentHash());
+  auto state = std::make_unique<ConsoleState>();
+  for (int i = 0; i < n; ++i) {
+    cpu.SaveState(state.get());
+    uint16_t pc = state->cpu.program_counter;
+    uint64_t cycle = cpu.Cycle();
+    cpu.RunCycle();
+    profile.Record(cart->PrgRom()[pc - 0x8000], pc, cpu.Cycle() - cycle);
+  }
+  return profile;
+}
+
+} // namespace
+
+TEST(ExecProfileSplitsBranchCycles) {
+  ExecProfile profile = RunProfiled(R"(
+        .org $8000
+reset:  ldx #0
+        bne reset       ; not taken: 2 cycles
+        inx
+        bne next        ; taken to the next instruction: 3 cycles
+next:   jmp far
+        .org $80FD
+far:    bne cross       ; taken onto the next page: 4 cycles
+        .org $8110
+cross:  jmp cross
+        .org $FFFA
+        .word reset, reset, reset
+)", 6);
+  const ExecProfile::OpcodeStats& bne = profile.Opcode(kBne);
+  CHECK_EQ(bne.count, 3u);
+  CHECK_EQ(bne.cycles, 2u + 3u + 4u);
+  CHECK_EQ(bne.taken, 2u);
+  CHECK_EQ(bne.page_crosses, 1u);
+}
+
+TEST(ExecProfileCountsPageCrossesAndDma) {
+  ExecProfile profile = RunProfiled(R"(
+        .org $8000
+reset:  ldx #$10
+        lda $80F8,x     ; $8108: crosses a page, 5 cycles
+        lda $8000,x     ; 4 cycles
+        lda #$02
+        sta $4014       ; OAM DMA: 4 cycles plus 513 or 514
+spin:   jmp spin
+        .org $FFFA
+        .word reset, reset, reset
+)", 6);
+  const ExecProfile::OpcodeStats& lda = profile.Opcode(kLdaAbsoluteX);
+  CHECK_EQ(lda.count, 2u);
+  CHECK_EQ(lda.cycles, 9u);
+  CHECK_EQ(lda.page_crosses, 1u);
+  const ExecProfile::OpcodeStats& sta = profile.Opcode(kStaAbsolute);
+  CHECK_EQ(sta.count, 1u);
+  CHECK_EQ(sta.page_crosses, 0u);
+  CHECK(sta.dma_cycles == 513 || sta.dma_cycles == 514);
+  CHECK_EQ(sta.cycles, 4 + sta.dma_cycles);
+}
@@ -0,0 +1,106 @@
+#include "cpu6502.h"
+#include "frame_memo.h"
+#include "job_pool.h"
+#include "movie.h"
+#include "test/test.h"
+
+namespace {
+
+// Sums controller 1 into $13 every NMI and draws it as the backdrop colour.
+const char* kInputRom = R"(
+        .org $8000
+reset:  sei
+        ldx #$FF
+        txs
+        lda #$80
+        sta $2000       ; NMI on
+        lda #$0A
+        sta $2001       ; background on
+spin:   inc $10
+        jmp spin
+nmi:    pha
+        lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        ldx #8
+read:   lda $4016
+        lsr a
+        rol $14
+        dex
+        bne read
+        lda $14
+        clc
+        adc $13
+        sta $13
+        lda #$3F
+        sta $2006
+        lda #$00
+        sta $2006
+        lda $14
+        and #$3F
+        sta $2007       ; backdrop colour
+        lda #0
+        sta $2005
+        sta $2005
+        pla
+        rti
+        .org $FFFA
+        .word nmi, reset, reset
+)";
+
+const uint64_t kFrames = 40;
+
+// Records kFrames with input from seed, except that the first shared frames take theirs
+// from seed 1, so movies with different seeds share a prefix.
+Movie Record(const Cartridge& cartridge, Cpu6502* cpu, uint32_t seed, uint64_t shared) {
+  Movie movie(cartridge, cpu, 1, 16);
+  uint32_t shared_seed = 1;
+  for (uint64_t frame = 0; frame < kFrames; ++frame) {
+    uint32_t& x = frame < shared ? shared_seed : seed;
+    x = x * 1103515245u + 12345u;
+    uint8_t buttons[1] = {static_cast<uint8_t>(x >> 16)};
+    cpu->SetButtons(0, buttons[0]);
+    cpu->RunFrame();
+    movie.AddFrame(buttons, cpu);
+  }
+  return movie;
+}
+
+} // namespace
+
+TEST(MemoizedReplayEndsInThePlainReplaysState) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kInputRom);
+  std::vector<Movie> movies;
+  for (uint32_t seed = 2; seed < 5; ++seed) {
+    Cpu6502 recorder(cart);
+    movies.push_back(Record(*cart, &recorder, seed, 25));
+  }
+
+  FrameMemo memo(4 << 20);
+  JobPool pool(2);
+  for (int round = 0; round < 2; ++round) {
+    for (size_t m = 0; m < movies.size(); ++m) {
+      Cpu6502 plain(cart);
+      Movie::Divergence divergence = movies[m].Replay(*cart, &plain);
+      CHECK(!divergence.diverged);
+      CHECK_EQ(divergence.memo_hits, 0u);
+
+      Cpu6502 memoized(cart);
+      divergence = round == 0 ? movies[m].Replay(*cart, &memoized, &memo)
+                              : movies[m].ReplaySegments(cart, &memoized, &pool, &memo);
+      CHECK(!divergence.diverged);
+      CHECK_EQ(memoized.StateHash(), plain.StateHash());
+      CHECK_EQ(memcmp(memoized.Ram(), plain.Ram(), 0x800), 0);
+      if (round == 0) {
+        // Later movies replay the shared prefix from the memo; the first has nothing to hit.
+        CHECK_EQ(divergence.memo_hits, m == 0 ? 0u : 25u);
+      } else {
+        // Every frame has been seen by now.
+        CHECK_EQ(divergence.memo_hits, kFrames);
+      }
+    }
+  }
+  FrameMemo::Stats stats = memo.GetStats();
+  CHECK_EQ(stats.hits, 2 * 25 + 3 * kFrames);
+}
@@ -0,0 +1,54 @@
+#include "frame_telemetry.h"
+#include "test/test.h"
+
+TEST(DurationHistogramPercentilesAreBucketUpperBounds) {
+  DurationHistogram histogram;
+  CHECK_EQ(histogram.PercentileNs(0.5), 0u);
+  histogram.Record(1024);  // the first bucket after the catch-all one: [1024, 1280)
+  histogram.Record(5000);  // [4096, 5120)
+  CHECK_EQ(histogram.Count(), 2u);
+  CHECK_EQ(histogram.SumNs(), 6024u);
+  CHECK_EQ(histogram.MaxNs(), 5000u);
+  CHECK_EQ(histogram.PercentileNs(0.5), 1279u);
+  // The top bucket's bound is past the largest duration, so that is reported instead.
+  CHECK_EQ(histogram.PercentileNs(1.0), 5000u);
+  histogram.Clear();
+  CHECK_EQ(histogram.Count(), 0u);
+  CHECK_EQ(histogram.PercentileNs(1.0), 0u);
+}
+
+TEST(DurationHistogramIsAtMostAQuarterHigh) {
+  // A bucket spans a quarter of its power of two, so its bound is at most 25% over any
+  // duration in it. A larger second sample keeps the maximum from capping the p50.
+  for (uint64_t ns = 1024; ns < (1ULL << 31); ns += ns / 7 + 13) {
+    DurationHistogram histogram;
+    histogram.Record(ns);
+    histogram.Record(1ULL << 40);
+    uint64_t p50 = histogram.PercentileNs(0.5);
+    CHECK(p50 >= ns);
+    CHECK(p50 < ns + ns / 4);
+  }
+}
+
+TEST(DurationHistogramEnds) {
+  DurationHistogram histogram;
+  histogram.Record(0);
+  histogram.Record(1023);
+  CHECK_EQ(histogram.PercentileNs(0.5), 1023u);
+  // Beyond kMaxShift everything shares the last bucket, and the maximum is exact.
+  histogram.Record(1ULL << 33);
+  histogram.Record(1ULL << 40);
+  CHECK_EQ(histogram.PercentileNs(0.75), 1ULL << 40);
+  CHECK_EQ(histogram.PercentileNs(1.0), 1ULL << 40);
+}
+
+TEST(DurationHistogramCountsBelowPowersOfTwo) {
+  DurationHistogram histogram;
+  for (uint64_t ns : {500, 1000, 2047, 2048, 3000, 1 << 20}) {
+    histogram.Record(ns);
+  }
+  CHECK_EQ(histogram.CountAtMost(1024), 2u);
+  CHECK_EQ(histogram.CountAtMost(2048), 3u);
+  CHECK_EQ(histogram.CountAtMost(4096), 5u);
+  CHECK_EQ(histogram.CountAtMost(1ULL << 30), 6u);
+}
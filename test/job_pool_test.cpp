@@ -0,0 +1,24 @@
+#include <atomic>
+
+#include "job_pool.h"
+#include "test/test.h"
+
+TEST(JobPoolRunsEveryJobOncePerRun) {
+  JobPool pool(3);
+  std::vector<std::atomic<int>> runs(10);
+  // The same workers serve every Run(); each must finish its jobs before Run() returns.
+  for (int round = 1; round <= 50; ++round) {
+    std::vector<JobPool::Job> jobs;
+    for (size_t i = 0; i < runs.size(); ++i) {
+      jobs.push_back([&runs, i](int worker) {
+        CHECK(worker >= 0 && worker < 3);
+        runs[i]++;
+      });
+    }
+    pool.Run(std::move(jobs));
+    for (std::atomic<int>& count : runs) {
+      CHECK_EQ(count.load(), round);
+    }
+  }
+  pool.Run({});
+}
@@ -0,0 +1,159 @@
+#include <unistd.h>
+
+#include <cstddef>
+
+#include "cpu6502.h"
+#include "job_pool.h"
+#include "movie.h"
+#include "test/test.h"
+
+namespace {
+
+// Reads controller 1 every NMI, adds it into $13, and draws it as the backdrop colour, so
+// both halves of FrameChecksum() follow the input.
+const char* kInputRom = R"(
+        .org $8000
+reset:  sei
+        ldx #$FF
+        txs
+        lda #$80
+        sta $2000       ; NMI on
+        lda #$0A
+        sta $2001       ; background on
+spin:   inc $10
+        jmp spin
+nmi:    pha
+        lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        ldx #8
+read:   lda $4016
+        lsr a
+        rol $14
+        dex
+        bne read
+        lda $14
+        clc
+        adc $13
+        sta $13
+        lda #$3F
+        sta $2006
+        lda #$00
+        sta $2006
+        lda $14
+        and #$3F
+        sta $2007       ; backdrop colour
+        lda #0
+        sta $2005
+        sta $2005
+        pla
+        rti
+        .org $FFFA
+        .word nmi, reset, reset
+)";
+
+const uint64_t kFrames = 50;
+const uint32_t kCheckpointInterval = 8;
+
+std::string MoviePath() {
+  return string_format("/tmp/nes2x_movie_test_%d.nesm", static_cast<int>(getpid()));
+}
+
+// Records kFrames of seeded pseudo-random input on both ports. *end gets the state hash
+// the recording finished in.
+Movie Record(const Cartridge& cartridge, Cpu6502* cpu, uint32_t seed, uint64_t* end) {
+  Movie movie(cartridge, cpu, 2, kCheckpointInterval);
+  for (uint64_t frame = 0; frame < kFrames; ++frame) {
+    uint8_t buttons[2];
+    for (int port = 0; port < 2; ++port) {
+      seed = seed * 1103515245u + 12345u;
+      buttons[port] = static_cast<uint8_t>(seed >> 16);
+      cpu->SetButtons(port, buttons[port]);
+    }
+    cpu->RunFrame();
+    movie.AddFrame(buttons, cpu);
+  }
+  *end = cpu->StateHash();
+  return movie;
+}
+
+} // namespace
+
+TEST(MovieReplaysWhatItRecorded) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kInputRom);
+  Cpu6502 recorder(cart);
+  uint64_t end_hash;
+  Movie recorded = Record(*cart, &recorder, 7, &end_hash);
+  CHECK_EQ(recorded.NumFrames(), kFrames);
+  CHECK_EQ(recorded.NumCheckpoints(), static_cast<size_t>(1 + kFrames / kCheckpointInterval));
+  recorded.WriteFile(MoviePath());
+  Movie movie = Movie::FromFile(MoviePath());
+  unlink(MoviePath().c_str());
+  CHECK_EQ(movie.NumFrames(), kFrames);
+
+  // Every frame's checksum matches a plain run with the recorded buttons.
+  Cpu6502 plain(cart);
+  movie.Start(*cart, &plain);
+  for (uint64_t frame = 0; frame < kFrames; ++frame) {
+    plain.SetButtons(0, movie.Buttons(frame, 0));
+    plain.SetButtons(1, movie.Buttons(frame, 1));
+    plain.RunFrame();
+    CHECK_EQ(Movie::FrameChecksum(&plain), movie.Hash(frame));
+  }
+  CHECK_EQ(plain.StateHash(), end_hash);
+
+  Cpu6502 serial(cart);
+  Movie::Divergence divergence = movie.Replay(*cart, &serial);
+  CHECK(!divergence.diverged);
+  CHECK_EQ(serial.StateHash(), end_hash);
+
+  JobPool pool(3);
+  Cpu6502 segmented(cart);
+  divergence = movie.ReplaySegments(cart, &segmented, &pool);
+  CHECK(!divergence.diverged);
+  CHECK_EQ(segmented.StateHash(), end_hash);
+
+  // Different input makes a different movie.
+  Cpu6502 other(cart);
+  uint64_t other_hash;
+  Movie reseeded = Record(*cart, &other, 8, &other_hash);
+  CHECK(reseeded.Hash(kFrames - 1) != movie.Hash(kFrames - 1));
+  CHECK(other_hash != end_hash);
+}
+
+TEST(MovieRejectsACorruptedCheckpoint) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kInputRom);
+  Cpu6502 recorder(cart);
+  uint64_t end_hash;
+  Record(*cart, &recorder, 7, &end_hash).WriteFile(MoviePath());
+
+  // Flip a byte of RAM the ROM never touches in checkpoint 2, the one that ends segment 1.
+  FILE* file = fopen(MoviePath().c_str(), "r+b");
+  CHECK(file != nullptr);
+  long offset = 48 + 2 * sizeof(ConsoleState) + offsetof(ConsoleState, cpu.internal_ram) + 0x7FF;
+  fseek(file, offset, SEEK_SET);
+  fputc(0x5A, file);
+  fclose(file);
+  Movie movie = Movie::FromFile(MoviePath());
+
+  Cpu6502 serial(cart);
+  Movie::Divergence divergence = movie.Replay(*cart, &serial);
+  CHECK(divergence.diverged);
+  CHECK(divergence.at_checkpoint);
+  CHECK_EQ(divergence.frame, 2 * kCheckpointInterval - 1);
+  CHECK(divergence.actual != divergence.expected);
+
+  // Segment 2 starts from the bad checkpoint too, but the earliest divergence wins.
+  JobPool pool(3);
+  Cpu6502 segmented(cart);
+  divergence = movie.ReplaySegments(cart, &segmented, &pool);
+  CHECK(divergence.diverged);
+  CHECK(divergence.at_checkpoint);
+  CHECK_EQ(divergence.frame, 2 * kCheckpointInterval - 1);
+
+  // A file cut short doesn't load at all.
+  CHECK_EQ(truncate(MoviePath().c_str(), offset), 0);
+  CHECK_THROWS(Movie::FromFile(MoviePath()), "truncated");
+  unlink(MoviePath().c_str());
+}
@@ -0,0 +1,125 @@
+#include <deque>
+
+#include "cpu6502.h"
+#include "netplay.h"
+#include "test/test.h"
+
+namespace {
+
+// Sums both controllers into RAM every NMI, so a frame run with the wrong remote input
+// leaves a different state.
+const char* kTwoPlayerRom = R"(
+        .org $8000
+reset:  sei
+        ldx #$FF
+        txs
+        lda #$80
+        sta $2000       ; NMI on
+spin:   inc $10
+        jmp spin
+nmi:    lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        ldx #8
+read:   lda $4016
+        and #1
+        adc $11
+        sta $11
+        lda $4017
+        and #1
+        asl a
+        adc $12
+        sta $12
+        dex
+        bne read
+        rti
+        .org $FFFA
+        .word nmi, reset, reset
+)";
+
+// One end of an in-memory link. While held, datagrams queue up undelivered.
+class QueueTransport : public NetTransport {
+  public:
+    void Connect(QueueTransport* peer) { peer_ = peer; }
+    void Hold(bool hold) { held_ = hold; }
+
+    void Send(const void* data, size_t size) override {
+      const uint8_t* bytes = static_cast<const uint8_t*>(data);
+      peer_->inbox_.emplace_back(bytes, bytes + size);
+    }
+
+    size_t Receive(void* data, size_t capacity) override {
+      if (held_ || inbox_.empty()) {
+        return 0;
+      }
+      size_t size = std::min(capacity, inbox_.front().size());
+      memcpy(data, inbox_.front().data(), size);
+      inbox_.pop_front();
+      return size;
+    }
+
+  private:
+    QueueTransport* peer_ = nullptr;
+    bool held_ = false;
+    std::deque<std::vector<uint8_t>> inbox_;
+};
+
+uint8_t Buttons(int port, int frame) {
+  return static_cast<uint8_t>((frame * (port ? 37 : 11) + port) % 256);
+}
+
+} // namespace
+
+TEST(RollbackMatchesAPlainRunOfTheConfirmedInputs) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kTwoPlayerRom);
+  QueueTransport link0, link1;
+  link0.Connect(&link1);
+  link1.Connect(&link0);
+  RollbackSession player0(cart, 0, &link0);
+  RollbackSession player1(cart, 1, &link1);
+
+  const int kFrames = 40;
+  for (int f = 0; f < kFrames; ++f) {
+    // Player 1 hears nothing for stretches of up to five frames and must roll back.
+    link1.Hold(f % 6 != 5);
+    player0.AdvanceFrame(Buttons(0, f));
+    player1.AdvanceFrame(Buttons(1, f));
+  }
+  link1.Hold(false);
+  player0.Finish(std::chrono::milliseconds(0));
+  player1.Finish(std::chrono::milliseconds(0));
+
+  CHECK(player1.GetStats().rollbacks > 0);
+  CHECK_EQ(player1.GetStats().stalls, 0u);
+  std::vector<uint8_t> inputs = player0.ConfirmedInputs();
+  CHECK(inputs == player1.ConfirmedInputs());
+  CHECK_EQ(inputs.size(), 2u * kFrames);
+
+  Cpu6502 plain(cart);
+  for (int f = 0; f < kFrames; ++f) {
+    CHECK_EQ(inputs[2 * f], Buttons(0, f));
+    CHECK_EQ(inputs[2 * f + 1], Buttons(1, f));
+    plain.SetButtons(0, inputs[2 * f]);
+    plain.SetButtons(1, inputs[2 * f + 1]);
+    plain.RunFrame();
+  }
+  CHECK_EQ(player0.Console()->StateHash(), plain.StateHash());
+  CHECK_EQ(player1.Console()->StateHash(), plain.StateHash());
+}
+
+TEST(RollbackDoesNotStallWhenTheRemoteIsAhead) {
+  std::shared_ptr<const Cartridge> cart = test::AssembleRom(kTwoPlayerRom);
+  QueueTransport link0, link1;
+  link0.Connect(&link1);
+  link1.Connect(&link0);
+  RollbackSession player0(cart, 0, &link0);
+  RollbackSession player1(cart, 1, &link1);
+  for (int f = 0; f < 3; ++f) {
+    player0.AdvanceFrame(Buttons(0, f));
+  }
+  // Player 1 now has confirmed input past its own next frame.
+  player1.AdvanceFrame(Buttons(1, 0));
+  CHECK_EQ(player1.GetStats().stalls, 0u);
+  CHECK_EQ(player1.Console()->FrameCount(), 1u);
+}
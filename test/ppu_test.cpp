@@ -0,0 +1,38 @@
+#include "assembler.h"
+#include "ppu.h"
+#include "test/test.h"
+
+namespace {
+
+// The nametable ($2000, $2400, $2800 or $2C00) that shares RAM with $2000.
+std::vector<uint16_t> SharesWith2000(Mirroring mirroring) {
+  PpuState state;
+  uint8_t chr_ram[0x2000];
+  Ppu ppu(nullptr, 0, mirroring, &state, chr_ram);
+  ppu.SetMMAP(0x2005, 0xAB);
+  std::vector<uint16_t> shared;
+  for (uint16_t base = 0x2000; base < 0x3000; base += 0x400) {
+    if (ppu.GetMMAP(base + 5) == 0xAB) {
+      shared.push_back(base);
+    }
+  }
+  // $3000-$3EFF mirrors $2000-$2EFF.
+  CHECK_EQ(ppu.GetMMAP(0x3005), 0xAB);
+  return shared;
+}
+
+} // namespace
+
+TEST(PpuNametableMirroring) {
+  CHECK(SharesWith2000(Mirroring::kHorizontal) == std::vector<uint16_t>({0x2000, 0x2400}));
+  CHECK(SharesWith2000(Mirroring::kVertical) == std::vector<uint16_t>({0x2000, 0x2800}));
+}
+
+TEST(CartridgeReadsMirroringFromHeader) {
+  std::vector<uint8_t> prg(0x8000);
+  CHECK(Cartridge::FromBytes(InesImage(prg, {}, true))->Mirroring() == Mirroring::kVertical);
+  CHECK(Cartridge::FromBytes(InesImage(prg, {}, false))->Mirroring() == Mirroring::kHorizontal);
+  std::vector<uint8_t> four_screen = InesImage(prg, {});
+  four_screen[6] |= 0b1000;
+  CHECK_THROWS(Cartridge::FromBytes(four_screen), "four-screen");
+}
@@ -0,0 +1,77 @@
+#include "cpu6502.h"
+#include "rewind_buffer.h"
+#include "test/test.h"
+
+namespace {
+
+uint64_t Hash(const ConsoleState& state) {
+  return Fnv1a64(reinterpret_cast<const uint8_t*>(&state), sizeof(state));
+}
+
+// Rewinds until the buffer is empty, checking each state against hashes from the newest
+// but one backwards. Returns how many steps it took.
+size_t RewindAll(RewindBuffer* rewind, const std::vector<uint64_t>& hashes) {
+  auto state = std::make_unique<ConsoleState>();
+  size_t steps = 0;
+  while (rewind->Rewind(state.get())) {
+    steps++;
+    CHECK(steps < hashes.size());
+    if (steps < hashes.size()) {
+      CHECK_EQ(Hash(*state), hashes[hashes.size() - 1 - steps]);
+    }
+  }
+  return steps;
+}
+
+} // namespace
+
+TEST(RewindStepsBackOneFrameAtATime) {
+  Cpu6502 cpu(test::AssembleRom(R"(
+        .org $8000
+reset:  lda #$80
+        sta $2000       ; NMI on
+spin:   inc $10
+        jmp spin
+nmi:    inc $11
+        rti
+        .org $FFFA
+        .word nmi, reset, reset
+)"));
+  RewindBuffer rewind(4 << 20);
+  auto state = std::make_unique<ConsoleState>();
+  std::vector<uint64_t> hashes;
+  // Pushed back to back, so the encoder falls behind and Push() has to wait for it.
+  const int kFrames = 40;
+  for (int i = 0; i < kFrames; ++i) {
+    cpu.RunFrame();
+    cpu.SaveState(state.get());
+    rewind.Push(*state);
+    hashes.push_back(Hash(*state));
+  }
+  CHECK_EQ(rewind.GetStats().frames, static_cast<uint64_t>(kFrames));
+  CHECK_EQ(rewind.GetStats().evicted, 0u);
+  CHECK_EQ(RewindAll(&rewind, hashes), static_cast<size_t>(kFrames - 1));
+  CHECK_EQ(rewind.GetStats().frames, 1u);
+}
+
+TEST(RewindEvictsTheOldestFramesToStayInBudget) {
+  // Just above the smallest budget allowed. Each delta below has 2k of changed RAM, so only
+  // a few dozen fit.
+  const size_t kCapacity = sizeof(ConsoleState) * 4 + 64;
+  RewindBuffer rewind(kCapacity);
+  auto state = std::make_unique<ConsoleState>();
+  std::vector<uint64_t> hashes;
+  const int kFrames = 300;
+  for (int i = 0; i < kFrames; ++i) {
+    memset(state->cpu.internal_ram, i, sizeof(state->cpu.internal_ram));
+    state->cpu.cycle = i;
+    rewind.Push(*state);
+    hashes.push_back(Hash(*state));
+  }
+  RewindBuffer::Stats stats = rewind.GetStats();
+  CHECK(stats.evicted > 0);
+  CHECK_EQ(stats.frames + stats.evicted, static_cast<uint64_t>(kFrames));
+  CHECK(stats.encoded_bytes <= kCapacity);
+  // Everything left still rewinds in order, newest first.
+  CHECK_EQ(RewindAll(&rewind, hashes), stats.frames - 1);
+}
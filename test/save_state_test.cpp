@@ -0,0 +1,141 @@
+#include "assembler.h"
+#include "cpu6502.h"
+#include "nes2x.h"
+#include "test/test.h"
+
+namespace {
+
+// Counts frames in RAM from the NMI, and mixes controller 1 into a running sum, so states
+// differ from frame to frame and with the input. start is stored at $10 on reset, which
+// makes ROMs that differ only in it otherwise identical.
+std::string CounterRom(int start) {
+  return string_format(R"(
+        .org $8000
+reset:  sei
+        ldx #$FF
+        txs
+        lda #%d
+        sta $10
+        lda #$80
+        sta $2000       ; NMI on
+spin:   inc $11
+        jmp spin
+nmi:    inc $12
+        lda #1
+        sta $4016
+        lda #0
+        sta $4016
+        lda $4016
+        and #1
+        adc $13
+        sta $13
+        rti
+        .org $FFFA
+        .word nmi, reset, reset
+)", start);
+}
+
+std::unique_ptr<ConsoleState> Save(Cpu6502* cpu) {
+  auto state = std::make_unique<ConsoleState>();
+  cpu->SaveState(state.get());
+  return state;
+}
+
+} // namespace
+
+TEST(SaveStateRoundTrip) {
+  Cpu6502 cpu(test::AssembleRom(CounterRom(1)));
+  for (int i = 0; i < 5; ++i) {
+    cpu.SetButtons(0, i & 1);
+    cpu.RunFrame();
+  }
+  std::unique_ptr<ConsoleState> state = Save(&cpu);
+  uint64_t frame = cpu.FrameCount();
+  uint64_t hash_at_save = cpu.StateHash();
+
+  // Run on with some input, remember where that lands, then go back and do it again.
+  auto run = [&cpu]() {
+    for (int i = 0; i < 7; ++i) {
+      cpu.SetButtons(0, i % 3 == 0);
+      cpu.RunFrame();
+    }
+    return cpu.StateHash();
+  };
+  uint64_t hash_after = run();
+  CHECK(hash_after != hash_at_save);
+  cpu.LoadState(*state);
+  CHECK_EQ(cpu.FrameCount(), frame);
+  CHECK_EQ(cpu.StateHash(), hash_at_save);
+  CHECK_EQ(run(), hash_after);
+}
+
+TEST(LoadStateRejectsOtherVersionsAndLayouts) {
+  Cpu6502 cpu(test::AssembleRom(CounterRom(1)));
+  cpu.RunFrame();
+  std::unique_ptr<ConsoleState> good = Save(&cpu);
+  cpu.RunFrame();
+  uint64_t hash = cpu.StateHash();
+
+  ConsoleState bad = *good;
+  bad.magic ^= 1;
+  CHECK_THROWS(cpu.LoadState(bad), "save state");
+  bad = *good;
+  bad.version = ConsoleState::kVersion - 1;
+  CHECK_THROWS(cpu.LoadState(bad), "save state");
+  bad = *good;
+  bad.size = sizeof(ConsoleState) - 64;
+  CHECK_THROWS(cpu.LoadState(bad), "save state");
+  // A rejected state leaves the console as it was.
+  CHECK_EQ(cpu.StateHash(), hash);
+}
+
+TEST(LoadStateRejectsOtherCartridges) {
+  // Same size, mapper and CHR type; only one byte of code differs.
+  Cpu6502 first(test::AssembleRom(CounterRom(1)));
+  Cpu6502 second(test::AssembleRom(CounterRom(2)));
+  first.RunFrame();
+  second.RunFrame();
+  uint64_t hash = second.StateHash();
+  CHECK_THROWS(second.LoadState(*Save(&first)), "different cartridge");
+  CHECK_EQ(second.StateHash(), hash);
+  // The same ROM loaded again is the same cartridge.
+  Cpu6502 again(test::AssembleRom(CounterRom(1)));
+  again.LoadState(*Save(&first));
+  CHECK_EQ(again.StateHash(), first.StateHash());
+}
+
+TEST(CApiLoadStateFailsForOtherRomsAndSizes) {
+  auto image = [](int start) {
+    Assembler assembler(0x8000, 0x8000);
+    assembler.Assemble(CounterRom(start));
+    return InesImage(assembler.Output(), {});
+  };
+  std::vector<uint8_t> rom1 = image(1);
+  std::vector<uint8_t> rom2 = image(2);
+  nes2x* first = nes2x_create(rom1.data(), rom1.size(), nullptr, 0);
+  nes2x* second = nes2x_create(rom2.data(), rom2.size(), nullptr, 0);
+  CHECK(first != nullptr && second != nullptr);
+  CHECK_EQ(nes2x_step(first, 3), 0);
+  std::vector<uint8_t> state(nes2x_state_size(first));
+  CHECK_EQ(nes2x_save_state(first, state.data(), state.size()), 0);
+  CHECK_EQ(nes2x_load_state(second, state.data(), state.size()), -1);
+  CHECK(std::string(nes2x_last_error(second)).find("different cartridge") != std::string::npos);
+  CHECK_EQ(nes2x_load_state(first, state.data(), state.size() - 1), -1);
+  CHECK_EQ(nes2x_load_state(first, state.data(), state.size()), 0);
+  CHECK_EQ(nes2x_frame_count(first), 3u);
+  nes2x_destroy(first);
+  nes2x_destroy(second);
+}
+
+TEST(CApiCreateFailsForPrgSizesNromCannotMap) {
+  Assembler assembler(0x8000, 0x8000);
+  assembler.Assemble(CounterRom(1));
+  for (uint8_t banks : {0, 3, 4}) {
+    std::vector<uint8_t> rom = InesImage(assembler.Output(), {});
+    rom[4] = banks;  // 16k PRG-ROM banks; the data behind the header is long enough for each
+    rom.resize(16 + 4 * 0x4000);
+    char error[128] = "";
+    CHECK(nes2x_create(rom.data(), rom.size(), error, sizeof(error)) == nullptr);
+    CHECK(std::string(error).find("NROM needs 16k or 32k of PRG-ROM") != std::string::npos);
+  }
+}
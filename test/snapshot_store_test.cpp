@@ -0,0 +1,94 @@
+#include "snapshot_store.h"
+#include "test/test.h"
+
+namespace {
+
+// Fills every page of the state with its own byte, so no two pages are alike, then makes
+// page `page` differ by `tweak`.
+void FillPages(ConsoleState* state, size_t page, uint8_t tweak) {
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(state);
+  for (size_t i = 0; i < sizeof(ConsoleState); ++i) {
+    bytes[i] = static_cast<uint8_t>(i / SnapshotStore::kPageBytes);
+  }
+  bytes[page * SnapshotStore::kPageBytes] ^= tweak;
+}
+
+bool SameState(const ConsoleState& a, const ConsoleState& b) {
+  return memcmp(&a, &b, sizeof(ConsoleState)) == 0;
+}
+
+// Files every page under one hash.
+uint64_t CollidingHash(const uint8_t*) {
+  return 0;
+}
+
+} // namespace
+
+TEST(SnapshotStoreSharesIdenticalPages) {
+  SnapshotStore store;
+  auto a = std::make_unique<ConsoleState>();
+  auto b = std::make_unique<ConsoleState>();
+  auto restored = std::make_unique<ConsoleState>();
+  FillPages(a.get(), 0, 0);
+  FillPages(b.get(), 3, 0x80);
+  const uint64_t kPages = SnapshotStore::kPagesPerState;
+
+  SnapshotStore::Snapshot snap_a = store.Insert(*a);
+  SnapshotStore::Snapshot snap_b = store.Insert(*b);
+  // b only adds the page it changed.
+  CHECK_EQ(store.GetStats().unique_pages, kPages + 1);
+  CHECK_EQ(store.GetStats().logical_pages, kPages * 2);
+  store.Restore(snap_a, restored.get());
+  CHECK(SameState(*restored, *a));
+  store.Restore(snap_b, restored.get());
+  CHECK(SameState(*restored, *b));
+
+  // A shared snapshot lives until its last reference goes.
+  store.Share(snap_a);
+  store.Release(snap_a);
+  CHECK_EQ(store.GetStats().unique_pages, kPages + 1);
+  store.Restore(snap_a, restored.get());
+  CHECK(SameState(*restored, *a));
+  store.Release(snap_a);
+  CHECK_EQ(store.GetStats().unique_pages, kPages);
+  store.Restore(snap_b, restored.get());
+  CHECK(SameState(*restored, *b));
+  store.Release(snap_b);
+  CHECK_EQ(store.GetStats().snapshots, 0u);
+  CHECK_EQ(store.GetStats().unique_pages, 0u);
+}
+
+TEST(SnapshotStoreKeepsDedupWhenCollidingPagesAreFreed) {
+  SnapshotStore store(CollidingHash);
+  auto a = std::make_unique<ConsoleState>();
+  auto b = std::make_unique<ConsoleState>();
+  auto restored = std::make_unique<ConsoleState>();
+  FillPages(a.get(), 0, 0);
+  FillPages(b.get(), 0, 0x80);
+  const uint64_t kPages = SnapshotStore::kPagesPerState;
+
+  // Every page shares a hash, so a's first page sits ahead of b's changed one, and
+  // freeing it must not hide b's from later lookups.
+  SnapshotStore::Snapshot snap_a = store.Insert(*a);
+  SnapshotStore::Snapshot snap_b = store.Insert(*b);
+  CHECK_EQ(store.GetStats().unique_pages, kPages + 1);
+  store.Release(snap_a);
+  CHECK_EQ(store.GetStats().unique_pages, kPages);
+  SnapshotStore::Snapshot again = store.Insert(*b);
+  CHECK_EQ(store.GetStats().unique_pages, kPages);
+  CHECK(memcmp(again.pages, snap_b.pages, sizeof(again.pages)) == 0);
+  store.Restore(again, restored.get());
+  CHECK(SameState(*restored, *b));
+
+  // a's page comes back into a free slot and is told apart from b's by its bytes.
+  snap_a = store.Insert(*a);
+  CHECK_EQ(store.GetStats().unique_pages, kPages + 1);
+  store.Restore(snap_a, restored.get());
+  CHECK(SameState(*restored, *a));
+  store.Restore(snap_b, restored.get());
+  CHECK(SameState(*restored, *b));
+  store.Release(snap_a);
+  store.Release(snap_b);
+  store.Release(again);
+  CHECK_EQ(store.GetStats().unique_pages, 0u);
+}
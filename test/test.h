@@ -0,0 +1,74 @@
+#ifndef TEST_TEST_H_
+#define TEST_TEST_H_
+
+#include <sstream>
+#include <type_traits>
+
+#include "cartridge.h"
+#include "common.h"
+
+// The small harness behind nes2x_test. TEST(Name) { ... } defines and registers a test;
+// CHECK(), CHECK_EQ() and CHECK_THROWS() record a failure with its line and let the test
+// carry on. ./nes2x_test [substring] runs every test, or those whose name contains it.
+namespace test {
+
+using TestFn = void (*)();
+// Adds a test for main() to run. Used by TEST().
+bool Register(const char* name, TestFn fn);
+// Marks the running test failed.
+void Fail(const char* file, int line, const std::string& message);
+
+// Assembles source (see assembler.h) into a 32k NROM cartridge with CHR-RAM. The source
+// sets its own vectors at $FFFA.
+std::shared_ptr<const Cartridge> AssembleRom(const std::string& source);
+
+template <typename T>
+std::string Show(const T& value) {
+  std::ostringstream out;
+  if constexpr (std::is_integral_v<T>) {
+    out << +value;  // numbers, not characters, for uint8_t
+  } else {
+    out << value;
+  }
+  return out.str();
+}
+
+} // namespace test
+
+#define TEST(name) \
+  static void name(); \
+  static const bool name##_registered = test::Register(#name, name); \
+  static void name()
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      test::Fail(__FILE__, __LINE__, "CHECK(" #cond ")"); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    auto check_a = (a); \
+    auto check_b = (b); \
+    if (!(check_a == check_b)) { \
+      test::Fail(__FILE__, __LINE__, "CHECK_EQ(" #a ", " #b "): " + test::Show(check_a) + " != " + \
+                 test::Show(check_b)); \
+    } \
+  } while (0)
+
+// Checks that stmt throws a std::exception whose message contains substring.
+#define CHECK_THROWS(stmt, substring) \
+  do { \
+    try { \
+      stmt; \
+      test::Fail(__FILE__, __LINE__, #stmt " did not throw"); \
+    } catch (const std::exception& e) { \
+      if (std::string(e.what()).find(substring) == std::string::npos) { \
+        test::Fail(__FILE__, __LINE__, #stmt " threw \"" + std::string(e.what()) + "\", not \"" + \
+                   (substring) + "\""); \
+      } \
+    } \
+  } while (0)
+
+#endif  // TEST_TEST_H_
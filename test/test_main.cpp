@@ -0,0 +1,69 @@
+#include <cstring>
+
+#include "test/test.h"
+
+#include "assembler.h"
+
+// Behaviour tests for the emulator's libraries; see test/test.h. ./test.sh runs them.
+//
+// Usage: nes2x_test [substring]
+
+namespace {
+
+struct Test {
+  const char* name;
+  test::TestFn fn;
+};
+
+std::vector<Test>& Tests() {
+  static std::vector<Test> tests;
+  return tests;
+}
+
+std::vector<std::string> failures;  // of the running test
+
+} // namespace
+
+bool test::Register(const char* name, TestFn fn) {
+  Tests().push_back({name, fn});
+  return true;
+}
+
+void test::Fail(const char* file, int line, const std::string& message) {
+  failures.push_back(string_format("%s:%d: %s", file, line, message.c_str()));
+}
+
+std::shared_ptr<const Cartridge> test::AssembleRom(const std::string& source) {
+  Assembler assembler(0x8000, 0x8000);
+  assembler.Assemble(source);
+  return Cartridge::FromBytes(InesImage(assembler.Output(), {}));
+}
+
+int main(int argc, char* argv[]) {
+  const char* filter = argc > 1 ? argv[1] : "";
+  int run = 0;
+  int failed = 0;
+  for (const Test& t : Tests()) {
+    if (strstr(t.name, filter) == nullptr) {
+      continue;
+    }
+    failures.clear();
+    try {
+      t.fn();
+    } catch (const std::exception& e) {
+      failures.push_back(string_format("threw: %s", e.what()));
+    }
+    run++;
+    if (failures.empty()) {
+      printf("ok   %s\n", t.name);
+    } else {
+      failed++;
+      printf("FAIL %s\n", t.name);
+      for (const std::string& failure : failures) {
+        printf("     %s\n", failure.c_str());
+      }
+    }
+  }
+  printf("%d tests, %d failed\n", run, failed);
+  return failed == 0 && run > 0 ? 0 : 1;
+}
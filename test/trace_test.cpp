@@ -0,0 +1,35 @@
+#include "cpu6502.h"
+#include "test/test.h"
+#include "trace.h"
+
+TEST(FlightRecorderKeepsTheInstructionsBeforeAThrow) {
+  Cpu6502 cpu(test::AssembleRom(R"(
+        .org $8000
+reset:  ldx #0
+loop:   inx
+        cpx #20
+        bne loop
+        lda $5000       ; not mapped on NROM: throws
+        .org $FFFA
+        .word reset, reset, reset
+)"));
+  TraceBuffer buffer(8, TraceBuffer::Mode::kFlightRecorder);
+  cpu.SetTrace(&buffer);
+  CHECK_THROWS(cpu.RunFrame(), "Invalid read addr");
+  CHECK_EQ(buffer.Committed(), 1u + 20 * 3);  // the throwing LDA is never committed
+
+  std::vector<TraceRecord> last = buffer.Last(8);
+  CHECK_EQ(last.size(), 8u);
+  // The ring wrapped many times; what is left are the loop's final turns and the LDA.
+  const TraceRecord& lda = last.back();
+  CHECK_EQ(lda.opcode, 0xAD);
+  CHECK_EQ(lda.pc, 0x8007);
+  CHECK_EQ(lda.addr, 0x5000);
+  CHECK_EQ(lda.x, 20);
+  CHECK(FormatNestest(lda).find("LDA $5000") != std::string::npos);
+  for (size_t i = 0; i + 1 < last.size(); ++i) {
+    CHECK_EQ(last[i].opcode, std::vector<uint8_t>({0xE8, 0xE0, 0xD0})[(i + 2) % 3]);
+    CHECK(last[i + 1].cycle > last[i].cycle);
+  }
+  CHECK_EQ(buffer.Newest().opcode, 0xD0);
+}
@@ -0,0 +1,63 @@
+#include "timeline.h"
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+
+namespace {
+
+struct KindInfo {
+  const char* name;
+  const char* arg;  // the name of Event::arg
+  int tid;          // track
+  bool hex;
+};
+
+const std::array<KindInfo, Timeline::kNumKinds> kKinds = {{
+  {"cpu", "cycles", 1, false},
+  {"scanline", "scanline", 2, false},
+  {"oam_dma", "stall_cycles", 1, false},
+  {"nmi", "handler", 1, true},
+  {"input_poll", "buttons", 1, false},
+  {"present", "frame", 3, false},
+}};
+
+const std::array<const char*, 3> kTracks = {"cpu", "ppu", "frames"};
+
+} // namespace
+
+Timeline::Timeline(size_t capacity) : events_(capacity), start_(Clock::now()) {}
+
+void Timeline::WriteJson(const std::string& path, const std::string& name) const {
+  FILE* f = fopen(path.c_str(), "w");
+  if (f == nullptr) {
+    throw std::runtime_error("Could not write " + path + ": " + strerror(errno));
+  }
+  fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"%s\"}}",
+      name.c_str());
+  for (size_t t = 0; t < kTracks.size(); ++t) {
+    fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+        t + 1, kTracks[t]);
+  }
+  for (size_t i = 0; i < count_; ++i) {
+    const Event& e = events_[i];
+    const KindInfo& kind = kKinds[e.kind];
+    // Timestamps are in microseconds.
+    fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"%s\", \"ts\": %.3f, ", kind.name, e.kind <= kScanline ? "X" : "i",
+        e.ns / 1e3);
+    if (e.kind <= kScanline) {
+      fprintf(f, "\"dur\": %.3f, ", e.dur_ns / 1e3);
+    } else {
+      fprintf(f, "\"s\": \"t\", ");
+    }
+    fprintf(f, "\"pid\": 1, \"tid\": %d, \"args\": {\"cycle\": %llu, \"%s\": ", kind.tid,
+        static_cast<unsigned long long>(e.cycle), kind.arg);
+    fprintf(f, kind.hex ? "\"$%04X\"}}" : "%u}}", e.arg);
+  }
+  fprintf(f, "\n]}\n");
+  bool ok = ferror(f) == 0;
+  if (fclose(f) != 0 || !ok) {
+    throw std::runtime_error("Could not write " + path);
+  }
+}
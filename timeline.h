@@ -0,0 +1,90 @@
+#ifndef TIMELINE_H_
+#define TIMELINE_H_
+
+#include "common.h"
+
+// Records what a console does within each frame as timestamped events, for seeing how CPU
+// work, PPU scanlines, OAM DMA, NMIs and input polls interleave. Attach it with
+// Cpu6502::SetTimeline(); the runner adds kPresent when it takes a finished frame.
+//
+// Every event has its host time (ns since construction) and the CPU cycle it happened on.
+// The buffer is allocated up front and recording never allocates: once it is full, further
+// events are counted as dropped. WriteJson() writes the Chrome trace-event format, which
+// Perfetto and chrome://tracing open.
+class Timeline {
+  public:
+    enum Kind : uint8_t {
+      kCpu,        // span: instructions run between two PPU catch-ups; arg is their cycles
+      kScanline,   // span: one Ppu::Update; arg is the scanline
+      kOamDma,     // instant: a write to $4014; arg is the cycles the CPU stalls
+      kNmi,        // instant: NMI taken; arg is the handler's address
+      kInputPoll,  // instant: the game latched the controllers; arg is port 0's buttons
+      kPresent,    // instant: the runner took the finished frame; arg is the frame number
+      kNumKinds,
+    };
+
+    // Preallocates capacity events.
+    explicit Timeline(size_t capacity);
+
+    uint64_t Now() const {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+    }
+    // A span of kind from start_ns to now.
+    void Span(Kind kind, uint64_t start_ns, uint64_t cycle, uint32_t arg) {
+      uint64_t now = Now();
+      Add({start_ns, now - start_ns, cycle, arg, kind});
+    }
+    void Instant(Kind kind, uint64_t cycle, uint32_t arg) { Add({Now(), 0, cycle, arg, kind}); }
+
+    // A write to $4016. The strobe falling latches the buttons, which is a kInputPoll; games
+    // that write 0 over and over are only polling once.
+    void Strobe(bool high, uint64_t cycle, uint8_t buttons) {
+      if (strobe_ && !high) {
+        Instant(kInputPoll, cycle, buttons);
+      }
+      strobe_ = high;
+    }
+    // Opens a kCpu span at cycle.
+    void BeginCpu(uint64_t cycle) {
+      cpu_start_ns_ = Now();
+      cpu_start_cycle_ = cycle;
+    }
+    // Closes the open kCpu span at cycle.
+    void EndCpu(uint64_t cycle) {
+      Span(kCpu, cpu_start_ns_, cpu_start_cycle_, static_cast<uint32_t>(cycle - cpu_start_cycle_));
+    }
+
+    size_t Events() const { return count_; }
+    uint64_t Dropped() const { return dropped_; }
+
+    // Writes the events as a Chrome trace with one track each for the CPU, the PPU and
+    // frames, under a process called name. Throws if it can not.
+    void WriteJson(const std::string& path, const std::string& name) const;
+
+  private:
+    struct Event {
+      uint64_t ns;
+      uint64_t dur_ns;  // 0 for instants
+      uint64_t cycle;
+      uint32_t arg;
+      Kind kind;
+    };
+
+    void Add(const Event& event) {
+      if (count_ < events_.size()) {
+        events_[count_++] = event;
+      } else {
+        dropped_++;
+      }
+    }
+
+    std::vector<Event> events_;
+    size_t count_ = 0;
+    uint64_t dropped_ = 0;
+    Clock::time_point start_;
+    uint64_t cpu_start_ns_ = 0;
+    uint64_t cpu_start_cycle_ = 0;
+    bool strobe_ = false;
+};
+
+#endif  // TIMELINE_H_
@@ -0,0 +1,319 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+
+#include "opcode_info.h"
+
+namespace {
+
+constexpr uint32_t kMagic = 0x5254454E;  // "NETR"
+constexpr uint32_t kVersion = 1;
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+Header MakeHeader() {
+  return {kMagic, kVersion, sizeof(TraceRecord), 0};
+}
+
+// Appends to a caller's buffer. snprintf would cost more than emulating the instruction.
+class LineWriter {
+  public:
+    explicit LineWriter(char* out) : begin_(out), end_(out) {}
+
+    void Char(char c) { *end_++ = c; }
+    void Str(const char* s) {
+      while (*s != '\0') {
+        *end_++ = *s++;
+      }
+    }
+    void Hex8(uint8_t v) {
+      static const char kDigits[] = "0123456789ABCDEF";
+      *end_++ = kDigits[v >> 4];
+      *end_++ = kDigits[v & 0xF];
+    }
+    void Hex16(uint16_t v) {
+      Hex8(v >> 8);
+      Hex8(v);
+    }
+    // Right-aligned in width columns, like %*llu.
+    void Dec(uint64_t v, size_t width) {
+      char digits[20];
+      size_t n = 0;
+      do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+      } while (v > 0);
+      for (; width > n; --width) {
+        *end_++ = ' ';
+      }
+      while (n > 0) {
+        *end_++ = digits[--n];
+      }
+    }
+    // Like %-Ns: spaces up to column, if the line is shorter.
+    void PadTo(size_t column) {
+      while (Size() < column) {
+        *end_++ = ' ';
+      }
+    }
+    size_t Size() const { return end_ - begin_; }
+
+  private:
+    char* begin_;
+    char* end_;
+};
+
+uint64_t RoundUpToPowerOfTwo(size_t n) {
+  uint64_t size = 1;
+  while (size < n) {
+    size <<= 1;
+  }
+  return size;
+}
+
+} // namespace
+
+TraceBuffer::TraceBuffer(size_t capacity, Mode mode)
+    : mode_(mode), ring_(RoundUpToPowerOfTwo(std::max<size_t>(capacity, 1))), mask_(ring_.size() - 1) {}
+
+size_t TraceBuffer::Read(TraceRecord* out, size_t max) {
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  size_t count = std::min<uint64_t>(max, head_.load(std::memory_order_acquire) - tail);
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = ring_[(tail + i) & mask_];
+  }
+  tail_.store(tail + count, std::memory_order_release);
+  return count;
+}
+
+std::vector<TraceRecord> TraceBuffer::Last(size_t max) const {
+  uint64_t end = head_.load(std::memory_order_acquire) + (pending_ ? 1 : 0);
+  uint64_t begin = end - std::min<uint64_t>({max, end, ring_.size()});
+  if (mode_ == Mode::kStream) {
+    begin = std::max(begin, tail_.load(std::memory_order_acquire));
+  }
+  std::vector<TraceRecord> records;
+  for (uint64_t i = begin; i < end; ++i) {
+    records.push_back(ring_[i & mask_]);
+  }
+  return records;
+}
+
+TraceWriter::TraceWriter(const std::string& path, size_t capacity)
+    : path_(path), file_(fopen(path.c_str(), "wb")), buffer_(capacity, TraceBuffer::Mode::kStream) {
+  if (file_ == nullptr) {
+    throw std::runtime_error("Could not write trace " + path);
+  }
+  Header header = MakeHeader();
+  ok_ = fwrite(&header, sizeof(header), 1, file_) == 1;
+  writer_ = std::thread(&TraceWriter::WriterLoop, this);
+}
+
+TraceWriter::~TraceWriter() {
+  if (writer_.joinable()) {
+    try {
+      Finish();
+    } catch (const std::exception&) {
+      // Finish() reports failures to callers that ask.
+    }
+  }
+}
+
+uint64_t TraceWriter::Finish() {
+  if (writer_.joinable()) {
+    stop_ = true;
+    writer_.join();
+    ok_ = fclose(file_) == 0 && ok_;
+  }
+  if (!ok_) {
+    throw std::runtime_error("Could not write trace " + path_);
+  }
+  return written_;
+}
+
+void TraceWriter::WriterLoop() {
+  std::vector<TraceRecord> batch(4096);
+  while (true) {
+    // Check before reading so records committed before Finish() are never left behind.
+    bool stopping = stop_;
+    size_t count = buffer_.Read(batch.data(), batch.size());
+    if (count > 0) {
+      ok_ = ok_ && fwrite(batch.data(), sizeof(TraceRecord), count, file_) == count;
+      written_ += count;
+    } else if (stopping) {
+      return;
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+}
+
+void WriteTraceFile(const std::string& path, const std::vector<TraceRecord>& records) {
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    throw std::runtime_error("Could not write trace " + path);
+  }
+  Header header = MakeHeader();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+      (records.empty() || fwrite(records.data(), sizeof(TraceRecord), records.size(), file) == records.size());
+  if (fclose(file) != 0 || !ok) {
+    throw std::runtime_error("Could not write trace " + path);
+  }
+}
+
+std::vector<TraceRecord> ReadTraceFile(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    throw std::runtime_error("Could not open trace " + path);
+  }
+  Header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != kMagic || header.version != kVersion ||
+      header.record_size != sizeof(TraceRecord)) {
+    fclose(file);
+    throw std::runtime_error(string_format("%s is not a version %u trace.", path.c_str(), kVersion));
+  }
+  std::vector<TraceRecord> records;
+  TraceRecord record;
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    records.push_back(record);
+  }
+  fclose(file);
+  return records;
+}
+
+std::string FormatNestest(const TraceRecord& record, bool with_ppu) {
+  char line[kMaxNestestLine];
+  return std::string(line, FormatNestestTo(record, with_ppu, line));
+}
+
+size_t FormatNestestTo(const TraceRecord& r, bool with_ppu, char* out) {
+  const OpcodeInfo& info = OpcodeInfos()[r.opcode];
+  LineWriter line(out);
+  line.Hex16(r.pc);
+  line.Str("  ");
+  line.Hex8(r.opcode);
+  line.Char(' ');
+  switch (info.mode) {
+    case AddressingMode::kAbsolute:
+    case AddressingMode::kAbsoluteX:
+    case AddressingMode::kAbsoluteY:
+    case AddressingMode::kAbsoluteIndirect:
+      line.Hex8(r.operands[0]);
+      line.Char(' ');
+      line.Hex8(r.operands[1]);
+      line.Char(' ');
+      break;
+    case AddressingMode::kAccumulator:
+    case AddressingMode::kNone:
+      line.Str("      ");
+      break;
+    default:
+      line.Hex8(r.operands[0]);
+      line.Str("    ");
+  }
+  line.Char(info.unofficial ? '*' : ' ');
+  line.Str(info.mnemonic);
+
+  uint16_t abs = r.operands[0] | (r.operands[1] << 8);
+  switch (info.mode) {
+    case AddressingMode::kImmediate:
+      line.Str(" #$");
+      line.Hex8(r.val);
+      break;
+    case AddressingMode::kZeroPage:
+      line.Str(" $");
+      line.Hex8(r.addr);
+      line.Str(" = ");
+      line.Hex8(r.val);
+      break;
+    case AddressingMode::kZeroPageX:
+    case AddressingMode::kZeroPageY:
+      line.Str(" $");
+      line.Hex8(r.operands[0]);
+      line.Str(info.mode == AddressingMode::kZeroPageX ? ",X @ " : ",Y @ ");
+      line.Hex8(r.addr);
+      line.Str(" = ");
+      line.Hex8(r.val);
+      break;
+    case AddressingMode::kAbsolute:
+      line.Str(" $");
+      line.Hex16(r.addr);
+      // nestest leaves the value out for jumps.
+      if (r.opcode != 0x4C && r.opcode != 0x20) {
+        line.Str(" = ");
+        line.Hex8(r.val);
+      }
+      break;
+    case AddressingMode::kAbsoluteX:
+    case AddressingMode::kAbsoluteY:
+      line.Str(" $");
+      line.Hex16(abs);
+      line.Str(info.mode == AddressingMode::kAbsoluteX ? ",X @ " : ",Y @ ");
+      line.Hex16(r.addr);
+      line.Str(" = ");
+      line.Hex8(r.val);
+      break;
+    case AddressingMode::kIndirectX:
+      line.Str(" ($");
+      line.Hex8(r.operands[0]);
+      line.Str(",X) @ ");
+      line.Hex8(r.operands[0] + r.x);
+      line.Str(" = ");
+      line.Hex16(r.addr);
+      line.Str(" = ");
+      line.Hex8(r.val);
+      break;
+    case AddressingMode::kIndirectY:
+      line.Str(" ($");
+      line.Hex8(r.operands[0]);
+      line.Str("),Y = ");
+      line.Hex16(r.addr - r.y);
+      line.Str(" @ ");
+      line.Hex16(r.addr);
+      line.Str(" = ");
+      line.Hex8(r.val);
+      break;
+    case AddressingMode::kAbsoluteIndirect:
+      line.Str(" ($");
+      line.Hex16(abs);
+      line.Str(") = ");
+      line.Hex16(r.addr);
+      break;
+    case AddressingMode::kRelative:
+      line.Str(" $");
+      line.Hex16(r.addr);
+      break;
+    case AddressingMode::kAccumulator:
+      line.Str(" A");
+      break;
+    case AddressingMode::kNone:
+      break;
+  }
+  line.PadTo(48);
+
+  line.Str("A:");
+  line.Hex8(r.a);
+  line.Str(" X:");
+  line.Hex8(r.x);
+  line.Str(" Y:");
+  line.Hex8(r.y);
+  line.Str(" P:");
+  line.Hex8(r.p);
+  line.Str(" SP:");
+  line.Hex8(r.sp);
+  if (with_ppu) {
+    line.Str(" PPU:");
+    line.Dec(r.scanline, 3);
+    line.Char(',');
+    line.Dec(r.dot, 3);
+  }
+  line.Str(" CYC:");
+  line.Dec(r.cycle, 0);
+  return line.Size();
+}
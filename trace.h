@@ -0,0 +1,121 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <thread>
+
+#include "common.h"
+
+// One executed instruction, as the CPU saw it before running it. Fixed-size and trivially
+// copyable so tracing costs a few stores per instruction; FormatNestest() turns it into
+// text later, off the emulation thread.
+struct TraceRecord {
+  uint64_t cycle;        // CPU cycle the instruction started on
+  uint16_t pc;
+  uint16_t addr;         // effective address, for modes that have one
+  uint16_t scanline;     // PPU position when the instruction started
+  uint16_t dot;
+  uint8_t opcode;
+  uint8_t operands[2];   // the bytes after the opcode; 0 if they are I/O registers
+  uint8_t a;
+  uint8_t x;
+  uint8_t y;
+  uint8_t p;
+  uint8_t sp;
+  uint8_t val;           // value at addr (or the immediate) before the instruction ran
+  uint8_t reserved[7];
+};
+static_assert(sizeof(TraceRecord) == 32, "Trace record layout changed.");
+
+// Single-producer ring of TraceRecords. The CPU fills one record per instruction with
+// Begin() and Commit(); neither allocates nor locks.
+class TraceBuffer {
+  public:
+    enum class Mode {
+      // Nothing is lost: Begin() waits for the reader when the ring is full.
+      kStream,
+      // Newer records overwrite the oldest, so the ring holds the last capacity
+      // instructions. Read them with Last() once the producer has stopped.
+      kFlightRecorder,
+    };
+
+    // capacity is rounded up to a power of two.
+    TraceBuffer(size_t capacity, Mode mode);
+
+    // The record for the next instruction. It stays pending until Commit().
+    TraceRecord* Begin() {
+      uint64_t head = head_.load(std::memory_order_relaxed);
+      if (mode_ == Mode::kStream) {
+        while (head - tail_.load(std::memory_order_acquire) > mask_) {
+          std::this_thread::yield();
+        }
+      }
+      pending_ = true;
+      return &ring_[head & mask_];
+    }
+    void Commit() {
+      pending_ = false;
+      head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Reader side of kStream: moves up to max committed records into out, oldest first,
+    // and returns how many. Only one thread may read.
+    size_t Read(TraceRecord* out, size_t max);
+    // The last max records, oldest first, including one still pending because its
+    // instruction threw. Only call once the producer has stopped.
+    std::vector<TraceRecord> Last(size_t max) const;
+    // The last committed record. Only valid once there is one.
+    const TraceRecord& Newest() const { return ring_[(head_.load(std::memory_order_relaxed) - 1) & mask_]; }
+    // Records committed so far.
+    uint64_t Committed() const { return head_.load(std::memory_order_acquire); }
+    size_t Capacity() const { return ring_.size(); }
+
+  private:
+    const Mode mode_;
+    std::vector<TraceRecord> ring_;
+    const uint64_t mask_;
+    bool pending_ = false;
+    alignas(64) std::atomic<uint64_t> head_{0};  // written by the producer
+    alignas(64) std::atomic<uint64_t> tail_{0};  // written by the reader
+};
+
+// Streams a whole trace to a file. The CPU writes into Buffer() and a background thread
+// drains it, so the emulation thread never formats or does I/O.
+class TraceWriter {
+  public:
+    explicit TraceWriter(const std::string& path, size_t capacity = 1 << 16);
+    // Calls Finish().
+    ~TraceWriter();
+
+    TraceBuffer* Buffer() { return &buffer_; }
+    // Waits until every committed record is in the file, then closes it. Throws if the
+    // file could not be written. Returns the number of records.
+    uint64_t Finish();
+
+  private:
+    void WriterLoop();
+
+    std::string path_;
+    FILE* file_;
+    TraceBuffer buffer_;
+    std::atomic<bool> stop_{false};
+    bool ok_ = true;
+    uint64_t written_ = 0;
+    std::thread writer_;
+};
+
+// File layout, little-endian: a 16-byte header ("NETR", version, record size, 0) and then
+// the records in order.
+void WriteTraceFile(const std::string& path, const std::vector<TraceRecord>& records);
+std::vector<TraceRecord> ReadTraceFile(const std::string& path);
+
+// The record as a line of nestest.log, without the newline. with_ppu = false leaves out
+// the PPU column, as in test/nestest_golden-noppu.log.
+std::string FormatNestest(const TraceRecord& record, bool with_ppu = true);
+// Room for any line FormatNestestTo() writes.
+constexpr size_t kMaxNestestLine = 128;
+// FormatNestest() into out without allocating, cheap enough to run on every instruction.
+// Returns the length; out is not NUL-terminated.
+size_t FormatNestestTo(const TraceRecord& record, bool with_ppu, char* out);
+
+#endif  // TRACE_H_
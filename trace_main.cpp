@@ -0,0 +1,104 @@
+#include <unistd.h>
+
+#include <string>
+
+#include "common.h"
+#include "cpu6502.h"
+#include "golden_trace.h"
+#include "trace.h"
+
+// Prints a binary trace from nes2x_headless --trace or --flight-recorder as nestest.log lines,
+// or runs a ROM against a golden nestest.log.
+//
+// Usage: nes2x_trace [--no-ppu] [--last N] file.trace
+//        nes2x_trace --golden LOG [--no-ppu] [--context N] rom.nes
+//
+// --no-ppu leaves out the PPU column, for diffing against test/nestest_golden-noppu.log.
+// --last prints only the final N instructions.
+// --golden starts the ROM at the log's first PC (nestest's automation mode starts at $C000)
+// and checks each instruction against the log as it runs, stopping at the first that
+// differs. --no-ppu then ignores the log's PPU column. --context sets how many matching
+// instructions are shown before a divergence (8 by default).
+
+namespace {
+
+const char kUsage[] = "Usage: nes2x_trace [--no-ppu] [--last N] file.trace\n"
+                      "       nes2x_trace --golden LOG [--no-ppu] [--context N] rom.nes";
+
+// Returns the exit status.
+int RunGolden(const std::string& rom_path, const std::string& log_path, bool compare_ppu, size_t context) {
+  GoldenTrace golden(log_path, compare_ppu, context);
+  Cpu6502 cpu(rom_path);
+  std::unique_ptr<ConsoleState> state = std::make_unique<ConsoleState>();
+  cpu.SaveState(state.get());
+  state->cpu.program_counter = golden.StartPc();
+  cpu.LoadState(*state);
+  cpu.SetTrace(golden.Buffer());
+
+  std::string error;
+  auto start_time = Clock::now();
+  try {
+    while (!golden.Finished()) {
+      cpu.RunCycle();
+    }
+  } catch (const std::exception& e) {
+    // Only a failure if the checker had not already finished.
+    error = e.what();
+  }
+  bool passed = golden.Stop();
+  double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+  if (!passed) {
+    printf("%s", golden.Describe(isatty(fileno(stdout))).c_str());
+    if (!error.empty()) {
+      printf("  got  exception: %s\n", error.c_str());
+    }
+    return 1;
+  }
+  printf("PASSED %llu instructions match %s%s time=%.3fs\n", static_cast<unsigned long long>(golden.Matched()),
+      log_path.c_str(), compare_ppu ? "" : " (PPU column ignored)", seconds);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  try {
+    bool with_ppu = true;
+    size_t last = 0;
+    size_t context = 8;
+    std::string golden;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg == "--no-ppu") {
+        with_ppu = false;
+      } else if (arg == "--last" && i + 1 < argc) {
+        last = std::stoull(argv[++i]);
+      } else if (arg == "--golden" && i + 1 < argc) {
+        golden = argv[++i];
+      } else if (arg == "--context" && i + 1 < argc) {
+        context = std::stoull(argv[++i]);
+      } else if (arg.rfind("--", 0) == 0 || !path.empty()) {
+        throw std::runtime_error(kUsage);
+      } else {
+        path = arg;
+      }
+    }
+    if (path.empty()) {
+      throw std::runtime_error(kUsage);
+    }
+    if (!golden.empty()) {
+      return RunGolden(path, golden, with_ppu, context);
+    }
+
+    std::vector<TraceRecord> records = ReadTraceFile(path);
+    size_t first = last > 0 && last < records.size() ? records.size() - last : 0;
+    for (size_t i = first; i < records.size(); ++i) {
+      printf("%s\n", FormatNestest(records[i], with_ppu).c_str());
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,21 @@
+#ifndef VERSION_H_
+#define VERSION_H_
+
+#include "common.h"
+#include "movie.h"
+#include "state.h"
+
+// Bump with any change that makes a ROM run differently.
+constexpr uint32_t kEmulationRevision = 3;
+
+// Identifies how this build emulates, as "nes2x-<revision>.<state>.<movie>". The save-state
+// and movie format versions are read from ConsoleState::kVersion and Movie::kFormatVersion,
+// so changing either format changes it without a separate bump. Cached boot states (see
+// boot_cache.h) are only reused by the same version.
+inline const std::string& EmulatorVersion() {
+  static const std::string version = string_format("nes2x-%u.%u.%u", kEmulationRevision,
+      static_cast<unsigned>(ConsoleState::kVersion), Movie::kFormatVersion);
+  return version;
+}
+
+#endif  // VERSION_H_